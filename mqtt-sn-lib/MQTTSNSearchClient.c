@@ -38,14 +38,14 @@ int MQTTSNDeserialize_advertise(unsigned char* gatewayid, unsigned short* durati
 	FUNC_ENTRY;
 	curdata += MQTTSNPacket_decode(curdata, buflen, &mylen); /* read length */
 	enddata = buf + mylen;
-	if (enddata - curdata > buflen)
+	if (enddata - curdata > (int) buflen)
 		goto exit;
 
 	if (readChar(&curdata) != MQTTSN_ADVERTISE)
 		goto exit;
 
-	*gatewayid = readChar(&curdata);
-	*duration = readInt(&curdata);
+	*gatewayid = (unsigned char) readChar(&curdata);
+	*duration = (unsigned short) readInt(&curdata);
 
 	rc = 1;
 exit:
@@ -77,9 +77,9 @@ int MQTTSNSerialize_searchgw(unsigned char* buf, size_t buflen, unsigned char ra
 	ptr += MQTTSNPacket_encode(ptr, len);   /* write length */
 	writeChar(&ptr, MQTTSN_SEARCHGW);      /* write message type */
 
-	writeChar(&ptr, radius);
+	writeChar(&ptr, (char) radius);
 
-	rc = ptr - buf;
+	rc = (int) (ptr - buf);
 exit:
 	FUNC_EXIT_RC(rc);
 	return rc;
@@ -107,16 +107,16 @@ int MQTTSNDeserialize_gwinfo(unsigned char* gatewayid, unsigned short* gatewayad
 	FUNC_ENTRY;
 	curdata += MQTTSNPacket_decode(curdata, buflen, &mylen); /* read length */
 	enddata = buf + mylen;
-	if (enddata - curdata > buflen)
+	if (enddata - curdata > (int) buflen)
 		goto exit;
 
 	if (readChar(&curdata) != MQTTSN_GWINFO)
 		goto exit;
 
-	*gatewayid = readChar(&curdata);
+	*gatewayid = (unsigned char) readChar(&curdata);
 
-	*gatewayaddress_len = enddata - curdata;
-	*gatewayaddress = (gatewayaddress_len > 0) ? curdata : NULL;
+	*gatewayaddress_len = (unsigned short) (enddata - curdata);
+	*gatewayaddress = (*gatewayaddress_len > 0) ? curdata : NULL;
 
 	rc = 1;
 exit:
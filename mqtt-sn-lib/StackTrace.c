@@ -99,3 +99,266 @@ void StackTrace_dumpStack(char* dest)
 		*/
 }
 
+
+
+/**
+The binary trace ring used in place of the stack trace above. Every thread that records an event gets a ring of its
+own, so recording takes no lock and shares no cache line with other threads: an event is a timestamp, the address of
+the function name, the line, and the return code, written to the next slot of the ring. Rings are never freed, so a
+dump still has the events of threads that have ended. A dump only makes write calls, so it can be taken from a signal
+handler; an event that is being written while the dump runs can come out torn.
+*/
+#include <stdint.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+
+typedef struct TraceRing
+{
+	struct TraceRing* next;
+	uint64_t thread;
+	uint64_t head;
+	TraceEvent events[TRACE_EVENTS];
+} TraceRing;
+
+int Trace_on = 0;
+static __thread TraceRing* myRing = NULL;
+static TraceRing* rings = NULL;
+static double ticksPerUs = 0;
+static char dumpPath[256] = "";
+
+
+static uint64_t Trace_nanos(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+
+/**
+@return the timestamp counter where the CPU has one that is cheap to read, nanoseconds otherwise
+*/
+static inline uint64_t Trace_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return Trace_nanos();
+#endif
+}
+
+
+/**
+Record an event in the calling thread's ring. Called through the FUNC_ENTRY, FUNC_EXIT_RC, and TRACE_CODE macros
+while tracing is on.
+*/
+void Trace_record(const char* name, int line, int kind, int32_t rc)
+{
+	TraceRing* r = myRing;
+	TraceEvent* e;
+
+	if (r == NULL)
+	{
+		if ((r = calloc(1, sizeof(TraceRing))) == NULL)
+			return;
+		r->thread = (uint64_t)syscall(SYS_gettid);
+		r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+		myRing = r;
+	}
+	e = &r->events[r->head & (TRACE_EVENTS - 1)];
+	e->time = Trace_ticks();
+	e->name = (uint64_t)(uintptr_t)name;
+	e->rc = rc;
+	e->line = (uint16_t)line;
+	e->kind = (uint8_t)kind;
+	__atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+Switch recording on or off. Can be called at any time, from any thread. The first time tracing is switched on, the
+timestamp counter is measured against the clock for 2 ms, so dumps can be decoded into microseconds.
+*/
+void Trace_enable(int on)
+{
+	if (on && ticksPerUs == 0)
+	{
+		uint64_t startNs = Trace_nanos(), startTicks = Trace_ticks(), nowNs;
+		while ((nowNs = Trace_nanos()) - startNs < 2000000)
+			;
+		ticksPerUs = (double)(Trace_ticks() - startTicks) * 1000.0 / (double)(nowNs - startNs);
+	}
+	__atomic_store_n(&Trace_on, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+
+/**
+Set the file Trace_dump writes to, and that a signal given to Trace_dumpOnSignal dumps to.
+@return 0 on success, -1 if the path is too long
+*/
+int Trace_setDumpPath(const char* path)
+{
+	if (strlen(path) >= sizeof(dumpPath))
+		return -1;
+	strcpy(dumpPath, path);
+	return 0;
+}
+
+
+static int Trace_write(int fd, const void* data, size_t length)
+{
+	const char* next = data;
+
+	while (length > 0)
+	{
+		ssize_t written = write(fd, next, length);
+		if (written <= 0)
+			return -1;
+		next += written;
+		length -= (size_t)written;
+	}
+	return 0;
+}
+
+
+/**
+Write every thread's ring to a descriptor, in the format described by TraceDumpHeader. Async-signal-safe, and can run
+on several threads at once, or from a signal handler that interrupts another dump, since it keeps its state on the stack.
+@return 0 on success, -1 if a write failed
+*/
+int Trace_dumpFd(int fd)
+{
+	TraceDumpHeader header;
+	TraceRing* head = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+	TraceRing* r;
+	uint64_t dumpNames[TRACE_NAMES];
+	uint32_t names = 0;
+	uint32_t i;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.ticksPerUs = ticksPerUs;
+	/* Rings of threads that start tracing during the dump are added in front of head, so they are left out of both
+	   the count and the dump. */
+	for (r = head; r != NULL; r = r->next)
+		++header.rings;
+	if (Trace_write(fd, &header, sizeof(header)) != 0)
+		return -1;
+
+	for (r = head; r != NULL; r = r->next)
+	{
+		TraceDumpRing ring;
+		uint64_t last = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint64_t first;
+
+		memset(&ring, 0, sizeof(ring));
+		ring.thread = r->thread;
+		ring.total = last;
+		ring.count = (uint32_t)((last < TRACE_EVENTS) ? last : TRACE_EVENTS);
+		first = last - ring.count;
+		if (Trace_write(fd, &ring, sizeof(ring)) != 0)
+			return -1;
+		/* Oldest to newest, which is two pieces once the ring has wrapped. */
+		if ((first & (TRACE_EVENTS - 1)) + ring.count > TRACE_EVENTS)
+		{
+			size_t tail = TRACE_EVENTS - (first & (TRACE_EVENTS - 1));
+			if (Trace_write(fd, &r->events[first & (TRACE_EVENTS - 1)], tail * sizeof(TraceEvent)) != 0 ||
+					Trace_write(fd, &r->events[0], (ring.count - tail) * sizeof(TraceEvent)) != 0)
+				return -1;
+		}
+		else if (Trace_write(fd, &r->events[first & (TRACE_EVENTS - 1)], ring.count * sizeof(TraceEvent)) != 0)
+			return -1;
+
+		/* Collect the distinct function names, without allocating. */
+		for (uint64_t n = first; n < last; ++n)
+		{
+			uint64_t name = r->events[n & (TRACE_EVENTS - 1)].name;
+			for (i = 0; i < names && dumpNames[i] != name; ++i)
+				;
+			if (i == names && names < TRACE_NAMES && name != 0)
+				dumpNames[names++] = name;
+		}
+	}
+
+	if (Trace_write(fd, &names, sizeof(names)) != 0)
+		return -1;
+	for (i = 0; i < names; ++i)
+	{
+		const char* name = (const char*)(uintptr_t)dumpNames[i];
+		uint32_t length = (uint32_t)strlen(name);
+		if (Trace_write(fd, &dumpNames[i], sizeof(dumpNames[i])) != 0 || Trace_write(fd, &length, sizeof(length)) != 0 ||
+				Trace_write(fd, name, length) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+
+/**
+Write every thread's ring to the dump path, replacing the file. Does nothing if no path was set or nothing was ever
+recorded. Async-signal-safe.
+@return 0 on success or if there was nothing to do, -1 if the file could not be written
+*/
+int Trace_dump(void)
+{
+	int fd;
+	int rc;
+
+	if (dumpPath[0] == '\0' || __atomic_load_n(&rings, __ATOMIC_ACQUIRE) == NULL)
+		return 0;
+	if ((fd = open(dumpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	rc = Trace_dumpFd(fd);
+	close(fd);
+	return rc;
+}
+
+
+static void Trace_signal(int signo)
+{
+	int savedErrno = errno;
+
+	(void)signo;
+	Trace_dump();
+	errno = savedErrno;
+}
+
+
+/**
+Dump the rings to the dump path whenever the process receives a signal, for example SIGUSR1.
+@return 0 on success, -1 if the handler could not be installed
+*/
+int Trace_dumpOnSignal(int signo)
+{
+	struct sigaction action;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = Trace_signal;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	return sigaction(signo, &action, NULL);
+}
+
+
+/**
+Tracing can be switched on without changing the application: if the MQTTSN_TRACE environment variable holds a path
+when the program starts, recording starts straight away, and the rings are dumped to that path on SIGUSR1 and
+whenever a session ends with an error.
+*/
+__attribute__((constructor)) static void Trace_fromEnvironment(void)
+{
+	const char* path = getenv("MQTTSN_TRACE");
+
+	if (path == NULL || path[0] == '\0' || Trace_setDumpPath(path) != 0)
+		return;
+	Trace_dumpOnSignal(SIGUSR1);
+	Trace_enable(1);
+}
@@ -18,21 +18,84 @@
 #define STACKTRACE_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #define NOSTACKTRACE 1
 #define TRACE_MINIMUM (3)
 #define TRACE_MEDIUM (2)
 #define TRACE_MAX (1)
 
+/**
+Kinds of event kept in the binary trace ring: a function entered, a function left (with its return code, if it has
+one), and a status code recorded with TRACE_CODE.
+*/
+#define TRACE_KIND_ENTRY 1
+#define TRACE_KIND_EXIT 2
+#define TRACE_KIND_CODE 3
+
+/** number of events each thread's trace ring keeps, a power of 2; older events are overwritten */
+#define TRACE_EVENTS 4096
+/** most distinct function names a dump can name; events of any others are decoded by address */
+#define TRACE_NAMES 1024
+#define TRACE_MAGIC "MQSNTRC1"
+#define TRACE_VERSION 1
+
+/**
+One recorded event, as it is kept in a ring and written to a dump. The name is the address of the function name,
+which the name table at the end of a dump maps back to the name.
+*/
+typedef struct
+{
+	uint64_t time;
+	uint64_t name;
+	int32_t rc;
+	uint16_t line;
+	uint8_t kind;
+	uint8_t pad;
+} TraceEvent;
+
+/**
+A dump is a TraceDumpHeader, then for every thread that recorded anything a TraceDumpRing followed by its events from
+oldest to newest, then a uint32_t count of names, each a uint64_t address, a uint32_t length, and the name itself.
+Times are in ticks of the timestamp counter; ticksPerUs converts them.
+*/
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t rings;
+	double ticksPerUs;
+} TraceDumpHeader;
+
+typedef struct
+{
+	uint64_t thread;
+	uint64_t total;
+	uint32_t count;
+	uint32_t pad;
+} TraceDumpRing;
+
+/** non-zero while events are being recorded; switched with Trace_enable */
+extern int Trace_on;
+
+#if defined(NOTRACE)
+#define TRACE_EVENT(kind, rc)
+#else
+/** costs a single load and branch while tracing is off */
+#define TRACE_EVENT(kind, rc) do { if (__atomic_load_n(&Trace_on, __ATOMIC_RELAXED)) \
+	Trace_record(__func__, __LINE__, (kind), (int32_t)(rc)); } while (0)
+#endif
+#define TRACE_CODE(rc) TRACE_EVENT(TRACE_KIND_CODE, rc)
+
 #if defined(NOSTACKTRACE)
-#define FUNC_ENTRY
+#define FUNC_ENTRY TRACE_EVENT(TRACE_KIND_ENTRY, 0)
 #define FUNC_ENTRY_NOLOG
 #define FUNC_ENTRY_MED
 #define FUNC_ENTRY_MAX
-#define FUNC_EXIT
+#define FUNC_EXIT TRACE_EVENT(TRACE_KIND_EXIT, 0)
 #define FUNC_EXIT_NOLOG
 #define FUNC_EXIT_MED
 #define FUNC_EXIT_MAX
-#define FUNC_EXIT_RC(x)
+#define FUNC_EXIT_RC(x) TRACE_EVENT(TRACE_KIND_EXIT, x)
 #define FUNC_EXIT_MED_RC(x)
 #define FUNC_EXIT_MAX_RC(x)
 #else
@@ -70,5 +133,12 @@ void StackTrace_exit(const char* name, int line, void* return_value, int trace);
 void StackTrace_printStack(FILE* dest);
 char* StackTrace_get(unsigned long);
 
+void Trace_record(const char* name, int line, int kind, int32_t rc);
+void Trace_enable(int on);
+int Trace_setDumpPath(const char* path);
+int Trace_dumpOnSignal(int signo);
+int Trace_dumpFd(int fd);
+int Trace_dump(void);
+
 
 #endif /* STACKTRACE_H_ */
@@ -15,6 +15,11 @@
  *    Sergio R. Caprile - "commonalization" from prior samples and/or documentation extension
  *******************************************************************************/
 
+#if !defined(_GNU_SOURCE)
+	/** needed for sendmmsg */
+	#define _GNU_SOURCE
+#endif
+
 #include <sys/types.h>
 
 #if !defined(SOCKET_ERROR)
@@ -52,6 +57,9 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 #endif
 
 #if defined(WIN32)
@@ -61,6 +69,8 @@
 #include <net/if.h>
 #endif
 
+#include "transport.h"
+
 /**
 This simple low-level implementation assumes a single connection for a single thread. Thus, a static
 variable is used for that connection.
@@ -101,7 +111,7 @@ ssize_t transport_sendPacketBuffer(char* host, int port, unsigned char* buf, siz
 	memset(&cliaddr, 0, sizeof(cliaddr));
 	cliaddr.sin_family = AF_INET;
 	cliaddr.sin_addr.s_addr = inet_addr(host);
-	cliaddr.sin_port = htons(port);
+	cliaddr.sin_port = htons((uint16_t)port);
 
 	if ((rc = sendto(mysock, buf, buflen, 0, (const struct sockaddr*)&cliaddr, sizeof(cliaddr))) == SOCKET_ERROR)
 		Socket_error("sendto", mysock);
@@ -111,10 +121,10 @@ ssize_t transport_sendPacketBuffer(char* host, int port, unsigned char* buf, siz
 }
 
 
-int transport_getdata(unsigned char* buf, size_t count)
+int transport_getdata(unsigned char* buf, int count)
 {
 	// ! fix this later
-	int rc = (int) recvfrom(mysock, buf, count, 0, NULL, NULL);
+	int rc = (int) recvfrom(mysock, buf, (size_t)count, 0, NULL, NULL);
 	//printf("received %d bytes count %d\n", rc, (int)count);
 	return rc;
 }
@@ -140,3 +150,751 @@ int rc;
 
 	return rc;
 }
+
+
+static int ringSend(TransportRing_t* r, Transport_t* t, const struct iovec* iov, int iovcnt);
+
+
+/**
+Set up a session that has never been opened: no socket, no ring, and no sockets opened yet.
+Must be called once before the first transport_sessionOpen, and not between opens, which would reset the count of
+sockets opened that a socket reusing a closed one's descriptor is told apart by.
+@param t the session to be set up
+*/
+void transport_sessionInit(Transport_t* t)
+{
+	t->sock = INVALID_SOCKET;
+	t->peerAddr = 0;
+	t->peerPort = 0;
+	t->rxLen = 0;
+	t->ring = NULL;
+	t->ringSlot = 0;
+	t->rxQueued = 0;
+	t->opens = 0;
+}
+
+
+/**
+Open a socket for a single session and connect it to the gateway.
+The host is resolved once here. Because the socket is connected, the kernel keeps the gateway address and route,
+later sends do not carry an address, and datagrams from anyone but the gateway are dropped before they reach the client.
+@param t the session to be opened
+@param host the gateway host name or IP address
+@param port the gateway port
+@return >=0 for a socket descriptor, <0 for an error code
+*/
+int transport_sessionOpen(Transport_t* t, char* host, int port)
+{
+	struct addrinfo hints;
+	struct addrinfo* result = NULL;
+	struct addrinfo* res;
+	char service[8];
+	int rc = SOCKET_ERROR;
+
+	t->rxLen = 0;
+	t->sock = INVALID_SOCKET;
+	t->ring = NULL;
+	t->rxQueued = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	snprintf(service, sizeof(service), "%d", port);
+
+	if (getaddrinfo(host, service, &hints, &result) != 0)
+		return SOCKET_ERROR;
+
+	for (res = result; res != NULL; res = res->ai_next)
+	{
+		t->sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+		if (t->sock == INVALID_SOCKET)
+			continue;
+		if (connect(t->sock, res->ai_addr, res->ai_addrlen) == 0)
+		{
+			struct sockaddr_in* peer = (struct sockaddr_in*)res->ai_addr;
+			t->peerAddr = peer->sin_addr.s_addr;
+			t->peerPort = peer->sin_port;
+			t->opens++;
+			rc = t->sock;
+			break;
+		}
+		Socket_error("connect", t->sock);
+		close(t->sock);
+		t->sock = INVALID_SOCKET;
+	}
+	freeaddrinfo(result);
+
+	return rc;
+}
+
+
+/**
+Send one datagram to the gateway of this session.
+@return 0 if the whole buffer was sent, SOCKET_ERROR otherwise
+*/
+ssize_t transport_sessionSend(Transport_t* t, unsigned char* buf, size_t buflen)
+{
+	ssize_t rc = 0;
+
+	if (t->ring != NULL)
+	{
+		struct iovec iov = { buf, buflen };
+		if (ringSend(t->ring, t, &iov, 1))
+			return 0;
+	}
+	if ((rc = send(t->sock, buf, buflen, 0)) == SOCKET_ERROR)
+		Socket_error("send", t->sock);
+	else
+		rc = 0;
+	return rc;
+}
+
+
+/**
+Send one datagram to the gateway of this session, gathered from several buffers.
+The buffers are not copied, so a packet header and its payload can live in different places.
+@return 0 if every buffer was sent, SOCKET_ERROR otherwise
+*/
+ssize_t transport_sessionSendv(Transport_t* t, const struct iovec* iov, int iovcnt)
+{
+	struct msghdr msg;
+	ssize_t rc = 0;
+
+	if (t->ring != NULL && ringSend(t->ring, t, iov, iovcnt))
+		return 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec*)iov;
+	msg.msg_iovlen = (size_t)iovcnt;
+
+	if ((rc = sendmsg(t->sock, &msg, 0)) == SOCKET_ERROR)
+		Socket_error("sendmsg", t->sock);
+	else
+		rc = 0;
+	return rc;
+}
+
+
+/**
+Send several datagrams to the gateway of this session with a single system call.
+Each iovec is one whole datagram.
+@return the number of datagrams sent, which can be less than count, or SOCKET_ERROR
+*/
+int transport_sessionSendBatch(Transport_t* t, struct iovec* frames, unsigned int count)
+{
+	struct mmsghdr msgs[TRANSPORT_BATCH_MAX];
+	int rc = 0;
+
+	if (count > TRANSPORT_BATCH_MAX)
+		count = TRANSPORT_BATCH_MAX;
+
+	if (t->ring != NULL)
+	{
+		unsigned int queued = 0;
+		while (queued < count && ringSend(t->ring, t, &frames[queued], 1))
+			++queued;
+		if (queued > 0)
+			return (int)queued;
+	}
+
+	memset(msgs, 0, sizeof(msgs[0]) * count);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		msgs[i].msg_hdr.msg_iov = &frames[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	if ((rc = sendmmsg(t->sock, msgs, count, 0)) == SOCKET_ERROR)
+		Socket_error("sendmmsg", t->sock);
+	return rc;
+}
+
+
+/**
+Read one datagram into the receive buffer of this session.
+A session attached to a ring does not read the socket itself; it takes the datagram the ring already put in rxBuf.
+@return the length of the datagram, which is also stored in t->rxLen, or <0 on error
+*/
+int transport_sessionRecv(Transport_t* t)
+{
+	ssize_t rc;
+
+	if (t->rxQueued)
+	{
+		t->rxQueued = 0;
+		return (int)t->rxLen;
+	}
+	if (t->ring != NULL)
+	{
+		t->rxLen = 0;
+		errno = EAGAIN;
+		return SOCKET_ERROR;
+	}
+	rc = recv(t->sock, t->rxBuf, sizeof(t->rxBuf), 0);
+
+	if (rc == SOCKET_ERROR)
+	{
+		Socket_error("recv", t->sock);
+		t->rxLen = 0;
+		return SOCKET_ERROR;
+	}
+	t->rxLen = (size_t)rc;
+	return (int)rc;
+}
+
+
+int transport_sessionClose(Transport_t* t)
+{
+	int rc;
+
+	transport_ringDetach(t);
+	rc = shutdown(t->sock, SHUT_WR);
+	rc = close(t->sock);
+	t->sock = INVALID_SOCKET;
+
+	return rc;
+}
+
+
+/** what a ring completion belongs to, kept in the top byte of its user_data along with a slot index and generation */
+#define RING_RECV 1ULL
+#define RING_SEND 2ULL
+#define RING_CANCEL 3ULL
+#define RING_PROBE 4ULL
+#define RING_DATA(kind, gen, index) (((kind) << 56) | ((uint64_t)(gen) << 24) | (uint64_t)(index))
+#define RING_KIND(data) ((data) >> 56)
+#define RING_GEN(data) ((uint32_t)((data) >> 24))
+#define RING_INDEX(data) ((unsigned int)((data) & 0xffffff))
+
+/**
+A slot of the ring's session table. The generation changes every time the slot is freed, so completions for a
+session that has since been detached are recognised and dropped.
+*/
+struct TransportRingSession
+{
+	Transport_t* t;
+	void* context;
+	uint32_t gen;
+};
+
+
+static int ringEnter(TransportRing_t* r, unsigned int toSubmit, unsigned int minComplete, unsigned int flags,
+		const void* arg, size_t argSize)
+{
+	return (int)syscall(__NR_io_uring_enter, r->fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+
+/**
+Get the next free submission queue entry, handing the queued ones to the kernel first if the queue is full.
+@return the entry, cleared, or NULL if the queue is still full
+*/
+static struct io_uring_sqe* ringSqe(TransportRing_t* r)
+{
+	struct io_uring_sqe* sqe;
+
+	if (r->sqLocal - __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE) >= r->sqEntries)
+	{
+		transport_ringSubmit(r);
+		if (r->sqLocal - __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE) >= r->sqEntries)
+			return NULL;
+	}
+	sqe = &((struct io_uring_sqe*)r->sqes)[r->sqLocal & r->sqMask];
+	memset(sqe, 0, sizeof(*sqe));
+	++r->sqLocal;
+	return sqe;
+}
+
+
+/**
+Give a receive buffer back to the kernel once its datagram has been copied out.
+*/
+static void ringBufferReturn(TransportRing_t* r, unsigned int bid)
+{
+	struct io_uring_buf_ring* br = r->bufRing;
+	struct io_uring_buf* buf = &br->bufs[r->bufTail & (r->bufCount - 1)];
+
+	buf->addr = (uint64_t)(uintptr_t)(r->bufData + (size_t)bid * TRANSPORT_RX_LEN);
+	buf->len = TRANSPORT_RX_LEN;
+	buf->bid = (uint16_t)bid;
+	++r->bufTail;
+	__atomic_store_n(&br->tail, r->bufTail, __ATOMIC_RELEASE);
+}
+
+
+/**
+Post a multishot receive on the socket of an attached session. It keeps reading datagrams into the ring's buffers
+until it is cancelled, or until the kernel ends it, for example when every buffer is in use.
+@return 0 if the receive was queued, SOCKET_ERROR otherwise
+*/
+static int ringArm(TransportRing_t* r, unsigned int index)
+{
+	struct TransportRingSession* session = &r->sessions[index];
+	struct io_uring_sqe* sqe = ringSqe(r);
+
+	if (sqe == NULL)
+		return SOCKET_ERROR;
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = session->t->sock;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = RING_DATA(RING_RECV, session->gen, index);
+	return 0;
+}
+
+
+/**
+Check that the kernel supports multishot receives. Linux 5.19 registers the buffer ring but fails every multishot
+receive as soon as it is posted, which would otherwise only show up once sessions are attached, as receives that never
+deliver anything. A receive is posted on a socket of its own, with nothing to read, and cancelled straight away.
+@return 0 if multishot receives are supported, SOCKET_ERROR otherwise, with errno set
+*/
+static int ringProbe(TransportRing_t* r)
+{
+	struct io_uring_sqe* sqe;
+	int sock;
+	int rc = SOCKET_ERROR;
+	int result = 0;
+	int pending = 2;
+
+	if ((sock = (int)socket(AF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET)
+		return SOCKET_ERROR;
+	if ((sqe = ringSqe(r)) == NULL)
+	{
+		errno = EBUSY;
+		goto exit;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = sock;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = RING_DATA(RING_PROBE, 0, 0);
+	/* The ring is closed if the probe fails, which drops the receive along with everything else. */
+	if ((sqe = ringSqe(r)) == NULL)
+	{
+		errno = EBUSY;
+		goto exit;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = RING_DATA(RING_PROBE, 0, 0);
+	sqe->user_data = RING_DATA(RING_CANCEL, 0, 0);
+	__atomic_store_n(r->sqTail, r->sqLocal, __ATOMIC_RELEASE);
+
+	/* Both the receive and the cancel complete, whether the receive was accepted or not. */
+	while (pending > 0)
+	{
+		unsigned int head = *r->cqHead;
+		int entered = ringEnter(r, r->sqLocal - r->sqSubmitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (entered < 0 && errno != EINTR)
+			goto exit;
+		if (entered > 0)
+			r->sqSubmitted += (unsigned int)entered;
+		while (head != __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE))
+		{
+			struct io_uring_cqe* cqe = &((struct io_uring_cqe*)r->cqes)[head & r->cqMask];
+
+			if (RING_KIND(cqe->user_data) == RING_PROBE && !(cqe->flags & IORING_CQE_F_MORE))
+			{
+				result = cqe->res;
+				--pending;
+			}
+			else if (RING_KIND(cqe->user_data) == RING_CANCEL)
+				--pending;
+			__atomic_store_n(r->cqHead, ++head, __ATOMIC_RELEASE);
+		}
+	}
+	if (result == -EINVAL || result == -EOPNOTSUPP)
+		errno = EOPNOTSUPP;
+	else
+		rc = 0;
+
+exit:
+	close(sock);
+	return rc;
+}
+
+
+/**
+Queue one datagram, gathered from several buffers, to be sent on the next submit.
+The datagram is copied, so the buffers can be reused as soon as this returns.
+@return 1 if the datagram was queued, 0 if the caller has to send it itself, which happens when it is too large or
+every send buffer is in use. Whatever was queued before is submitted first in that case, so the order is kept.
+*/
+static int ringSend(TransportRing_t* r, Transport_t* t, const struct iovec* iov, int iovcnt)
+{
+	struct io_uring_sqe* sqe;
+	unsigned char* data;
+	unsigned int slot;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; ++i)
+		len += iov[i].iov_len;
+	if (len > TRANSPORT_RX_LEN || r->sendFreeCount == 0 || (sqe = ringSqe(r)) == NULL)
+	{
+		transport_ringSubmit(r);
+		return 0;
+	}
+
+	slot = r->sendFree[--r->sendFreeCount];
+	data = r->sendData + (size_t)slot * TRANSPORT_RX_LEN;
+	len = 0;
+	for (i = 0; i < iovcnt; ++i)
+	{
+		memcpy(data + len, iov[i].iov_base, iov[i].iov_len);
+		len += iov[i].iov_len;
+	}
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = t->sock;
+	sqe->addr = (uint64_t)(uintptr_t)data;
+	sqe->len = (uint32_t)len;
+	sqe->user_data = RING_DATA(RING_SEND, 0, slot);
+	return 1;
+}
+
+
+/**
+Open a ring for up to sessions transport sessions.
+@param r the ring to be opened
+@param sessions the most sessions that can be attached at once
+@param entries the size of the submission queue, which is also the number of receive buffers and the most sends that
+can be in flight; rounded up to a power of 2 by the kernel
+@return 0 on success, SOCKET_ERROR if the kernel does not support what the ring needs, with errno set
+*/
+int transport_ringOpen(TransportRing_t* r, unsigned int sessions, unsigned int entries)
+{
+	struct io_uring_params p;
+	struct io_uring_buf_reg reg;
+	unsigned char* sq;
+	unsigned char* cq;
+	unsigned int i;
+
+	memset(r, 0, sizeof(*r));
+	r->fd = INVALID_SOCKET;
+	if (sessions == 0 || sessions > TRANSPORT_RING_SESSIONS_MAX || entries == 0 || entries > TRANSPORT_RING_ENTRIES_MAX)
+	{
+		errno = EINVAL;
+		return SOCKET_ERROR;
+	}
+
+	/* Completions are only collected when the ring is waited on, which lets the kernel batch them. Older kernels
+	   without those flags still work, with completions posted as they happen. */
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	p.cq_entries = entries * 4;
+	r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0 && errno == EINVAL)
+	{
+		memset(&p, 0, sizeof(p));
+		p.flags = IORING_SETUP_CQSIZE;
+		p.cq_entries = entries * 4;
+		r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	}
+	if (r->fd < 0)
+		return SOCKET_ERROR;
+
+	r->sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (r->cqRingSize > r->sqRingSize)
+			r->sqRingSize = r->cqRingSize;
+		r->cqRingSize = r->sqRingSize;
+	}
+	r->sqRing = mmap(NULL, r->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sqRing == MAP_FAILED)
+		goto fail;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cqRing = r->sqRing;
+	else
+	{
+		r->cqRing = mmap(NULL, r->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cqRing == MAP_FAILED)
+			goto fail;
+	}
+	r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	sq = r->sqRing;
+	cq = r->cqRing;
+	r->sqHead = (unsigned int*)(sq + p.sq_off.head);
+	r->sqTail = (unsigned int*)(sq + p.sq_off.tail);
+	r->sqMask = *(unsigned int*)(sq + p.sq_off.ring_mask);
+	r->sqEntries = p.sq_entries;
+	r->sqLocal = r->sqSubmitted = *r->sqTail;
+	/* Entries are always used in order, so each slot of the index array points at the entry of the same number. */
+	for (i = 0; i < p.sq_entries; ++i)
+		((unsigned int*)(sq + p.sq_off.array))[i] = i;
+	r->cqHead = (unsigned int*)(cq + p.cq_off.head);
+	r->cqTail = (unsigned int*)(cq + p.cq_off.tail);
+	r->cqMask = *(unsigned int*)(cq + p.cq_off.ring_mask);
+	r->cqes = cq + p.cq_off.cqes;
+
+	/* The receive buffers, handed to the kernel through a ring registered as buffer group 0. */
+	r->bufCount = p.sq_entries;
+	r->bufRingSize = r->bufCount * sizeof(struct io_uring_buf);
+	r->bufRing = mmap(NULL, r->bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r->bufRing == MAP_FAILED)
+		goto fail;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)r->bufRing;
+	reg.ring_entries = r->bufCount;
+	reg.bgid = 0;
+	if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto fail;
+	r->bufData = malloc((size_t)r->bufCount * TRANSPORT_RX_LEN);
+	r->sendData = malloc((size_t)p.sq_entries * TRANSPORT_RX_LEN);
+	r->sendFree = malloc(p.sq_entries * sizeof(unsigned int));
+	r->sessions = calloc(sessions, sizeof(struct TransportRingSession));
+	r->sessionFree = malloc(sessions * sizeof(unsigned int));
+	if (r->bufData == NULL || r->sendData == NULL || r->sendFree == NULL || r->sessions == NULL || r->sessionFree == NULL)
+	{
+		errno = ENOMEM;
+		goto fail;
+	}
+	for (i = 0; i < r->bufCount; ++i)
+		ringBufferReturn(r, i);
+	for (i = 0; i < p.sq_entries; ++i)
+		r->sendFree[i] = p.sq_entries - 1 - i;
+	r->sendFreeCount = p.sq_entries;
+	for (i = 0; i < sessions; ++i)
+		r->sessionFree[i] = sessions - 1 - i;
+	r->sessionFreeCount = sessions;
+	r->sessionCount = sessions;
+	if (ringProbe(r) != 0)
+		goto fail;
+	return 0;
+
+fail:
+	i = (unsigned int)errno;
+	transport_ringClose(r);
+	errno = (int)i;
+	return SOCKET_ERROR;
+}
+
+
+/**
+Close a ring. Sessions still attached to it go back to plain system calls.
+*/
+void transport_ringClose(TransportRing_t* r)
+{
+	unsigned int i;
+
+	for (i = 0; r->sessions != NULL && i < r->sessionCount; ++i)
+	{
+		if (r->sessions[i].t != NULL)
+		{
+			r->sessions[i].t->ring = NULL;
+			r->sessions[i].t->rxQueued = 0;
+		}
+	}
+	if (r->fd >= 0)
+		close(r->fd);
+	if (r->sqes != NULL && r->sqes != MAP_FAILED)
+		munmap(r->sqes, r->sqesSize);
+	if (r->cqRing != NULL && r->cqRing != MAP_FAILED && r->cqRing != r->sqRing)
+		munmap(r->cqRing, r->cqRingSize);
+	if (r->sqRing != NULL && r->sqRing != MAP_FAILED)
+		munmap(r->sqRing, r->sqRingSize);
+	if (r->bufRing != NULL && r->bufRing != MAP_FAILED)
+		munmap(r->bufRing, r->bufRingSize);
+	free(r->bufData);
+	free(r->sendData);
+	free(r->sendFree);
+	free(r->sessions);
+	free(r->sessionFree);
+	memset(r, 0, sizeof(*r));
+	r->fd = INVALID_SOCKET;
+}
+
+
+/**
+Attach an open transport session to a ring. From then on its sends are queued on the ring and its datagrams are
+received by the ring and handed over by transport_ringWait.
+@param r the ring
+@param t the session, whose socket must be open
+@param context passed to the function given to transport_ringWait with every datagram of this session
+@return 0 on success, SOCKET_ERROR if the session is already attached or the ring has no room for it
+*/
+int transport_ringAttach(TransportRing_t* r, Transport_t* t, void* context)
+{
+	unsigned int index;
+
+	if (t->ring != NULL || t->sock == INVALID_SOCKET || r->sessionFreeCount == 0)
+		return SOCKET_ERROR;
+	index = r->sessionFree[--r->sessionFreeCount];
+	r->sessions[index].t = t;
+	r->sessions[index].context = context;
+	if (ringArm(r, index) != 0)
+	{
+		r->sessions[index].t = NULL;
+		r->sessions[index].context = NULL;
+		r->sessionFree[r->sessionFreeCount++] = index;
+		return SOCKET_ERROR;
+	}
+	t->ring = r;
+	t->ringSlot = index;
+	t->rxQueued = 0;
+	return 0;
+}
+
+
+/**
+Detach a session from its ring, cancelling its receive straight away, so datagrams that arrive from now on stay on
+the socket. Does nothing if the session is not attached.
+*/
+void transport_ringDetach(Transport_t* t)
+{
+	TransportRing_t* r = t->ring;
+	struct TransportRingSession* session;
+	struct io_uring_sqe* sqe;
+
+	if (r == NULL)
+		return;
+	session = &r->sessions[t->ringSlot];
+	if ((sqe = ringSqe(r)) != NULL)
+	{
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = RING_DATA(RING_RECV, session->gen, t->ringSlot);
+		sqe->user_data = RING_DATA(RING_CANCEL, 0, 0);
+	}
+	session->t = NULL;
+	session->context = NULL;
+	++session->gen;
+	r->sessionFree[r->sessionFreeCount++] = t->ringSlot;
+	t->ring = NULL;
+	t->rxQueued = 0;
+	transport_ringSubmit(r);
+}
+
+
+/**
+Hand every queued submission to the kernel without waiting for anything.
+@return the number of submissions handed over, or SOCKET_ERROR
+*/
+int transport_ringSubmit(TransportRing_t* r)
+{
+	int rc;
+
+	__atomic_store_n(r->sqTail, r->sqLocal, __ATOMIC_RELEASE);
+	if (r->sqLocal == r->sqSubmitted)
+		return 0;
+	if ((rc = ringEnter(r, r->sqLocal - r->sqSubmitted, 0, 0, NULL, 0)) < 0)
+	{
+		/* The kernel was busy and the submissions are still queued; they go out with the next submit. */
+		if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+			return 0;
+		Socket_error("io_uring_enter", r->fd);
+		return SOCKET_ERROR;
+	}
+	r->sqSubmitted += (unsigned int)rc;
+	return rc;
+}
+
+
+/**
+Submit everything queued, wait up to timeoutMs for a completion, and handle every completion there is: finished sends
+free their buffers, and every received datagram is copied into the receive buffer of its session and passed to recv.
+A session that recv detaches or closes gets no more datagrams, even ones that already arrived.
+@param r the ring
+@param timeoutMs the longest to wait in milliseconds, 0 not to wait, or -1 to wait until something completes
+@param recv called for every datagram received, or NULL to drop them
+@return the number of datagrams received, or SOCKET_ERROR
+*/
+int transport_ringWait(TransportRing_t* r, int timeoutMs, transport_ringRecvFn recv)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int head = *r->cqHead;
+	unsigned int tail;
+	unsigned int flags = IORING_ENTER_GETEVENTS;
+	int received = 0;
+	int rc;
+
+	__atomic_store_n(r->sqTail, r->sqLocal, __ATOMIC_RELEASE);
+	memset(&arg, 0, sizeof(arg));
+	if (timeoutMs >= 0)
+	{
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = (long long)(timeoutMs % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+	/* Only block if nothing has completed yet. */
+	rc = ringEnter(r, r->sqLocal - r->sqSubmitted,
+			(timeoutMs != 0 && head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) ? 1 : 0,
+			flags, (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL, (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+	if (rc > 0)
+		r->sqSubmitted += (unsigned int)rc;
+	else if (rc < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+	{
+		Socket_error("io_uring_enter", r->fd);
+		return SOCKET_ERROR;
+	}
+
+	tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+	while (head != tail)
+	{
+		struct io_uring_cqe* cqe = &((struct io_uring_cqe*)r->cqes)[head & r->cqMask];
+		uint64_t data = cqe->user_data;
+		int res = cqe->res;
+		unsigned int cqeFlags = cqe->flags;
+
+		/* The entry has been copied, so the kernel can reuse it while this one is handled. */
+		__atomic_store_n(r->cqHead, ++head, __ATOMIC_RELEASE);
+		if (RING_KIND(data) == RING_SEND)
+		{
+			r->sendFree[r->sendFreeCount++] = RING_INDEX(data);
+			if (res < 0)
+			{
+				errno = -res;
+				Socket_error("send", r->fd);
+			}
+		}
+		else if (RING_KIND(data) == RING_RECV)
+		{
+			unsigned int index = RING_INDEX(data);
+			struct TransportRingSession* session = &r->sessions[index];
+			Transport_t* t = (session->gen == RING_GEN(data)) ? session->t : NULL;
+
+			if (cqeFlags & IORING_CQE_F_BUFFER)
+			{
+				unsigned int bid = cqeFlags >> IORING_CQE_BUFFER_SHIFT;
+				if (t != NULL && res > 0)
+				{
+					memcpy(t->rxBuf, r->bufData + (size_t)bid * TRANSPORT_RX_LEN, (size_t)res);
+					t->rxLen = (size_t)res;
+					t->rxQueued = 1;
+				}
+				ringBufferReturn(r, bid);
+				if (t != NULL && res > 0)
+				{
+					++received;
+					if (recv != NULL)
+						recv(t, session->context);
+				}
+			}
+			else if (t != NULL && res < 0 && res != -ENOBUFS && res != -ECANCELED)
+			{
+				errno = -res;
+				Socket_error("recv", t->sock);
+			}
+			/* The kernel ended the receive, for example because every buffer was in use. Post it again if the
+			   session is still attached, unless the kernel refused it, which would only be refused again. */
+			if (!(cqeFlags & IORING_CQE_F_MORE) && session->t != NULL && session->gen == RING_GEN(data) &&
+					res != -ECANCELED && res != -EBADF && res != -EINVAL && res != -EOPNOTSUPP)
+				ringArm(r, index);
+		}
+		if (head == tail)
+			tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+	}
+	return received;
+}
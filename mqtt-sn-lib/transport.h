@@ -15,7 +15,116 @@
  *    Sergio R. Caprile - "commonalization" from prior samples and/or documentation extension
  *******************************************************************************/
 
+#if !defined(TRANSPORT_H)
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/** size of the per-session receive buffer, large enough for any datagram the client accepts */
+#define TRANSPORT_RX_LEN 1600
+
+/** most datagrams handed to the socket by one transport_sessionSendBatch call */
+#define TRANSPORT_BATCH_MAX 64
+
+/** most sessions, and most submission queue entries, a transport ring can be opened with */
+#define TRANSPORT_RING_SESSIONS_MAX 0xffffff
+#define TRANSPORT_RING_ENTRIES_MAX 4096
+
+struct TransportRing;
+struct TransportRingSession;
+
+/**
+A transport session: one UDP socket connected to one gateway.
+Each MQTT-SN client session owns one of these, so a single process can drive any number of sessions.
+The gateway address the socket is connected to is kept in network byte order for reference; sends do not need it.
+While the session is attached to a transport ring, its datagrams are sent and received through the ring instead of
+with one system call each, and rxQueued tells transport_sessionRecv that the ring has already put one in rxBuf.
+opens counts the sockets opened for the session, so a new socket that was given the descriptor of a closed one can
+still be told apart from it. transport_sessionInit must be called before the session is first opened, since
+transport_sessionOpen only adds to the count.
+*/
+typedef struct
+{
+	int sock;
+	uint32_t peerAddr;
+	uint16_t peerPort;
+	size_t rxLen;
+	struct TransportRing* ring;
+	unsigned int ringSlot;
+	int rxQueued;
+	unsigned int opens;
+	unsigned char rxBuf[TRANSPORT_RX_LEN];
+} Transport_t;
+
+/** called by transport_ringWait for every datagram the ring received, once it has been copied into the session's rxBuf */
+typedef void (*transport_ringRecvFn)(Transport_t* t, void* context);
+
+/**
+An io_uring instance shared by many transport sessions, so that a single io_uring_enter call sends the datagrams queued
+by all of them and collects everything they received. Every attached socket keeps a multishot receive posted, which
+reads datagrams into a ring of buffers registered with the kernel, and every send is copied into a buffer owned by the
+ring until the kernel has completed it. The ring is set up with raw system calls, needs Linux 6.0 or later, and must
+only be used from the thread that opened it.
+*/
+typedef struct TransportRing
+{
+	int fd;
+	/** the submission queue, shared with the kernel, and the entries written but not yet handed to it */
+	unsigned int* sqHead;
+	unsigned int* sqTail;
+	unsigned int sqMask;
+	unsigned int sqEntries;
+	unsigned int sqLocal;
+	unsigned int sqSubmitted;
+	void* sqes;
+	/** the completion queue, shared with the kernel */
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	unsigned int cqMask;
+	void* cqes;
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	size_t sqesSize;
+	/** the buffers multishot receives are read into, and the ring that hands them to the kernel */
+	void* bufRing;
+	size_t bufRingSize;
+	unsigned char* bufData;
+	unsigned int bufCount;
+	uint16_t bufTail;
+	/** copies of datagrams being sent, one buffer per send the kernel has not completed */
+	unsigned char* sendData;
+	unsigned int* sendFree;
+	unsigned int sendFreeCount;
+	/** the attached sessions, and the slots of the table that are free */
+	struct TransportRingSession* sessions;
+	unsigned int* sessionFree;
+	unsigned int sessionFreeCount;
+	unsigned int sessionCount;
+} TransportRing_t;
+
 ssize_t transport_sendPacketBuffer(char* host, int port, unsigned char* buf, size_t buflen);
 int transport_getdata(unsigned char* buf, int count);
 int transport_open(void);
 int transport_close(void);
+
+void transport_sessionInit(Transport_t* t);
+int transport_sessionOpen(Transport_t* t, char* host, int port);
+ssize_t transport_sessionSend(Transport_t* t, unsigned char* buf, size_t buflen);
+ssize_t transport_sessionSendv(Transport_t* t, const struct iovec* iov, int iovcnt);
+int transport_sessionSendBatch(Transport_t* t, struct iovec* frames, unsigned int count);
+int transport_sessionRecv(Transport_t* t);
+int transport_sessionClose(Transport_t* t);
+
+int transport_ringOpen(TransportRing_t* r, unsigned int sessions, unsigned int entries);
+void transport_ringClose(TransportRing_t* r);
+int transport_ringAttach(TransportRing_t* r, Transport_t* t, void* context);
+void transport_ringDetach(Transport_t* t);
+int transport_ringSubmit(TransportRing_t* r);
+int transport_ringWait(TransportRing_t* r, int timeoutMs, transport_ringRecvFn recv);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * Contains the functions that add the fixed length acknowledgements to a client's send batch.
+ * A PubAck, RegAck, PubRec, PubRel, or PubComp is always the same length, so room for it is reserved in the batch and
+ * it is copied there from a template with only its topicID, msgID, and return code filled in, instead of being
+ * serialized into a buffer on the stack and then copied into the batch.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "MQTTSNPacket.h"
+#include "ErrorCodes.h"
+#include "AckFrame.h"
+
+const unsigned char pubAckTemplate[Q_PUBACK_LEN] = { Q_PUBACK_LEN, MQTTSN_PUBACK, 0, 0, 0, 0, MQTTSN_RC_ACCEPTED };
+const unsigned char regAckTemplate[Q_REGACK_LEN] = { Q_REGACK_LEN, MQTTSN_REGACK, 0, 0, 0, 0, MQTTSN_RC_ACCEPTED };
+const unsigned char pingReqTemplate[Q_PINGREQ_LEN] = { Q_PINGREQ_LEN, MQTTSN_PINGREQ };
+
+//The fixed lengths must fit in the one byte length field, and in a batch.
+_Static_assert(Q_PUBACK_LEN < 256 && Q_REGACK_LEN < 256 && Q_PUBRESP_LEN < 256, "Acknowledgements need a 1 byte length");
+_Static_assert(Q_PUBACK_LEN <= Q_BATCH_BYTES, "An acknowledgement must fit in a send batch");
+//ackFrameQueue fills in both PubAck and RegAck messages.
+_Static_assert(Q_REGACK_LEN == Q_PUBACK_LEN, "PubAck and RegAck share a layout");
+
+/**
+ * Writes a 16 bit value in network byte order.
+ * @param pos Where the value is written.
+ * @param value The value.
+ * @return void
+ */
+static void putInt(unsigned char *pos, uint16_t value)
+{
+    pos[0] = (unsigned char)(value >> 8);
+    pos[1] = (unsigned char)(value & 0xFF);
+}//End putInt
+
+/**
+ * Finds where a fixed length message is written: straight into the batch, or into fallback if the batch could not
+ * be sent to make room.
+ * @param batch The client's batch.
+ * @param transport The transport session used if the batch has to be sent to make room.
+ * @param fallback A buffer of at least length bytes.
+ * @param length The length of the message.
+ * @return A pointer to where the message should be written.
+ */
+static unsigned char *frameReserve(SendBatch_t *batch, Transport_t *transport, unsigned char *fallback, size_t length)
+{
+    unsigned char *slot = sendBatchReserve(batch, transport, length);
+    return (slot != NULL) ? slot : fallback;
+}//End frameReserve
+
+/**
+ * Adds the message written after frameReserve to the batch, or sends it on its own if it was written into fallback.
+ * @param batch The client's batch.
+ * @param transport The transport session the message is sent on if it is not in the batch.
+ * @param frame The pointer frameReserve returned.
+ * @param fallback The buffer given to frameReserve.
+ * @param length The length of the message.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Socket indicates an error.
+ */
+static int frameCommit(SendBatch_t *batch, Transport_t *transport, unsigned char *frame, unsigned char *fallback, size_t length)
+{
+    if(frame == fallback){
+        return sendBatchDirect(batch, transport, frame, length);
+    }
+    sendBatchCommit(batch, length);
+    return Q_NO_ERR;
+}//End frameCommit
+
+/**
+ * Adds a PubAck or RegAck to the batch, filled in from its template.
+ * @param batch The client's batch.
+ * @param transport The transport session used if the batch has to be sent to make room.
+ * @param frameTemplate pubAckTemplate or regAckTemplate.
+ * @param topicID The topicID of the message being acknowledged.
+ * @param msgID The msgID of the message being acknowledged.
+ * @param returnCode The return code, for example MQTTSN_RC_ACCEPTED.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Socket indicates an error.
+ */
+int ackFrameQueue(SendBatch_t *batch, Transport_t *transport, const unsigned char *frameTemplate, uint16_t topicID, uint16_t msgID, uint8_t returnCode)
+{
+    unsigned char fallback[Q_PUBACK_LEN];
+    unsigned char *frame = frameReserve(batch, transport, fallback, Q_PUBACK_LEN);
+
+    memcpy(frame, frameTemplate, Q_PUBACK_LEN);
+    putInt(frame + Q_ACK_TOPICID_OFFSET, topicID);
+    putInt(frame + Q_ACK_MSGID_OFFSET, msgID);
+    frame[Q_ACK_RC_OFFSET] = returnCode;
+    return frameCommit(batch, transport, frame, fallback, Q_PUBACK_LEN);
+}//End ackFrameQueue
+
+/**
+ * Adds a PubRec, PubRel, or PubComp to the batch.
+ * @param batch The client's batch.
+ * @param transport The transport session used if the batch has to be sent to make room.
+ * @param msgType MQTTSN_PUBREC, MQTTSN_PUBREL, or MQTTSN_PUBCOMP.
+ * @param msgID The msgID of the QoS level 2 Publish message.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Socket indicates an error.
+ */
+int pubRespFrameQueue(SendBatch_t *batch, Transport_t *transport, uint8_t msgType, uint16_t msgID)
+{
+    unsigned char fallback[Q_PUBRESP_LEN];
+    unsigned char *frame = frameReserve(batch, transport, fallback, Q_PUBRESP_LEN);
+
+    frame[0] = Q_PUBRESP_LEN;
+    frame[1] = msgType;
+    putInt(frame + Q_PUBRESP_MSGID_OFFSET, msgID);
+    return frameCommit(batch, transport, frame, fallback, Q_PUBRESP_LEN);
+}//End pubRespFrameQueue
@@ -0,0 +1,36 @@
+/**
+ * Header file for AckFrame.c
+ * Defines the layout of the fixed length messages a client sends in answer to the Gateway. Their lengths never
+ * change, so each one is copied from a template and only its topicID, msgID, and return code are filled in.
+ */
+
+#ifndef Q_ACKFRAME_H
+#define Q_ACKFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SendBatch.h"
+
+//PubAck and RegAck: Length, MsgType, TopicId (2 bytes), MsgId (2 bytes), ReturnCode.
+#define Q_PUBACK_LEN 7
+#define Q_REGACK_LEN 7
+//PubRec, PubRel, and PubComp: Length, MsgType, MsgId (2 bytes).
+#define Q_PUBRESP_LEN 4
+//PingReq without a clientID: Length, MsgType.
+#define Q_PINGREQ_LEN 2
+
+//Where the fields are filled in. The msgID follows the topicID in a PubAck or RegAck.
+#define Q_ACK_TOPICID_OFFSET 2
+#define Q_ACK_MSGID_OFFSET 4
+#define Q_ACK_RC_OFFSET 6
+#define Q_PUBRESP_MSGID_OFFSET 2
+
+extern const unsigned char pubAckTemplate[Q_PUBACK_LEN];
+extern const unsigned char regAckTemplate[Q_REGACK_LEN];
+extern const unsigned char pingReqTemplate[Q_PINGREQ_LEN];
+
+int ackFrameQueue(SendBatch_t *batch, Transport_t *transport, const unsigned char *frameTemplate, uint16_t topicID, uint16_t msgID, uint8_t returnCode); //prototype
+int pubRespFrameQueue(SendBatch_t *batch, Transport_t *transport, uint8_t msgType, uint16_t msgID); //prototype
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * Contains the functions used to track the Register and Subscribe messages of a bulk request.
+ * A client that registers and subscribes to many topics after connecting would otherwise wait a round trip for each
+ * of them. The messages of a bulk request are given consecutive msgIDs, so the RegAck or SubAck for any of them is
+ * matched by a subtraction, in whatever order the answers arrive.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "Bulk.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Empties a bulk request table. Must be called before the table is used.
+ * @param bulk The table to be initialized.
+ * @return void
+ */
+void bulkInit(Bulk_t *bulk)
+{
+    bulk->ops = NULL;
+    bulk->count = 0;
+    bulk->waiting = 0;
+    bulk->firstMsgID = 0;
+}//End bulkInit
+
+/**
+ * Makes room for the messages of a new bulk request. Any earlier request and its results are freed.
+ * @param bulk The table.
+ * @param count The number of messages, at most Q_BULK_MAX.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_QueueFull indicates count is larger than Q_BULK_MAX
+ * and Q_ERR_Unknown that the messages could not be allocated.
+ */
+int bulkStart(Bulk_t *bulk, size_t count)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(count > Q_BULK_MAX){
+        returnCode = Q_ERR_QueueFull;
+        goto exit;
+    }
+    bulkFree(bulk);
+    if(count > 0){
+        bulk->ops = calloc(count, sizeof(BulkOp_t));
+        if(bulk->ops == NULL){
+            goto exit;
+        }
+    }
+    bulk->count = count;
+    bulk->waiting = count;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End bulkStart
+
+/**
+ * Releases the memory held by the table and empties it.
+ * @param bulk The table to be freed.
+ * @return void
+ */
+void bulkFree(Bulk_t *bulk)
+{
+    free(bulk->ops);
+    bulkInit(bulk);
+}//End bulkFree
+
+/**
+ * Looks up the message of a bulk request a RegAck or SubAck answers.
+ * @param bulk The table to be searched.
+ * @param msgType MQTTSN_REGISTER for a RegAck, or MQTTSN_SUBSCRIBE for a SubAck.
+ * @param msgID The msgID contained in the answer.
+ * @return A pointer to the message, or NULL if it is not part of the bulk request.
+ */
+BulkOp_t *bulkFind(Bulk_t *bulk, uint8_t msgType, uint16_t msgID)
+{
+    size_t index = (uint16_t)(msgID - bulk->firstMsgID);
+    if(bulk->ops == NULL || index >= bulk->count || bulk->ops[index].msgType != msgType){
+        return NULL;
+    }
+    return &bulk->ops[index];
+}//End bulkFind
+
+/**
+ * @param bulk The table that holds the message.
+ * @param op A message of the bulk request.
+ * @return The msgID the message is sent with.
+ */
+uint16_t bulkMsgID(const Bulk_t *bulk, const BulkOp_t *op)
+{
+    return (uint16_t)(bulk->firstMsgID + (size_t)(op - bulk->ops));
+}//End bulkMsgID
+
+/**
+ * Records the answer to a message of a bulk request. Nothing happens if it was already answered.
+ * @param bulk The table that holds the message.
+ * @param op The message.
+ * @param status How it was answered, for example Q_RegAckRead, Q_ERR_Rejected, or Q_ERR_RetryLimit.
+ * @return void
+ */
+void bulkAnswered(Bulk_t *bulk, BulkOp_t *op, int status)
+{
+    if(op->answered){
+        return;
+    }
+    op->answered = true;
+    op->status = status;
+    op->deadlineMs = 0;
+    bulk->waiting -= 1;
+}//End bulkAnswered
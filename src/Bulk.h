@@ -0,0 +1,58 @@
+/**
+ * Header file for Bulk.c
+ * Defines the table used to track the Register and Subscribe messages of a bulk request, which are all sent back to
+ * back with consecutive msgIDs instead of one at a time, and matched with their RegAck or SubAck as they arrive.
+ */
+
+#ifndef Q_BULK_H
+#define Q_BULK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "TopicTable.h"
+
+//The most Register and Subscribe messages a bulk request can hold.
+#define Q_BULK_MAX 1024
+
+//A Register or Subscribe message of a bulk request.
+typedef struct {
+    //MQTTSN_REGISTER or MQTTSN_SUBSCRIBE.
+    uint8_t msgType;
+    uint8_t qos;
+    //The topic name, which must stay valid until the bulk request is done with.
+    const char *topicName;
+    MessageHandler_t handler;
+    void *context;
+    //When the message was sent, in microseconds on the monotonic clock.
+    uint64_t sentUs;
+    //When the message is sent again if it has not been answered, in milliseconds on the monotonic clock. 0 until sent.
+    uint64_t deadlineMs;
+    //The number of times the message has been sent again.
+    uint8_t attempts;
+    //True once the message has been answered or given up on.
+    bool answered;
+    //How the message was answered: Q_RegAckRead or Q_SubAckRead, or an error such as Q_ERR_Rejected or Q_ERR_RetryLimit.
+    int status;
+    //The topicID in the RegAck or SubAck, 0 for a wildcard subscription or an error.
+    uint16_t topicID;
+} BulkOp_t;
+
+//The messages of a bulk request. Message index is sent with msgID firstMsgID + index.
+typedef struct {
+    BulkOp_t *ops;
+    size_t count;
+    //The number of messages that have not been answered or given up on yet.
+    size_t waiting;
+    uint16_t firstMsgID;
+} Bulk_t;
+
+void bulkInit(Bulk_t *bulk); //prototype
+int bulkStart(Bulk_t *bulk, size_t count); //prototype
+void bulkFree(Bulk_t *bulk); //prototype
+BulkOp_t *bulkFind(Bulk_t *bulk, uint8_t msgType, uint16_t msgID); //prototype
+uint16_t bulkMsgID(const Bulk_t *bulk, const BulkOp_t *op); //prototype
+void bulkAnswered(Bulk_t *bulk, BulkOp_t *op, int status); //prototype
+
+#endif
@@ -0,0 +1,531 @@
+/**
+ * Contains the functions used to run a session on an I/O thread of its own, so any number of application threads can
+ * publish, register, subscribe, and sleep without sharing a lock around the library.
+ * Nothing else in the library is safe to call from more than one thread at a time, so the I/O thread owns the client,
+ * its socket, and its session, and is the only thread that ever touches them. Application threads copy their requests
+ * into a submission ring that many threads can add to at once without a lock, and wake the I/O thread through an
+ * eventfd the session waits on next to its socket. Received Publish messages and the session's events are copied into
+ * a completion ring read by a single application thread, which can wait on an eventfd of its own.
+ * A Publish request that finds the in flight window full stays at the front of the submission ring until an
+ * acknowledgement makes room, so the ring pushes back on producers when the Gateway cannot keep up. The I/O thread
+ * waits for the application to make room in a full completion ring rather than drop a message it already acknowledged.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "Events.h"
+#include "ErrorCodes.h"
+#include "Session.h"
+#include "ClientThread.h"
+#include "StackTrace.h"
+
+/**
+ * Makes an eventfd readable. A counter that is already at its limit still wakes the reader, so a failed write needs
+ * no handling.
+ * @param fd The eventfd.
+ * @return void
+ */
+static void threadWake(int fd)
+{
+    uint64_t one = 1;
+    ssize_t written = write(fd, &one, sizeof(one));
+    (void)written;
+}//End threadWake
+
+/**
+ * Resets an eventfd, so the next wait on it blocks until it is made readable again.
+ * @param fd The eventfd, which must be non-blocking.
+ * @return void
+ */
+static void threadClear(int fd)
+{
+    uint64_t count;
+    ssize_t got = read(fd, &count, sizeof(count));
+    (void)got;
+}//End threadClear
+
+/**
+ * Wakes the application if completions were added since it was last woken.
+ * @param ct The I/O thread.
+ * @return void
+ */
+static void threadSignal(ClientThread_t *ct)
+{
+    if(ct->completed){
+        ct->completed = false;
+        threadWake(ct->completeFd);
+    }
+}//End threadSignal
+
+/**
+ * Finds the next free slot of the completion ring, waiting for the application to release one if the ring is full.
+ * @param ct The I/O thread.
+ * @return The slot, which is handed to the application by threadCommit, or NULL if the thread was stopped while waiting.
+ */
+static ThreadCompletion_t *threadClaim(ClientThread_t *ct)
+{
+    CompleteRing_t *ring = &ct->complete;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    while(head - atomic_load_explicit(&ring->tail, memory_order_acquire) > ring->mask){
+        //The application may be waiting on completeFd for the completions it has not read yet.
+        threadSignal(ct);
+        if(atomic_load(&ct->stop)){
+            return NULL;
+        }
+        poll(NULL, 0, 1);
+    }
+    ThreadCompletion_t *slot = &ring->slots[head & ring->mask];
+    memset(slot, 0, offsetof(ThreadCompletion_t, payload));
+    return slot;
+}//End threadClaim
+
+/**
+ * Hands the slot returned by threadClaim to the application.
+ * @param ct The I/O thread.
+ * @return void
+ */
+static void threadCommit(ClientThread_t *ct)
+{
+    CompleteRing_t *ring = &ct->complete;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    ct->completed = true;
+}//End threadCommit
+
+/**
+ * Copies a received Publish message into the completion ring. Used as the handler of every topic subscribed to
+ * through the I/O thread, and as the client's default handler.
+ * @param message The received message.
+ * @param context The I/O thread.
+ * @return void
+ */
+static void threadMessageArrived(const Q_Message_t *message, void *context)
+{
+    ClientThread_t *ct = context;
+    ThreadCompletion_t *slot = threadClaim(ct);
+    if(slot == NULL){
+        return;
+    }
+    slot->kind = Q_COMPLETE_MESSAGE;
+    slot->code = Q_NO_ERR;
+    slot->op = Q_OP_PUBLISH;
+    slot->topicID = message->topicID;
+    slot->msgID = message->msgID;
+    slot->qos = message->qos;
+    slot->retained = message->retained;
+    slot->dup = message->dup;
+    snprintf(slot->topicName, sizeof(slot->topicName), "%s", (message->topicName != NULL) ? message->topicName : "");
+    slot->payloadLen = (message->payloadLen < Q_THREAD_PAYLOAD) ? message->payloadLen : Q_THREAD_PAYLOAD;
+    memcpy(slot->payload, message->payload, slot->payloadLen);
+    threadCommit(ct);
+}//End threadMessageArrived
+
+/**
+ * Copies a status code into the completion ring.
+ * @param ct The I/O thread.
+ * @param code The status code.
+ * @param op The operation of the request that failed, or Q_OP_PUBLISH for an event of the session.
+ * @param topicName The topic name of the request that failed, or NULL.
+ * @return void
+ */
+static void threadStatus(ClientThread_t *ct, int code, enum Q_THREAD_OP op, const char *topicName)
+{
+    ThreadCompletion_t *slot = threadClaim(ct);
+    if(slot == NULL){
+        return;
+    }
+    slot->kind = Q_COMPLETE_STATUS;
+    slot->code = code;
+    slot->op = op;
+    //The topicID and msgID of the message that caused the event, such as a RegAck.
+    slot->topicID = ct->session->event.topicID;
+    slot->msgID = ct->session->event.msgID;
+    snprintf(slot->topicName, sizeof(slot->topicName), "%s", (topicName != NULL) ? topicName : "");
+    threadCommit(ct);
+}//End threadStatus
+
+/**
+ * Passes the session's events to the application through the completion ring.
+ * @param session The session run by the I/O thread.
+ * @param code The status code of the event.
+ * @param context The I/O thread.
+ * @return void
+ */
+static void threadNotify(Session_t *session, int code, void *context)
+{
+    (void)session;
+    threadStatus(context, code, Q_OP_PUBLISH, NULL);
+}//End threadNotify
+
+/**
+ * Carries out a request on the I/O thread.
+ * @param ct The I/O thread.
+ * @param request The request.
+ * @return An int: the status code the session returned for the request.
+ */
+static int threadRun(ClientThread_t *ct, const ThreadRequest_t *request)
+{
+    switch(request->op){
+        case Q_OP_PUBLISH:
+            return sessionPublish(ct->session, request->topicName, request->qos, request->payload, request->payloadLen);
+
+        case Q_OP_REGISTER:
+            return sessionRegister(ct->session, request->topicName);
+
+        case Q_OP_SUBSCRIBE:
+            return sessionSubscribe(ct->session, request->topicName, request->qos, threadMessageArrived, ct);
+
+        case Q_OP_SLEEP:
+            return sessionSleep(ct->session, request->seconds);
+
+        case Q_OP_DISCONNECT:
+            return sessionDisconnect(ct->session);
+
+        default:
+            return Q_ERR_Unknown;
+    }
+}//End threadRun
+
+/**
+ * Carries out every request in the submission ring, in the order they were submitted. A Publish request that finds
+ * no room for the message is left at the front of the ring and tried again once the session has read more messages.
+ * Requests that fail are reported through the completion ring.
+ * @param ct The I/O thread.
+ * @return void
+ */
+static void threadDrain(ClientThread_t *ct)
+{
+    SubmitRing_t *ring = &ct->submit;
+
+    for(;;){
+        ThreadRequest_t *slot = &ring->slots[ring->tail & ring->mask];
+        //The producer marks a slot as filled by moving its sequence one past the slot's position.
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring->tail + 1){
+            break;
+        }
+        int returnCode = threadRun(ct, slot);
+        if(returnCode == Q_ERR_WindowFull || returnCode == Q_ERR_QueueFull){
+            break;
+        }
+        if(returnCode != Q_NO_ERR){
+            threadStatus(ct, returnCode, slot->op, slot->topicName);
+        }
+        //Hand the slot back to the producers for its next lap around the ring.
+        atomic_store_explicit(&slot->sequence, ring->tail + ring->mask + 1, memory_order_release);
+        ring->tail += 1;
+    }
+}//End threadDrain
+
+/**
+ * Body of the I/O thread. Runs until clientThreadStop is called or the session ends, and reports Q_DisconRead once
+ * the session is over.
+ * @param arg The I/O thread.
+ * @return NULL
+ */
+static void *clientThreadMain(void *arg)
+{
+    ClientThread_t *ct = arg;
+
+    while(!atomic_load(&ct->stop)){
+        //Reset the eventfd before draining, so a request submitted after the drain still wakes sessionPoll.
+        threadClear(ct->submitFd);
+        threadDrain(ct);
+        threadSignal(ct);
+        if(sessionPoll(ct->session) != Q_NO_ERR){
+            threadStatus(ct, Q_DisconRead, Q_OP_DISCONNECT, NULL);
+            break;
+        }
+    }
+    threadSignal(ct);
+    atomic_store(&ct->running, false);
+    return NULL;
+}//End clientThreadMain
+
+/**
+ * Creates the rings and eventfds of an I/O thread for a session, without starting the thread.
+ * @param ct The I/O thread to be initialized.
+ * @param session The session the thread runs. Must have been set up with sessionInit.
+ * @param slots The number of requests and completions each ring holds, rounded up to a power of two. Usually Q_THREAD_RING.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the rings or eventfds could not be created.
+ */
+int clientThreadInit(ClientThread_t *ct, Session_t *session, size_t slots)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    memset(ct, 0, sizeof(*ct));
+    ct->session = session;
+    ct->submitFd = -1;
+    ct->completeFd = -1;
+    //Positions are masked with the capacity to find their slot, so the capacity must be a power of two.
+    size_t capacity = 2;
+    while(capacity < slots){
+        capacity <<= 1;
+    }
+
+    ct->submit.slots = calloc(capacity, sizeof(ThreadRequest_t));
+    ct->complete.slots = calloc(capacity, sizeof(ThreadCompletion_t));
+    ct->submitFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ct->completeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(ct->submit.slots == NULL || ct->complete.slots == NULL || ct->submitFd < 0 || ct->completeFd < 0){
+        clientThreadFree(ct);
+        goto exit;
+    }
+    ct->submit.mask = capacity - 1;
+    ct->complete.mask = capacity - 1;
+    //Slot i is free for the producer that claims position i.
+    for(size_t index = 0; index < capacity; ++index){
+        atomic_init(&ct->submit.slots[index].sequence, index);
+    }
+    atomic_init(&ct->submit.head, 0);
+    atomic_init(&ct->complete.head, 0);
+    atomic_init(&ct->complete.tail, 0);
+    atomic_init(&ct->stop, false);
+    atomic_init(&ct->running, false);
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End clientThreadInit
+
+/**
+ * Releases the rings and eventfds of an I/O thread. The thread must have been stopped with clientThreadStop.
+ * @param ct The I/O thread to be freed.
+ * @return void
+ */
+void clientThreadFree(ClientThread_t *ct)
+{
+    free(ct->submit.slots);
+    free(ct->complete.slots);
+    ct->submit.slots = NULL;
+    ct->complete.slots = NULL;
+    if(ct->submitFd >= 0){
+        close(ct->submitFd);
+    }
+    if(ct->completeFd >= 0){
+        close(ct->completeFd);
+    }
+    ct->submitFd = -1;
+    ct->completeFd = -1;
+}//End clientThreadFree
+
+/**
+ * Starts the I/O thread. The session is usually connected first with sessionConnect; from then on it must only be
+ * used through the I/O thread until clientThreadStop returns. The session's notify function and the client's default
+ * handler are taken over by the thread, and their events and messages arrive through clientThreadPeek instead.
+ * @param ct The I/O thread, set up with clientThreadInit.
+ * @return An int: Q_NO_ERR indicates the thread is running. Otherwise, Q_ERR_Unknown indicates it could not be started.
+ */
+int clientThreadStart(ClientThread_t *ct)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    Session_t *session = ct->session;
+    session->notify = threadNotify;
+    session->notifyContext = ct;
+    session->wakeFd = ct->submitFd;
+    session->event.client->defaultHandler = threadMessageArrived;
+    session->event.client->defaultContext = ct;
+    atomic_store(&ct->stop, false);
+    atomic_store(&ct->running, true);
+    if(pthread_create(&ct->thread, NULL, clientThreadMain, ct) != 0){
+        atomic_store(&ct->running, false);
+        session->wakeFd = -1;
+        goto exit;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End clientThreadStart
+
+/**
+ * Stops the I/O thread and waits for it to finish, after which the session can be used directly again, for example to
+ * read session->status. A client that is asleep is only stopped once it next wakes up. Requests still in the
+ * submission ring are not carried out.
+ * @param ct The I/O thread.
+ * @return void
+ */
+void clientThreadStop(ClientThread_t *ct)
+{
+    atomic_store(&ct->stop, true);
+    threadWake(ct->submitFd);
+    pthread_join(ct->thread, NULL);
+    ct->session->wakeFd = -1;
+}//End clientThreadStop
+
+/**
+ * Copies a request into the submission ring and wakes the I/O thread. Safe to call from any number of threads at once.
+ * @param ct The I/O thread.
+ * @param op What the request asks for.
+ * @param topicName The topic name, or NULL.
+ * @param qos The QoS level of a Publish or Subscribe request.
+ * @param seconds The sleep duration of a Sleep request.
+ * @param data The payload of a Publish request, or NULL.
+ * @param dataLength The length of the payload in bytes.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_MaxLength indicates the payload is
+ * larger than Q_THREAD_PAYLOAD, Q_ERR_QueueFull that the ring is full, and Q_ERR_NotConnected that the I/O thread has
+ * stopped.
+ */
+static int threadSubmit(ClientThread_t *ct, enum Q_THREAD_OP op, const char *topicName, uint8_t qos, uint16_t seconds,
+        const unsigned char *data, size_t dataLength)
+{
+    SubmitRing_t *ring = &ct->submit;
+    ThreadRequest_t *slot = NULL;
+
+    if(dataLength > Q_THREAD_PAYLOAD){
+        return Q_ERR_MaxLength;
+    }
+    if(!atomic_load(&ct->running)){
+        return Q_ERR_NotConnected;
+    }
+
+    //Claim the next position whose slot the I/O thread has finished with.
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for(;;){
+        slot = &ring->slots[pos & ring->mask];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t lap = (intptr_t)sequence - (intptr_t)pos;
+        if(lap == 0){
+            if(atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)){
+                break;
+            }
+        } else if(lap < 0){
+            //The slot still holds a request from the last lap, so the ring is full.
+            return Q_ERR_QueueFull;
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+
+    slot->op = op;
+    slot->topicName = topicName;
+    slot->qos = qos;
+    slot->seconds = seconds;
+    slot->payloadLen = dataLength;
+    if(dataLength > 0){
+        memcpy(slot->payload, data, dataLength);
+    }
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    threadWake(ct->submitFd);
+    return Q_NO_ERR;
+}//End threadSubmit
+
+/**
+ * Asks the I/O thread to publish a message to a registered topic name. The payload is copied, so the caller's buffer
+ * can be reused straight away. Acknowledgements and errors are reported through clientThreadPeek.
+ * @param ct The I/O thread.
+ * @param topicName The topic name, which must stay valid while the thread runs.
+ * @param qos The QoS level of the message: 0, 1, or 2.
+ * @param data The payload of the message.
+ * @param dataLength The length of the payload in bytes, at most Q_THREAD_PAYLOAD.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_MaxLength, Q_ERR_QueueFull, or
+ * Q_ERR_NotConnected, as for threadSubmit.
+ */
+int clientThreadPublish(ClientThread_t *ct, const char *topicName, uint8_t qos, const unsigned char *data, size_t dataLength)
+{
+    return threadSubmit(ct, Q_OP_PUBLISH, topicName, qos, 0, data, dataLength);
+}//End clientThreadPublish
+
+/**
+ * Asks the I/O thread to register a topic name. The RegAck is reported through clientThreadPeek as Q_RegAckRead.
+ * @param ct The I/O thread.
+ * @param topicName The topic name, which must stay valid while the thread runs.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_QueueFull or Q_ERR_NotConnected.
+ */
+int clientThreadRegister(ClientThread_t *ct, const char *topicName)
+{
+    return threadSubmit(ct, Q_OP_REGISTER, topicName, 0, 0, NULL, 0);
+}//End clientThreadRegister
+
+/**
+ * Asks the I/O thread to subscribe to a topic name. Messages received on it are returned by clientThreadPeek.
+ * @param ct The I/O thread.
+ * @param topicName The topic name, which must stay valid while the thread runs.
+ * @param qos The QoS level of the subscription.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_QueueFull or Q_ERR_NotConnected.
+ */
+int clientThreadSubscribe(ClientThread_t *ct, const char *topicName, uint8_t qos)
+{
+    return threadSubmit(ct, Q_OP_SUBSCRIBE, topicName, qos, 0, NULL, 0);
+}//End clientThreadSubscribe
+
+/**
+ * Asks the I/O thread to put the client to sleep, as sessionSleep does. Requests submitted while the client sleeps are
+ * carried out once it wakes up.
+ * @param ct The I/O thread.
+ * @param seconds The sleep duration sent to the Gateway.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_QueueFull or Q_ERR_NotConnected.
+ */
+int clientThreadSleep(ClientThread_t *ct, uint16_t seconds)
+{
+    return threadSubmit(ct, Q_OP_SLEEP, NULL, 0, seconds, NULL, 0);
+}//End clientThreadSleep
+
+/**
+ * Asks the I/O thread to disconnect from the Gateway. The thread stops once the session is over, after reporting
+ * Q_DisconRead through clientThreadPeek.
+ * @param ct The I/O thread.
+ * @return An int: Q_NO_ERR indicates the request was submitted. Otherwise, Q_ERR_QueueFull or Q_ERR_NotConnected.
+ */
+int clientThreadDisconnect(ClientThread_t *ct)
+{
+    return threadSubmit(ct, Q_OP_DISCONNECT, NULL, 0, 0, NULL, 0);
+}//End clientThreadDisconnect
+
+/**
+ * @param ct The I/O thread.
+ * @return A descriptor that becomes readable when completions are ready, to be waited on with poll or socketWait.
+ */
+int clientThreadFd(const ClientThread_t *ct)
+{
+    return ct->completeFd;
+}//End clientThreadFd
+
+/**
+ * Returns the oldest completion the application has not released yet. Must only be called from one application thread.
+ * @param ct The I/O thread.
+ * @return A pointer to the completion, which stays valid until clientThreadRelease, or NULL if there is none.
+ */
+ThreadCompletion_t *clientThreadPeek(ClientThread_t *ct)
+{
+    CompleteRing_t *ring = &ct->complete;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if(tail == atomic_load_explicit(&ring->head, memory_order_acquire)){
+        //Reset the eventfd before looking again, so a completion added after the second look still wakes the caller.
+        threadClear(ct->completeFd);
+        if(tail == atomic_load_explicit(&ring->head, memory_order_acquire)){
+            return NULL;
+        }
+    }
+    return &ring->slots[tail & ring->mask];
+}//End clientThreadPeek
+
+/**
+ * Hands the completion returned by clientThreadPeek back to the I/O thread.
+ * @param ct The I/O thread.
+ * @return void
+ */
+void clientThreadRelease(ClientThread_t *ct)
+{
+    CompleteRing_t *ring = &ct->complete;
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}//End clientThreadRelease
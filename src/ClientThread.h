@@ -0,0 +1,112 @@
+/**
+ * Header file for ClientThread.c
+ * Defines the ClientThread_t struct that runs a session on an I/O thread of its own, and the requests and completions
+ * other threads exchange with it. Client_t.h, Events.h, and Session.h must be included before this file.
+ */
+
+#ifndef Q_CLIENTTHREAD_H
+#define Q_CLIENTTHREAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "transport.h"
+
+//The number of requests and completions each ring holds when no other size is chosen.
+#define Q_THREAD_RING 64
+//The largest payload a request or completion can carry, which is the most a single datagram can hold.
+#define Q_THREAD_PAYLOAD TRANSPORT_RX_LEN
+//The longest topic name a completion carries, including the null character. Longer names are cut short.
+#define Q_THREAD_TOPIC 128
+
+//Defines what a request asks the I/O thread to do.
+enum Q_THREAD_OP {
+    Q_OP_PUBLISH, Q_OP_REGISTER, Q_OP_SUBSCRIBE, Q_OP_SLEEP, Q_OP_DISCONNECT
+};
+
+//Defines what a completion reports: a received Publish message, or a status code.
+enum Q_THREAD_COMPLETION {
+    Q_COMPLETE_MESSAGE, Q_COMPLETE_STATUS
+};
+
+//A request from an application thread, copied into the submission ring.
+typedef struct {
+    //The position in the ring the slot is ready for, which tells producers and the I/O thread who owns it.
+    atomic_size_t sequence;
+    enum Q_THREAD_OP op;
+    uint8_t qos;
+    //The sleep duration of a Q_OP_SLEEP request.
+    uint16_t seconds;
+    //The topic name, which must stay valid while the thread runs, since the session keeps it.
+    const char *topicName;
+    size_t payloadLen;
+    unsigned char payload[Q_THREAD_PAYLOAD];
+} ThreadRequest_t;
+
+//Something the I/O thread hands back to the application.
+typedef struct {
+    enum Q_THREAD_COMPLETION kind;
+    //For Q_COMPLETE_STATUS, the status code of the event, as passed to a session's notify function, or the error a
+    //request failed with. Q_NO_ERR for a received message.
+    int code;
+    //For a failed request, the request's operation. Otherwise Q_OP_PUBLISH.
+    enum Q_THREAD_OP op;
+    //The received message, for Q_COMPLETE_MESSAGE. For a failed request, its topic name.
+    uint16_t topicID;
+    uint16_t msgID;
+    uint8_t qos;
+    bool retained;
+    bool dup;
+    char topicName[Q_THREAD_TOPIC];
+    size_t payloadLen;
+    unsigned char payload[Q_THREAD_PAYLOAD];
+} ThreadCompletion_t;
+
+//Requests from any number of application threads to the I/O thread. Producers claim a position with a
+//compare and swap on head; the I/O thread is the only consumer and owns tail.
+typedef struct {
+    ThreadRequest_t *slots;
+    size_t mask;
+    atomic_size_t head;
+    size_t tail;
+} SubmitRing_t;
+
+//Completions from the I/O thread to a single application thread. Each side only writes its own index.
+typedef struct {
+    ThreadCompletion_t *slots;
+    size_t mask;
+    atomic_size_t head;
+    atomic_size_t tail;
+} CompleteRing_t;
+
+typedef struct {
+    Session_t *session;
+    SubmitRing_t submit;
+    CompleteRing_t complete;
+    //eventfds that wake the I/O thread when a request is submitted, and the application when a completion is ready.
+    int submitFd;
+    int completeFd;
+    pthread_t thread;
+    atomic_bool stop;
+    atomic_bool running;
+    //Set by the I/O thread whenever it adds a completion, and cleared once it has signalled completeFd.
+    bool completed;
+} ClientThread_t;
+
+int clientThreadInit(ClientThread_t *ct, Session_t *session, size_t slots); //prototype
+void clientThreadFree(ClientThread_t *ct); //prototype
+int clientThreadStart(ClientThread_t *ct); //prototype
+void clientThreadStop(ClientThread_t *ct); //prototype
+int clientThreadPublish(ClientThread_t *ct, const char *topicName, uint8_t qos, const unsigned char *data, size_t dataLength); //prototype
+int clientThreadRegister(ClientThread_t *ct, const char *topicName); //prototype
+int clientThreadSubscribe(ClientThread_t *ct, const char *topicName, uint8_t qos); //prototype
+int clientThreadSleep(ClientThread_t *ct, uint16_t seconds); //prototype
+int clientThreadDisconnect(ClientThread_t *ct); //prototype
+int clientThreadFd(const ClientThread_t *ct); //prototype
+ThreadCompletion_t *clientThreadPeek(ClientThread_t *ct); //prototype
+void clientThreadRelease(ClientThread_t *ct); //prototype
+
+#endif
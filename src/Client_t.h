@@ -1,41 +1,82 @@
 /**
  * Percentage Contribution: Sandeep Bindra (100%)
  * Defines a struct that holds information the Client needs. This includes the port being used to communicate with the 
- * Gateway(destinationPort), the destination IP address (host), the id of the client, and the socket the client will be using 
- * to communicate. The topic IDs of subscribed and registered topics will be stored as well, including their number. 
- * The client will only be allowed to subscribe and publish to 10 topicIDs, excluding topics with a wildcard character. 
- * Topics with a wildcard character will be stored separately and can be replaced easily since the topicID for wildcard topics 
- * can change when a new series of publish messages comes in.
+ * Gateway(destinationPort), the destination IP address (host), the id of the client, and the transport session (socket, 
+ * gateway address and receive buffer) the client will be using to communicate. Every client owns its own transport, 
+ * so a single process can run many clients at once. Every topicID the client subscribed to, registered, or was given for
+ * a wildcard subscription is stored in the client's topic table along with its topic name, so there is no limit on the
+ * number of topics. The topic table must be set up with topicTableInit before the client connects.
+ * Received Publish messages are passed to the handler of their topic, or to the client's default handler.
+ * QoS level 1 and 2 Publish messages that have not been fully acknowledged are kept in the client's in flight table,
+ * which must be set up with inFlightInit before the client publishes.
+ * The msgIDs of received QoS level 2 Publish messages are kept in the client's QoS 2 receive table until the Gateway
+ * releases them, so a message the Gateway sends again is not passed to the application twice. The table must be set up
+ * with qos2RecvInit before the client connects.
+ * Acknowledgements and QoS level 0 Publish messages are collected in the client's send batch, which connect sets up.
+ * A client can also be given an offline queue, which keeps QoS level 1 and 2 Publish messages in a file until they are
+ * acknowledged, so they can be published while the client is disconnected.
+ * Messages the Gateway does not acknowledge in time are sent again, after a timeout that adapts to the measured
+ * round trip time of the Gateway. connect sets up the estimate.
+ * Register and Subscribe messages can also be sent many at once as a bulk request, in which case they are tracked in the
+ * client's bulk request table until they have all been answered.
+ * The client counts the messages it sends and receives, the round trips it measures, and the time it spends in each
+ * state in its statistics, which must be set up with statsInit before the client connects.
+ * The transport must be set up with transport_sessionInit before the client first connects.
+ * A Client_t takes up about 18 KB, most of it the statistics (about 10 KB) and the send batch (about 4.4 KB), plus what
+ * its tables allocate, which is worth keeping in mind when one process runs thousands of clients.
  */ 
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "transport.h"
+#include "PacketView.h"
+#include "InFlight.h"
+#include "Qos2Recv.h"
+#include "TopicTable.h"
+#include "SendBatch.h"
+#include "OfflineQueue.h"
+#include "Rtt.h"
+#include "Bulk.h"
+#include "Stats.h"
+
 typedef struct {
     //The port the Gateway is using to communicate.
     int destinationPort;
     //The IP address of the gateway
     char *host;
-    //Socket the client will use to communicate with the gateway
-    int mySocket;
+    //Socket, gateway address and receive buffer the client will use to communicate with the gateway
+    Transport_t transport;
+    //The last message readMsg read into the transport's receive buffer, decoded once for every function that handles it.
+    PacketView_t rxView;
+    //Acknowledgements and QoS level 0 Publish messages waiting to be sent together.
+    SendBatch_t batch;
     //ID used to identify the client to the server.
     char *clientID;
-    //Used to hold the topicIDs for all subscribed topics, excluding wildcards.
-    uint16_t sub_topicID[10];
-    //Contains the number of topics subscribed to.
-    size_t subscribe_Num;
-
-    //Used to hold the topicIDs for all topics the can publish to.
-    uint16_t pub_topicID[10];
-    //Contains the number of topics the client can publish to.
-    size_t publish_Num;
+    //Holds every topicID known to the client: subscribed topics, topics registered for publishing,
+    //and topics the Gateway registered for a wildcard subscription.
+    TopicTable_t topics;
 
     //Indicates if the client has any wildcard subscriptions.
     bool wildcard_Sub;
     //The number of wildcard subscriptions the client has.
     size_t sub_Wild_Num;
-    //Used to hold the topicID (obtained by a register message from the server)
-    //for any wildcard topics the client subscribed to.
-    uint16_t wild_topicID;
+    //Called for Publish messages on topics that have no handler of their own, such as wildcard matches. Can be NULL.
+    MessageHandler_t defaultHandler;
+    void *defaultContext;
+    //QoS level 1 and 2 Publish messages waiting for a PubAck, PubRec, or PubComp from the Gateway.
+    InFlight_t inFlight;
+    //msgIDs of received QoS level 2 Publish messages that have been sent a PubRec and are waiting for their PubRel.
+    Qos2Recv_t qos2Recv;
+    //QoS level 1 and 2 Publish messages stored until they are acknowledged. NULL if the client does not use one.
+    OfflineQueue_t *offline;
+    //Round trip time estimate of the Gateway, which decides when unacknowledged messages are sent again.
+    Rtt_t rtt;
+    //The Connect, Register, or Subscribe message waiting on an answer from the Gateway.
+    Request_t request;
+    //The Register and Subscribe messages of the last bulk request, sent together and answered in any order.
+    Bulk_t bulk;
+    //Message counters, round trip histograms, and time spent in each state. Read them with statsSnapshot.
+    Stats_t stats;
 } Client_t;
@@ -13,12 +13,37 @@
 #include "Client_t.h"
 #include "StackTrace.h"
 #include "Connect.h"
+#include "Retransmit.h"
+#include "Publish.h"
 #include "ErrorCodes.h"
 
 size_t MQTTSNSerialize_connectLength(MQTTSNPacket_connectData *options); //prototype for a needed function
 
+/**
+ * Opens the client's socket to the Gateway without sending a Connect message. clientConnect does this itself; a client
+ * that only publishes with QoS level -1 calls it instead, since it never connects.
+ * @param clientPtr The client whose socket is opened. Its host and destinationPort must be set.
+ * @return An int: Q_NO_ERR indicates the socket is open. Otherwise, Q_ERR_SocketOpen indicates an error.
+ */
+int clientOpen(Client_t *clientPtr)
+{
+    //Resolve the gateway address and connect the client's socket to it.
+    if(transport_sessionOpen(&clientPtr->transport, clientPtr->host, clientPtr->destinationPort) < 0){
+        return Q_ERR_SocketOpen;
+    }
+    //Nothing is waiting to be sent on a new connection, and the round trip time of the Gateway is not known yet.
+    sendBatchInit(&clientPtr->batch, &clientPtr->stats);
+    rttInit(&clientPtr->rtt);
+    clientPtr->request.msgType = 0;
+    bulkInit(&clientPtr->bulk);
+    //Messages sent from the offline queue on an earlier connection are sent again on this one.
+    publishRewind(clientPtr);
+    return Q_NO_ERR;
+}//End clientOpen
+
 /**
  * Creates a Connect message for a client and sends it out to the server/gateway.
+ * Named clientConnect so it does not take the place of the socket library's connect when the program is linked.
  * @param clientPtr The client struct that will be sending out the Connect message.
  * @param timeOut The Keep Alive timer for the duration portion of the Connect message.
  * @param willF The value of the will flag, either a 1 or 0.
@@ -27,7 +52,7 @@ size_t MQTTSNSerialize_connectLength(MQTTSNPacket_connectData *options); //proto
  * the connect message was successfully sent and a the server/GW responded with a WillTopicReq message. Otherwise,
  * Q_ERR_Unknown, Q_ERR_Socket, Q_ERR_SocketOpen, and Q_ERR_Serial.
  */
-int connect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSession)
+int clientConnect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSession)
 {
     int returnCode = Q_ERR_Unknown;
     //Length of the serialized message.
@@ -51,13 +76,15 @@ int connect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSes
     unsigned char buf[bufBytes];
     size_t bufSize = sizeof(buf);
     
-    //Create the socket for connection.
-    clientPtr->mySocket = transport_open();
-
-    if(clientPtr->mySocket < 0){
+    //Resolve the gateway address and connect the client's socket to it.
+    if(clientOpen(clientPtr) != Q_NO_ERR){
         return Q_ERR_SocketOpen;
         goto exit;
     }
+    //With a clean session the Gateway forgets the QoS level 2 messages it has not released, so the client does too.
+    if(clnSession){
+        qos2RecvClear(&clientPtr->qos2Recv);
+    }
     //Establish a connection to the server using the information provided above.
     returnCode = MQTTSNSerialize_connect(buf, bufSize, &options);
 
@@ -68,8 +95,8 @@ int connect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSes
         goto exit;
     }
 	
-	//Send the Connect message to the server.
-    ssize_t rc = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+	//Send the Connect message to the server. It is sent again if no Connack arrives in time.
+    int rc = requestSend(clientPtr, buf, serialLength, MQTTSN_CONNECT, 0);
 
     if (rc != 0){
         returnCode = Q_ERR_Socket;
@@ -1,4 +1,5 @@
 //Header file for connect
 
-int connect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSession); //prototype
+int clientOpen(Client_t *clientPtr); //prototype
+int clientConnect(Client_t *clientPtr, uint16_t timeOut, uint8_t willF, uint8_t clnSession); //prototype
 
@@ -54,7 +54,7 @@ int disconnect(Client_t *clientPtr, uint16_t sleepTimer)
     }
 
     //Send the message. 
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
 
     if(returnCode2 != 0){
         returnCode = Q_ERR_Socket;
@@ -0,0 +1,376 @@
+/**
+ * Contains the functions a client uses to find its Gateway instead of having its address built in.
+ * The client listens for the Gateway's Advertise messages and sends SearchGw messages, and the first Advertise or
+ * GwInfo it hears gives it the Gateway's address. The last Gateway the client connected to is kept in a small file,
+ * so a client that restarts connects straight away and only searches if that Gateway no longer answers.
+ * When many clients start at once, such as after a power cut, each one waits a random time before searching and
+ * stays quiet if it hears another client search first, since the Gateway's GwInfo answer reaches all of them.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "MQTTSNPacket.h"
+#include "MQTTSNSearch.h"
+#include "transport.h"
+#include "ErrorCodes.h"
+#include "EventLoop.h"
+#include "Stats.h"
+#include "Discovery.h"
+#include "StackTrace.h"
+
+//Identifies a cache file written by this client ("QGWC").
+#define Q_CACHE_MAGIC 0x51475743u
+#define Q_CACHE_VERSION 1u
+//The length of a GwInfo address a client sends for a Gateway it knows: an IPv4 address and a port.
+#define Q_GWINFO_ADDR_LEN 6
+
+/**
+ * @param seed The state of the random number generator.
+ * @param limit The largest value wanted.
+ * @return A random number from 0 to limit.
+ */
+static uint32_t jitter(uint64_t *seed, uint32_t limit)
+{
+    //xorshift64, random enough to spread clients out and needs no global state.
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return (limit == 0) ? 0 : (uint32_t)(*seed % ((uint64_t)limit + 1));
+}//End jitter
+
+/**
+ * Fills in a Gateway from its address.
+ * @param gateway The Gateway to be filled in.
+ * @param addr The Gateway's IPv4 address in network byte order.
+ * @param port The Gateway's port in network byte order.
+ * @return void
+ */
+static void gatewaySet(Gateway_t *gateway, uint32_t addr, uint16_t port)
+{
+    struct in_addr inAddr;
+    inAddr.s_addr = addr;
+    inet_ntop(AF_INET, &inAddr, gateway->host, sizeof(gateway->host));
+    gateway->port = ntohs(port);
+}//End gatewaySet
+
+/**
+ * Reads the Gateway the client last connected to.
+ * @param path The cache file.
+ * @param gateway Where the Gateway is written.
+ * @return An int: Q_NO_ERR indicates a Gateway was read. Otherwise, Q_ERR_GatewayCache indicates there is no cache file
+ * or it does not hold a Gateway.
+ */
+int discoveryLoad(const char *path, Gateway_t *gateway)
+{
+    int returnCode = Q_ERR_GatewayCache;
+    GatewayCache_t cache;
+
+    FUNC_ENTRY;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        goto exit;
+    }
+    ssize_t readLength = read(fd, &cache, sizeof(cache));
+    close(fd);
+    if(readLength != (ssize_t)sizeof(cache) || cache.magic != Q_CACHE_MAGIC || cache.version != Q_CACHE_VERSION ||
+            cache.addr == 0 || cache.port == 0){
+        goto exit;
+    }
+    gateway->gatewayID = cache.gatewayID;
+    gateway->duration = cache.duration;
+    gatewaySet(gateway, cache.addr, cache.port);
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End discoveryLoad
+
+/**
+ * Remembers a Gateway the client connected to. The file is written in full and then renamed over the old one, so a
+ * client that loses power while saving still finds the old Gateway next time.
+ * @param path The cache file.
+ * @param gateway The Gateway.
+ * @return An int: Q_NO_ERR indicates the Gateway was saved. Otherwise, Q_ERR_GatewayCache indicates an error.
+ */
+int discoverySave(const char *path, const Gateway_t *gateway)
+{
+    int returnCode = Q_ERR_GatewayCache;
+    GatewayCache_t cache;
+    struct in_addr addr;
+    char tempPath[256];
+
+    FUNC_ENTRY;
+    if(inet_pton(AF_INET, gateway->host, &addr) != 1 || gateway->port <= 0 || gateway->port > 65535){
+        goto exit;
+    }
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath)){
+        goto exit;
+    }
+    memset(&cache, 0, sizeof(cache));
+    cache.magic = Q_CACHE_MAGIC;
+    cache.version = Q_CACHE_VERSION;
+    cache.gatewayID = gateway->gatewayID;
+    cache.duration = gateway->duration;
+    cache.addr = addr.s_addr;
+    cache.port = htons((uint16_t)gateway->port);
+
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0){
+        goto exit;
+    }
+    bool written = write(fd, &cache, sizeof(cache)) == (ssize_t)sizeof(cache) && fsync(fd) == 0;
+    close(fd);
+    if(!written || rename(tempPath, path) != 0){
+        unlink(tempPath);
+        goto exit;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End discoverySave
+
+/**
+ * Forgets the cached Gateway, so the next start searches for one. Used when the cached Gateway does not answer.
+ * @param path The cache file.
+ * @return void
+ */
+void discoveryForget(const char *path)
+{
+    unlink(path);
+}//End discoveryForget
+
+/**
+ * Opens the socket discovery listens and searches on: bound to the discovery port so Advertise and GwInfo messages
+ * sent to the group reach it, and joined to the group if it is a multicast address.
+ * @param group The multicast group or broadcast address.
+ * @param port The discovery port.
+ * @param radius The broadcast radius, used as the multicast time to live.
+ * @param groupAddr Where the address SearchGw messages are sent to is written.
+ * @return The socket, or -1 if it could not be opened.
+ */
+static int discoveryOpen(const char *group, int port, uint8_t radius, struct sockaddr_in *groupAddr)
+{
+    int one = 1;
+    memset(groupAddr, 0, sizeof(*groupAddr));
+    groupAddr->sin_family = AF_INET;
+    groupAddr->sin_port = htons((uint16_t)port);
+    if(inet_pton(AF_INET, group, &groupAddr->sin_addr) != 1){
+        return -1;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0){
+        return -1;
+    }
+    //Other clients on the same host listen on the same port.
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((uint16_t)port);
+    if(bind(sock, (struct sockaddr *)&local, sizeof(local)) != 0){
+        close(sock);
+        return -1;
+    }
+
+    if(IN_MULTICAST(ntohl(groupAddr->sin_addr.s_addr))){
+        struct ip_mreq membership;
+        membership.imr_multiaddr = groupAddr->sin_addr;
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership));
+        //The radius is the number of hops a SearchGw may travel.
+        unsigned char ttl = (radius > 0) ? radius : 1;
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+    return sock;
+}//End discoveryOpen
+
+/**
+ * Looks at a message heard on the discovery port.
+ * @param gateway Where the Gateway is written if the message names one.
+ * @param buf The message.
+ * @param length The length of the message.
+ * @param from Who sent the message.
+ * @return An int: Q_NO_ERR indicates the message named a Gateway. MQTTSN_SEARCHGW indicates another client is searching.
+ * Q_NoMsg indicates anything else.
+ */
+static int discoveryHeard(Gateway_t *gateway, unsigned char *buf, size_t length, const struct sockaddr_in *from)
+{
+    unsigned char gatewayID = 0;
+    unsigned short duration = 0;
+    unsigned short addrLength = 0;
+    unsigned char *addr = NULL;
+
+    switch(statsFrameType(buf, length)){
+        case MQTTSN_ADVERTISE:
+            if(MQTTSNDeserialize_advertise(&gatewayID, &duration, buf, length) != 1){
+                return Q_NoMsg;
+            }
+            gateway->gatewayID = gatewayID;
+            gateway->duration = duration;
+            gatewaySet(gateway, from->sin_addr.s_addr, from->sin_port);
+            return Q_NO_ERR;
+
+        case MQTTSN_GWINFO:
+            if(MQTTSNDeserialize_gwinfo(&gatewayID, &addrLength, &addr, buf, length) != 1){
+                return Q_NoMsg;
+            }
+            gateway->gatewayID = gatewayID;
+            gateway->duration = 0;
+            //Sent by the Gateway itself, or by a client that knows it, with its address and port.
+            if(addrLength == 0){
+                gatewaySet(gateway, from->sin_addr.s_addr, from->sin_port);
+            } else if(addrLength == Q_GWINFO_ADDR_LEN){
+                uint32_t gwAddr;
+                uint16_t gwPort;
+                memcpy(&gwAddr, addr, sizeof(gwAddr));
+                memcpy(&gwPort, addr + sizeof(gwAddr), sizeof(gwPort));
+                gatewaySet(gateway, gwAddr, gwPort);
+            } else {
+                return Q_NoMsg;
+            }
+            return Q_NO_ERR;
+
+        case MQTTSN_SEARCHGW:
+            return MQTTSN_SEARCHGW;
+
+        default:
+            return Q_NoMsg;
+    }
+}//End discoveryHeard
+
+/**
+ * Finds a Gateway on the network. The client listens for an Advertise or GwInfo message and sends a SearchGw after a
+ * random delay of up to a quarter of timeoutMs, then again with exponential backoff. Hearing another client's SearchGw
+ * puts off the client's own, so many clients starting together send few SearchGw messages between them.
+ * @param gateway Where the Gateway is written.
+ * @param group The multicast group or broadcast address the Gateway uses, for example Q_DISCOVERY_GROUP.
+ * @param port The port the Gateway uses for discovery, for example Q_DISCOVERY_PORT.
+ * @param radius The broadcast radius of the SearchGw message.
+ * @param timeoutMs How long to search for before giving up.
+ * @return An int: Q_NO_ERR indicates a Gateway was found. Otherwise, Q_ERR_NoGateway indicates none answered in time,
+ * Q_ERR_SocketOpen indicates the discovery socket could not be opened, and Q_ERR_Serial indicates an error.
+ */
+int discoverySearch(Gateway_t *gateway, const char *group, int port, uint8_t radius, uint32_t timeoutMs)
+{
+    int returnCode = Q_ERR_NoGateway;
+    struct sockaddr_in groupAddr;
+    unsigned char search[3];
+    unsigned char buf[TRANSPORT_RX_LEN];
+
+    FUNC_ENTRY;
+    int searchLength = MQTTSNSerialize_searchgw(search, sizeof(search), radius);
+    if(searchLength <= 0){
+        returnCode = Q_ERR_Serial;
+        goto exit;
+    }
+    int sock = discoveryOpen(group, port, radius, &groupAddr);
+    if(sock < 0){
+        returnCode = Q_ERR_SocketOpen;
+        goto exit;
+    }
+
+    uint64_t seed = timeNowUs() ^ ((uint64_t)getpid() << 32);
+    uint64_t now = timeNowMs();
+    uint64_t deadline = now + timeoutMs;
+    uint32_t backoff = Q_SEARCHGW_INITIAL_MS;
+    //A short search still gets its SearchGw out early enough for the Gateway to answer it.
+    uint32_t firstJitter = (timeoutMs / 4 < Q_SEARCHGW_JITTER_MS) ? timeoutMs / 4 : Q_SEARCHGW_JITTER_MS;
+    uint64_t nextSearch = now + jitter(&seed, firstJitter);
+
+    while(now < deadline){
+        if(now >= nextSearch){
+            sendto(sock, search, (size_t)searchLength, 0, (struct sockaddr *)&groupAddr, sizeof(groupAddr));
+            //Half the wait is fixed and half is random, so retries from clients that started together drift apart.
+            nextSearch = now + backoff / 2 + jitter(&seed, backoff / 2);
+            backoff = (backoff * 2 > Q_SEARCHGW_MAX_MS) ? Q_SEARCHGW_MAX_MS : backoff * 2;
+        }
+
+        uint64_t wakeAt = (nextSearch < deadline) ? nextSearch : deadline;
+        struct pollfd pfd;
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, (int)(wakeAt - now)) > 0 && (pfd.revents & POLLIN)){
+            struct sockaddr_in from;
+            socklen_t fromLength = sizeof(from);
+            ssize_t length = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromLength);
+            if(length > 0){
+                int heard = discoveryHeard(gateway, buf, (size_t)length, &from);
+                if(heard == Q_NO_ERR){
+                    returnCode = Q_NO_ERR;
+                    break;
+                }
+                //Another client is already searching, wait for the Gateway's answer to it instead. The client's own
+                //SearchGw can come back to it as well, which only puts off a search that was just sent.
+                if(heard == MQTTSN_SEARCHGW){
+                    nextSearch = timeNowMs() + backoff / 2 + jitter(&seed, backoff / 2);
+                }
+            }
+        }
+        now = timeNowMs();
+    }
+    close(sock);
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End discoverySearch
+
+/**
+ * Finds the Gateway a client should connect to: the one in the cache file if there is one, otherwise one found with
+ * discoverySearch on Q_DISCOVERY_GROUP and Q_DISCOVERY_PORT. The client should call discoverySave once it has
+ * connected, and discoveryForget if the Gateway does not answer.
+ * @param gateway Where the Gateway is written.
+ * @param path The cache file.
+ * @param radius The broadcast radius of the SearchGw message.
+ * @param timeoutMs How long to search for if there is no cached Gateway.
+ * @return An int: Same as discoverySearch.
+ */
+int discoveryFind(Gateway_t *gateway, const char *path, uint8_t radius, uint32_t timeoutMs)
+{
+    if(discoveryLoad(path, gateway) == Q_NO_ERR){
+        return Q_NO_ERR;
+    }
+    return discoverySearch(gateway, Q_DISCOVERY_GROUP, Q_DISCOVERY_PORT, radius, timeoutMs);
+}//End discoveryFind
+
+/**
+ * Finds the Gateway a client should connect to like discoveryFind, and falls back to an address built into the client
+ * if no Gateway is cached or answers, so gateway always holds an address to connect to.
+ * @param gateway Where the Gateway is written.
+ * @param path The cache file.
+ * @param radius The broadcast radius of the SearchGw message.
+ * @param timeoutMs How long to search for if there is no cached Gateway.
+ * @param host The address used if no Gateway is found.
+ * @param port The port used if no Gateway is found.
+ * @return An int: Q_NO_ERR indicates a Gateway was cached or found. Otherwise, the status code of discoverySearch, and
+ * gateway holds host and port.
+ */
+int discoveryFindOr(Gateway_t *gateway, const char *path, uint8_t radius, uint32_t timeoutMs, const char *host, int port)
+{
+    int returnCode = discoveryFind(gateway, path, radius, timeoutMs);
+    if(returnCode != Q_NO_ERR){
+        memset(gateway, 0, sizeof(*gateway));
+        snprintf(gateway->host, sizeof(gateway->host), "%s", host);
+        gateway->port = port;
+    }
+    return returnCode;
+}//End discoveryFindOr
@@ -0,0 +1,54 @@
+/**
+ * Header file for Discovery.c
+ * Defines the Gateway a client found by listening for Advertise messages or by sending SearchGw, and the small file
+ * the last Gateway the client connected to is kept in, so a client that restarts can connect without searching.
+ */
+
+#ifndef Q_DISCOVERY_H
+#define Q_DISCOVERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+//The group and port the Gateway sends its Advertise and GwInfo messages to, the defaults of the Paho MQTT-SN Gateway.
+//A broadcast address such as "255.255.255.255" works as well.
+#define Q_DISCOVERY_GROUP "225.1.1.1"
+#define Q_DISCOVERY_PORT 1883
+//The longest a client waits before its first SearchGw, or a quarter of the search's timeout if that is shorter. Each
+//client picks a random delay up to this, and one that hears another client's SearchGw or the Gateway's answer first
+//never sends its own.
+#define Q_SEARCHGW_JITTER_MS 5000
+//The wait before a SearchGw is sent again, doubled after every attempt up to Q_SEARCHGW_MAX_MS.
+#define Q_SEARCHGW_INITIAL_MS 1000
+#define Q_SEARCHGW_MAX_MS 60000
+
+//A Gateway found by discovery or read from the cache file.
+typedef struct {
+    uint8_t gatewayID;
+    //The interval between the Gateway's Advertise messages in seconds, 0 if it was found through a GwInfo.
+    uint16_t duration;
+    //The address the client connects to, as a string so it can be given to Client_t.host.
+    char host[INET_ADDRSTRLEN];
+    int port;
+} Gateway_t;
+
+//The contents of the cache file.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t gatewayID;
+    uint16_t duration;
+    //In network byte order.
+    uint32_t addr;
+    uint16_t port;
+} GatewayCache_t;
+
+int discoveryLoad(const char *path, Gateway_t *gateway); //prototype
+int discoverySave(const char *path, const Gateway_t *gateway); //prototype
+void discoveryForget(const char *path); //prototype
+int discoverySearch(Gateway_t *gateway, const char *group, int port, uint8_t radius, uint32_t timeoutMs); //prototype
+int discoveryFind(Gateway_t *gateway, const char *path, uint8_t radius, uint32_t timeoutMs); //prototype
+int discoveryFindOr(Gateway_t *gateway, const char *path, uint8_t radius, uint32_t timeoutMs, const char *host, int port); //prototype
+
+#endif
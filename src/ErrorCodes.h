@@ -75,3 +75,30 @@
 #define Q_pubQos1 60
 #define Q_pubQos2 61
 #define Q_PubAckRead 62
+//Indicates a timer of the client's event loop has reached its deadline.
+#define Q_TimerExpired 63
+//Indicates the client already has as many QoS level 1 and 2 Publish messages in flight as its window allows.
+#define Q_ERR_WindowFull 64
+//Indicates the offline queue has no room for another message.
+#define Q_ERR_QueueFull 65
+//Indicates the offline queue file could not be opened, created, or mapped into memory.
+#define Q_ERR_QueueFile 66
+//Indicates a message was sent the maximum number of times without being acknowledged by the Gateway.
+#define Q_ERR_RetryLimit 67
+//Indicates the session is not connected to the Gateway, so the message cannot be sent.
+#define Q_ERR_NotConnected 68
+//Indicates the topic name has not been registered with the Gateway, so there is no topicID to publish to.
+#define Q_ERR_NotRegistered 69
+//Indicates no Gateway answered a SearchGw or sent an Advertise message in time.
+#define Q_ERR_NoGateway 70
+//Indicates the file the last Gateway is kept in could not be read or written.
+#define Q_ERR_GatewayCache 71
+//Indicates the file the client's topicIDs are kept in could not be read or written, or belongs to another client or Gateway.
+#define Q_ERR_TopicCache 72
+//Indicates the Gateway rejected a Publish message because it does not know its topicID, so the topic name has to be
+//registered again.
+#define Q_ERR_TopicRejected 73
+//Indicates every Register and Subscribe message of a bulk request has been answered or given up on.
+#define Q_BulkDone 74
+//Indicates the wait was ended by another thread through the event loop's wake descriptor.
+#define Q_Wakeup 75
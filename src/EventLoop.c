@@ -0,0 +1,267 @@
+/**
+ * Contains the timers and the wait function used to drive a client's state machine.
+ * Instead of polling the socket on a fixed interval and comparing wall clock seconds, the client arms
+ * a timer for every deadline it has (keep alive ping, publish interval, retry, sleep) and then blocks
+ * until either the socket has a message to be read or the nearest deadline has passed.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "EventLoop.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Reads the monotonic clock, which is not affected by changes to the system time.
+ * @return The current time in milliseconds.
+ */
+uint64_t timeNowMs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}//End timeNowMs
+
+/**
+ * Reads the monotonic clock with enough precision to time a round trip on a local network.
+ * @return The current time in microseconds.
+ */
+uint64_t timeNowUs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}//End timeNowUs
+
+/**
+ * Stops every timer of the event loop.
+ * @param loop The event loop to be initialized.
+ * @return void
+ */
+void eventLoopInit(EventLoop_t *loop)
+{
+    for(int index = 0; index < Q_TIMER_COUNT; ++index){
+        loop->deadline[index] = 0;
+    }
+}//End eventLoopInit
+
+/**
+ * Starts (or restarts) a timer so it expires the given number of milliseconds from now.
+ * @param loop The event loop that holds the timer.
+ * @param timer The timer to be started.
+ * @param timeoutMs How many milliseconds from now the timer should expire.
+ * @return void
+ */
+void timerStart(EventLoop_t *loop, enum Q_TIMER_ID timer, uint32_t timeoutMs)
+{
+    loop->deadline[timer] = timeNowMs() + timeoutMs;
+}//End timerStart
+
+/**
+ * Stops a timer so it is no longer considered when computing the next deadline.
+ * @param loop The event loop that holds the timer.
+ * @param timer The timer to be stopped.
+ * @return void
+ */
+void timerStop(EventLoop_t *loop, enum Q_TIMER_ID timer)
+{
+    loop->deadline[timer] = 0;
+}//End timerStop
+
+/**
+ * @param loop The event loop that holds the timer.
+ * @param timer The timer to be checked.
+ * @return true if the timer has been started and not stopped since.
+ */
+bool timerRunning(const EventLoop_t *loop, enum Q_TIMER_ID timer)
+{
+    return loop->deadline[timer] != 0;
+}//End timerRunning
+
+/**
+ * @param loop The event loop that holds the timer.
+ * @param timer The timer to be checked.
+ * @param now The current time in milliseconds, as returned by timeNowMs.
+ * @return true if the timer is running and its deadline has been reached.
+ */
+bool timerExpired(const EventLoop_t *loop, enum Q_TIMER_ID timer, uint64_t now)
+{
+    return loop->deadline[timer] != 0 && now >= loop->deadline[timer];
+}//End timerExpired
+
+/**
+ * Computes how long the client can block before the nearest running timer expires.
+ * @param loop The event loop that holds the timers.
+ * @param now The current time in milliseconds.
+ * @return The number of milliseconds until the nearest deadline, 0 if a deadline has already passed,
+ * or -1 if no timer is running.
+ */
+int eventLoopTimeout(const EventLoop_t *loop, uint64_t now)
+{
+    int timeoutMs = -1;
+
+    for(int index = 0; index < Q_TIMER_COUNT; ++index){
+        if(loop->deadline[index] == 0){
+            continue;
+        }
+        if(loop->deadline[index] <= now){
+            return 0;
+        }
+        uint64_t remaining = loop->deadline[index] - now;
+        if(remaining > INT_MAX){
+            remaining = INT_MAX;
+        }
+        if(timeoutMs < 0 || (int)remaining < timeoutMs){
+            timeoutMs = (int)remaining;
+        }
+    }
+    return timeoutMs;
+}//End eventLoopTimeout
+
+/**
+ * Blocks until the socket has data to be read or the timeout has passed.
+ * @param clientSock The socket to be checked. If it is negative, only the timeout is waited on.
+ * @param timeoutMs The maximum number of milliseconds to wait, or -1 to wait with no limit.
+ * @return An int: Q_MsgPending indicates there is a message to be read. Q_NoMsg indicates the timeout
+ * passed (or the wait was interrupted by a signal) without a message. Q_ERR_Socket indicates an error.
+ */
+int socketWait(int clientSock, int timeoutMs)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    struct pollfd readFD;
+    readFD.fd = clientSock;
+    readFD.events = POLLIN;
+    readFD.revents = 0;
+
+    //poll ignores negative file descriptors, which lets this function double as a plain sleep.
+    int numFD_Rtrn = poll(&readFD, 1, timeoutMs);
+    if(numFD_Rtrn > 0 && (readFD.revents & POLLIN)){
+        returnCode = Q_MsgPending;
+    } else if(numFD_Rtrn < 0 && errno != EINTR){
+        returnCode = Q_ERR_Socket;
+    } else if(numFD_Rtrn > 0 && (readFD.revents & POLLERR)){
+        //The connected socket holds an error, such as the Gateway's port being unreachable. Clear it so the
+        //next wait blocks instead of returning straight away, the message is sent again once its time is up.
+        int sockErr = 0;
+        socklen_t errLen = sizeof(sockErr);
+        getsockopt(clientSock, SOL_SOCKET, SO_ERROR, &sockErr, &errLen);
+        returnCode = Q_NoMsg;
+    } else {
+        returnCode = Q_NoMsg;
+    }
+
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End socketWait
+
+/**
+ * Blocks until the client's socket has a message to be read or the nearest running timer expires.
+ * The caller is expected to check timerExpired for each of its timers afterwards and to stop or
+ * restart any timer it has handled, otherwise the next call will return immediately.
+ * @param loop The event loop that holds the timers.
+ * @param clientSock The socket the client uses to communicate with the Gateway.
+ * @return An int: Q_MsgPending indicates there is a message to be read. Q_TimerExpired indicates a deadline
+ * has been reached. Q_NoMsg indicates nothing happened (the wait was interrupted or there was nothing to wait on).
+ * Q_ERR_Socket indicates an error.
+ */
+int eventLoopWait(EventLoop_t *loop, int clientSock)
+{
+    return eventLoopWaitWake(loop, clientSock, -1);
+}//End eventLoopWait
+
+/**
+ * Same as eventLoopWait, but the wait also ends when wakeFd becomes readable, so another thread can hand the client
+ * work while it is blocked. Reading wakeFd is left to the caller.
+ * @param loop The event loop that holds the timers.
+ * @param clientSock The socket the client uses to communicate with the Gateway.
+ * @param wakeFd A descriptor other threads make readable, such as an eventfd, or -1 for none.
+ * @return An int: Q_MsgPending indicates there is a message to be read. Q_Wakeup indicates wakeFd is readable.
+ * Q_TimerExpired indicates a deadline has been reached. Q_NoMsg indicates nothing happened (the wait was interrupted
+ * or there was nothing to wait on). Q_ERR_Socket indicates an error.
+ */
+int eventLoopWaitWake(EventLoop_t *loop, int clientSock, int wakeFd)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    int timeoutMs = eventLoopTimeout(loop, timeNowMs());
+
+    //Nothing could ever wake the client up, so do not block forever.
+    if(clientSock < 0 && wakeFd < 0 && timeoutMs < 0){
+        returnCode = Q_NoMsg;
+        goto exit;
+    }
+    if(wakeFd < 0){
+        returnCode = socketWait(clientSock, timeoutMs);
+    } else {
+        struct pollfd readFD[2];
+        readFD[0].fd = clientSock;
+        readFD[0].events = POLLIN;
+        readFD[0].revents = 0;
+        readFD[1].fd = wakeFd;
+        readFD[1].events = POLLIN;
+        readFD[1].revents = 0;
+        int numFD_Rtrn = poll(readFD, 2, timeoutMs);
+        if(numFD_Rtrn < 0 && errno != EINTR){
+            returnCode = Q_ERR_Socket;
+        } else if(numFD_Rtrn > 0 && (readFD[0].revents & POLLIN)){
+            returnCode = Q_MsgPending;
+        } else if(numFD_Rtrn > 0 && (readFD[1].revents & POLLIN)){
+            returnCode = Q_Wakeup;
+        } else if(numFD_Rtrn > 0 && (readFD[0].revents & POLLERR)){
+            //Clear the socket's error the same way socketWait does.
+            returnCode = socketWait(clientSock, 0);
+        } else {
+            returnCode = Q_NoMsg;
+        }
+    }
+    if(returnCode == Q_NoMsg && timeoutMs >= 0){
+        returnCode = Q_TimerExpired;
+    }
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End eventLoopWaitWake
+
+/**
+ * Blocks until a single timer expires, ignoring the socket and every other timer.
+ * Used by a sleeping client, which should not wake up for anything but its sleep timer.
+ * @param loop The event loop that holds the timer.
+ * @param timer The timer to wait on.
+ * @return An int: Q_TimerExpired indicates the timer has expired. Q_NoMsg indicates the timer is not running
+ * or the wait was interrupted before the deadline.
+ */
+int timerWait(EventLoop_t *loop, enum Q_TIMER_ID timer)
+{
+    int returnCode = Q_NoMsg;
+
+    FUNC_ENTRY;
+    if(!timerRunning(loop, timer)){
+        goto exit;
+    }
+
+    uint64_t now = timeNowMs();
+    if(now < loop->deadline[timer]){
+        uint64_t remaining = loop->deadline[timer] - now;
+        socketWait(-1, remaining > INT_MAX ? INT_MAX : (int)remaining);
+    }
+
+    if(timerExpired(loop, timer, timeNowMs())){
+        returnCode = Q_TimerExpired;
+    }
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End timerWait
@@ -0,0 +1,37 @@
+/**
+ * Header file for EventLoop.c
+ * Defines the timers a client can arm and the EventLoop_t struct that holds their deadlines.
+ * All deadlines are kept on a monotonic clock in milliseconds.
+ */
+
+#ifndef Q_EVENTLOOP_H
+#define Q_EVENTLOOP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//Defines the names of all the timers a client can have running at the same time.
+//Q_TIMER_STATE limits how long a client waits in a state for an answer to a message that is not sent again.
+enum Q_TIMER_ID {
+    Q_TIMER_PING, Q_TIMER_PUBLISH, Q_TIMER_RETRY, Q_TIMER_SLEEP, Q_TIMER_STATE, Q_TIMER_COUNT
+};
+
+//Holds the deadline of every timer. A deadline of 0 means the timer is not running.
+typedef struct {
+    uint64_t deadline[Q_TIMER_COUNT];
+} EventLoop_t;
+
+uint64_t timeNowMs(void); //prototype
+uint64_t timeNowUs(void); //prototype
+void eventLoopInit(EventLoop_t *loop); //prototype
+void timerStart(EventLoop_t *loop, enum Q_TIMER_ID timer, uint32_t timeoutMs); //prototype
+void timerStop(EventLoop_t *loop, enum Q_TIMER_ID timer); //prototype
+bool timerRunning(const EventLoop_t *loop, enum Q_TIMER_ID timer); //prototype
+bool timerExpired(const EventLoop_t *loop, enum Q_TIMER_ID timer, uint64_t now); //prototype
+int eventLoopTimeout(const EventLoop_t *loop, uint64_t now); //prototype
+int socketWait(int clientSock, int timeoutMs); //prototype
+int eventLoopWait(EventLoop_t *loop, int clientSock); //prototype
+int eventLoopWaitWake(EventLoop_t *loop, int clientSock, int wakeFd); //prototype
+int timerWait(EventLoop_t *loop, enum Q_TIMER_ID timer); //prototype
+
+#endif
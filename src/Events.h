@@ -7,12 +7,14 @@
 
 #include <stdint.h>
 
-//Defines the names of all the states the client can transition to.
+//Defines the names of all the states the client can transition to. Q_EVENT_COUNT is not a state, it sizes the
+//tables indexed by state and must stay last.
 enum Q_MQTTSN_EVENT {
     Q_CONNECTING, Q_CONNECTED, Q_WILL_TOP_REQ, Q_WILL_MSG_REQ,
     Q_REGISTERING, Q_SLEEP, Q_SUBSCRIBING, Q_DISCONNECTING,
     Q_DISCONNECTED, Q_WILL_TOP_UPD, Q_WILL_MSG_UPD, Q_UNSUBSCRIBE, 
-    Q_CLIENT_PING, Q_SERVER_PING, Q_PUBLISH, Q_PUB_QOS2, Q_RCV_QOS1, Q_RCV_QOS2    
+    Q_CLIENT_PING, Q_SERVER_PING, Q_PUBLISH, Q_PUB_QOS2, Q_RCV_QOS1, Q_RCV_QOS2,
+    Q_EVENT_COUNT
 };
 
 //Stores the client along with information needed when sending acknowledgement messages with the server.
@@ -28,6 +30,13 @@ typedef struct {
     uint16_t duration;
     //Used to keep track of the message id for messages sent from client.
     uint16_t send_msgID;
+    //The topic name of the last Register or Subscribe message sent, so it can be stored with the topicID
+    //that comes back in the RegAck or SubAck.
+    const char *topicName;
+    //The handler for the topic of the last Subscribe message sent. Stored with the topicID from the SubAck,
+    //or used as the client's default handler if it was a wildcard subscription.
+    MessageHandler_t handler;
+    void *handlerContext;
     Client_t *client;
 } Client_Event_t;
 
@@ -0,0 +1,468 @@
+/**
+ * Contains the executor, which runs any number of client sessions on a single thread, each driven by a flow.
+ * A flow is a function the application writes as straight-line code, for example connect, register, then publish and
+ * wait for every PubAck, instead of a state machine of its own. Every time it has to wait for the Gateway it returns,
+ * and the executor runs it again from the same place once the session reports the status code it is waiting for. This
+ * is done with a switch on the line the flow last waited at, so a flow costs a few bytes instead of a thread and a stack.
+ * The executor waits on the sockets of every session with one epoll descriptor and keeps the sessions in a heap
+ * ordered by their next timer, so a wake up only costs time for the sessions that have something to do.
+ * With a transport ring the sockets are not waited on at all: each keeps a receive posted on the ring, and a single
+ * io_uring_enter per wake up sends what every session queued and collects what they all received.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "Events.h"
+#include "ErrorCodes.h"
+#include "Session.h"
+#include "Executor.h"
+#include "StackTrace.h"
+
+/**
+ * Keeps a status code the session reported until the executor runs the flow for it. The end of the session is
+ * reported by the executor itself, once, whatever ended it.
+ * @param session The flow's session.
+ * @param code The status code.
+ * @param context The flow.
+ * @return void
+ */
+static void flowNotify(Session_t *session, int code, void *context)
+{
+    Flow_t *flow = context;
+    (void)session;
+
+    if(code == Q_DisconRead){
+        return;
+    }
+    if(flow->codeCount == Q_FLOW_CODES){
+        flow->dropped += 1;
+        return;
+    }
+    flow->codes[(flow->codeHead + flow->codeCount) % Q_FLOW_CODES] = code;
+    flow->codeCount += 1;
+}//End flowNotify
+
+/**
+ * Runs a flow once for every status code waiting for it, in the order they were reported.
+ * @param flow The flow.
+ * @return true if the flow was run at least once.
+ */
+static bool flowRun(Flow_t *flow)
+{
+    bool ran = false;
+
+    while(flow->codeCount > 0){
+        int code = flow->codes[flow->codeHead];
+        flow->codeHead = (flow->codeHead + 1) % Q_FLOW_CODES;
+        flow->codeCount -= 1;
+        //A flow that has reached its end has nothing left to wait for.
+        if(flow->resume < 0){
+            continue;
+        }
+        flow->code = code;
+        flow->run(flow);
+        ran = true;
+    }
+    return ran;
+}//End flowRun
+
+/**
+ * Finds when a flow next needs the executor's attention. A sleeping client only wakes for its sleep timer, and a
+ * disconnected one only for a wait in its flow, so their other timers are left out.
+ * @param flow The flow.
+ * @return The deadline in milliseconds on the monotonic clock, or UINT64_MAX if there is none.
+ */
+static uint64_t flowDeadline(const Flow_t *flow)
+{
+    const EventLoop_t *loop = &flow->session->loop;
+    enum Q_MQTTSN_EVENT state = flow->session->event.eventID;
+    uint64_t deadline = UINT64_MAX;
+
+    for(int timer = 0; timer < Q_TIMER_COUNT; ++timer){
+        if(loop->deadline[timer] == 0){
+            continue;
+        }
+        if(timer != Q_TIMER_PUBLISH && (state == Q_DISCONNECTED || (state == Q_SLEEP && timer != Q_TIMER_SLEEP))){
+            continue;
+        }
+        if(loop->deadline[timer] < deadline){
+            deadline = loop->deadline[timer];
+        }
+    }
+    return deadline;
+}//End flowDeadline
+
+/**
+ * @param flow The flow.
+ * @return true if the flow's session reads the messages that arrive: it is not over, and it is awake or a sleeping
+ * client collecting its buffered messages.
+ */
+static bool flowListening(const Flow_t *flow)
+{
+    enum Q_MQTTSN_EVENT state = flow->session->event.eventID;
+    return state != Q_DISCONNECTED && (state != Q_SLEEP || flow->session->waking);
+}//End flowListening
+
+/**
+ * Swaps two flows in the executor's heap.
+ * @param exec The executor.
+ * @param first The index of one flow.
+ * @param second The index of the other.
+ * @return void
+ */
+static void heapSwap(Executor_t *exec, size_t first, size_t second)
+{
+    Flow_t *flow = exec->heap[first];
+    exec->heap[first] = exec->heap[second];
+    exec->heap[second] = flow;
+    exec->heap[first]->heapIndex = first;
+    exec->heap[second]->heapIndex = second;
+}//End heapSwap
+
+/**
+ * Moves a flow up or down the executor's heap until its deadline is in order again.
+ * @param exec The executor.
+ * @param index The index of the flow whose deadline changed.
+ * @return void
+ */
+static void heapFix(Executor_t *exec, size_t index)
+{
+    while(index > 0 && exec->heap[index]->deadlineMs < exec->heap[(index - 1) / 2]->deadlineMs){
+        heapSwap(exec, index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+    for(;;){
+        size_t smallest = index;
+        size_t left = index * 2 + 1;
+        size_t right = left + 1;
+        if(left < exec->count && exec->heap[left]->deadlineMs < exec->heap[smallest]->deadlineMs){
+            smallest = left;
+        }
+        if(right < exec->count && exec->heap[right]->deadlineMs < exec->heap[smallest]->deadlineMs){
+            smallest = right;
+        }
+        if(smallest == index){
+            break;
+        }
+        heapSwap(exec, index, smallest);
+        index = smallest;
+    }
+}//End heapFix
+
+/**
+ * Takes a flow out of the executor. Its socket was already closed when its session ended, which removed it from epoll.
+ * @param exec The executor.
+ * @param flow The flow.
+ * @return void
+ */
+static void executorRemove(Executor_t *exec, Flow_t *flow)
+{
+    size_t index = flow->heapIndex;
+    exec->count -= 1;
+    if(index != exec->count){
+        heapSwap(exec, index, exec->count);
+        heapFix(exec, index);
+    }
+    flow->exec = NULL;
+}//End executorRemove
+
+/**
+ * Watches the socket of a flow's session with epoll, if the session has opened a new one since it was last checked.
+ * Sockets are told apart by the transport's count of opened sockets rather than the descriptor, since a flow that
+ * reconnects as soon as its session ends usually gets the descriptor of the socket that was just closed.
+ * With a transport ring, attaches the socket to the ring while the session is listening instead, and detaches it while
+ * the client sleeps, so the messages the Gateway sends in that time stay on the socket for its next wake.
+ * @param exec The executor.
+ * @param flow The flow.
+ * @return void
+ */
+static void flowWatch(Executor_t *exec, Flow_t *flow)
+{
+    Transport_t *transport = &flow->session->event.client->transport;
+    int sock = transport->sock;
+
+    if(exec->ring != NULL){
+        bool awake = (flowListening(flow) && sock >= 0);
+        if(awake && transport->ring == NULL){
+            transport_ringAttach(exec->ring, transport, flow);
+        } else if(!awake && transport->ring != NULL){
+            transport_ringDetach(transport);
+        }
+        return;
+    }
+    if(transport->opens == flow->opens){
+        return;
+    }
+    flow->opens = transport->opens;
+    if(sock >= 0){
+        //Edge triggered, since sessionRead reads until the socket is empty, or leaves the rest to a waking client.
+        struct epoll_event watch;
+        memset(&watch, 0, sizeof(watch));
+        watch.events = EPOLLIN | EPOLLET;
+        watch.data.ptr = flow;
+        epoll_ctl(exec->epollFd, EPOLL_CTL_ADD, sock, &watch);
+    }
+}//End flowWatch
+
+/**
+ * Gives a flow everything it is due: acts on its session's timers, runs the flow for the status codes that were
+ * reported, and sends whatever the flow queued. A flow whose session is over and that has nothing left to wait for
+ * is taken out of the executor.
+ * @param exec The executor.
+ * @param flow The flow.
+ * @param wasConnected True if the session was not over before the messages that led here were read.
+ * @return void
+ */
+static void flowService(Executor_t *exec, Flow_t *flow, bool wasConnected)
+{
+    Session_t *session = flow->session;
+    EventLoop_t *loop = &session->loop;
+    uint64_t now = timeNowMs();
+
+    if(timerExpired(loop, Q_TIMER_PUBLISH, now)){
+        timerStop(loop, Q_TIMER_PUBLISH);
+        flowNotify(session, Q_TimerExpired, flow);
+    }
+    enum Q_MQTTSN_EVENT state = session->event.eventID;
+    if(state != Q_DISCONNECTED && (state != Q_SLEEP || timerExpired(loop, Q_TIMER_SLEEP, now))){
+        sessionPrepare(session);
+    }
+    for(;;){
+        state = session->event.eventID;
+        //Tell the flow the session is over, even if its queue is full, since it may be waiting for exactly that.
+        if(wasConnected && state == Q_DISCONNECTED){
+            wasConnected = false;
+            if(flow->codeCount == Q_FLOW_CODES){
+                flow->codeCount -= 1;
+                flow->dropped += 1;
+            }
+            flow->codes[(flow->codeHead + flow->codeCount) % Q_FLOW_CODES] = Q_DisconRead;
+            flow->codeCount += 1;
+        }
+        if(!flowRun(flow)){
+            break;
+        }
+        //Send what the flow queued straight away rather than on the next wake up.
+        state = session->event.eventID;
+        if(state != Q_DISCONNECTED && state != Q_SLEEP){
+            wasConnected = true;
+            sessionPrepare(session);
+        }
+    }
+    flowWatch(exec, flow);
+
+    if(session->event.eventID == Q_DISCONNECTED && !timerRunning(loop, Q_TIMER_PUBLISH)){
+        executorRemove(exec, flow);
+        return;
+    }
+    flow->deadlineMs = flowDeadline(flow);
+    heapFix(exec, flow->heapIndex);
+}//End flowService
+
+/**
+ * Handles a message the transport ring received for a flow's session.
+ * @param transport The session's transport, with the message in its receive buffer.
+ * @param context The flow.
+ * @return void
+ */
+static void flowReceived(Transport_t *transport, void *context)
+{
+    Flow_t *flow = context;
+    (void)transport;
+
+    if(flow->exec == NULL || !flowListening(flow)){
+        return;
+    }
+    sessionRead(flow->session);
+    flowService(flow->exec, flow, true);
+}//End flowReceived
+
+/**
+ * Creates an executor with no flows.
+ * @param exec The executor to be initialized.
+ * @param capacity The most flows the executor can run at once.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the epoll descriptor or the heap could
+ * not be created.
+ */
+int executorInit(Executor_t *exec, size_t capacity)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    exec->count = 0;
+    exec->capacity = capacity;
+    exec->ring = NULL;
+    exec->heap = calloc((capacity > 0) ? capacity : 1, sizeof(Flow_t *));
+    exec->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(exec->heap == NULL || exec->epollFd < 0){
+        executorFree(exec);
+        goto exit;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End executorInit
+
+/**
+ * Releases the executor. The flows and their sessions are left as they are.
+ * @param exec The executor to be freed.
+ * @return void
+ */
+void executorFree(Executor_t *exec)
+{
+    //Sessions still attached go back to plain system calls.
+    if(exec->ring != NULL){
+        transport_ringClose(exec->ring);
+        free(exec->ring);
+        exec->ring = NULL;
+    }
+    if(exec->epollFd >= 0){
+        close(exec->epollFd);
+    }
+    free(exec->heap);
+    exec->heap = NULL;
+    exec->epollFd = -1;
+    exec->count = 0;
+    exec->capacity = 0;
+}//End executorFree
+
+/**
+ * Makes the executor send and receive the datagrams of every session through a transport ring instead of epoll and one
+ * system call per datagram. Must be called before any flow is added. Needs Linux 6.0 or later; if the ring cannot be
+ * set up the executor keeps using epoll.
+ * @param exec The executor.
+ * @param entries The size of the ring's submission queue, which is also the number of receive buffers shared by the
+ * sessions and the most sends that can wait for the kernel at once. At most TRANSPORT_RING_ENTRIES_MAX.
+ * @return An int: Q_NO_ERR indicates the ring is in use. Otherwise, Q_ERR_QueueFull indicates flows were already added,
+ * and Q_ERR_Socket that the ring could not be set up.
+ */
+int executorUseRing(Executor_t *exec, unsigned int entries)
+{
+    int returnCode = Q_ERR_Socket;
+
+    FUNC_ENTRY;
+    if(exec->count > 0 || exec->ring != NULL){
+        returnCode = Q_ERR_QueueFull;
+        goto exit;
+    }
+    TransportRing_t *ring = malloc(sizeof(TransportRing_t));
+    if(ring == NULL){
+        goto exit;
+    }
+    //Every session the executor can run has a place in the ring, so attaching one never fails for lack of room.
+    if(transport_ringOpen(ring, (unsigned int)exec->capacity, entries) != 0){
+        free(ring);
+        goto exit;
+    }
+    exec->ring = ring;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End executorUseRing
+
+/**
+ * Adds a flow to the executor and runs it for the first time, with a code of Q_NO_ERR. The flow usually starts by
+ * calling sessionConnect and waiting for Q_ConnackRead. From then on it is run every time its session reports a status
+ * code, with Q_DisconRead once the session is over, and it is taken out of the executor once the session is over and
+ * the flow is not waiting on a Q_FLOW_SLEEP.
+ * @param exec The executor.
+ * @param flow The flow, which must stay valid until it has been taken out of the executor.
+ * @param session The session the flow runs, set up with sessionInit. Its notify function is taken over by the executor.
+ * @param run The flow function.
+ * @param context Kept in the flow for the flow function.
+ * @return An int: Q_NO_ERR indicates the flow was added. Otherwise, Q_ERR_QueueFull indicates the executor is full.
+ */
+int executorAdd(Executor_t *exec, Flow_t *flow, Session_t *session, FlowFn_t run, void *context)
+{
+    if(exec->count == exec->capacity){
+        return Q_ERR_QueueFull;
+    }
+
+    memset(flow, 0, sizeof(*flow));
+    flow->session = session;
+    flow->run = run;
+    flow->context = context;
+    flow->exec = exec;
+    session->notify = flowNotify;
+    session->notifyContext = flow;
+
+    flow->heapIndex = exec->count;
+    flow->deadlineMs = 0;
+    exec->heap[exec->count] = flow;
+    exec->count += 1;
+
+    flow->codes[0] = Q_NO_ERR;
+    flow->codeCount = 1;
+    flowService(exec, flow, session->event.eventID != Q_DISCONNECTED);
+    return Q_NO_ERR;
+}//End executorAdd
+
+/**
+ * Waits until any session has a message to be read or a timer due, and gives every such flow what it is due.
+ * Called in a loop for as long as it returns more than 0.
+ * @param exec The executor.
+ * @param timeoutMs The longest to wait in milliseconds, or -1 to wait until something happens.
+ * @return The number of flows still in the executor, or -1 if epoll failed.
+ */
+int executorRun(Executor_t *exec, int timeoutMs)
+{
+    struct epoll_event events[Q_EXECUTOR_EVENTS];
+
+    if(exec->count == 0){
+        return 0;
+    }
+    uint64_t now = timeNowMs();
+    uint64_t next = exec->heap[0]->deadlineMs;
+    if(next != UINT64_MAX){
+        uint64_t untilNext = (next > now) ? next - now : 0;
+        if(timeoutMs < 0 || untilNext < (uint64_t)timeoutMs){
+            timeoutMs = (untilNext > INT32_MAX) ? INT32_MAX : (int)untilNext;
+        }
+    }
+
+    if(exec->ring != NULL){
+        //Everything received is handled by flowReceived while the ring's completions are collected.
+        if(transport_ringWait(exec->ring, timeoutMs, flowReceived) < 0){
+            return -1;
+        }
+    } else {
+        int ready = epoll_wait(exec->epollFd, events, Q_EXECUTOR_EVENTS, timeoutMs);
+        if(ready < 0){
+            return (errno == EINTR) ? (int)exec->count : -1;
+        }
+        for(int index = 0; index < ready; ++index){
+            Flow_t *flow = events[index].data.ptr;
+            //A sleeping client leaves its messages for its next wake.
+            if(flow->exec != exec || !flowListening(flow)){
+                continue;
+            }
+            sessionRead(flow->session);
+            flowService(exec, flow, true);
+        }
+    }
+
+    //Every flow whose deadline has passed, each at most once, so a timer that is still due cannot hold up the others.
+    now = timeNowMs();
+    for(size_t due = exec->count; due > 0 && exec->count > 0 && exec->heap[0]->deadlineMs <= now; --due){
+        Flow_t *flow = exec->heap[0];
+        flowService(exec, flow, flow->session->event.eventID != Q_DISCONNECTED);
+        //A deadline that is still due goes to the back of the line.
+        if(flow->exec == exec && flow->deadlineMs <= now){
+            flow->deadlineMs = now + 1;
+            heapFix(exec, flow->heapIndex);
+        }
+    }
+    return (int)exec->count;
+}//End executorRun
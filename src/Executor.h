@@ -0,0 +1,86 @@
+/**
+ * Header file for Executor.c
+ * Defines the Flow_t struct an application writes a client's logic in as straight-line code that waits for the
+ * Gateway's answers, and the Executor_t struct that runs any number of flows on one thread with epoll, or with a
+ * transport ring (io_uring) if executorUseRing is called.
+ * Client_t.h, Events.h, and Session.h must be included before this file.
+ */
+
+#ifndef Q_EXECUTOR_H
+#define Q_EXECUTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//The most sockets epoll reports in one wait.
+#define Q_EXECUTOR_EVENTS 64
+//The most status codes that can wait for a flow to run. More are dropped and counted in the flow's dropped field.
+#define Q_FLOW_CODES 32
+
+//Returned by a flow function that is waiting, and by one that has reached its end.
+#define Q_FLOW_WAITING 0
+#define Q_FLOW_DONE 1
+
+//Starts the body of a flow function. Everything up to Q_FLOW_END is resumed where the flow last waited, so local
+//variables do not keep their values across a wait; keep them in the flow's context instead.
+#define Q_FLOW_BEGIN(flow) switch((flow)->resume){ case 0:
+//Waits for the next status code that makes cond true. cond is tested every time the session reports a status code,
+//which is in (flow)->code. The flow always returns here first, so a code from before the wait never satisfies it.
+#define Q_FLOW_AWAIT(flow, cond) do { (flow)->resume = __LINE__; return Q_FLOW_WAITING; case __LINE__: \
+    if(!(cond)){ return Q_FLOW_WAITING; } } while(0)
+//Waits until the session reports the status code given, or the session ends.
+#define Q_FLOW_AWAIT_CODE(flow, expected) Q_FLOW_AWAIT(flow, (flow)->code == (expected) || (flow)->code == Q_DisconRead)
+//Waits for ms milliseconds, using the session's Q_TIMER_PUBLISH timer.
+#define Q_FLOW_SLEEP(flow, ms) do { timerStart(&(flow)->session->loop, Q_TIMER_PUBLISH, (ms)); \
+    Q_FLOW_AWAIT_CODE(flow, Q_TimerExpired); } while(0)
+//Leaves the flow early, as if it had reached Q_FLOW_END.
+#define Q_FLOW_EXIT(flow) do { (flow)->resume = -1; return Q_FLOW_DONE; } while(0)
+//Ends the body of a flow function.
+#define Q_FLOW_END(flow) } (flow)->resume = -1; return Q_FLOW_DONE
+
+typedef struct Flow Flow_t;
+typedef struct Executor Executor_t;
+
+//Runs the flow from where it last waited. Returns Q_FLOW_WAITING or Q_FLOW_DONE, through the Q_FLOW_ macros.
+typedef int (*FlowFn_t)(Flow_t *flow);
+
+struct Flow {
+    //The session the flow runs, set up with sessionInit. Its notify function is taken over by the executor.
+    Session_t *session;
+    FlowFn_t run;
+    void *context;
+    //The line the flow resumes at: 0 before it first runs, and -1 once it has reached Q_FLOW_END.
+    int resume;
+    //The status code the flow is being run for, or Q_NO_ERR for its first run.
+    int code;
+    //Status codes the session reported while the flow could not be run, in order.
+    int codes[Q_FLOW_CODES];
+    size_t codeHead;
+    size_t codeCount;
+    uint64_t dropped;
+    //Used by the executor: the executor, the transport's count of opened sockets when its socket was last watched, and
+    //the flow's place in the deadline heap.
+    Executor_t *exec;
+    unsigned int opens;
+    uint64_t deadlineMs;
+    size_t heapIndex;
+};
+
+struct Executor {
+    int epollFd;
+    //The ring every session's datagrams are sent and received through, or NULL to use epoll and plain system calls.
+    TransportRing_t *ring;
+    //The flows being run, as a binary heap ordered by their next deadline.
+    Flow_t **heap;
+    size_t count;
+    size_t capacity;
+};
+
+int executorInit(Executor_t *exec, size_t capacity); //prototype
+void executorFree(Executor_t *exec); //prototype
+int executorUseRing(Executor_t *exec, unsigned int entries); //prototype
+int executorAdd(Executor_t *exec, Flow_t *flow, Session_t *session, FlowFn_t run, void *context); //prototype
+int executorRun(Executor_t *exec, int timeoutMs); //prototype
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * Contains the functions used to track QoS level 1 and 2 Publish messages that are waiting for a PubAck, PubRec, or PubComp.
+ * Instead of waiting for the acknowledgement of every Publish message before sending the next one, a client can have up to
+ * a window of messages in flight and match the acknowledgements in whatever order they arrive.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "InFlight.h"
+#include "EventLoop.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Creates an empty table of in flight messages.
+ * @param table The table to be initialized.
+ * @param window The maximum number of messages that can be in flight at the same time.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the table could not be allocated.
+ */
+int inFlightInit(InFlight_t *table, size_t window)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(window == 0){
+        window = 1;
+    }
+    //The msgID is masked with the capacity to find its slot, so the capacity must be a power of two.
+    size_t capacity = 1;
+    while(capacity < window){
+        capacity <<= 1;
+    }
+
+    table->slots = calloc(capacity, sizeof(InFlightMsg_t));
+    if(table->slots == NULL){
+        goto exit;
+    }
+    table->capacity = capacity;
+    table->window = window;
+    table->count = 0;
+    //A msgID of 0 is not allowed, so start from 1.
+    table->nextMsgID = 1;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End inFlightInit
+
+/**
+ * Releases the memory held by the table.
+ * @param table The table to be freed.
+ * @return void
+ */
+void inFlightFree(InFlight_t *table)
+{
+    for(size_t index = 0; index < table->capacity; ++index){
+        free(table->slots[index].frame);
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->window = 0;
+    table->count = 0;
+}//End inFlightFree
+
+/**
+ * @param table The table of in flight messages.
+ * @return true if no more messages can be sent until one of the in flight messages is acknowledged.
+ */
+bool inFlightFull(const InFlight_t *table)
+{
+    return table->count >= table->window;
+}//End inFlightFull
+
+/**
+ * Finds a msgID that is not being used by any in flight message.
+ * @param table The table of in flight messages.
+ * @return A msgID that can be used for the next Publish message, or 0 if the window is full.
+ */
+uint16_t inFlightNextMsgID(InFlight_t *table)
+{
+    if(table->slots == NULL || inFlightFull(table)){
+        return 0;
+    }
+
+    for(size_t tries = 0; tries < table->capacity; ++tries){
+        uint16_t msgID = table->nextMsgID;
+        table->nextMsgID = (uint16_t)(table->nextMsgID + 1);
+        if(table->nextMsgID == 0){
+            table->nextMsgID = 1;
+        }
+        if(msgID != 0 && table->slots[msgID & (table->capacity - 1)].state == Q_INFLIGHT_FREE){
+            return msgID;
+        }
+    }
+    return 0;
+}//End inFlightNextMsgID
+
+/**
+ * Records a Publish message that has just been sent and is waiting for an acknowledgement.
+ * @param table The table of in flight messages.
+ * @param msgID The msgID of the Publish message.
+ * @param topicID The topicID of the Publish message. Needed to check the PubAck.
+ * @param qos The QoS level of the Publish message, either 1 or 2.
+ * @return An int: Q_NO_ERR indicates the message is now in flight. Otherwise, Q_ERR_Qos indicates an invalid QoS level,
+ * Q_ERR_WindowFull indicates the window is full or the slot for this msgID is still in use by another message,
+ * and Q_ERR_MsgID indicates the msgID is 0 or already in flight.
+ */
+int inFlightAdd(InFlight_t *table, uint16_t msgID, uint16_t topicID, uint8_t qos)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(qos != 1 && qos != 2){
+        returnCode = Q_ERR_Qos;
+        goto exit;
+    }
+    if(table->slots == NULL || inFlightFull(table)){
+        returnCode = Q_ERR_WindowFull;
+        goto exit;
+    }
+    if(msgID == 0){
+        returnCode = Q_ERR_MsgID;
+        goto exit;
+    }
+
+    InFlightMsg_t *slot = &table->slots[msgID & (table->capacity - 1)];
+    if(slot->state != Q_INFLIGHT_FREE){
+        returnCode = (slot->msgID == msgID) ? Q_ERR_MsgID : Q_ERR_WindowFull;
+        goto exit;
+    }
+
+    slot->msgID = msgID;
+    slot->topicID = topicID;
+    slot->qos = qos;
+    slot->state = (qos == 1) ? Q_INFLIGHT_PUBACK : Q_INFLIGHT_PUBREC;
+    slot->sentUs = timeNowUs();
+    slot->deadlineMs = 0;
+    slot->attempts = 0;
+    slot->queued = false;
+    slot->frameLen = 0;
+    table->count += 1;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End inFlightAdd
+
+/**
+ * Looks up the in flight message an acknowledgement belongs to.
+ * @param table The table of in flight messages.
+ * @param msgID The msgID contained in the acknowledgement.
+ * @return A pointer to the in flight message, or NULL if no message with this msgID is in flight.
+ */
+InFlightMsg_t *inFlightFind(InFlight_t *table, uint16_t msgID)
+{
+    if(table->slots == NULL || msgID == 0){
+        return NULL;
+    }
+
+    InFlightMsg_t *slot = &table->slots[msgID & (table->capacity - 1)];
+    if(slot->state == Q_INFLIGHT_FREE || slot->msgID != msgID){
+        return NULL;
+    }
+    return slot;
+}//End inFlightFind
+
+/**
+ * Removes a message that has been fully acknowledged, freeing its slot for a new message.
+ * @param table The table of in flight messages.
+ * @param msg The message to be removed, as returned by inFlightFind.
+ * @return void
+ */
+void inFlightRemove(InFlight_t *table, InFlightMsg_t *msg)
+{
+    if(msg->state == Q_INFLIGHT_FREE){
+        return;
+    }
+    msg->state = Q_INFLIGHT_FREE;
+    table->count -= 1;
+}//End inFlightRemove
+
+/**
+ * Keeps a copy of an in flight Publish message so it can be sent again if it is not acknowledged in time.
+ * The copy is made into a buffer owned by the slot, which is only reallocated when a larger message comes along.
+ * @param msg The in flight message, as returned by inFlightFind.
+ * @param parts The buffers that make up the serialized message, in order.
+ * @param partCount The number of buffers.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates memory could not be allocated,
+ * in which case the message will not be sent again.
+ */
+int inFlightStoreFrame(InFlightMsg_t *msg, const struct iovec *parts, int partCount)
+{
+    size_t length = 0;
+    for(int index = 0; index < partCount; ++index){
+        length += parts[index].iov_len;
+    }
+
+    msg->frameLen = 0;
+    if(length > msg->frameCap){
+        unsigned char *frame = realloc(msg->frame, length);
+        if(frame == NULL){
+            return Q_ERR_Unknown;
+        }
+        msg->frame = frame;
+        msg->frameCap = length;
+    }
+    for(int index = 0; index < partCount; ++index){
+        memcpy(msg->frame + msg->frameLen, parts[index].iov_base, parts[index].iov_len);
+        msg->frameLen += parts[index].iov_len;
+    }
+    return Q_NO_ERR;
+}//End inFlightStoreFrame
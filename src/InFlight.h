@@ -0,0 +1,66 @@
+/**
+ * Header file for InFlight.c
+ * Defines the table used to track the QoS level 1 and 2 Publish messages a client has sent
+ * and that have not been fully acknowledged by the Gateway yet.
+ */
+
+#ifndef Q_INFLIGHT_H
+#define Q_INFLIGHT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+//The number of Publish messages a client can have in flight when no other window is chosen.
+#define Q_INFLIGHT_WINDOW 32
+
+//Defines the acknowledgement an in flight Publish message is waiting for.
+enum Q_INFLIGHT_STATE {
+    Q_INFLIGHT_FREE, Q_INFLIGHT_PUBACK, Q_INFLIGHT_PUBREC, Q_INFLIGHT_PUBCOMP
+};
+
+//A Publish message that has been sent out and is waiting for an acknowledgement.
+typedef struct {
+    uint16_t msgID;
+    uint16_t topicID;
+    uint8_t qos;
+    enum Q_INFLIGHT_STATE state;
+    //When the message (or its PubRel) was sent, in microseconds on the monotonic clock.
+    uint64_t sentUs;
+    //When the message is sent again if it has not been acknowledged, in milliseconds on the monotonic clock.
+    uint64_t deadlineMs;
+    //The number of times the message has been sent again.
+    uint8_t attempts;
+    //The message was sent from the client's offline queue, which still holds it until it is acknowledged.
+    bool queued;
+    //Copy of the serialized Publish message so it can be sent again. The buffer is kept when the slot is reused.
+    unsigned char *frame;
+    size_t frameLen;
+    size_t frameCap;
+} InFlightMsg_t;
+
+//Table of in flight messages. A message is stored in the slot given by its msgID,
+//so matching an acknowledgement never requires a search.
+typedef struct {
+    InFlightMsg_t *slots;
+    //Number of slots, always a power of two that is at least as large as the window.
+    size_t capacity;
+    //Maximum number of messages that can be in flight at once.
+    size_t window;
+    //Number of messages currently in flight.
+    size_t count;
+    //The msgID that will be tried first when a new one is needed.
+    uint16_t nextMsgID;
+} InFlight_t;
+
+int inFlightInit(InFlight_t *table, size_t window); //prototype
+void inFlightFree(InFlight_t *table); //prototype
+bool inFlightFull(const InFlight_t *table); //prototype
+uint16_t inFlightNextMsgID(InFlight_t *table); //prototype
+int inFlightAdd(InFlight_t *table, uint16_t msgID, uint16_t topicID, uint8_t qos); //prototype
+InFlightMsg_t *inFlightFind(InFlight_t *table, uint16_t msgID); //prototype
+void inFlightRemove(InFlight_t *table, InFlightMsg_t *msg); //prototype
+int inFlightStoreFrame(InFlightMsg_t *msg, const struct iovec *parts, int partCount); //prototype
+
+#endif
@@ -0,0 +1,336 @@
+/**
+ * Contains the functions used to store QoS level 1 and 2 Publish messages in a memory mapped file.
+ * Messages are appended to the file as soon as they are published, whether or not the client is connected, so a
+ * client can keep publishing during a long outage without blocking and without losing messages if it restarts.
+ * Once connected, the queued messages are sent through the client's in flight window and the start of the queue is
+ * moved past them as they are acknowledged. The space is reused once every message has been acknowledged, or by moving
+ * the remaining messages to the start of the file when the end is reached.
+ * The file lives in the page cache, so queued messages survive the client crashing, but not the system losing power.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "OfflineQueue.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+//Identifies a queue file ("MQSQ") and the layout of its records.
+#define Q_QUEUE_MAGIC 0x4D515351u
+#define Q_QUEUE_VERSION 1u
+
+/**
+ * @param frameLength The length of a serialized Publish message.
+ * @return The number of bytes a record holding the message takes up, a multiple of 8 so records stay aligned.
+ */
+static size_t recordSize(size_t frameLength)
+{
+    return (sizeof(OfflineRecord_t) + frameLength + 7u) & ~(size_t)7u;
+}//End recordSize
+
+/**
+ * @param queue The queue that holds the record.
+ * @param offset The offset of the record from the start of the record area.
+ * @return A pointer to the record.
+ */
+static OfflineRecord_t *recordAt(OfflineQueue_t *queue, uint64_t offset)
+{
+    return (OfflineRecord_t *)(queue->data + offset);
+}//End recordAt
+
+/**
+ * Opens the queue file, creating it if it does not exist. Messages left in the file by an earlier run are kept,
+ * and any that were sent but not acknowledged will be sent again.
+ * @param queue The queue to be opened.
+ * @param path The path of the queue file.
+ * @param size The size of the file in bytes if it has to be created. An existing file keeps its size.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_QueueFile indicates the file could not be opened or mapped.
+ */
+int offlineQueueOpen(OfflineQueue_t *queue, const char *path, size_t size)
+{
+    int returnCode = Q_ERR_QueueFile;
+    struct stat fileInfo;
+
+    FUNC_ENTRY;
+    queue->map = NULL;
+    queue->requeued = 0;
+    queue->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if(queue->fd < 0){
+        goto exit;
+    }
+    if(fstat(queue->fd, &fileInfo) != 0){
+        goto exit;
+    }
+    if(fileInfo.st_size > 0){
+        size = (size_t)fileInfo.st_size;
+    }
+    if(size < sizeof(OfflineQueueHeader_t) + recordSize(1)){
+        goto exit;
+    }
+    if(fileInfo.st_size == 0 && ftruncate(queue->fd, (off_t)size) != 0){
+        goto exit;
+    }
+
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, queue->fd, 0);
+    if(map == MAP_FAILED){
+        goto exit;
+    }
+    queue->map = map;
+    queue->mapLen = size;
+    queue->header = (OfflineQueueHeader_t *)queue->map;
+    queue->data = queue->map + sizeof(OfflineQueueHeader_t);
+    queue->dataLen = size - sizeof(OfflineQueueHeader_t);
+
+    //Start over if this is a new file or it does not hold a valid queue.
+    OfflineQueueHeader_t *header = queue->header;
+    if(header->magic != Q_QUEUE_MAGIC || header->version != Q_QUEUE_VERSION || header->head > header->send ||
+            header->send > header->tail || header->tail > queue->dataLen){
+        header->magic = Q_QUEUE_MAGIC;
+        header->version = Q_QUEUE_VERSION;
+        header->head = 0;
+        header->send = 0;
+        header->tail = 0;
+    }
+    //Messages sent during an earlier run were never acknowledged in this one.
+    offlineQueueRewind(queue);
+    returnCode = Q_NO_ERR;
+
+exit:
+    if(returnCode != Q_NO_ERR && queue->fd >= 0){
+        close(queue->fd);
+        queue->fd = -1;
+    }
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End offlineQueueOpen
+
+/**
+ * Writes the queue back to its file and closes it. The messages in it are kept for the next time it is opened.
+ * @param queue The queue to be closed.
+ * @return void
+ */
+void offlineQueueClose(OfflineQueue_t *queue)
+{
+    if(queue->map != NULL){
+        msync(queue->map, queue->mapLen, MS_SYNC);
+        munmap(queue->map, queue->mapLen);
+        queue->map = NULL;
+    }
+    if(queue->fd >= 0){
+        close(queue->fd);
+        queue->fd = -1;
+    }
+}//End offlineQueueClose
+
+/**
+ * Makes room at the end of the queue for a serialized Publish message. If the end of the file has been reached,
+ * the messages still in the queue are moved to the start of the file first.
+ * offlineQueueCommit must be called once the message has been written.
+ * @param queue The queue the message will be added to.
+ * @param frameLength The length of the serialized message.
+ * @return A pointer to where the message should be written, or NULL if the queue is full.
+ */
+unsigned char *offlineQueueReserve(OfflineQueue_t *queue, size_t frameLength)
+{
+    OfflineQueueHeader_t *header = queue->header;
+    size_t needed = recordSize(frameLength);
+
+    if(header->tail + needed > queue->dataLen && header->head > 0){
+        //Reclaim the space of the acknowledged messages at the start of the file.
+        memmove(queue->data, queue->data + header->head, (size_t)(header->tail - header->head));
+        header->send -= header->head;
+        header->tail -= header->head;
+        header->head = 0;
+    }
+    if(header->tail + needed > queue->dataLen){
+        return NULL;
+    }
+    return Q_RECORD_FRAME(recordAt(queue, header->tail));
+}//End offlineQueueReserve
+
+/**
+ * Adds the message written after a call to offlineQueueReserve to the end of the queue.
+ * @param queue The queue the message was written into.
+ * @param frameLength The length of the serialized message, the same as was reserved.
+ * @param topicID The topicID the message is published to.
+ * @param qos The QoS level of the message.
+ * @return void
+ */
+void offlineQueueCommit(OfflineQueue_t *queue, size_t frameLength, uint16_t topicID, uint8_t qos)
+{
+    OfflineRecord_t *record = recordAt(queue, queue->header->tail);
+
+    record->length = (uint32_t)frameLength;
+    record->msgID = 0;
+    record->topicID = topicID;
+    record->qos = qos;
+    memset(record->reserved, 0, sizeof(record->reserved));
+    record->state = Q_RECORD_QUEUED;
+    //Only move the tail once the record is complete, so a crash never leaves half a record in the queue.
+    queue->header->tail += recordSize(frameLength);
+}//End offlineQueueCommit
+
+/**
+ * @param queue The queue to be checked.
+ * @return The next message that has not been sent yet, or NULL if every message has been sent. Messages that were
+ * given up on come first.
+ */
+OfflineRecord_t *offlineQueueNext(OfflineQueue_t *queue)
+{
+    OfflineQueueHeader_t *header = queue->header;
+
+    //Messages given up on are behind send, among those waiting for an acknowledgement, as in offlineQueueAcked.
+    if(queue->requeued > 0){
+        for(uint64_t offset = header->head; offset < header->send; ){
+            OfflineRecord_t *record = recordAt(queue, offset);
+            if(record->state == Q_RECORD_QUEUED){
+                return record;
+            }
+            offset += recordSize(record->length);
+        }
+        queue->requeued = 0;
+    }
+    //After a rewind, messages acknowledged out of order are skipped.
+    while(header->send < header->tail && recordAt(queue, header->send)->state != Q_RECORD_QUEUED){
+        header->send += recordSize(recordAt(queue, header->send)->length);
+    }
+    if(header->send >= header->tail){
+        return NULL;
+    }
+    return recordAt(queue, header->send);
+}//End offlineQueueNext
+
+/**
+ * Marks the message returned by offlineQueueNext as sent, so the one after it is returned next.
+ * @param queue The queue that holds the message.
+ * @param record The message that was sent.
+ * @param msgID The msgID the message was sent with, used to match the acknowledgement.
+ * @return void
+ */
+void offlineQueueSent(OfflineQueue_t *queue, OfflineRecord_t *record, uint16_t msgID)
+{
+    record->msgID = msgID;
+    record->state = Q_RECORD_SENT;
+    if(record == recordAt(queue, queue->header->send)){
+        queue->header->send += recordSize(record->length);
+    } else if(queue->requeued > 0){
+        queue->requeued -= 1;
+    }
+}//End offlineQueueSent
+
+/**
+ * Marks a sent message as acknowledged and moves the start of the queue past every acknowledged message at the front.
+ * Nothing happens if no sent message has this msgID, since the message may not have come from the queue.
+ * @param queue The queue that holds the message.
+ * @param msgID The msgID contained in the PubAck or PubComp.
+ * @return void
+ */
+void offlineQueueAcked(OfflineQueue_t *queue, uint16_t msgID)
+{
+    OfflineQueueHeader_t *header = queue->header;
+
+    //Only messages waiting for an acknowledgement are checked, which is at most the client's in flight window.
+    for(uint64_t offset = header->head; offset < header->send; offset += recordSize(recordAt(queue, offset)->length)){
+        OfflineRecord_t *record = recordAt(queue, offset);
+        if(record->state == Q_RECORD_SENT && record->msgID == msgID){
+            record->state = Q_RECORD_ACKED;
+            break;
+        }
+    }
+
+    while(header->head < header->send && recordAt(queue, header->head)->state == Q_RECORD_ACKED){
+        header->head += recordSize(recordAt(queue, header->head)->length);
+    }
+    //Every message has been acknowledged, so start again from the beginning of the file.
+    if(header->head == header->tail){
+        header->head = 0;
+        header->send = 0;
+        header->tail = 0;
+    }
+}//End offlineQueueAcked
+
+/**
+ * Marks every message that was sent but not acknowledged as not sent, so they are all sent again.
+ * Used when the queue is opened and, through publishRewind, every time the client connects, since acknowledgements
+ * from an earlier connection will never arrive.
+ * @param queue The queue to be rewound.
+ * @return void
+ */
+void offlineQueueRewind(OfflineQueue_t *queue)
+{
+    OfflineQueueHeader_t *header = queue->header;
+
+    for(uint64_t offset = header->head; offset < header->send; offset += recordSize(recordAt(queue, offset)->length)){
+        OfflineRecord_t *record = recordAt(queue, offset);
+        if(record->state == Q_RECORD_SENT){
+            record->state = Q_RECORD_QUEUED;
+        }
+    }
+    header->send = header->head;
+    queue->requeued = 0;
+}//End offlineQueueRewind
+
+/**
+ * Marks a sent message as not sent, so offlineQueueNext returns it again and it is sent again with a new msgID.
+ * Used when the client gives up on a message while it is still connected, since the acknowledgement for the msgID it
+ * was sent with will never arrive. Nothing happens if no sent message has this msgID.
+ * send stays where it is, so the messages sent after this one are still found by offlineQueueAcked and rewound by
+ * offlineQueueRewind, even if the queue is closed before the message is sent again.
+ * @param queue The queue that holds the message.
+ * @param msgID The msgID the message was sent with.
+ * @return void
+ */
+void offlineQueueRequeue(OfflineQueue_t *queue, uint16_t msgID)
+{
+    OfflineQueueHeader_t *header = queue->header;
+
+    for(uint64_t offset = header->head; offset < header->send; offset += recordSize(recordAt(queue, offset)->length)){
+        OfflineRecord_t *record = recordAt(queue, offset);
+        if(record->state == Q_RECORD_SENT && record->msgID == msgID){
+            record->state = Q_RECORD_QUEUED;
+            queue->requeued += 1;
+            break;
+        }
+    }
+}//End offlineQueueRequeue
+
+/**
+ * @param queue The queue to be checked.
+ * @return The number of bytes used by messages that have not been acknowledged yet.
+ */
+size_t offlineQueuePending(const OfflineQueue_t *queue)
+{
+    return (size_t)(queue->header->tail - queue->header->head);
+}//End offlineQueuePending
+
+/**
+ * Moves every message in the queue that is published to a topicID the Gateway no longer knows to the topicID the
+ * topic name was given when it was registered again. This includes messages that have been sent but not acknowledged,
+ * so they go out with the new topicID if they are sent again after the client reconnects.
+ * @param queue The queue to be updated.
+ * @param oldTopicID The topicID the Gateway rejected.
+ * @param newTopicID The topicID in the RegAck.
+ * @return void
+ */
+void offlineQueueRetarget(OfflineQueue_t *queue, uint16_t oldTopicID, uint16_t newTopicID)
+{
+    OfflineQueueHeader_t *header = queue->header;
+
+    for(uint64_t offset = header->head; offset < header->tail; offset += recordSize(recordAt(queue, offset)->length)){
+        OfflineRecord_t *record = recordAt(queue, offset);
+        if(record->state == Q_RECORD_ACKED || record->topicID != oldTopicID){
+            continue;
+        }
+        record->topicID = newTopicID;
+        //The topicID follows the length field, type, and flags of the stored message.
+        unsigned char *frame = Q_RECORD_FRAME(record);
+        unsigned char *pos = frame + (frame[0] == 0x01 ? 3 : 1) + 2;
+        pos[0] = (unsigned char)(newTopicID >> 8);
+        pos[1] = (unsigned char)(newTopicID & 0xFF);
+    }
+}//End offlineQueueRetarget
@@ -0,0 +1,76 @@
+/**
+ * Header file for OfflineQueue.c
+ * Defines the file backed queue that holds QoS level 1 and 2 Publish messages until the Gateway has acknowledged them.
+ * The queue is a single memory mapped file: a small header followed by records that are only ever appended.
+ */
+
+#ifndef Q_OFFLINEQUEUE_H
+#define Q_OFFLINEQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//The size of the queue file when no other size is chosen.
+#define Q_OFFLINE_QUEUE_SIZE (1024 * 1024)
+
+//Defines where a queued Publish message is in its exchange with the Gateway.
+enum Q_RECORD_STATE {
+    Q_RECORD_QUEUED = 1, Q_RECORD_SENT, Q_RECORD_ACKED
+};
+
+//Stored at the start of the queue file. All offsets are relative to the first record.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    //Oldest message that has not been acknowledged yet.
+    uint64_t head;
+    //Next message to be sent. Messages between head and send are waiting for an acknowledgement, already have one, or
+    //were given up on and wait to be sent again. Every message from send on is still to be sent, so send only moves
+    //back when the queue is rewound.
+    uint64_t send;
+    //Where the next message will be appended.
+    uint64_t tail;
+} OfflineQueueHeader_t;
+
+//Stored in front of every serialized Publish message in the queue file.
+typedef struct {
+    //Length of the serialized Publish message that follows.
+    uint32_t length;
+    //The msgID the message was sent with. Only valid once it has been sent.
+    uint16_t msgID;
+    uint16_t topicID;
+    uint8_t qos;
+    uint8_t state;
+    uint8_t reserved[6];
+} OfflineRecord_t;
+
+//Gives the serialized Publish message stored after a record.
+#define Q_RECORD_FRAME(record) ((unsigned char *)((record) + 1))
+
+typedef struct {
+    int fd;
+    //The whole mapped file.
+    unsigned char *map;
+    size_t mapLen;
+    OfflineQueueHeader_t *header;
+    //The area records are stored in, right after the header.
+    unsigned char *data;
+    size_t dataLen;
+    //Messages between head and send that were given up on and not sent again yet. Not kept in the file, since opening
+    //the queue rewinds it.
+    size_t requeued;
+} OfflineQueue_t;
+
+int offlineQueueOpen(OfflineQueue_t *queue, const char *path, size_t size); //prototype
+void offlineQueueClose(OfflineQueue_t *queue); //prototype
+unsigned char *offlineQueueReserve(OfflineQueue_t *queue, size_t frameLength); //prototype
+void offlineQueueCommit(OfflineQueue_t *queue, size_t frameLength, uint16_t topicID, uint8_t qos); //prototype
+OfflineRecord_t *offlineQueueNext(OfflineQueue_t *queue); //prototype
+void offlineQueueSent(OfflineQueue_t *queue, OfflineRecord_t *record, uint16_t msgID); //prototype
+void offlineQueueAcked(OfflineQueue_t *queue, uint16_t msgID); //prototype
+void offlineQueueRewind(OfflineQueue_t *queue); //prototype
+void offlineQueueRequeue(OfflineQueue_t *queue, uint16_t msgID); //prototype
+size_t offlineQueuePending(const OfflineQueue_t *queue); //prototype
+void offlineQueueRetarget(OfflineQueue_t *queue, uint16_t oldTopicID, uint16_t newTopicID); //prototype
+
+#endif
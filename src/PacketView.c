@@ -0,0 +1,156 @@
+/**
+ * Contains the function that decodes a received message into a PacketView_t.
+ * The length field and the message type are checked once, the fields the type has are read straight out of the
+ * buffer, and the read functions in Util.c then only look at the view, instead of each of them decoding the header
+ * again while deserializing the message.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "PacketView.h"
+#include "MQTTSNPacket.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * @param data Points at the first of two bytes.
+ * @return The two bytes as a number, most significant byte first.
+ */
+static uint16_t viewInt(const unsigned char *data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}//End viewInt
+
+/**
+ * Decodes a message. The message type is stored even when the message turns out to be malformed, so the caller
+ * can still tell what was received.
+ * @param view The view the fields are written to.
+ * @param buf The buffer the message was read into. It must stay unchanged for as long as the view is used.
+ * @param length The number of bytes received.
+ * @param maxLength The longest message that is accepted.
+ * @return An int: Q_NO_ERR indicates the message was decoded. Otherwise, Q_ERR_MaxLength indicates its length field is
+ * longer than maxLength, Q_ERR_Read that it is too short, its length field does not match the number of bytes
+ * received, or its type is not an MQTT-SN message type, and Q_ERR_Deserial that it is too short for the fields of
+ * its type. Only a message of an unknown type gives Q_ERR_Read with a length that matches the bytes received.
+ */
+int packetViewParse(PacketView_t *view, const unsigned char *buf, size_t length, size_t maxLength)
+{
+    int returnCode = Q_ERR_Read;
+
+    FUNC_ENTRY;
+    memset(view, 0, sizeof(*view));
+    view->msgType = -1;
+    if(length < 2){
+        goto exit;
+    }
+    //The length field is 1 byte, or 3 bytes starting with 0x01.
+    size_t headerLen = 2;
+    view->length = buf[0];
+    if(buf[0] == 0x01){
+        if(length < 4){
+            goto exit;
+        }
+        headerLen = 4;
+        view->length = viewInt(buf + 1);
+    }
+    view->msgType = buf[headerLen - 1];
+    if(view->length > maxLength){
+        returnCode = Q_ERR_MaxLength;
+        goto exit;
+    }
+    if(view->length != length){
+        goto exit;
+    }
+
+    const unsigned char *body = buf + headerLen;
+    size_t bodyLen = length - headerLen;
+    returnCode = Q_ERR_Deserial;
+    switch(view->msgType){
+        case MQTTSN_CONNACK:
+        case MQTTSN_WILLTOPICRESP:
+        case MQTTSN_WILLMSGRESP:
+            if(bodyLen < 1){
+                goto exit;
+            }
+            view->returnCode = body[0];
+            break;
+
+        case MQTTSN_REGISTER:
+            if(bodyLen < 4){
+                goto exit;
+            }
+            view->topicID = viewInt(body);
+            view->msgID = viewInt(body + 2);
+            view->payload = body + 4;
+            view->payloadLen = bodyLen - 4;
+            break;
+
+        case MQTTSN_REGACK:
+        case MQTTSN_PUBACK:
+            if(bodyLen < 5){
+                goto exit;
+            }
+            view->topicID = viewInt(body);
+            view->msgID = viewInt(body + 2);
+            view->returnCode = body[4];
+            break;
+
+        case MQTTSN_PUBLISH:
+        case MQTTSN_SUBACK:
+            if(bodyLen < ((view->msgType == MQTTSN_PUBLISH) ? 5u : 6u)){
+                goto exit;
+            }
+            view->flags = body[0];
+            //The flags byte is DUP (bit 7), QoS (bits 6 and 5), Retain (bit 4), and TopicIdType (bits 1 and 0).
+            view->dup = (uint8_t)((body[0] >> 7) & 0x01);
+            view->qos = (uint8_t)((body[0] >> 5) & 0x03);
+            view->retained = (uint8_t)((body[0] >> 4) & 0x01);
+            view->topicIdType = (uint8_t)(body[0] & 0x03);
+            view->topicID = viewInt(body + 1);
+            view->msgID = viewInt(body + 3);
+            if(view->msgType == MQTTSN_SUBACK){
+                view->returnCode = body[5];
+            } else {
+                view->payload = body + 5;
+                view->payloadLen = bodyLen - 5;
+            }
+            break;
+
+        case MQTTSN_PUBREC:
+        case MQTTSN_PUBREL:
+        case MQTTSN_PUBCOMP:
+        case MQTTSN_UNSUBACK:
+            if(bodyLen < 2){
+                goto exit;
+            }
+            view->msgID = viewInt(body);
+            break;
+
+        case MQTTSN_PINGREQ:
+            view->payload = body;
+            view->payloadLen = bodyLen;
+            break;
+
+        //Reserved values, and those past the last message type, are not messages at all.
+        case MQTTSN_RESERVED1:
+        case MQTTSN_RESERVED2:
+        case MQTTSN_RESERVED3:
+            returnCode = Q_ERR_Read;
+            goto exit;
+
+        //Every other message type has no fields the client reads.
+        default:
+            if(view->msgType > MQTTSN_WILLMSGRESP){
+                returnCode = Q_ERR_Read;
+                goto exit;
+            }
+            break;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End packetViewParse
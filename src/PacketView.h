@@ -0,0 +1,36 @@
+/**
+ * Header file for PacketView.c
+ * Defines the view of a received message that readMsg decodes once and every read function works from.
+ */
+
+#ifndef Q_PACKETVIEW_H
+#define Q_PACKETVIEW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//The fields of a received message, decoded in a single pass. Fields the message type does not have are 0.
+//The view does not own anything: the payload points into the buffer the message was decoded from.
+typedef struct {
+    //The message type, or -1 if the message is too short to have one.
+    int msgType;
+    //The length of the whole message, taken from its length field.
+    size_t length;
+    //The flags byte of a Publish or SubAck message, along with the fields it holds.
+    uint8_t flags;
+    uint8_t qos;
+    uint8_t topicIdType;
+    uint8_t dup;
+    uint8_t retained;
+    //The return code of a Connack, WillTopicResp, WillMsgResp, RegAck, PubAck, or SubAck message.
+    uint8_t returnCode;
+    uint16_t topicID;
+    uint16_t msgID;
+    //The data of a Publish message, the topic name of a Register message, or the clientID of a PingReq message.
+    const unsigned char *payload;
+    size_t payloadLen;
+} PacketView_t;
+
+int packetViewParse(PacketView_t *view, const unsigned char *buf, size_t length, size_t maxLength); //prototype
+
+#endif
@@ -13,6 +13,7 @@
 #include "MQTTSNPacket.h"
 #include "ErrorCodes.h"
 #include "PingReq.h"
+#include "AckFrame.h"
 #include "PubAck.h"
 #include "StackTrace.h"
 #include "transport.h"
@@ -33,46 +34,43 @@ int pingReq(Client_t *clientPtr, MQTTSNString *clientID)
     
     int returnCode = Q_ERR_Unknown;
 
-    //The number of bytes needed by the buffer.
-    size_t bufBytes = 0;
-
-    //The size of the buffer.
-    size_t bufSize = 0;
-
-    //Serialized length of the message.
-    size_t serialLength = 0;
-
-    //Checking if we want to specify the client ID for this PingReq message.
-    //If we are not including a clientID, the buffer will only need to hold two bytes of data.
+    FUNC_ENTRY;
+    //Without a clientID a PingReq is always 2 bytes, so it is copied from its template instead of being serialized.
     if(clientID->lenstring.len == 0){
-        bufBytes = 2;
-    } else {
-        //Add 1 for the MsgType portion of the message.
-        bufBytes = MQTTSNPacket_len(MQTTSNstrlen(*clientID) + 1);
+        unsigned char frame[Q_PINGREQ_LEN];
+        memcpy(frame, pingReqTemplate, sizeof(frame));
+        if(sendBatchDirect(&clientPtr->batch, &clientPtr->transport, frame, sizeof(frame)) != 0){
+            returnCode = Q_ERR_Socket;
+            goto exit;
+        }
+        returnCode = Q_NO_ERR;
+        goto exit;
     }
 
-    //The buffer to hold the message.
-    unsigned char buf[bufBytes];
+    //The clientID is included, so this is a sleeping client waking up. Kept in its own block so the
+    //buffer's variable length does not reach the exit label.
+    {
+        //Add 1 for the MsgType portion of the message.
+        size_t bufBytes = MQTTSNPacket_len(MQTTSNstrlen(*clientID) + 1);
 
-    bufSize = sizeof(buf);
+        //The buffer to hold the message.
+        unsigned char buf[bufBytes];
 
-    FUNC_ENTRY;
-    //Serialize the message
-    returnCode = MQTTSNSerialize_pingreq(buf, bufSize, *clientID);
-    
-    //Check if serialization was successful and if it was, assign the serialized length of the message.
-    if(returnCode > 0){
-        serialLength = (size_t) returnCode;
-    } else {
-        returnCode = Q_ERR_Serial;
-        goto exit;
-    }
+        //Serialize the message
+        returnCode = MQTTSNSerialize_pingreq(buf, sizeof(buf), *clientID);
 
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+        //Check if serialization was successful and if it was, send the serialized message.
+        if(returnCode <= 0){
+            returnCode = Q_ERR_Serial;
+            goto exit;
+        }
 
-    if (returnCode2 != 0){
-        returnCode = Q_ERR_Socket;
-        goto exit;
+        int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, (size_t)returnCode);
+
+        if (returnCode2 != 0){
+            returnCode = Q_ERR_Socket;
+            goto exit;
+        }
     }
 
 returnCode = Q_NO_ERR;
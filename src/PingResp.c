@@ -36,7 +36,7 @@ int pingResp(Client_t *clientPtr)
     }
 
     //Send out the message and check if it failed to send.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
     if(returnCode2 != 0){
         returnCode = Q_ERR_Socket;
         goto exit;
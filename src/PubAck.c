@@ -9,6 +9,7 @@
 #include "MQTTSNPublish.h"
 #include "ErrorCodes.h"
 #include "PubAck.h"
+#include "AckFrame.h"
 #include "StackTrace.h"
 #include "transport.h"
 
@@ -19,48 +20,22 @@
  * @param topicID The topicID used in the corresponding Publish message.
  * @param msgID The message ID used in the corresponding Publish message.
  * @param msgReturnCode Indicates the corresponding Publish message is either accepted or rejected.
- * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown Q_ERR_Serial and Q_ERR_Socket indicate an error.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Socket indicates an error.
  */ 
 int pubAck(Client_t *clientPtr, uint16_t topicID, uint16_t msgID, uint8_t msgReturnCode)
 {
     int returnCode = Q_ERR_Unknown;
 
-    //The number of bytes needed in the buffer.
-    size_t bufBytes = 7;
-
-    //The buffer the message will be written into.
-    unsigned char buf[bufBytes];
-
-    //The size of the buffer.
-    size_t bufSize = sizeof(buf);
-
-    //The serialized length of the message.
-    size_t serialLength = 0;
-
     FUNC_ENTRY;
-    //Serialize the message.
-    returnCode = MQTTSNSerialize_puback(buf, bufSize, topicID, msgID, msgReturnCode);
-
-    //Check if serialization was successful.
-    if(returnCode > 0){
+    //A PubAck is always 7 bytes, so it is filled in from a template straight into the client's batch.
+    returnCode = ackFrameQueue(&clientPtr->batch, &clientPtr->transport, pubAckTemplate, topicID, msgID, msgReturnCode);
 
-        serialLength = (size_t) returnCode;
-    } else {
-        returnCode = Q_ERR_Serial;
-        goto exit;
-    }
-
-    //Send out the message.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
-
-    //Ensure that the message was successfully sent.
-    if(returnCode2 != 0){
+    //Ensure that the message was successfully added.
+    if(returnCode != Q_NO_ERR){
         returnCode = Q_ERR_Socket;
         goto exit;
     }
 
-    returnCode = Q_NO_ERR;
-
 exit: 
     FUNC_EXIT_RC(returnCode);
     return returnCode;
@@ -9,6 +9,7 @@
 #include "MQTTSNPublish.h"
 #include "ErrorCodes.h"
 #include "PubRecRelComp.h"
+#include "AckFrame.h"
 #include "StackTrace.h"
 #include "transport.h"
 
@@ -27,15 +28,6 @@ int pubRecRelComp(Client_t *clientPtr, uint16_t msgID, enum MQTTSN_msgTypes msgT
 {
     int returnCode = Q_ERR_Unknown;
 
-    //The buffer to hold the message.
-    unsigned char buf[4];
-
-    //The size of the buffer.
-    size_t bufSize = sizeof(buf);
-
-    //The length of the serialized message
-    size_t serialLength = 0;
-
     FUNC_ENTRY;
 
     if(msgType > MQTTSN_PUBREL || msgType < MQTTSN_PUBCOMP){
@@ -43,28 +35,10 @@ int pubRecRelComp(Client_t *clientPtr, uint16_t msgID, enum MQTTSN_msgTypes msgT
         goto exit;
     }
 
-    //Check which message type of PubRec, PubRel, PubComp is being sent out and serialize that message.
-    if(msgType == MQTTSN_PUBCOMP){
-        returnCode = MQTTSNSerialize_pubcomp(buf, bufSize, msgID);
-    }
-
-    else if(msgType == MQTTSN_PUBREC){
-        returnCode = MQTTSNSerialize_pubrec(buf, bufSize, msgID);
-    }
-
-    else{
-        returnCode = MQTTSNSerialize_pubrel(buf, bufSize, msgID);
-    }
-    
-    //Check that serialization was successful
-    if(returnCode > 0){
-        serialLength = (size_t)returnCode;
-    }
-
-    //Send the message and check if it was successfully sent
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    //All three are 4 bytes and differ only in their MsgType, so they are written straight into the client's batch.
+    returnCode = pubRespFrameQueue(&clientPtr->batch, &clientPtr->transport, (uint8_t)msgType, msgID);
 
-    if(returnCode2 != 0){
+    if(returnCode != Q_NO_ERR){
         returnCode = Q_ERR_Socket;
         goto exit;
     }
@@ -1,9 +1,12 @@
 //Percentage Contribution: Sandeep Bindra (30%), Bianca Lavaud (70%)
 //Build and send a Publish message for a client.
+//The header is built in a small buffer and sent together with the caller's payload buffers, so the payload is never copied.
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <stdbool.h>
 
 #include "Client_t.h"
 #include "MQTTSNPublish.h"
@@ -12,93 +15,388 @@
 #include "Publish.h"
 #include "transport.h"
 #include "PubRecRelComp.h"
+#include "Retransmit.h"
 #include "StackTrace.h"
 
+//Largest possible Publish header: 3 length bytes, message type, flags, topicID and msgID.
+#define Q_PUB_HEADER_LEN 9
+//Most payload buffers a single Publish message can be gathered from.
+#define Q_PUB_MAX_IOV 16
+
 /**
  *  Builds and sends out a Publish message for a client containing the specified data.
  * @param cltPtr A pointer to the client who will be publishing a message.
  * @param flags A pointer to a MQTTSNFlags struct that will contain the message flags set to the appropriate values.
  * @param topicID The topic Id that this message will be tied to.
  * @param msgID The ID of the message being sent.
- * @param data The actual data contained within the message.
- * @return An int: Q_NO_ERR indicates no error for building and sending the message. Otherwise, Q_ERR_Unknown, Q_ERR_TopicIdType, 
- * Q_ERR_Serial, and Q_ERR_Socket indicate errors.
+ * @param data The actual data contained within the message, as a null terminated string. Use publishLen or publishv
+ * for binary data.
+ * @return An int: Same as publishv.
  */
-
 int publish(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, unsigned char *data)
 {
-    int returnCode = Q_ERR_Unknown;
-    //Number of bytes needed in the buffer.
-    size_t bufBytes = 0;
-    //Length of the buffer that will hold the data of the message in bytes
-    size_t bufSize = 0;
-    //Length of the serialized message.
-    size_t serialLength = 0;
+    return publishLen(clientPtr, flags, topicID, msgID, data, strlen((char *)data));
+}//End publish
 
-    MQTTSN_topicid topic;
+/**
+ * Builds and sends out a Publish message whose payload can contain any bytes, including zeros.
+ * @param clientPtr A pointer to the client who will be publishing a message.
+ * @param flags A pointer to a MQTTSNFlags struct that will contain the message flags set to the appropriate values.
+ * @param topicID The topic Id that this message will be tied to.
+ * @param msgID The ID of the message being sent.
+ * @param data The payload of the message.
+ * @param dataLength The length of the payload in bytes.
+ * @return An int: Same as publishv.
+ */
+int publishLen(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, const unsigned char *data, size_t dataLength)
+{
+    struct iovec payload;
+    payload.iov_base = (void *)data;
+    payload.iov_len = dataLength;
+    return publishv(clientPtr, flags, topicID, msgID, &payload, 1);
+}//End publishLen
+
+/**
+ * Builds and sends out a Publish message whose payload is gathered from several buffers. Only the header is
+ * built by the client, the payload buffers are handed to the socket as they are. A QoS level 0 or -1 message is instead
+ * copied into the client's send batch and goes out with the next flush, unless it is too large for a batch.
+ * QoS level 1 and 2 messages are added to the client's in flight table, so the client does not have to wait for
+ * their acknowledgement before publishing the next message. A message sent again with the dup flag set keeps its entry.
+ * A copy of every QoS level 1 and 2 message is kept in the in flight table, and the client sends it again by itself
+ * if it is not acknowledged in time, so the caller's buffers are free to reuse once this returns.
+ * @param clientPtr A pointer to the client who will be publishing a message.
+ * @param flags A pointer to a MQTTSNFlags struct that will contain the message flags set to the appropriate values.
+ * For a short topic name, the two characters are packed into the topicID with the first one in the high byte.
+ * @param topicID The topic Id that this message will be tied to.
+ * @param msgID The ID of the message being sent.
+ * @param payload The buffers that make up the payload, in order.
+ * @param payloadCount The number of payload buffers, at most Q_PUB_MAX_IOV.
+ * @return An int: Q_NO_ERR indicates no error for building and sending the message. Otherwise, Q_ERR_Unknown,
+ * Q_ERR_TopicIdType (which includes a QoS level -1 message with a normal topicID), 
+ * Q_ERR_Serial, and Q_ERR_Socket indicate errors. Q_ERR_MaxLength indicates the message is too large for a single packet.
+ * Q_ERR_WindowFull indicates the client has too many messages in flight and should wait for an acknowledgement,
+ * and Q_ERR_MsgID indicates the msgID is already used by an in flight message.
+ */
+int publishv(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, const struct iovec *payload, int payloadCount)
+{
+    int returnCode = Q_ERR_Unknown;
+    //Holds the header of the message, the payload is sent straight from the caller's buffers.
+    unsigned char header[Q_PUB_HEADER_LEN];
+    unsigned char *ptr = header;
+    struct iovec packet[Q_PUB_MAX_IOV + 1];
+    //Length of the payload in bytes.
+    size_t dataLength = 0;
 
     FUNC_ENTRY;
-    //Length of the message being sent.
-    size_t dataLength = strlen((char *)data);
+    //Only normal, pre-defined, and short topic names are accepted.
+    if(flags->bits.topicIdType > 0b10){
+        returnCode = Q_ERR_TopicIdType;
+        goto exit;
+    }
+    //A QoS level -1 message is sent without a connection, so there is no registered topicID it could use.
+    if(flags->bits.QoS == 0b11 && flags->bits.topicIdType == MQTTSN_TOPIC_TYPE_NORMAL){
+        returnCode = Q_ERR_TopicIdType;
+        goto exit;
+    }
+    if(payloadCount < 0 || payloadCount > Q_PUB_MAX_IOV){
+        returnCode = Q_ERR_Serial;
+        goto exit;
+    }
 
     //MsgID is only considered for QoS levels 1 and 2 
-    if(flags->bits.QoS == 0b00){
+    if(flags->bits.QoS == 0b00 || flags->bits.QoS == 0b11){
         msgID = 0;
     }
 
-    //Check if this is a normal topic ID
-    if(flags->bits.topicIdType == 0b00) {
-        topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
-        topic.data.id = topicID;
+    for(int index = 0; index < payloadCount; ++index){
+        dataLength += payload[index].iov_len;
+        packet[index + 1] = payload[index];
     }
-    //Otherwise, check if this is a pre-defined topic ID
-    else if(flags->bits.topicIdType == 0b01) {
-        topic.type = MQTTSN_TOPIC_TYPE_PREDEFINED;
-        topic.data.id = topicID;
-    }
-    //Otherwise, check if this is a short topic name
-    else if(flags->bits.topicIdType == 0b10) {
-        topic.type = MQTTSN_TOPIC_TYPE_SHORT;
-        topic.data.short_name[1] = (char)topicID;
-    }
-    //If not one of the above values, this is not an accepted value for the topicIdType.
-    //We must do the goto statement after the buffer has been created, otherwise the compiler will 
-    //give a warning
-    else {
-        returnCode = Q_ERR_TopicIdType;
-    }
-    //Obtain the packet length so we know how large the buffer needs to be.
-    bufBytes = MQTTSNPacket_len(MQTTSNSerialize_publishLength(dataLength, topic, flags->bits.QoS));
-    //Create the buffer that will be sent out and contains the entire packet.
-    unsigned char buf[bufBytes];
-    //Obtain the size of the buffer for serializing the message.
-    bufSize = sizeof(buf);
 
-    if(returnCode == Q_ERR_TopicIdType){
-        goto exit;  
+    //Type, flags, topicID, and msgID take 6 bytes, MQTTSNPacket_len adds the length field.
+    size_t packetLength = MQTTSNPacket_len(dataLength + 6);
+    if(packetLength > 65535){
+        returnCode = Q_ERR_MaxLength;
+        goto exit;
     }
 
-    //Serialize the message with the given information and check the return code.
-    returnCode = MQTTSNSerialize_publish(buf, bufSize, flags->bits.dup, flags->bits.QoS, flags->bits.retain, msgID, topic, data, dataLength);
+    //Only the dup, QoS, retain, and topicIdType flags belong in a Publish message.
+    MQTTSNFlags pubFlags;
+    pubFlags.all = 0;
+    pubFlags.bits.dup = flags->bits.dup;
+    pubFlags.bits.QoS = flags->bits.QoS;
+    pubFlags.bits.retain = flags->bits.retain;
+    pubFlags.bits.topicIdType = flags->bits.topicIdType;
 
-    if(returnCode > 0){
-        serialLength = (size_t) returnCode;
-    } else {
-        returnCode = Q_ERR_Serial;
+    ptr += MQTTSNPacket_encode(ptr, packetLength);
+    writeChar(&ptr, MQTTSN_PUBLISH);
+    writeChar(&ptr, (char)pubFlags.all);
+    writeInt(&ptr, topicID);
+    writeInt(&ptr, msgID);
+    packet[0].iov_base = header;
+    packet[0].iov_len = (size_t)(ptr - header);
+
+    //QoS level 0 and -1 messages need no acknowledgement, so they are copied into the client's batch and sent
+    //together with other messages. One copy is cheaper than a system call per message.
+    if(flags->bits.QoS == 0b00 || flags->bits.QoS == 0b11){
+        size_t frameLength = packet[0].iov_len + dataLength;
+        unsigned char *frame = sendBatchReserve(&clientPtr->batch, &clientPtr->transport, frameLength);
+        if(frame != NULL){
+            for(int index = 0; index <= payloadCount; ++index){
+                memcpy(frame, packet[index].iov_base, packet[index].iov_len);
+                frame += packet[index].iov_len;
+            }
+            sendBatchCommit(&clientPtr->batch, frameLength);
+            returnCode = Q_NO_ERR;
+            goto exit;
+        }
+    }
+
+    //Anything waiting in the batch is sent first so the Gateway receives the messages in order.
+    if(sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+        returnCode = Q_ERR_Socket;
         goto exit;
     }
 
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    //Reserve a slot in the in flight table before sending so a full window is reported without sending anything.
+    bool tracked = false;
+    if(flags->bits.QoS == 0b01 || flags->bits.QoS == 0b10){
+        if(!(flags->bits.dup && inFlightFind(&clientPtr->inFlight, msgID) != NULL)){
+            returnCode = inFlightAdd(&clientPtr->inFlight, msgID, topicID, (uint8_t)flags->bits.QoS);
+            if(returnCode != Q_NO_ERR){
+                goto exit;
+            }
+            tracked = true;
+        }
+    }
+
+    ssize_t returnCode2 = transport_sessionSendv(&clientPtr->transport, packet, payloadCount + 1);
 
     //Check if the message was successfully sent to the server.
     if(returnCode2 != 0){
+        //The message never left, so it will not be acknowledged.
+        if(tracked){
+            inFlightRemove(&clientPtr->inFlight, inFlightFind(&clientPtr->inFlight, msgID));
+        }
         returnCode = Q_ERR_Socket;
         goto exit;
     }
+    statsSent(&clientPtr->stats, MQTTSN_PUBLISH);
+    //Keep a copy of the message so it can be sent again if it is not acknowledged in time.
+    if(tracked){
+        InFlightMsg_t *inFlight = inFlightFind(&clientPtr->inFlight, msgID);
+        inFlightStoreFrame(inFlight, packet, payloadCount + 1);
+        retransmitStart(clientPtr, inFlight);
+    }
 
     returnCode = Q_NO_ERR;
 
 exit:
     FUNC_EXIT_RC(returnCode);
     return returnCode;
-}
+}//End publishv
+
+/**
+ * Publishes a QoS level -1 message, which needs no Connect, Register, or keep alive. The client only has to have its
+ * socket open with clientOpen. The message is added to the client's send batch, so many of them can be published
+ * back to back and sent together with sendBatchFlush; a full batch is sent by itself. Nothing is acknowledged, and
+ * the Gateway drops messages for a topicID it does not know.
+ * @param clientPtr A pointer to the client who will be publishing the message.
+ * @param topicIdType MQTTSN_TOPIC_TYPE_PREDEFINED or MQTTSN_TOPIC_TYPE_SHORT.
+ * @param topicID The pre-defined topicID, or the two characters of a short topic name with the first one in the high byte.
+ * @param data The payload of the message.
+ * @param dataLength The length of the payload in bytes.
+ * @return An int: Same as publishv.
+ */
+int publishM1(Client_t *clientPtr, uint8_t topicIdType, uint16_t topicID, const unsigned char *data, size_t dataLength)
+{
+    MQTTSNFlags flags;
+    flags.all = 0;
+    flags.bits.QoS = 0b11;
+    //Anything else is left as a normal topicID, which publishv rejects.
+    flags.bits.topicIdType = (topicIdType == MQTTSN_TOPIC_TYPE_SHORT) ? MQTTSN_TOPIC_TYPE_SHORT :
+        (topicIdType == MQTTSN_TOPIC_TYPE_PREDEFINED) ? MQTTSN_TOPIC_TYPE_PREDEFINED : MQTTSN_TOPIC_TYPE_NORMAL;
+    return publishLen(clientPtr, &flags, topicID, 0, data, dataLength);
+}//End publishM1
+
+/**
+ * Adds a QoS level 1 or 2 Publish message to the client's offline queue instead of sending it. This works whether or
+ * not the client is connected and never blocks on the network. The message is given a msgID and sent by publishQueued
+ * once the client is connected and has room in its in flight window, and it stays in the queue until it is acknowledged.
+ * @param clientPtr A pointer to the client who will be publishing the message. Its offline queue must be open.
+ * @param flags A pointer to a MQTTSNFlags struct that will contain the message flags set to the appropriate values.
+ * @param topicID The topic Id that this message will be tied to.
+ * @param data The payload of the message.
+ * @param dataLength The length of the payload in bytes.
+ * @return An int: Q_NO_ERR indicates the message was queued. Otherwise, Q_ERR_Qos indicates the message is not QoS level
+ * 1 or 2, Q_ERR_TopicIdType indicates an invalid topic type, Q_ERR_MaxLength indicates the message is too large for a
+ * single packet, Q_ERR_QueueFull indicates the queue has no room, and Q_ERR_Unknown indicates the client has no queue.
+ */
+int publishOffline(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, const unsigned char *data, size_t dataLength)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(clientPtr->offline == NULL){
+        goto exit;
+    }
+    //QoS level 0 messages are never acknowledged, so the queue would never be able to let go of them.
+    if(flags->bits.QoS != 0b01 && flags->bits.QoS != 0b10){
+        returnCode = Q_ERR_Qos;
+        goto exit;
+    }
+    if(flags->bits.topicIdType > 0b10){
+        returnCode = Q_ERR_TopicIdType;
+        goto exit;
+    }
+
+    //Type, flags, topicID, and msgID take 6 bytes, MQTTSNPacket_len adds the length field.
+    size_t frameLength = MQTTSNPacket_len(dataLength + 6);
+    if(frameLength > 65535){
+        returnCode = Q_ERR_MaxLength;
+        goto exit;
+    }
+    unsigned char *frame = offlineQueueReserve(clientPtr->offline, frameLength);
+    if(frame == NULL){
+        returnCode = Q_ERR_QueueFull;
+        goto exit;
+    }
+
+    MQTTSNFlags pubFlags;
+    pubFlags.all = 0;
+    pubFlags.bits.QoS = flags->bits.QoS;
+    pubFlags.bits.retain = flags->bits.retain;
+    pubFlags.bits.topicIdType = flags->bits.topicIdType;
+
+    //The message is written straight into the queue file. Its msgID is filled in when it is sent.
+    unsigned char *ptr = frame;
+    ptr += MQTTSNPacket_encode(ptr, frameLength);
+    writeChar(&ptr, MQTTSN_PUBLISH);
+    writeChar(&ptr, (char)pubFlags.all);
+    writeInt(&ptr, topicID);
+    writeInt(&ptr, 0);
+    memcpy(ptr, data, dataLength);
+    offlineQueueCommit(clientPtr->offline, frameLength, topicID, (uint8_t)flags->bits.QoS);
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End publishOffline
+
+/**
+ * Sends the messages waiting in the client's offline queue, as many as the client's in flight window has room for.
+ * Should be called while the client is connected, for example each time its event loop runs. Messages that are
+ * still waiting for their acknowledgement when the client reconnects are sent again after publishRewind.
+ * @param clientPtr A pointer to the client whose queued messages are sent.
+ * @return An int: Q_NO_ERR indicates every message that fit in the window was sent, or the client has no queue.
+ * Otherwise, Q_ERR_Socket indicates a message could not be sent and stays in the queue.
+ */
+int publishQueued(Client_t *clientPtr)
+{
+    int returnCode = Q_ERR_Unknown;
+    OfflineRecord_t *record = NULL;
+
+    FUNC_ENTRY;
+    if(clientPtr->offline == NULL){
+        returnCode = Q_NO_ERR;
+        goto exit;
+    }
+
+    while((record = offlineQueueNext(clientPtr->offline)) != NULL){
+        uint16_t msgID = inFlightNextMsgID(&clientPtr->inFlight);
+        //The window is full, the rest are sent as acknowledgements come in.
+        if(msgID == 0){
+            break;
+        }
+        if(inFlightAdd(&clientPtr->inFlight, msgID, record->topicID, record->qos) != Q_NO_ERR){
+            break;
+        }
+
+        //Patch the msgID into the stored message. It follows the length field, type, flags, and topicID.
+        unsigned char *frame = Q_RECORD_FRAME(record);
+        unsigned char *ptr = frame + (frame[0] == 0x01 ? 3 : 1) + 4;
+        writeInt(&ptr, msgID);
+
+        if(sendBatchDirect(&clientPtr->batch, &clientPtr->transport, frame, record->length) != Q_NO_ERR){
+            inFlightRemove(&clientPtr->inFlight, inFlightFind(&clientPtr->inFlight, msgID));
+            returnCode = Q_ERR_Socket;
+            goto exit;
+        }
+        //The record can move when the queue is compacted, so the in flight table keeps its own copy.
+        struct iovec copy;
+        copy.iov_base = frame;
+        copy.iov_len = record->length;
+        InFlightMsg_t *inFlight = inFlightFind(&clientPtr->inFlight, msgID);
+        inFlightStoreFrame(inFlight, &copy, 1);
+        inFlight->queued = true;
+        retransmitStart(clientPtr, inFlight);
+        offlineQueueSent(clientPtr->offline, record, msgID);
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End publishQueued
+
+/**
+ * Gets the client's offline queue ready for a new connection. Acknowledgements for the messages sent from the queue
+ * on an earlier connection will never arrive, so those messages are taken out of the in flight table and marked as
+ * not sent, and publishQueued sends them again with new msgIDs once the client is connected. Without this, a message
+ * given up on while the Gateway was gone would stay in the queue as sent, and the start of the queue could never move
+ * past it. Nothing happens if the client has no queue.
+ * @param clientPtr A pointer to the client that is connecting.
+ * @return void
+ */
+void publishRewind(Client_t *clientPtr)
+{
+    InFlight_t *inFlight = &clientPtr->inFlight;
+
+    if(clientPtr->offline == NULL){
+        return;
+    }
+    for(size_t index = 0; inFlight->count > 0 && index < inFlight->capacity; ++index){
+        InFlightMsg_t *msg = &inFlight->slots[index];
+        if(msg->state != Q_INFLIGHT_FREE && msg->queued){
+            inFlightRemove(inFlight, msg);
+        }
+    }
+    offlineQueueRewind(clientPtr->offline);
+}//End publishRewind
+
+/**
+ * Moves the client's QoS level 1 and 2 Publish messages from a topicID the Gateway rejected to the topicID the topic name
+ * was given when it was registered again, both in the in flight table and in the offline queue. In flight messages that
+ * were held back when the Gateway rejected them are sent again straight away.
+ * @param clientPtr A pointer to the client whose messages are moved.
+ * @param oldTopicID The topicID the Gateway rejected.
+ * @param newTopicID The topicID in the RegAck.
+ * @param nowMs The current time in milliseconds, from timeNowMs.
+ * @return void
+ */
+void publishRetarget(Client_t *clientPtr, uint16_t oldTopicID, uint16_t newTopicID, uint64_t nowMs)
+{
+    InFlight_t *inFlight = &clientPtr->inFlight;
+
+    for(size_t index = 0; inFlight->count > 0 && index < inFlight->capacity; ++index){
+        InFlightMsg_t *msg = &inFlight->slots[index];
+        if(msg->state == Q_INFLIGHT_FREE || msg->topicID != oldTopicID){
+            continue;
+        }
+        msg->topicID = newTopicID;
+        if(msg->frameLen == 0){
+            continue;
+        }
+        //The topicID follows the length field, type, and flags of the stored message.
+        unsigned char *ptr = msg->frame + (msg->frame[0] == 0x01 ? 3 : 1) + 2;
+        writeInt(&ptr, newTopicID);
+        //A message held back by readPubAck has no deadline.
+        if(msg->deadlineMs == 0){
+            msg->deadlineMs = nowMs;
+        }
+    }
+    if(clientPtr->offline != NULL){
+        offlineQueueRetarget(clientPtr->offline, oldTopicID, newTopicID);
+    }
+}//End publishRetarget
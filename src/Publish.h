@@ -1,4 +1,12 @@
 //Header file for Publish
 
-int publish(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, unsigned char *data); //prototype
+#include <sys/uio.h>
 
+int publish(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, unsigned char *data); //prototype
+int publishLen(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, const unsigned char *data, size_t dataLength); //prototype
+int publishv(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, uint16_t msgID, const struct iovec *payload, int payloadCount); //prototype
+int publishM1(Client_t *clientPtr, uint8_t topicIdType, uint16_t topicID, const unsigned char *data, size_t dataLength); //prototype
+int publishOffline(Client_t *clientPtr, MQTTSNFlags *flags, uint16_t topicID, const unsigned char *data, size_t dataLength); //prototype
+int publishQueued(Client_t *clientPtr); //prototype
+void publishRewind(Client_t *clientPtr); //prototype
+void publishRetarget(Client_t *clientPtr, uint16_t oldTopicID, uint16_t newTopicID, uint64_t nowMs); //prototype
@@ -0,0 +1,155 @@
+/**
+ * Contains the functions used to track the QoS level 2 Publish messages a client has received.
+ * A QoS level 2 message is passed to the application when it first arrives, and its msgID is kept until the Gateway
+ * sends the PubRel for it. A Publish message that arrives again in the meantime, because the PubRec was lost, is only
+ * answered with another PubRec, so the application sees every message exactly once. Since the msgIDs are chosen by
+ * the Gateway, many exchanges can be open at once and their PubRel messages can arrive in any order.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "Qos2Recv.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Creates an empty table of received QoS level 2 messages.
+ * @param table The table to be initialized.
+ * @param window The maximum number of messages that can wait on a PubRel at the same time.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the table could not be allocated.
+ */
+int qos2RecvInit(Qos2Recv_t *table, size_t window)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(window == 0){
+        window = 1;
+    }
+    //The msgID is masked with the capacity to find its slot, so the capacity must be a power of two.
+    size_t capacity = 2;
+    while(capacity < window * 2){
+        capacity <<= 1;
+    }
+
+    table->slots = calloc(capacity, sizeof(uint16_t));
+    if(table->slots == NULL){
+        goto exit;
+    }
+    table->capacity = capacity;
+    table->window = window;
+    table->count = 0;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End qos2RecvInit
+
+/**
+ * Releases the memory held by the table.
+ * @param table The table to be freed.
+ * @return void
+ */
+void qos2RecvFree(Qos2Recv_t *table)
+{
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->window = 0;
+    table->count = 0;
+}//End qos2RecvFree
+
+/**
+ * Forgets every received message. Used when the client connects with a clean session, since the Gateway then forgets
+ * the messages it has not released as well.
+ * @param table The table to be emptied.
+ * @return void
+ */
+void qos2RecvClear(Qos2Recv_t *table)
+{
+    if(table->slots != NULL){
+        memset(table->slots, 0, table->capacity * sizeof(uint16_t));
+    }
+    table->count = 0;
+}//End qos2RecvClear
+
+/**
+ * Records a received QoS level 2 Publish message, unless it was received before and has not been released yet.
+ * @param table The table of received messages.
+ * @param msgID The msgID of the Publish message.
+ * @return An int: Q_NO_ERR indicates the message is new and should be passed to the application. Otherwise,
+ * Q_ERR_MsgID indicates it was already received and must only be answered with a PubRec, and Q_ERR_WindowFull
+ * indicates the window is full, in which case the message should not be answered so the Gateway sends it again later.
+ */
+int qos2RecvAdd(Qos2Recv_t *table, uint16_t msgID)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    if(table->slots == NULL || msgID == 0){
+        returnCode = Q_ERR_WindowFull;
+        goto exit;
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t index = msgID & mask;
+    while(table->slots[index] != 0){
+        if(table->slots[index] == msgID){
+            returnCode = Q_ERR_MsgID;
+            goto exit;
+        }
+        index = (index + 1) & mask;
+    }
+    if(table->count >= table->window){
+        returnCode = Q_ERR_WindowFull;
+        goto exit;
+    }
+    table->slots[index] = msgID;
+    table->count += 1;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End qos2RecvAdd
+
+/**
+ * Forgets a received message once the Gateway has released it with a PubRel. The messages stored after it are moved
+ * back so none of them is cut off from its slot by the free one.
+ * @param table The table of received messages.
+ * @param msgID The msgID contained in the PubRel.
+ * @return true if the message was waiting on its PubRel, false if it was already released or never received.
+ */
+bool qos2RecvRelease(Qos2Recv_t *table, uint16_t msgID)
+{
+    if(table->slots == NULL || msgID == 0){
+        return false;
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t index = msgID & mask;
+    while(table->slots[index] != msgID){
+        if(table->slots[index] == 0){
+            return false;
+        }
+        index = (index + 1) & mask;
+    }
+
+    //Move each following msgID into the free slot if the free slot lies between its own slot and where it is now.
+    size_t next = (index + 1) & mask;
+    while(table->slots[next] != 0){
+        size_t home = table->slots[next] & mask;
+        if(((next - home) & mask) >= ((next - index) & mask)){
+            table->slots[index] = table->slots[next];
+            index = next;
+        }
+        next = (next + 1) & mask;
+    }
+    table->slots[index] = 0;
+    table->count -= 1;
+    return true;
+}//End qos2RecvRelease
@@ -0,0 +1,37 @@
+/**
+ * Header file for Qos2Recv.c
+ * Defines the table used to remember the QoS level 2 Publish messages a client has received and passed to the
+ * application, until the Gateway releases them with a PubRel.
+ */
+
+#ifndef Q_QOS2RECV_H
+#define Q_QOS2RECV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//The number of received QoS level 2 messages a client can wait on a PubRel for when no other window is chosen.
+//A message whose PubRel never comes is only forgotten when the client connects with a clean session, and until then
+//takes up its place in the window. Once every place is taken, new QoS level 2 messages are not answered.
+#define Q_QOS2_RECV_WINDOW 32
+
+//Table of received QoS level 2 msgIDs. A msgID is stored in the slot given by its value, or the next free one after it,
+//and 0 marks a free slot since it is not a valid msgID.
+typedef struct {
+    uint16_t *slots;
+    //Number of slots, always a power of two that is at least twice the window so searches stay short.
+    size_t capacity;
+    //Maximum number of messages that can wait on a PubRel at once.
+    size_t window;
+    //Number of messages currently waiting on a PubRel.
+    size_t count;
+} Qos2Recv_t;
+
+int qos2RecvInit(Qos2Recv_t *table, size_t window); //prototype
+void qos2RecvFree(Qos2Recv_t *table); //prototype
+void qos2RecvClear(Qos2Recv_t *table); //prototype
+int qos2RecvAdd(Qos2Recv_t *table, uint16_t msgID); //prototype
+bool qos2RecvRelease(Qos2Recv_t *table, uint16_t msgID); //prototype
+
+#endif
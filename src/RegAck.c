@@ -13,6 +13,7 @@
 #include "MQTTSNPublish.h"
 #include "ErrorCodes.h"
 #include "RegAck.h"
+#include "AckFrame.h"
 #include "transport.h"
 #include "StackTrace.h"
 
@@ -22,7 +23,7 @@
  * @param clientPtr The client who will be sending out the acknowledgment message
  * @param topicID The topicID that should have been sent by the server in its register message.
  * @param msgID The messsage ID that should have been sent by the server.
- * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Serial, Q_ERR_Socket, or Q_ERR_Rejected indicate errors.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Socket or Q_ERR_Rejected indicate errors.
  */
 
 int regAck(Client_t *clientPtr, uint16_t topicID, uint16_t msgID, uint8_t msgReturnCode)
@@ -34,39 +35,17 @@ int regAck(Client_t *clientPtr, uint16_t topicID, uint16_t msgID, uint8_t msgRet
     //it will acknowledge that it received and processed the register message with an "accepted" (0) return code.
     uint8_t regAckReturnCode = msgReturnCode;
 
-    //The number of bytes needed in the buffer. Since this is a RegAck message, it will only be 7 bytes.
-    size_t bufBytes = 7;
-
-    //buffer to hold the message
-    unsigned char buf[bufBytes];
-
-    //The size of the buffer.
-    size_t bufSize = sizeof(buf);
-
     FUNC_ENTRY;
-    //The serialized length of the message
-    size_t serialLength = 0;
-
     //Check if the return code provided is within the valid range.
     if(regAckReturnCode > 3){
         returnCode = Q_ERR_Rejected;
         goto exit;
     }
 
-    //Serialize the message and then check the returnCode.
-    returnCode = MQTTSNSerialize_regack(buf, bufSize, topicID, msgID, regAckReturnCode);
-
-    if(returnCode > 0){
-        serialLength = (size_t) returnCode;
-    }
-    else{
-        returnCode = Q_ERR_Serial;
-        goto exit;
-    }
-
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    //A RegAck is always 7 bytes, so it is filled in from a template straight into the client's batch.
+    returnCode = ackFrameQueue(&clientPtr->batch, &clientPtr->transport, regAckTemplate, topicID, msgID, regAckReturnCode);
 
-    if(returnCode2 != 0){
+    if(returnCode != Q_NO_ERR){
         returnCode = Q_ERR_Socket;
         goto exit;
     }
@@ -10,6 +10,7 @@
 #include "MQTTSNPublish.h"
 #include "ErrorCodes.h"
 #include "Register.h"
+#include "Retransmit.h"
 #include "transport.h"
 #include "StackTrace.h"
 
@@ -59,7 +60,8 @@ int reg(Client_t *clientPtr, uint16_t msgID, MQTTSNString *topicname)
         goto exit;
     }
 
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    //Send the message, it is sent again if no RegAck arrives in time.
+    int returnCode2 = requestSend(clientPtr, buf, serialLength, MQTTSN_REGISTER, msgID);
 
     //Check that the message was successfully sent to the server.
     if(returnCode2 != 0){
@@ -73,3 +75,33 @@ exit:
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 }
+
+/**
+ * Builds a Register message and adds it to the client's send batch instead of sending it on its own, so the messages
+ * of a bulk request go out back to back. The message is not kept by the client; the bulk request sends it again
+ * if no RegAck arrives in time.
+ * @param clientPtr The client that will be sending out a message.
+ * @param msgID Used to identify this particular message and match it with the regack.
+ * @param topicname The name of the topic the client is trying to register with the server.
+ * @return An int: Q_NO_ERR is a success. Otherwise, Q_ERR_Serial or Q_ERR_Socket indicate an error.
+ */
+int regQueue(Client_t *clientPtr, uint16_t msgID, MQTTSNString *topicname)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    size_t topicNameLen = (topicname->cstring) ? strlen(topicname->cstring) : topicname->lenstring.len;
+    unsigned char buf[MQTTSNPacket_len(MQTTSNSerialize_registerLength(topicNameLen))];
+
+    //The topicID is 0 since the client is asking the Gateway for one.
+    returnCode = MQTTSNSerialize_register(buf, sizeof(buf), 0, msgID, topicname);
+    if(returnCode <= 0){
+        returnCode = Q_ERR_Serial;
+        goto exit;
+    }
+    returnCode = sendBatchQueue(&clientPtr->batch, &clientPtr->transport, buf, (size_t)returnCode);
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End regQueue
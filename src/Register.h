@@ -1,4 +1,5 @@
 //Header for Register
 
 int reg(Client_t *clientPtr, uint16_t msgID, MQTTSNString *topicname); //prototype
+int regQueue(Client_t *clientPtr, uint16_t msgID, MQTTSNString *topicname); //prototype
 
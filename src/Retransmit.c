@@ -0,0 +1,349 @@
+/**
+ * Contains the functions used to send messages again when the Gateway does not acknowledge them in time.
+ * A client keeps the Connect, Register, or Subscribe message it is waiting on an answer for, and a copy of every
+ * QoS level 1 and 2 Publish message in flight. Each has a deadline worked out from the client's round trip time
+ * estimate, as does every Register and Subscribe message of a bulk request. Once the deadline passes the message is
+ * sent again, with the dup flag set where the message has one, and the deadline is moved out with exponential backoff.
+ * The round trip time is measured from every message that is acknowledged without having been sent again.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "Events.h"
+#include "Util.h"
+#include "ErrorCodes.h"
+#include "EventLoop.h"
+#include "Retransmit.h"
+#include "PubRecRelComp.h"
+#include "Register.h"
+#include "Subscribe.h"
+#include "StackTrace.h"
+
+/**
+ * Sets the dup flag of a serialized Subscribe or Publish message, in both of which the flags follow the message type.
+ * @param frame The serialized message.
+ * @param length The length of the message.
+ * @return void
+ */
+static void setDupFlag(unsigned char *frame, size_t length)
+{
+    //The length field is 1 byte, or 3 bytes starting with 0x01.
+    size_t flagsOffset = ((frame[0] == 0x01) ? 3 : 1) + 1;
+    if(length > flagsOffset){
+        MQTTSNFlags flags;
+        flags.all = frame[flagsOffset];
+        flags.bits.dup = 1;
+        frame[flagsOffset] = flags.all;
+    }
+}//End setDupFlag
+
+/**
+ * Sends a Connect, Register, or Subscribe message and keeps it so it can be sent again until its answer arrives.
+ * The client waits on one such message at a time, so this replaces any message that was being waited on.
+ * @param clientPtr The client sending the message.
+ * @param frame The serialized message.
+ * @param length The length of the message.
+ * @param msgType The type of the message, for example MQTTSN_REGISTER.
+ * @param msgID The msgID of the message, or 0 for a Connect message.
+ * @return An int: Q_NO_ERR indicates the message was sent. Otherwise, Q_ERR_Socket indicates an error.
+ */
+int requestSend(Client_t *clientPtr, unsigned char *frame, size_t length, uint8_t msgType, uint16_t msgID)
+{
+    int returnCode = Q_ERR_Unknown;
+    Request_t *request = &clientPtr->request;
+
+    FUNC_ENTRY;
+    request->msgType = msgType;
+    request->msgID = msgID;
+    request->attempts = 0;
+    request->frameLen = 0;
+    //A message too large to keep is still sent, it just cannot be sent again.
+    if(length <= sizeof(request->frame)){
+        memcpy(request->frame, frame, length);
+        request->frameLen = length;
+    }
+
+    returnCode = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, frame, length);
+    if(returnCode != Q_NO_ERR){
+        request->msgType = 0;
+        goto exit;
+    }
+    request->sentUs = timeNowUs();
+    request->deadlineMs = timeNowMs() + rttTimeoutMs(&clientPtr->rtt, 0);
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End requestSend
+
+/**
+ * Stops waiting on a Connect, Register, or Subscribe message once the Gateway has answered it, whether the answer
+ * accepts or rejects it. Nothing happens if the answer is not for the message being waited on.
+ * @param clientPtr The client that received the answer.
+ * @param msgType The type of the message that was answered, for example MQTTSN_REGISTER for a RegAck.
+ * @param msgID The msgID contained in the answer, or 0 for a Connack.
+ * @return void
+ */
+void requestAcked(Client_t *clientPtr, uint8_t msgType, uint16_t msgID)
+{
+    Request_t *request = &clientPtr->request;
+
+    if(request->msgType != msgType || request->msgID != msgID){
+        return;
+    }
+    //Karn's rule: an answer to a message sent more than once cannot be timed.
+    if(request->attempts == 0){
+        uint64_t rttUs = timeNowUs() - request->sentUs;
+        rttSample(&clientPtr->rtt, rttUs);
+        if(msgType == MQTTSN_CONNECT){
+            statsRtt(&clientPtr->stats, Q_RTT_CONNACK, rttUs);
+        } else if(msgType == MQTTSN_REGISTER){
+            statsRtt(&clientPtr->stats, Q_RTT_REGACK, rttUs);
+        } else if(msgType == MQTTSN_SUBSCRIBE){
+            statsRtt(&clientPtr->stats, Q_RTT_SUBACK, rttUs);
+        }
+    }
+    request->msgType = 0;
+}//End requestAcked
+
+/**
+ * Starts the retransmission timer of an in flight message that has just been sent, or whose PubRel is about to be.
+ * @param clientPtr The client that sent the message.
+ * @param msg The in flight message.
+ * @return void
+ */
+void retransmitStart(Client_t *clientPtr, InFlightMsg_t *msg)
+{
+    msg->attempts = 0;
+    msg->sentUs = timeNowUs();
+    msg->deadlineMs = timeNowMs() + rttTimeoutMs(&clientPtr->rtt, 0);
+}//End retransmitStart
+
+/**
+ * Measures the round trip of an in flight message that has just been acknowledged by a PubAck, PubRec, or PubComp.
+ * @param clientPtr The client that received the acknowledgement.
+ * @param msg The in flight message.
+ * @return void
+ */
+void retransmitAcked(Client_t *clientPtr, InFlightMsg_t *msg)
+{
+    //Karn's rule: an acknowledgement of a message sent more than once cannot be timed.
+    if(msg->attempts == 0){
+        uint64_t rttUs = timeNowUs() - msg->sentUs;
+        rttSample(&clientPtr->rtt, rttUs);
+        //The state of the message tells which acknowledgement it was waiting for.
+        if(msg->state == Q_INFLIGHT_PUBACK){
+            statsRtt(&clientPtr->stats, Q_RTT_PUBACK, rttUs);
+        } else if(msg->state == Q_INFLIGHT_PUBREC){
+            statsRtt(&clientPtr->stats, Q_RTT_PUBREC, rttUs);
+        } else if(msg->state == Q_INFLIGHT_PUBCOMP){
+            statsRtt(&clientPtr->stats, Q_RTT_PUBCOMP, rttUs);
+        }
+    }
+}//End retransmitAcked
+
+/**
+ * Starts the retransmission timer of a Register or Subscribe message of a bulk request that has just been sent.
+ * @param clientPtr The client that sent the message.
+ * @param op The message.
+ * @return void
+ */
+void retransmitBulkStart(Client_t *clientPtr, BulkOp_t *op)
+{
+    op->attempts = 0;
+    op->sentUs = timeNowUs();
+    op->deadlineMs = timeNowMs() + rttTimeoutMs(&clientPtr->rtt, 0);
+}//End retransmitBulkStart
+
+/**
+ * Measures the round trip of a Register or Subscribe message of a bulk request that has just been answered.
+ * @param clientPtr The client that received the answer.
+ * @param op The message.
+ * @return void
+ */
+void retransmitBulkAcked(Client_t *clientPtr, BulkOp_t *op)
+{
+    //Karn's rule: an answer to a message sent more than once cannot be timed.
+    if(op->attempts == 0 && op->deadlineMs != 0){
+        uint64_t rttUs = timeNowUs() - op->sentUs;
+        rttSample(&clientPtr->rtt, rttUs);
+        statsRtt(&clientPtr->stats, (op->msgType == MQTTSN_REGISTER) ? Q_RTT_REGACK : Q_RTT_SUBACK, rttUs);
+    }
+}//End retransmitBulkAcked
+
+/**
+ * Adds a Register or Subscribe message of a bulk request to the client's send batch again, with the dup flag set
+ * on a Subscribe message.
+ * @param clientPtr The client that sent the message.
+ * @param op The message.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, the status code of regQueue or subscribeQueue.
+ */
+static int bulkResend(Client_t *clientPtr, BulkOp_t *op)
+{
+    uint16_t msgID = bulkMsgID(&clientPtr->bulk, op);
+
+    if(op->msgType == MQTTSN_REGISTER){
+        MQTTSNString topicName;
+        MQTTSNStrCreate(&topicName, (char *)op->topicName);
+        return regQueue(clientPtr, msgID, &topicName);
+    }
+    MQTTSN_topicid topic;
+    topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    topic.data.long_.name = (char *)op->topicName;
+    topic.data.long_.len = strlen(op->topicName);
+    MQTTSNFlags flags;
+    flags.all = 0;
+    flags.bits.QoS = (op->qos == 2) ? 0b10 : (op->qos == 1) ? 0b01 : 0b00;
+    flags.bits.dup = 1;
+    return subscribeQueue(clientPtr, &topic, flags, msgID);
+}//End bulkResend
+
+/**
+ * Sends again every message whose deadline has passed: the Connect, Register, or Subscribe message being waited on,
+ * the unanswered messages of a bulk request, QoS level 1 and 2 Publish messages (with the dup flag set), and the PubRel
+ * of QoS level 2 messages waiting for a PubComp. A message that has been sent Q_RETRANSMIT_MAX times without an answer
+ * is given up on, one per call so each can be reported: the caller calls again until Q_ERR_RetryLimit is no longer
+ * returned. A Publish message from the offline queue is not lost when it is given up on, it is put back in the queue
+ * and sent again with a new msgID.
+ * @param clientPtr The client whose messages are checked.
+ * @param nowMs The current time in milliseconds, from timeNowMs.
+ * @param givenUpID Set to the msgID of the message given up on (0 for a Connect message). Can be NULL.
+ * @return An int: Q_NO_ERR indicates nothing had to be given up on. Otherwise, Q_ERR_RetryLimit indicates a message
+ * was given up on and Q_ERR_Socket indicates a message could not be sent.
+ */
+int retransmitDue(Client_t *clientPtr, uint64_t nowMs, uint16_t *givenUpID)
+{
+    int returnCode = Q_NO_ERR;
+    Request_t *request = &clientPtr->request;
+    InFlight_t *inFlight = &clientPtr->inFlight;
+    uint16_t givenUp = 0;
+
+    FUNC_ENTRY;
+    if(request->msgType != 0 && nowMs >= request->deadlineMs){
+        if(request->attempts >= Q_RETRANSMIT_MAX || request->frameLen == 0){
+            request->msgType = 0;
+            givenUp = request->msgID;
+            returnCode = Q_ERR_RetryLimit;
+            goto flush;
+        } else {
+            //Connect and Register messages have no dup flag.
+            if(request->msgType == MQTTSN_SUBSCRIBE){
+                setDupFlag(request->frame, request->frameLen);
+            }
+            if(sendBatchDirect(&clientPtr->batch, &clientPtr->transport, request->frame, request->frameLen) != Q_NO_ERR){
+                returnCode = Q_ERR_Socket;
+                goto exit;
+            }
+            statsRetransmitted(&clientPtr->stats, request->msgType);
+            request->attempts += 1;
+            request->deadlineMs = nowMs + rttTimeoutMs(&clientPtr->rtt, request->attempts);
+        }
+    }
+
+    for(size_t index = 0; inFlight->count > 0 && index < inFlight->capacity; ++index){
+        InFlightMsg_t *msg = &inFlight->slots[index];
+        if(msg->state == Q_INFLIGHT_FREE || msg->deadlineMs == 0 || nowMs < msg->deadlineMs){
+            continue;
+        }
+        if(msg->attempts >= Q_RETRANSMIT_MAX){
+            givenUp = msg->msgID;
+            if(msg->queued && clientPtr->offline != NULL){
+                offlineQueueRequeue(clientPtr->offline, msg->msgID);
+            }
+            inFlightRemove(inFlight, msg);
+            returnCode = Q_ERR_RetryLimit;
+            goto flush;
+        }
+
+        int sendCode = Q_NO_ERR;
+        if(msg->state == Q_INFLIGHT_PUBCOMP){
+            //The PubRec arrived, so it is the PubRel that was lost or not answered.
+            sendCode = pubRecRelComp(clientPtr, msg->msgID, MQTTSN_PUBREL);
+            statsRetransmitted(&clientPtr->stats, MQTTSN_PUBREL);
+        } else if(msg->frameLen > 0){
+            setDupFlag(msg->frame, msg->frameLen);
+            sendCode = sendBatchQueue(&clientPtr->batch, &clientPtr->transport, msg->frame, msg->frameLen);
+            statsRetransmitted(&clientPtr->stats, MQTTSN_PUBLISH);
+        } else {
+            //No copy of the message could be kept, so it cannot be sent again.
+            msg->deadlineMs = 0;
+            continue;
+        }
+        if(sendCode != Q_NO_ERR){
+            returnCode = Q_ERR_Socket;
+            goto exit;
+        }
+        msg->attempts += 1;
+        msg->deadlineMs = nowMs + rttTimeoutMs(&clientPtr->rtt, msg->attempts);
+    }
+    for(size_t index = 0; clientPtr->bulk.waiting > 0 && index < clientPtr->bulk.count; ++index){
+        BulkOp_t *op = &clientPtr->bulk.ops[index];
+        if(op->answered || op->deadlineMs == 0 || nowMs < op->deadlineMs){
+            continue;
+        }
+        if(op->attempts >= Q_RETRANSMIT_MAX){
+            givenUp = bulkMsgID(&clientPtr->bulk, op);
+            bulkAnswered(&clientPtr->bulk, op, Q_ERR_RetryLimit);
+            returnCode = Q_ERR_RetryLimit;
+            goto flush;
+        }
+        if(bulkResend(clientPtr, op) != Q_NO_ERR){
+            returnCode = Q_ERR_Socket;
+            goto exit;
+        }
+        statsRetransmitted(&clientPtr->stats, op->msgType);
+        op->attempts += 1;
+        op->deadlineMs = nowMs + rttTimeoutMs(&clientPtr->rtt, op->attempts);
+    }
+flush:
+    //Messages sent again go out together.
+    if(sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+        returnCode = Q_ERR_Socket;
+    }
+
+exit:
+    if(givenUpID != NULL){
+        *givenUpID = givenUp;
+    }
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End retransmitDue
+
+/**
+ * Finds how long the client can wait before retransmitDue has something to send again.
+ * @param clientPtr The client whose messages are checked.
+ * @param nowMs The current time in milliseconds, from timeNowMs.
+ * @return The number of milliseconds until the nearest deadline, 0 if one has already passed, or -1 if the client
+ * is not waiting on any acknowledgement.
+ */
+int retransmitTimeout(Client_t *clientPtr, uint64_t nowMs)
+{
+    uint64_t nearest = 0;
+    InFlight_t *inFlight = &clientPtr->inFlight;
+
+    if(clientPtr->request.msgType != 0){
+        nearest = clientPtr->request.deadlineMs;
+    }
+    for(size_t index = 0; inFlight->count > 0 && index < inFlight->capacity; ++index){
+        InFlightMsg_t *msg = &inFlight->slots[index];
+        if(msg->state != Q_INFLIGHT_FREE && msg->deadlineMs != 0 && (nearest == 0 || msg->deadlineMs < nearest)){
+            nearest = msg->deadlineMs;
+        }
+    }
+    for(size_t index = 0; clientPtr->bulk.waiting > 0 && index < clientPtr->bulk.count; ++index){
+        BulkOp_t *op = &clientPtr->bulk.ops[index];
+        if(!op->answered && op->deadlineMs != 0 && (nearest == 0 || op->deadlineMs < nearest)){
+            nearest = op->deadlineMs;
+        }
+    }
+
+    if(nearest == 0){
+        return -1;
+    }
+    return (nearest > nowMs) ? (int)(nearest - nowMs) : 0;
+}//End retransmitTimeout
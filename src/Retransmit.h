@@ -0,0 +1,10 @@
+//Header file for Retransmit.c
+
+int requestSend(Client_t *clientPtr, unsigned char *frame, size_t length, uint8_t msgType, uint16_t msgID); //prototype
+void requestAcked(Client_t *clientPtr, uint8_t msgType, uint16_t msgID); //prototype
+void retransmitStart(Client_t *clientPtr, InFlightMsg_t *msg); //prototype
+void retransmitAcked(Client_t *clientPtr, InFlightMsg_t *msg); //prototype
+void retransmitBulkStart(Client_t *clientPtr, BulkOp_t *op); //prototype
+void retransmitBulkAcked(Client_t *clientPtr, BulkOp_t *op); //prototype
+int retransmitDue(Client_t *clientPtr, uint64_t nowMs, uint16_t *givenUpID); //prototype
+int retransmitTimeout(Client_t *clientPtr, uint64_t nowMs); //prototype
@@ -0,0 +1,98 @@
+/**
+ * Contains the round trip time estimator a client uses to decide how long to wait for an acknowledgement.
+ * The estimate follows RFC 6298: a smoothed round trip time and its variance are updated with every round trip
+ * measured, and the retransmission timeout is the smoothed time plus four times the variance. Each time a message
+ * is sent again the timeout is doubled, and a random amount of up to a quarter of it is added (or taken off, once the
+ * timeout would pass Q_RTO_MAX_MS) so that many clients that lost their messages at the same moment do not all send
+ * them again at the same moment.
+ * The same client can run over Ethernet, LTE-M, or a satellite link, and the timeout follows whichever it is on.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "Rtt.h"
+#include "EventLoop.h"
+
+//The clock granularity term of RFC 6298, the smallest variance allowance added to the smoothed round trip time.
+#define Q_RTT_GRANULARITY_US 1000u
+
+/**
+ * Sets the estimator back to the state it is in before any round trip has been measured.
+ * @param rtt The estimator to be initialized.
+ * @return void
+ */
+void rttInit(Rtt_t *rtt)
+{
+    rtt->srttUs = 0;
+    rtt->rttvarUs = 0;
+    rtt->rtoUs = (uint64_t)Q_RTO_INITIAL_MS * 1000u;
+    rtt->measured = false;
+    //Seeded from the clock so clients started together do not pick the same jitter.
+    rtt->jitterSeed = (uint32_t)timeNowUs() | 1u;
+}//End rttInit
+
+/**
+ * Updates the estimate with a measured round trip. Only messages that were sent once should be measured (Karn's rule),
+ * since the acknowledgement of a message sent more than once cannot be matched to the send it answers.
+ * @param rtt The estimator to be updated.
+ * @param sampleUs The time between sending the message and receiving its acknowledgement, in microseconds.
+ * @return void
+ */
+void rttSample(Rtt_t *rtt, uint64_t sampleUs)
+{
+    if(!rtt->measured){
+        rtt->srttUs = sampleUs;
+        rtt->rttvarUs = sampleUs / 2;
+        rtt->measured = true;
+    } else {
+        uint64_t delta = (rtt->srttUs > sampleUs) ? rtt->srttUs - sampleUs : sampleUs - rtt->srttUs;
+        //rttvar = 3/4 rttvar + 1/4 |srtt - sample|, srtt = 7/8 srtt + 1/8 sample
+        rtt->rttvarUs = (3 * rtt->rttvarUs + delta) / 4;
+        rtt->srttUs = (7 * rtt->srttUs + sampleUs) / 8;
+    }
+
+    uint64_t variance = 4 * rtt->rttvarUs;
+    if(variance < Q_RTT_GRANULARITY_US){
+        variance = Q_RTT_GRANULARITY_US;
+    }
+    rtt->rtoUs = rtt->srttUs + variance;
+    if(rtt->rtoUs < (uint64_t)Q_RTO_MIN_MS * 1000u){
+        rtt->rtoUs = (uint64_t)Q_RTO_MIN_MS * 1000u;
+    }
+    if(rtt->rtoUs > (uint64_t)Q_RTO_MAX_MS * 1000u){
+        rtt->rtoUs = (uint64_t)Q_RTO_MAX_MS * 1000u;
+    }
+}//End rttSample
+
+/**
+ * Works out how long to wait for an acknowledgement before sending a message again.
+ * @param rtt The estimator of the Gateway the message is sent to.
+ * @param attempts The number of times the message has already been sent again. The timeout doubles with each one.
+ * @return The timeout in milliseconds, including jitter, never more than Q_RTO_MAX_MS.
+ */
+uint32_t rttTimeoutMs(Rtt_t *rtt, uint8_t attempts)
+{
+    uint64_t timeoutUs = rtt->rtoUs;
+    for(uint8_t count = 0; count < attempts && timeoutUs < (uint64_t)Q_RTO_MAX_MS * 1000u; ++count){
+        timeoutUs *= 2;
+    }
+    if(timeoutUs > (uint64_t)Q_RTO_MAX_MS * 1000u){
+        timeoutUs = (uint64_t)Q_RTO_MAX_MS * 1000u;
+    }
+
+    //xorshift32, good enough to spread clients apart.
+    rtt->jitterSeed ^= rtt->jitterSeed << 13;
+    rtt->jitterSeed ^= rtt->jitterSeed >> 17;
+    rtt->jitterSeed ^= rtt->jitterSeed << 5;
+    uint64_t jitterUs = rtt->jitterSeed % (timeoutUs / 4 + 1);
+    //Near the cap the jitter is taken off instead, so clients stay spread apart without going over Q_RTO_MAX_MS.
+    if(timeoutUs + jitterUs > (uint64_t)Q_RTO_MAX_MS * 1000u){
+        timeoutUs -= jitterUs;
+    } else {
+        timeoutUs += jitterUs;
+    }
+
+    //Round up so a timeout under a millisecond still waits.
+    return (uint32_t)((timeoutUs + 999u) / 1000u);
+}//End rttTimeoutMs
@@ -0,0 +1,58 @@
+/**
+ * Header file for Rtt.c
+ * Defines the round trip time estimator a client keeps for its Gateway, and the request (Connect, Register, or
+ * Subscribe message) the client is waiting on an answer for. The estimator decides how long the client waits
+ * before a message that has not been acknowledged is sent again.
+ */
+
+#ifndef Q_RTT_H
+#define Q_RTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//The retransmission timeout used before the first round trip has been measured (RFC 6298).
+#define Q_RTO_INITIAL_MS 1000
+//The retransmission timeout never goes below this, however fast the Gateway answers.
+#define Q_RTO_MIN_MS 20
+//The retransmission timeout never goes above this, even after backing off.
+#define Q_RTO_MAX_MS 60000
+//The number of times a message is sent again before the client gives up on it.
+#define Q_RETRANSMIT_MAX 6
+//The largest Connect, Register, or Subscribe message that can be kept to be sent again.
+#define Q_REQUEST_LEN 1600
+
+//Smoothed round trip time and its variance, in microseconds.
+typedef struct {
+    uint64_t srttUs;
+    uint64_t rttvarUs;
+    //The current retransmission timeout.
+    uint64_t rtoUs;
+    //False until the first round trip has been measured.
+    bool measured;
+    //State of the random number generator used to add jitter.
+    uint32_t jitterSeed;
+} Rtt_t;
+
+//A Connect, Register, or Subscribe message waiting for its answer, kept so it can be sent again.
+typedef struct {
+    //The type of the message, or 0 if the client is not waiting on an answer.
+    uint8_t msgType;
+    uint16_t msgID;
+    //The number of times the message has been sent again.
+    uint8_t attempts;
+    //When the message was first sent, in microseconds on the monotonic clock.
+    uint64_t sentUs;
+    //When the message is sent again if no answer has arrived, in milliseconds on the monotonic clock.
+    uint64_t deadlineMs;
+    //The serialized message. A length of 0 means the message was too large to keep.
+    size_t frameLen;
+    unsigned char frame[Q_REQUEST_LEN];
+} Request_t;
+
+void rttInit(Rtt_t *rtt); //prototype
+void rttSample(Rtt_t *rtt, uint64_t sampleUs); //prototype
+uint32_t rttTimeoutMs(Rtt_t *rtt, uint8_t attempts); //prototype
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * Contains the functions used to batch outgoing messages.
+ * Acknowledgements (PubAck, RegAck, PubRec, PubRel, PubComp) and QoS level 0 Publish messages do not need an immediate
+ * answer from the Gateway, so instead of sending each of them with its own system call they are collected in the
+ * client's batch. The batch is sent with a single sendmmsg call when it is full, when the client is about to wait for
+ * a message from the Gateway, or when sendBatchFlush is called. Any other message is sent right away, after the
+ * batch, so the Gateway still receives every message in the order the client created them.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "SendBatch.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Empties a batch.
+ * @param batch The batch to be initialized.
+ * @param stats The statistics the messages sent are counted in, or NULL.
+ * @return void
+ */
+void sendBatchInit(SendBatch_t *batch, Stats_t *stats)
+{
+    batch->used = 0;
+    batch->frameCount = 0;
+    batch->stats = stats;
+}//End sendBatchInit
+
+/**
+ * Sends every message waiting in the batch and empties it.
+ * @param batch The batch to be sent.
+ * @param transport The transport session the messages are sent on.
+ * @return An int: Q_NO_ERR indicates every message was sent (or there was nothing to send). Otherwise, Q_ERR_Socket
+ * indicates an error, in which case the messages that were not sent are dropped.
+ */
+int sendBatchFlush(SendBatch_t *batch, Transport_t *transport)
+{
+    int returnCode = Q_NO_ERR;
+
+    if(batch->frameCount == 0){
+        return returnCode;
+    }
+
+    FUNC_ENTRY;
+    struct iovec frames[Q_BATCH_FRAMES];
+    for(size_t index = 0; index < batch->frameCount; ++index){
+        frames[index].iov_base = batch->buf + batch->frameOffset[index];
+        frames[index].iov_len = batch->frameLength[index];
+    }
+
+    //sendmmsg can send fewer messages than it was given, so keep going until all of them are out.
+    size_t sent = 0;
+    while(sent < batch->frameCount){
+        int count = transport_sessionSendBatch(transport, frames + sent, (unsigned int)(batch->frameCount - sent));
+        if(count <= 0){
+            returnCode = Q_ERR_Socket;
+            break;
+        }
+        sent += (size_t)count;
+    }
+
+    batch->used = 0;
+    batch->frameCount = 0;
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End sendBatchFlush
+
+/**
+ * Makes room in the batch for a message so it can be serialized straight into the batch.
+ * The batch is sent first if the message would not fit. sendBatchCommit must be called once the message is written.
+ * @param batch The batch the message will be added to.
+ * @param transport The transport session used if the batch has to be sent to make room.
+ * @param length The largest number of bytes the message can take up.
+ * @return A pointer to where the message should be written, or NULL if the message is too large for a batch
+ * or the batch could not be sent.
+ */
+unsigned char *sendBatchReserve(SendBatch_t *batch, Transport_t *transport, size_t length)
+{
+    if(length > Q_BATCH_BYTES){
+        return NULL;
+    }
+    if(batch->frameCount == Q_BATCH_FRAMES || batch->used + length > Q_BATCH_BYTES){
+        if(sendBatchFlush(batch, transport) != Q_NO_ERR){
+            return NULL;
+        }
+    }
+    return batch->buf + batch->used;
+}//End sendBatchReserve
+
+/**
+ * Adds the message written after a call to sendBatchReserve to the batch.
+ * @param batch The batch the message was written into.
+ * @param length The actual length of the message, no more than was reserved.
+ * @return void
+ */
+void sendBatchCommit(SendBatch_t *batch, size_t length)
+{
+    batch->frameOffset[batch->frameCount] = (uint16_t)batch->used;
+    batch->frameLength[batch->frameCount] = (uint16_t)length;
+    if(batch->stats != NULL){
+        statsSent(batch->stats, statsFrameType(batch->buf + batch->used, length));
+    }
+    batch->frameCount += 1;
+    batch->used += length;
+}//End sendBatchCommit
+
+/**
+ * Copies a serialized message into the batch.
+ * @param batch The batch the message is added to.
+ * @param transport The transport session used if the batch has to be sent to make room.
+ * @param frame The serialized message.
+ * @param length The length of the message in bytes.
+ * @return An int: Q_NO_ERR indicates the message was added (or sent, if it is too large for a batch).
+ * Otherwise, Q_ERR_Socket indicates an error.
+ */
+int sendBatchQueue(SendBatch_t *batch, Transport_t *transport, const unsigned char *frame, size_t length)
+{
+    unsigned char *slot = sendBatchReserve(batch, transport, length);
+    if(slot == NULL){
+        return sendBatchDirect(batch, transport, (unsigned char *)frame, length);
+    }
+    memcpy(slot, frame, length);
+    sendBatchCommit(batch, length);
+    return Q_NO_ERR;
+}//End sendBatchQueue
+
+/**
+ * Sends a message right away. Any messages waiting in the batch are sent first so the order is kept.
+ * @param batch The client's batch.
+ * @param transport The transport session the message is sent on.
+ * @param frame The serialized message.
+ * @param length The length of the message in bytes.
+ * @return An int: Q_NO_ERR indicates the message was sent. Otherwise, Q_ERR_Socket indicates an error.
+ */
+int sendBatchDirect(SendBatch_t *batch, Transport_t *transport, unsigned char *frame, size_t length)
+{
+    if(sendBatchFlush(batch, transport) != Q_NO_ERR){
+        return Q_ERR_Socket;
+    }
+    if(transport_sessionSend(transport, frame, length) != 0){
+        return Q_ERR_Socket;
+    }
+    if(batch->stats != NULL){
+        statsSent(batch->stats, statsFrameType(frame, length));
+    }
+    return Q_NO_ERR;
+}//End sendBatchDirect
@@ -0,0 +1,46 @@
+/**
+ * Header file for SendBatch.c
+ * Defines the buffer a client collects small outgoing messages in, so they can be handed to the socket
+ * together with one system call instead of one call per message.
+ */
+
+#ifndef Q_SENDBATCH_H
+#define Q_SENDBATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "transport.h"
+#include "Stats.h"
+
+//The most messages that can wait in a batch before it is sent.
+#define Q_BATCH_FRAMES TRANSPORT_BATCH_MAX
+//The number of bytes the messages waiting in a batch can take up in total. The messages batched are acknowledgements
+//of a few bytes and small QoS level 0 Publish messages, so this holds a full batch of messages up to 64 bytes long; a
+//batch of longer ones is just sent sooner. Every client has a batch of its own, so this is most of the roughly 4.4 KB a
+//SendBatch_t adds to each Client_t.
+#define Q_BATCH_BYTES 4096
+_Static_assert(Q_BATCH_BYTES <= UINT16_MAX, "The position and length of a batched message are kept in 16 bits");
+
+//Messages waiting to be sent. They are stored one after another in buf, with the position
+//and length of each kept separately so the batch can be moved or copied safely.
+typedef struct {
+    unsigned char buf[Q_BATCH_BYTES];
+    //Number of bytes of buf in use.
+    size_t used;
+    //Number of messages waiting.
+    size_t frameCount;
+    uint16_t frameOffset[Q_BATCH_FRAMES];
+    uint16_t frameLength[Q_BATCH_FRAMES];
+    //Every message added to the batch or sent right away is counted here. Can be NULL.
+    Stats_t *stats;
+} SendBatch_t;
+
+void sendBatchInit(SendBatch_t *batch, Stats_t *stats); //prototype
+int sendBatchFlush(SendBatch_t *batch, Transport_t *transport); //prototype
+unsigned char *sendBatchReserve(SendBatch_t *batch, Transport_t *transport, size_t length); //prototype
+void sendBatchCommit(SendBatch_t *batch, size_t length); //prototype
+int sendBatchQueue(SendBatch_t *batch, Transport_t *transport, const unsigned char *frame, size_t length); //prototype
+int sendBatchDirect(SendBatch_t *batch, Transport_t *transport, unsigned char *frame, size_t length); //prototype
+
+#endif
@@ -0,0 +1,1193 @@
+/**
+ * Contains the session engine, which runs a client's MQTT-SN state machine so an application does not need one of its own.
+ * The application connects, registers, subscribes, publishes, and sleeps through the session, and calls sessionPoll
+ * in a loop. Every message read from the Gateway is passed to the handler found in a table by the client's state and
+ * the message type, so a message costs one table lookup instead of a chain of comparisons. Messages that do not
+ * belong in the client's state have no handler and are dropped after readMsg has counted them.
+ * Register and Subscribe messages are sent one at a time, each one once the one before it has been answered, or all
+ * at once as a bulk request, whose answers are matched as they arrive and reported together once the last one is in.
+ * A session given a topic cache file keeps the topicIDs of its registered topic names in it, and after reconnecting
+ * without a clean session only registers the topic names the file does not have. A cached topicID the Gateway no longer
+ * knows is registered again, and the messages it rejected are sent again with the new topicID.
+ * Keep alive pings, retransmissions, and the sleep and wake cycle are all driven by the session's timers.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "Events.h"
+#include "ErrorCodes.h"
+#include "Util.h"
+#include "Connect.h"
+#include "WillTopic.h"
+#include "WillMsg.h"
+#include "Register.h"
+#include "RegAck.h"
+#include "Subscribe.h"
+#include "Publish.h"
+#include "PubAck.h"
+#include "PubRecRelComp.h"
+#include "PingReq.h"
+#include "PingResp.h"
+#include "Disconnect.h"
+#include "Retransmit.h"
+#include "WakeDrain.h"
+#include "TopicCache.h"
+#include "Bulk.h"
+#include "Session.h"
+#include "StackTrace.h"
+
+//Handles a message read in a given state. returnCode is the status code readMsg returned for the message.
+typedef void (*SessionHandler_t)(Session_t *session, int returnCode);
+
+static void onConnack(Session_t *session, int returnCode); //prototype
+static void onWillTopicReq(Session_t *session, int returnCode); //prototype
+static void onWillMsgReq(Session_t *session, int returnCode); //prototype
+static void onPublish(Session_t *session, int returnCode); //prototype
+static void onPubAck(Session_t *session, int returnCode); //prototype
+static void onPubRec(Session_t *session, int returnCode); //prototype
+static void onPubRel(Session_t *session, int returnCode); //prototype
+static void onPubComp(Session_t *session, int returnCode); //prototype
+static void onRegister(Session_t *session, int returnCode); //prototype
+static void onRegAck(Session_t *session, int returnCode); //prototype
+static void onSubAck(Session_t *session, int returnCode); //prototype
+static void onPingReq(Session_t *session, int returnCode); //prototype
+static void onPingResp(Session_t *session, int returnCode); //prototype
+static void onDisconnect(Session_t *session, int returnCode); //prototype
+
+//The messages a connected client handles whatever else it is waiting for. RegAck and SubAck messages can answer a
+//bulk request in any of these states.
+#define Q_SESSION_TRAFFIC \
+    [MQTTSN_PUBLISH] = onPublish, [MQTTSN_PUBACK] = onPubAck, [MQTTSN_PUBREC] = onPubRec, \
+    [MQTTSN_PUBREL] = onPubRel, [MQTTSN_PUBCOMP] = onPubComp, [MQTTSN_REGISTER] = onRegister, \
+    [MQTTSN_PINGREQ] = onPingReq, [MQTTSN_PINGRESP] = onPingResp, [MQTTSN_DISCONNECT] = onDisconnect, \
+    [MQTTSN_REGACK] = onRegAck, [MQTTSN_SUBACK] = onSubAck
+
+//One row per state and one column per message type. A sleeping client reads its messages through wakeRead,
+//and a disconnected client reads none, so their rows are empty.
+static const SessionHandler_t transitions[Q_EVENT_COUNT][Q_STATS_MSG_TYPES] = {
+    [Q_CONNECTING] = { [MQTTSN_CONNACK] = onConnack, [MQTTSN_WILLTOPICREQ] = onWillTopicReq,
+        [MQTTSN_DISCONNECT] = onDisconnect },
+    [Q_WILL_TOP_REQ] = { [MQTTSN_WILLMSGREQ] = onWillMsgReq, [MQTTSN_DISCONNECT] = onDisconnect },
+    [Q_WILL_MSG_REQ] = { [MQTTSN_CONNACK] = onConnack, [MQTTSN_DISCONNECT] = onDisconnect },
+    [Q_CONNECTED] = { Q_SESSION_TRAFFIC },
+    [Q_REGISTERING] = { Q_SESSION_TRAFFIC },
+    [Q_SUBSCRIBING] = { Q_SESSION_TRAFFIC },
+    [Q_DISCONNECTING] = { Q_SESSION_TRAFFIC },
+};
+
+/**
+ * Passes an event to the application, if it asked to be told about them.
+ * @param session The session the event happened in.
+ * @param code The status code of the event.
+ * @return void
+ */
+static void sessionNotify(Session_t *session, int code)
+{
+    TRACE_CODE(code);
+    if(session->notify != NULL){
+        session->notify(session, code, session->notifyContext);
+    }
+}//End sessionNotify
+
+/**
+ * @param session The session to be checked.
+ * @return true if the client is connected and can send and receive Publish messages.
+ */
+static bool sessionConnected(const Session_t *session)
+{
+    enum Q_MQTTSN_EVENT state = session->event.eventID;
+    return state == Q_CONNECTED || state == Q_REGISTERING || state == Q_SUBSCRIBING;
+}//End sessionConnected
+
+/**
+ * Moves the session into a state. States that wait for an answer that is never sent again start the state timer.
+ * @param session The session.
+ * @param state The state to move into.
+ * @return void
+ */
+static void sessionEnter(Session_t *session, enum Q_MQTTSN_EVENT state)
+{
+    session->event.eventID = state;
+    if(state == Q_WILL_TOP_REQ || state == Q_WILL_MSG_REQ || state == Q_DISCONNECTING){
+        timerStart(&session->loop, Q_TIMER_STATE, rttTimeoutMs(&session->event.client->rtt, 2));
+    } else {
+        timerStop(&session->loop, Q_TIMER_STATE);
+    }
+}//End sessionEnter
+
+/**
+ * Saves the topicIDs of the client's registered topic names, if the session keeps them and any were registered since
+ * they were last saved.
+ * @param session The session.
+ * @return void
+ */
+static void sessionSaveTopics(Session_t *session)
+{
+    if(session->topicCache == NULL || !session->topicsChanged){
+        return;
+    }
+    int returnCode = topicCacheSave(&session->event.client->topics, session->topicCache, session->topicCacheKey);
+    if(returnCode != Q_NO_ERR){
+        sessionNotify(session, returnCode);
+    }
+    session->topicsChanged = false;
+}//End sessionSaveTopics
+
+/**
+ * Ends the session: sends anything still batched, closes the client's socket, and stops every timer.
+ * @param session The session to be ended.
+ * @param status Why the session ended, Q_NO_ERR for a disconnect the application asked for.
+ * @return void
+ */
+static void sessionEnd(Session_t *session, int status)
+{
+    Client_t *clientPtr = session->event.client;
+
+    sessionSaveTopics(session);
+    sendBatchFlush(&clientPtr->batch, &clientPtr->transport);
+    transport_sessionClose(&clientPtr->transport);
+    //A bulk request that was not finished has to be made again after reconnecting.
+    bulkFree(&clientPtr->bulk);
+    session->bulkActive = false;
+    session->waking = false;
+    eventLoopInit(&session->loop);
+    session->status = status;
+    session->event.eventID = Q_DISCONNECTED;
+    //The Gateway never answered or stopped answering, so the next start searches for one.
+    if(session->gatewayCache != NULL && (status == Q_ERR_RetryLimit || status == Q_ERR_NoPingResp)){
+        discoveryForget(session->gatewayCache);
+    }
+    //Keep what led up to an error, if tracing is on and a dump path is set.
+    if(status != Q_NO_ERR && status != Q_DisconRead){
+        Trace_dump();
+    }
+}//End sessionEnd
+
+/**
+ * Reports a message the client could not send in answer to one from the Gateway. It will be answered again when the
+ * Gateway sends its message again.
+ * @param session The session.
+ * @param returnCode The status code of sending the answer.
+ * @return void
+ */
+static void sessionCheck(Session_t *session, int returnCode)
+{
+    if(returnCode != Q_NO_ERR){
+        sessionNotify(session, returnCode);
+    }
+}//End sessionCheck
+
+/**
+ * Reports the bulk request as done once every one of its messages has been answered or given up on, and saves the
+ * topicIDs it registered.
+ * @param session The session.
+ * @return void
+ */
+static void sessionBulkCheck(Session_t *session)
+{
+    if(!session->bulkActive || !session->bulkSent || session->event.client->bulk.waiting > 0){
+        return;
+    }
+    session->bulkActive = false;
+    sessionNotify(session, Q_BulkDone);
+    sessionSaveTopics(session);
+}//End sessionBulkCheck
+
+/**
+ * Sends every message of the bulk request back to back, with consecutive msgIDs so their answers are matched by a
+ * subtraction. A topic name that already has a topicID is answered straight away, and a message that cannot be sent
+ * is recorded as answered with the error.
+ * @param session The session.
+ * @return void
+ */
+static void sessionBulkSend(Session_t *session)
+{
+    Client_Event_t *event = &session->event;
+    Client_t *clientPtr = event->client;
+    Bulk_t *bulk = &clientPtr->bulk;
+
+    //The msgIDs must not wrap around to 0 part way through.
+    uint16_t firstMsgID = event->send_msgID;
+    if((uint32_t)firstMsgID + bulk->count > UINT16_MAX){
+        firstMsgID = 1;
+    }
+    bulk->firstMsgID = firstMsgID;
+    event->send_msgID = (uint16_t)(firstMsgID + bulk->count);
+    session->bulkSent = true;
+
+    for(size_t index = 0; index < bulk->count; ++index){
+        BulkOp_t *op = &bulk->ops[index];
+        uint16_t msgID = bulkMsgID(bulk, op);
+        int returnCode = Q_ERR_Unknown;
+        if(op->msgType == MQTTSN_REGISTER){
+            uint16_t known = session->cleanSession ? 0 : topicLookupID(&clientPtr->topics, op->topicName, Q_TOPIC_PUB);
+            if(known != 0){
+                op->topicID = known;
+                bulkAnswered(bulk, op, Q_RegAckRead);
+                continue;
+            }
+            MQTTSNString topicName;
+            MQTTSNStrCreate(&topicName, (char *)op->topicName);
+            returnCode = regQueue(clientPtr, msgID, &topicName);
+        } else {
+            MQTTSN_topicid topic;
+            topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+            topic.data.long_.name = (char *)op->topicName;
+            topic.data.long_.len = strlen(op->topicName);
+            MQTTSNFlags flags;
+            flags.all = 0;
+            flags.bits.QoS = (op->qos == 2) ? 0b10 : (op->qos == 1) ? 0b01 : 0b00;
+            returnCode = subscribeQueue(clientPtr, &topic, flags, msgID);
+        }
+        if(returnCode != Q_NO_ERR){
+            bulkAnswered(bulk, op, returnCode);
+            continue;
+        }
+        retransmitBulkStart(clientPtr, op);
+    }
+    sessionCheck(session, sendBatchFlush(&clientPtr->batch, &clientPtr->transport));
+    sessionBulkCheck(session);
+}//End sessionBulkSend
+
+/**
+ * Sends the next waiting Register or Subscribe message, if the client is connected and not waiting on an answer to one.
+ * A message that cannot be sent is reported and the one after it is tried. A topic name that already has a topicID,
+ * for example one read from the topic cache file, is reported as registered without sending anything.
+ * Once nothing is left to send, the topicIDs registered along the way are saved.
+ * @param session The session.
+ * @return void
+ */
+static void sessionNextOp(Session_t *session)
+{
+    Client_Event_t *event = &session->event;
+
+    //A bulk request goes out as soon as nothing sent on its own is waiting on an answer.
+    if(session->bulkActive && !session->bulkSent && event->eventID == Q_CONNECTED){
+        sessionBulkSend(session);
+    }
+
+    while(session->pendingCount > 0 && event->eventID == Q_CONNECTED){
+        SessionOp_t *op = &session->pending[session->pendingHead];
+        session->pendingHead = (session->pendingHead + 1) % Q_SESSION_PENDING;
+        session->pendingCount -= 1;
+
+        int returnCode = Q_ERR_Unknown;
+        enum Q_MQTTSN_EVENT next = Q_CONNECTED;
+        //Remembered so the topicID in the RegAck or SubAck can be stored with its name.
+        event->topicName = op->topicName;
+        if(op->msgType == MQTTSN_REGISTER){
+            //The Gateway kept the client's registrations unless it connected with a clean session.
+            uint16_t known = session->cleanSession ? 0 : topicLookupID(&event->client->topics, op->topicName, Q_TOPIC_PUB);
+            if(known != 0){
+                event->topicID = known;
+                sessionNotify(session, Q_RegAckRead);
+                continue;
+            }
+            session->replacesID = op->replacesID;
+            MQTTSNString topicName;
+            MQTTSNStrCreate(&topicName, (char *)op->topicName);
+            returnCode = reg(event->client, event->send_msgID, &topicName);
+            next = Q_REGISTERING;
+        } else {
+            MQTTSN_topicid topic;
+            topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+            topic.data.long_.name = (char *)op->topicName;
+            topic.data.long_.len = strlen(op->topicName);
+            MQTTSNFlags flags;
+            flags.all = 0;
+            flags.bits.QoS = (op->qos == 2) ? 0b10 : (op->qos == 1) ? 0b01 : 0b00;
+            event->qos = op->qos;
+            event->handler = op->handler;
+            event->handlerContext = op->context;
+            returnCode = subscribe(event->client, &topic, flags, event->send_msgID);
+            next = Q_SUBSCRIBING;
+        }
+
+        if(returnCode != Q_NO_ERR){
+            sessionNotify(session, returnCode);
+            continue;
+        }
+        sessionEnter(session, next);
+    }
+    if(session->pendingCount == 0 && event->eventID == Q_CONNECTED){
+        sessionSaveTopics(session);
+    }
+}//End sessionNextOp
+
+/**
+ * Adds a Register or Subscribe message to the session's queue and sends it if nothing is ahead of it.
+ * @param session The session.
+ * @param op The message to be sent.
+ * @return An int: Q_NO_ERR indicates the message was sent or will be sent. Otherwise, Q_ERR_QueueFull indicates
+ * Q_SESSION_PENDING messages are already waiting, and Q_ERR_NotConnected indicates the session is disconnecting,
+ * asleep, or over.
+ */
+static int sessionQueueOp(Session_t *session, const SessionOp_t *op)
+{
+    enum Q_MQTTSN_EVENT state = session->event.eventID;
+
+    if(state == Q_DISCONNECTING || state == Q_SLEEP || state == Q_DISCONNECTED){
+        return Q_ERR_NotConnected;
+    }
+    if(session->pendingCount == Q_SESSION_PENDING){
+        return Q_ERR_QueueFull;
+    }
+    session->pending[(session->pendingHead + session->pendingCount) % Q_SESSION_PENDING] = *op;
+    session->pendingCount += 1;
+    sessionNextOp(session);
+    return Q_NO_ERR;
+}//End sessionQueueOp
+
+/**
+ * Handles the Connack that answers the session's Connect, or the last of its will messages. An accepted Connack
+ * starts the keep alive timer and sends the first queued Register or Subscribe message, anything else ends the
+ * session.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the Connack, Q_ConnackRead if it was accepted.
+ * @return void
+ */
+static void onConnack(Session_t *session, int returnCode)
+{
+    if(returnCode != Q_ConnackRead){
+        sessionNotify(session, returnCode);
+        sessionEnd(session, returnCode);
+        return;
+    }
+    sessionEnter(session, Q_CONNECTED);
+    session->pingAttempts = 0;
+    timerStart(&session->loop, Q_TIMER_PING, session->pingMs);
+    if(session->gatewayCache != NULL){
+        discoverySave(session->gatewayCache, session->gateway);
+    }
+    sessionNotify(session, Q_ConnackRead);
+    sessionNextOp(session);
+}//End onConnack
+
+/**
+ * Answers the Gateway's WillTopicReq with the session's will topic, or an empty one if it has none.
+ * The session ends if it cannot be sent.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the WillTopicReq. Not used.
+ * @return void
+ */
+static void onWillTopicReq(Session_t *session, int returnCode)
+{
+    (void)returnCode;
+    MQTTSNString topic;
+    MQTTSNFlags flags;
+    flags.all = 0;
+    //A Gateway that asks for a will from a client that has none is given an empty one.
+    MQTTSNStrCreate(&topic, (char *)session->willTopic);
+    int sendCode = willTopic(session->event.client, flags, topic);
+    if(sendCode != Q_NO_ERR){
+        sessionNotify(session, sendCode);
+        sessionEnd(session, sendCode);
+        return;
+    }
+    sessionEnter(session, Q_WILL_TOP_REQ);
+}//End onWillTopicReq
+
+/**
+ * Answers the Gateway's WillMsgReq with the session's will message. The session ends if it cannot be sent.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the WillMsgReq. Not used.
+ * @return void
+ */
+static void onWillMsgReq(Session_t *session, int returnCode)
+{
+    (void)returnCode;
+    MQTTSNString message;
+    MQTTSNStrCreate(&message, (char *)session->willMsg);
+    int sendCode = willMsg(session->event.client, &message);
+    if(sendCode != Q_NO_ERR){
+        sessionNotify(session, sendCode);
+        sessionEnd(session, sendCode);
+        return;
+    }
+    sessionEnter(session, Q_WILL_MSG_REQ);
+}//End onWillMsgReq
+
+/**
+ * Acknowledges a Publish message from the Gateway: a PubAck for QoS level 1, a PubRec for QoS level 2, or a
+ * rejecting PubAck if the topicID is not known. QoS level 0 messages need nothing more.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the Publish message, for example Q_pubQos1.
+ * @return void
+ */
+static void onPublish(Session_t *session, int returnCode)
+{
+    Client_Event_t *event = &session->event;
+
+    //readMsg has already passed the message to its handler, only the acknowledgement is left.
+    switch(returnCode){
+        case Q_pubQos1:
+            sessionCheck(session, pubAck(event->client, event->topicID, event->msgID, MQTTSN_RC_ACCEPTED));
+            break;
+
+        case Q_pubQos2:
+            sessionCheck(session, pubRecRelComp(event->client, event->msgID, MQTTSN_PUBREC));
+            break;
+
+        case Q_ERR_WrongTopicID:
+            sessionCheck(session, pubAck(event->client, event->topicID, event->msgID, MQTTSN_RC_REJECTED_INVALID_TOPIC_ID));
+            break;
+
+        default:
+            break;
+    }
+}//End onPublish
+
+/**
+ * Registers a topic name again after the Gateway rejected its topicID, usually because the topicID came from the topic
+ * cache file and the Gateway has since forgotten it. The topic name cannot be published to until the RegAck arrives.
+ * @param session The session.
+ * @param topicID The topicID the Gateway rejected.
+ * @return void
+ */
+static void sessionReregister(Session_t *session, uint16_t topicID)
+{
+    Topic_t *topic = topicFind(&session->event.client->topics, topicID);
+    //Already being registered again, or not a topic the client registered.
+    if(topic == NULL || !(topic->flags & Q_TOPIC_PUB) || topic->name == NULL){
+        return;
+    }
+    topic->flags = (uint8_t)(topic->flags & ~Q_TOPIC_PUB);
+    session->topicsChanged = true;
+
+    SessionOp_t op;
+    op.msgType = MQTTSN_REGISTER;
+    op.qos = 0;
+    //The table keeps the name until the RegAck has replaced the topicID.
+    op.topicName = topic->name;
+    op.handler = NULL;
+    op.context = NULL;
+    op.replacesID = topicID;
+    int returnCode = sessionQueueOp(session, &op);
+    if(returnCode != Q_NO_ERR){
+        sessionNotify(session, returnCode);
+    }
+}//End sessionReregister
+
+/**
+ * Reports a PubAck to the application. A PubAck that rejects the topicID has the topic name registered again.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PubAck, for example Q_PubAckRead or Q_ERR_TopicRejected.
+ * @return void
+ */
+static void onPubAck(Session_t *session, int returnCode)
+{
+    sessionNotify(session, returnCode);
+    if(returnCode == Q_ERR_TopicRejected){
+        sessionReregister(session, session->event.topicID);
+    }
+}//End onPubAck
+
+/**
+ * Answers a PubRec with a PubRel, or reports the PubRec to the application if it did not match a message in flight.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PubRec, Q_PubRecRead if it matched.
+ * @return void
+ */
+static void onPubRec(Session_t *session, int returnCode)
+{
+    if(returnCode != Q_PubRecRead){
+        sessionNotify(session, returnCode);
+        return;
+    }
+    sessionCheck(session, pubRecRelComp(session->event.client, session->event.msgID, MQTTSN_PUBREL));
+}//End onPubRec
+
+/**
+ * Answers a PubRel from the Gateway with a PubComp if it releases a QoS level 2 message the client received.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PubRel, Q_PubRelRead if it matched.
+ * @return void
+ */
+static void onPubRel(Session_t *session, int returnCode)
+{
+    if(returnCode == Q_PubRelRead){
+        sessionCheck(session, pubRecRelComp(session->event.client, session->event.msgID, MQTTSN_PUBCOMP));
+    }
+}//End onPubRel
+
+/**
+ * Reports a PubComp, the end of a QoS level 2 Publish, to the application.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PubComp.
+ * @return void
+ */
+static void onPubComp(Session_t *session, int returnCode)
+{
+    sessionNotify(session, returnCode);
+}//End onPubComp
+
+/**
+ * Answers a Register message from the Gateway with a RegAck, accepting the topicID if the client subscribed to the
+ * topic name and rejecting it otherwise.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the Register message, for example Q_Subscribed or Q_RejectReg.
+ * @return void
+ */
+static void onRegister(Session_t *session, int returnCode)
+{
+    Client_Event_t *event = &session->event;
+
+    if(returnCode == Q_Subscribed || returnCode == Q_Wildcard){
+        sessionCheck(session, regAck(event->client, event->topicID, event->msgID, MQTTSN_RC_ACCEPTED));
+    } else if(returnCode == Q_RejectReg){
+        sessionCheck(session, regAck(event->client, event->topicID, event->msgID, MQTTSN_RC_REJECTED_INVALID_TOPIC_ID));
+    }
+}//End onRegister
+
+/**
+ * Handles a RegAck, either for a Register message of the bulk request or for the one the session is waiting for.
+ * An accepted RegAck that replaces a rejected topicID moves the messages published to it over to the new one. The
+ * session goes back to Q_CONNECTED and sends its next queued message.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the RegAck, Q_RegAckRead if it was accepted.
+ * @return void
+ */
+static void onRegAck(Session_t *session, int returnCode)
+{
+    //An answer to a Register message of the bulk request, reported with the rest of them.
+    if(bulkFind(&session->event.client->bulk, MQTTSN_REGISTER, session->event.msgID) != NULL){
+        if(returnCode == Q_RegAckRead){
+            session->topicsChanged = true;
+        }
+        sessionBulkCheck(session);
+        return;
+    }
+    //A RegAck for an earlier Register message that was sent again, or one the session is not waiting for.
+    if(returnCode == Q_ERR_MsgID || session->event.eventID != Q_REGISTERING){
+        return;
+    }
+    session->event.send_msgID = (uint16_t)(session->event.send_msgID + 1);
+    sessionEnter(session, Q_CONNECTED);
+    if(returnCode == Q_RegAckRead){
+        Client_t *clientPtr = session->event.client;
+        uint16_t newID = session->event.topicID;
+        session->topicsChanged = true;
+        //Messages the Gateway rejected go out again with the new topicID, and the old one is forgotten.
+        if(session->replacesID != 0 && session->replacesID != newID){
+            publishRetarget(clientPtr, session->replacesID, newID, timeNowMs());
+            Topic_t *old = topicFind(&clientPtr->topics, session->replacesID);
+            if(old != NULL && old->flags == 0){
+                topicRemove(&clientPtr->topics, session->replacesID);
+            }
+        }
+    }
+    session->replacesID = 0;
+    sessionNotify(session, returnCode);
+    sessionNextOp(session);
+}//End onRegAck
+
+/**
+ * Handles a SubAck, either for a Subscribe message of the bulk request or for the one the session is waiting for.
+ * The session goes back to Q_CONNECTED and sends its next queued message.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the SubAck, Q_SubAckRead if it was accepted.
+ * @return void
+ */
+static void onSubAck(Session_t *session, int returnCode)
+{
+    //An answer to a Subscribe message of the bulk request, reported with the rest of them.
+    if(bulkFind(&session->event.client->bulk, MQTTSN_SUBSCRIBE, session->event.msgID) != NULL){
+        sessionBulkCheck(session);
+        return;
+    }
+    //A SubAck for an earlier Subscribe message that was sent again, or one the session is not waiting for.
+    if(returnCode == Q_ERR_MsgID || session->event.eventID != Q_SUBSCRIBING){
+        return;
+    }
+    session->event.send_msgID = (uint16_t)(session->event.send_msgID + 1);
+    sessionEnter(session, Q_CONNECTED);
+    sessionNotify(session, returnCode);
+    sessionNextOp(session);
+}//End onSubAck
+
+/**
+ * Answers a PingReq from the Gateway with a PingResp.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PingReq. Not used.
+ * @return void
+ */
+static void onPingReq(Session_t *session, int returnCode)
+{
+    (void)returnCode;
+    sessionCheck(session, pingResp(session->event.client));
+}//End onPingReq
+
+/**
+ * Handles the PingResp to a keep alive PingReq: the Gateway is still there, so the keep alive timer starts again.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the PingResp.
+ * @return void
+ */
+static void onPingResp(Session_t *session, int returnCode)
+{
+    session->pingAttempts = 0;
+    timerStart(&session->loop, Q_TIMER_PING, session->pingMs);
+    sessionNotify(session, returnCode);
+}//End onPingResp
+
+/**
+ * Handles a Disconnect from the Gateway. If it answers the Disconnect of a client going to sleep, the session goes
+ * to sleep until it is time to wake; otherwise the session ends, without an error if the client asked to disconnect.
+ * @param session The session the message was read in.
+ * @param returnCode The status code readMsg returned for the Disconnect. Not used.
+ * @return void
+ */
+static void onDisconnect(Session_t *session, int returnCode)
+{
+    (void)returnCode;
+    //The Gateway answered the Disconnect message of a client going to sleep.
+    if(session->event.eventID == Q_DISCONNECTING && session->sleepSeconds > 0){
+        sessionEnter(session, Q_SLEEP);
+        timerStop(&session->loop, Q_TIMER_PING);
+        timerStop(&session->loop, Q_TIMER_RETRY);
+        timerStart(&session->loop, Q_TIMER_SLEEP, session->wakeMs);
+        return;
+    }
+    sessionNotify(session, Q_DisconRead);
+    sessionEnd(session, (session->event.eventID == Q_DISCONNECTING) ? Q_NO_ERR : Q_DisconRead);
+}//End onDisconnect
+
+/**
+ * Reads a message from the Gateway and passes it to the handler for the session's state and the message's type.
+ * @param session The session.
+ * @return void
+ */
+static void sessionDispatch(Session_t *session)
+{
+    int returnCode = readMsg(&session->event);
+    //readMsg has already decoded the message type, even for a message it rejected.
+    int msgType = session->event.client->rxView.msgType;
+    if(msgType < 0 || msgType >= Q_STATS_MSG_TYPES){
+        return;
+    }
+    SessionHandler_t handler = transitions[session->event.eventID][msgType];
+    if(handler != NULL){
+        handler(session, returnCode);
+    }
+}//End sessionDispatch
+
+/**
+ * Acts on every timer of the session that has expired: sends unanswered messages again, gives up on a state whose
+ * answer never came, and sends a keep alive PingReq, ending the session if the Gateway stops answering them.
+ * @param session The session.
+ * @param now The current time in milliseconds, from timeNowMs.
+ * @return void
+ */
+static void sessionTimers(Session_t *session, uint64_t now)
+{
+    Client_t *clientPtr = session->event.client;
+    enum Q_MQTTSN_EVENT state = session->event.eventID;
+
+    //Whatever the state, messages the Gateway has not answered in time are sent again.
+    uint8_t waitingOn = clientPtr->request.msgType;
+    uint16_t givenUpID = 0;
+    int returnCode = Q_ERR_Unknown;
+    //Each message given up on is reported on its own, with its msgID in the session's event.
+    while((returnCode = retransmitDue(clientPtr, now, &givenUpID)) == Q_ERR_RetryLimit){
+        session->event.msgID = givenUpID;
+        sessionNotify(session, Q_ERR_RetryLimit);
+    }
+    if(returnCode != Q_NO_ERR){
+        sessionNotify(session, returnCode);
+    }
+    //The last unanswered messages of the bulk request may have been given up on.
+    sessionBulkCheck(session);
+    //The Connect, Register, or Subscribe message was given up on.
+    if(waitingOn != 0 && clientPtr->request.msgType == 0){
+        if(state == Q_CONNECTING){
+            sessionEnd(session, Q_ERR_RetryLimit);
+            return;
+        }
+        if(state == Q_REGISTERING || state == Q_SUBSCRIBING){
+            session->event.send_msgID = (uint16_t)(session->event.send_msgID + 1);
+            sessionEnter(session, Q_CONNECTED);
+            sessionNextOp(session);
+        }
+    }
+
+    if(timerExpired(&session->loop, Q_TIMER_STATE, now)){
+        if(state == Q_WILL_TOP_REQ){
+            returnCode = Q_ERR_WillMsgReq;
+        } else if(state == Q_WILL_MSG_REQ){
+            returnCode = Q_ERR_Connack;
+        } else {
+            returnCode = Q_ERR_Disconnect;
+        }
+        sessionNotify(session, returnCode);
+        sessionEnd(session, returnCode);
+        return;
+    }
+
+    if(sessionConnected(session) && timerExpired(&session->loop, Q_TIMER_PING, now)){
+        if(session->pingAttempts > Q_SESSION_PING_RETRIES){
+            //The Gateway is gone. Ending the session lets the application reconnect, or find another Gateway, while
+            //the offline queue keeps what it publishes in the meantime.
+            sessionNotify(session, Q_ERR_NoPingResp);
+            sessionEnd(session, Q_ERR_NoPingResp);
+            return;
+        }
+        if(session->pingAttempts > 0){
+            statsRetransmitted(&clientPtr->stats, MQTTSN_PINGREQ);
+        }
+        //An empty clientID, so the Gateway does not treat this as a sleeping client waking up.
+        MQTTSNString clientID;
+        MQTTSNStrCreate(&clientID, NULL);
+        sessionCheck(session, pingReq(clientPtr, &clientID));
+        timerStart(&session->loop, Q_TIMER_PING, rttTimeoutMs(&clientPtr->rtt, session->pingAttempts));
+        session->pingAttempts += 1;
+    }
+}//End sessionTimers
+
+/**
+ * Ends a sleeping client's wake and puts it back to sleep, or ends the session if the Gateway disconnected it.
+ * @param session The session of the waking client.
+ * @param returnCode How the wake ended, from wakeRead or wakeTimeout.
+ * @return void
+ */
+static void sessionWakeEnd(Session_t *session, int returnCode)
+{
+    Client_t *clientPtr = session->event.client;
+
+    session->waking = false;
+    if(returnCode == Q_DisconRead){
+        sessionNotify(session, Q_DisconRead);
+        sessionEnd(session, Q_DisconRead);
+        return;
+    }
+    //The acknowledgements of the last messages read go out before the client goes back to sleep.
+    if(returnCode == Q_PingRespRead && sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+        returnCode = Q_ERR_Socket;
+    }
+    //Go back to sleep, even if the Gateway did not answer this time.
+    sessionNotify(session, returnCode);
+    timerStart(&session->loop, Q_TIMER_SLEEP, session->wakeMs);
+}//End sessionWakeEnd
+
+/**
+ * Wakes a sleeping client once its sleep timer expires to collect the messages the Gateway buffered for it. Never
+ * blocks: the PingReq is sent and Q_TIMER_SLEEP set to when it has to be sent again, sessionRead handles the messages
+ * as they arrive, and each later call acts on the timer running out with nothing received.
+ * @param session The session of the sleeping client.
+ * @return void
+ */
+static void sessionWake(Session_t *session)
+{
+    Client_t *clientPtr = session->event.client;
+
+    if(!timerExpired(&session->loop, Q_TIMER_SLEEP, timeNowMs())){
+        return;
+    }
+    MQTTSNString clientID;
+    MQTTSNStrCreate(&clientID, clientPtr->clientID);
+    int returnCode = Q_NO_ERR;
+    if(!session->waking){
+        session->waking = true;
+        returnCode = wakeStart(clientPtr, &clientID, &session->wake);
+    } else {
+        returnCode = wakeTimeout(clientPtr, &clientID, &session->wake);
+    }
+    if(returnCode != Q_NO_ERR){
+        sessionWakeEnd(session, returnCode);
+        return;
+    }
+    timerStart(&session->loop, Q_TIMER_SLEEP, rttTimeoutMs(&clientPtr->rtt, session->wake.attempts));
+}//End sessionWake
+
+/**
+ * Reads and handles every message that has already arrived for a waking client, then sends the acknowledgements for
+ * them together and waits for more, or puts the client back to sleep once the wake is over.
+ * @param session The session of the waking client.
+ * @return void
+ */
+static void sessionWakeRead(Session_t *session)
+{
+    Client_t *clientPtr = session->event.client;
+    int returnCode = Q_NO_ERR;
+
+    do {
+        returnCode = wakeRead(&session->event, &session->wake);
+    } while(returnCode == Q_NO_ERR && clientPtr->transport.ring == NULL &&
+            socketWait(clientPtr->transport.sock, 0) == Q_MsgPending);
+    if(returnCode == Q_NO_ERR && sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+        returnCode = Q_ERR_Socket;
+    }
+    if(returnCode != Q_NO_ERR){
+        sessionWakeEnd(session, returnCode);
+        return;
+    }
+    //The wait for the Gateway's next message starts again from the last one.
+    timerStart(&session->loop, Q_TIMER_SLEEP, rttTimeoutMs(&clientPtr->rtt, session->wake.attempts));
+}//End sessionWakeRead
+
+/**
+ * Sets up a session for a client. The client's topic table, in flight table, and statistics must already be set up.
+ * @param session The session to be initialized.
+ * @param clientPtr The client the session runs.
+ * @param keepAlive The Keep Alive duration in seconds sent in the Connect message. A PingReq is sent 5 seconds
+ * before it runs out.
+ * @param notify Called for every event the application may want to act on. Can be NULL.
+ * @param context Passed to notify.
+ * @return void
+ */
+void sessionInit(Session_t *session, Client_t *clientPtr, uint16_t keepAlive, SessionNotify_t notify, void *context)
+{
+    memset(session, 0, sizeof(*session));
+    session->event.client = clientPtr;
+    session->event.eventID = Q_DISCONNECTED;
+    session->event.duration = keepAlive;
+    session->event.send_msgID = 1;
+    session->pingMs = (keepAlive > 5) ? (uint32_t)(keepAlive - 5) * 1000u : (uint32_t)keepAlive * 500u;
+    session->notify = notify;
+    session->notifyContext = context;
+    session->wakeFd = -1;
+    eventLoopInit(&session->loop);
+}//End sessionInit
+
+/**
+ * Keeps the topicIDs of the topic names the client registers in a file, so a client that connects without a clean
+ * session does not have to register them again. Must be called before sessionConnect.
+ * @param session The session.
+ * @param path The topic cache file, which must stay valid while the session runs. NULL stops the topicIDs being kept.
+ * @return void
+ */
+void sessionTopicCache(Session_t *session, const char *path)
+{
+    session->topicCache = path;
+}//End sessionTopicCache
+
+/**
+ * Remembers the Gateway the session connects to in a file, so the next start connects to it without searching (see
+ * discoveryFind). The file is written once the Connack arrives, and removed if the session ends because the Gateway
+ * stopped answering, so the next start searches again.
+ * @param session The session.
+ * @param path The cache file, which must stay valid while the session runs. NULL stops the Gateway being kept.
+ * @param gateway The Gateway the client connects to, which must stay valid while the session runs.
+ * @return void
+ */
+void sessionGatewayCache(Session_t *session, const char *path, const Gateway_t *gateway)
+{
+    session->gatewayCache = path;
+    session->gateway = gateway;
+}//End sessionGatewayCache
+
+/**
+ * Sends the Connect message. The session is connected once sessionPoll has read the Connack; if the Gateway
+ * asks for the will, willTopic and willMsg are sent. With a topic cache file and a clean session flag of 0, the
+ * cached topicIDs for this client and Gateway are added to the client's topic table; with a clean session they are
+ * forgotten, since the Gateway forgets them too, and the ones registered from then on are cached.
+ * @param session The session.
+ * @param willTopic The Will Topic, or NULL if the client has no will.
+ * @param willMsg The Will Message, or NULL if the client has no will.
+ * @param cleanSession The value of the clean session flag, either a 1 or 0.
+ * @return An int: Q_NO_ERR indicates the Connect message was sent. Otherwise, Q_ERR_SocketOpen, Q_ERR_Serial, and
+ * Q_ERR_Socket indicate an error.
+ */
+int sessionConnect(Session_t *session, const char *willTopic, const char *willMsg, uint8_t cleanSession)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    session->willTopic = willTopic;
+    session->willMsg = willMsg;
+    session->sleepSeconds = 0;
+    session->waking = false;
+    session->status = Q_NO_ERR;
+    session->cleanSession = cleanSession;
+    if(session->topicCache != NULL){
+        Client_t *clientPtr = session->event.client;
+        if(topicCacheKey(session->topicCacheKey, sizeof(session->topicCacheKey), clientPtr->clientID, clientPtr->host,
+                clientPtr->destinationPort) != Q_NO_ERR){
+            session->topicCache = NULL;
+        } else if(cleanSession){
+            topicCacheForget(session->topicCache);
+        } else {
+            //A missing file or one for another client or Gateway just means every topic name is registered.
+            topicCacheLoad(&clientPtr->topics, session->topicCache, session->topicCacheKey);
+        }
+    }
+    returnCode = clientConnect(session->event.client, session->event.duration, (willTopic != NULL) ? 1 : 0, cleanSession);
+    if(returnCode == Q_NO_ERR){
+        sessionEnter(session, Q_CONNECTING);
+    }
+
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End sessionConnect
+
+/**
+ * Registers a topic name for publishing. The RegAck is reported to notify as Q_RegAckRead, after which
+ * sessionPublish can publish to the topic.
+ * @param session The session.
+ * @param topicName The topic name, which must stay valid while the session runs.
+ * @return An int: Q_NO_ERR indicates the Register message was sent or will be sent once the messages ahead of it are
+ * answered. Otherwise, Q_ERR_QueueFull and Q_ERR_NotConnected indicate it could not be added.
+ */
+int sessionRegister(Session_t *session, const char *topicName)
+{
+    SessionOp_t op;
+    op.msgType = MQTTSN_REGISTER;
+    op.qos = 0;
+    op.topicName = topicName;
+    op.handler = NULL;
+    op.context = NULL;
+    op.replacesID = 0;
+    return sessionQueueOp(session, &op);
+}//End sessionRegister
+
+/**
+ * Subscribes to a topic name. The SubAck is reported to notify as Q_SubAckRead.
+ * @param session The session.
+ * @param topicName The topic name, which must stay valid while the session runs.
+ * @param qos The QoS level to subscribe with.
+ * @param handler Called for every Publish message received on the topic.
+ * @param context Passed to handler.
+ * @return An int: Q_NO_ERR indicates the Subscribe message was sent or will be sent once the messages ahead of it are
+ * answered. Otherwise, Q_ERR_QueueFull and Q_ERR_NotConnected indicate it could not be added.
+ */
+int sessionSubscribe(Session_t *session, const char *topicName, uint8_t qos, MessageHandler_t handler, void *context)
+{
+    SessionOp_t op;
+    op.msgType = MQTTSN_SUBSCRIBE;
+    op.qos = qos;
+    op.topicName = topicName;
+    op.handler = handler;
+    op.context = context;
+    op.replacesID = 0;
+    return sessionQueueOp(session, &op);
+}//End sessionSubscribe
+
+/**
+ * Registers and subscribes to many topics at once. Every Register and Subscribe message is sent back to back as soon as
+ * the client is connected and not waiting on an answer to a message sent with sessionRegister or sessionSubscribe,
+ * so connecting and getting ready to publish and receive takes about one round trip however many topics there are.
+ * The answers are matched as they arrive, and reported to notify once as Q_BulkDone when every message has been
+ * answered or given up on. Until the session ends or the next bulk request is made, how each message was answered
+ * can be read from the client's bulk request table (clientPtr->bulk.ops, in the same order as ops).
+ * @param session The session.
+ * @param ops The topic names to register (msgType MQTTSN_REGISTER) and subscribe to (msgType MQTTSN_SUBSCRIBE, with
+ * its qos, handler, and context). The topic names must stay valid while the session runs.
+ * @param count The number of topics, at most Q_BULK_MAX.
+ * @return An int: Q_NO_ERR indicates the messages were sent or will be sent once the client is connected. Otherwise,
+ * Q_ERR_NotConnected indicates the session is disconnecting, asleep, or over, Q_ERR_QueueFull that a bulk request is
+ * already waiting to be answered or count is too large, and Q_ERR_Unknown that the request could not be allocated.
+ */
+int sessionBulk(Session_t *session, const SessionOp_t *ops, size_t count)
+{
+    Client_t *clientPtr = session->event.client;
+    enum Q_MQTTSN_EVENT state = session->event.eventID;
+
+    if(state == Q_DISCONNECTING || state == Q_SLEEP || state == Q_DISCONNECTED){
+        return Q_ERR_NotConnected;
+    }
+    if(session->bulkActive){
+        return Q_ERR_QueueFull;
+    }
+    int returnCode = bulkStart(&clientPtr->bulk, count);
+    if(returnCode != Q_NO_ERR){
+        return returnCode;
+    }
+    for(size_t index = 0; index < count; ++index){
+        BulkOp_t *op = &clientPtr->bulk.ops[index];
+        op->msgType = ops[index].msgType;
+        op->qos = ops[index].qos;
+        op->topicName = ops[index].topicName;
+        op->handler = ops[index].handler;
+        op->context = ops[index].context;
+    }
+    session->bulkActive = true;
+    session->bulkSent = false;
+    sessionNextOp(session);
+    return Q_NO_ERR;
+}//End sessionBulk
+
+/**
+ * Publishes a message to a registered topic name. QoS level 1 and 2 messages go through the client's offline queue
+ * if it has one, which works even while the client is not connected. Acknowledgements are reported to notify as
+ * Q_PubAckRead or Q_PubCompRead.
+ * @param session The session.
+ * @param topicName The topic name, registered with sessionRegister.
+ * @param qos The QoS level of the message: 0, 1, or 2.
+ * @param data The payload of the message.
+ * @param dataLength The length of the payload in bytes.
+ * @return An int: Q_NO_ERR indicates the message was sent or queued. Otherwise, Q_ERR_NotRegistered indicates the
+ * topic has no topicID yet, Q_ERR_NotConnected that the client is not connected, Q_ERR_WindowFull or Q_ERR_QueueFull
+ * that there is no room for the message until more are acknowledged, and Q_ERR_Socket or Q_ERR_Serial an error.
+ */
+int sessionPublish(Session_t *session, const char *topicName, uint8_t qos, const unsigned char *data, size_t dataLength)
+{
+    Client_t *clientPtr = session->event.client;
+    MQTTSNFlags flags;
+    flags.all = 0;
+    flags.bits.QoS = (qos == 2) ? 0b10 : (qos == 1) ? 0b01 : 0b00;
+
+    uint16_t topicID = topicLookupID(&clientPtr->topics, topicName, Q_TOPIC_PUB);
+    if(topicID == 0){
+        return Q_ERR_NotRegistered;
+    }
+    if(qos > 0 && clientPtr->offline != NULL){
+        return publishOffline(clientPtr, &flags, topicID, data, dataLength);
+    }
+    if(!sessionConnected(session)){
+        return Q_ERR_NotConnected;
+    }
+
+    uint16_t msgID = 0;
+    if(qos > 0){
+        msgID = inFlightNextMsgID(&clientPtr->inFlight);
+        if(msgID == 0){
+            return Q_ERR_WindowFull;
+        }
+    }
+    return publishLen(clientPtr, &flags, topicID, msgID, data, dataLength);
+}//End sessionPublish
+
+/**
+ * Puts the client to sleep. Once the Gateway answers the Disconnect message, the client wakes up 5 seconds before
+ * the sleep duration runs out to collect its buffered messages, and then goes back to sleep, until sessionConnect
+ * is called again.
+ * @param session The session.
+ * @param seconds The sleep duration sent to the Gateway.
+ * @return An int: Q_NO_ERR indicates the Disconnect message was sent. Otherwise, Q_ERR_NotConnected indicates the client
+ * is not connected, and Q_ERR_Socket or Q_ERR_Serial indicate an error.
+ */
+int sessionSleep(Session_t *session, uint16_t seconds)
+{
+    if(!sessionConnected(session)){
+        return Q_ERR_NotConnected;
+    }
+    int returnCode = disconnect(session->event.client, seconds);
+    if(returnCode != Q_NO_ERR){
+        return returnCode;
+    }
+    session->sleepSeconds = seconds;
+    session->wakeMs = (seconds > 5) ? (uint32_t)(seconds - 5) * 1000u : (uint32_t)seconds * 500u;
+    sessionEnter(session, Q_DISCONNECTING);
+    return Q_NO_ERR;
+}//End sessionSleep
+
+/**
+ * Disconnects from the Gateway. sessionPoll returns Q_DisconRead once the Gateway has answered.
+ * @param session The session.
+ * @return An int: Q_NO_ERR indicates the Disconnect message was sent. Otherwise, Q_ERR_NotConnected indicates the
+ * session is already over, and Q_ERR_Socket or Q_ERR_Serial indicate an error.
+ */
+int sessionDisconnect(Session_t *session)
+{
+    if(session->event.eventID == Q_DISCONNECTED){
+        return Q_ERR_NotConnected;
+    }
+    int returnCode = disconnect(session->event.client, 0);
+    if(returnCode != Q_NO_ERR){
+        return returnCode;
+    }
+    session->sleepSeconds = 0;
+    sessionEnter(session, Q_DISCONNECTING);
+    return Q_NO_ERR;
+}//End sessionDisconnect
+
+/**
+ * Does everything sessionPoll does before it waits: wakes a sleeping client whose sleep timer has expired, acts on
+ * expired timers, sends queued Publish messages, and sends any batched messages. Used together with sessionRead by an
+ * executor that waits on many sessions at once; the session's next deadline is then eventLoopTimeout of session->loop.
+ * @param session The session.
+ * @return An int: Q_NO_ERR indicates the session is still running. Q_DisconRead indicates it is over, in which case
+ * session->status holds the reason.
+ */
+int sessionPrepare(Session_t *session)
+{
+    Client_t *clientPtr = session->event.client;
+
+    //Adds the time since the last poll to the state the client was in.
+    statsState(&clientPtr->stats, session->event.eventID);
+    if(session->event.eventID == Q_SLEEP){
+        sessionWake(session);
+        return (session->event.eventID == Q_DISCONNECTED) ? Q_DisconRead : Q_NO_ERR;
+    }
+    if(session->event.eventID == Q_DISCONNECTED){
+        return Q_DisconRead;
+    }
+
+    sessionTimers(session, timeNowMs());
+    if(session->event.eventID == Q_DISCONNECTED){
+        return Q_DisconRead;
+    }
+    //Send as many queued Publish messages as the in flight window allows.
+    if(clientPtr->offline != NULL && sessionConnected(session)){
+        sessionCheck(session, publishQueued(clientPtr));
+    }
+    //Wake up when the next unacknowledged message is due to be sent again.
+    int retryMs = retransmitTimeout(clientPtr, timeNowMs());
+    if(retryMs >= 0){
+        timerStart(&session->loop, Q_TIMER_RETRY, (uint32_t)retryMs);
+    } else {
+        timerStop(&session->loop, Q_TIMER_RETRY);
+    }
+
+    sendBatchFlush(&clientPtr->batch, &clientPtr->transport);
+    return Q_NO_ERR;
+}//End sessionPrepare
+
+/**
+ * Reads and handles every message that has already arrived on the client's socket, so a burst costs one wake up.
+ * Stops early if the client goes to sleep, leaving the rest for its next wake. A client whose socket is attached to a
+ * transport ring only handles the message the ring has put in its receive buffer, since the ring reads the socket.
+ * @param session The session.
+ * @return An int: Q_NO_ERR indicates the session is still running. Q_DisconRead indicates it is over, in which case
+ * session->status holds the reason.
+ */
+int sessionRead(Session_t *session)
+{
+    Client_t *clientPtr = session->event.client;
+
+    //A sleeping client only reads while it is awake collecting its buffered messages.
+    if(session->event.eventID == Q_SLEEP){
+        if(session->waking){
+            sessionWakeRead(session);
+        }
+        return (session->event.eventID == Q_DISCONNECTED) ? Q_DisconRead : Q_NO_ERR;
+    }
+    do {
+        sessionDispatch(session);
+    } while(session->event.eventID != Q_DISCONNECTED && session->event.eventID != Q_SLEEP &&
+            clientPtr->transport.ring == NULL && socketWait(clientPtr->transport.sock, 0) == Q_MsgPending);
+
+    return (session->event.eventID == Q_DISCONNECTED) ? Q_DisconRead : Q_NO_ERR;
+}//End sessionRead
+
+/**
+ * Runs the session until something has happened: acts on expired timers, sends any batched messages, then blocks
+ * until a message arrives, the next timer (including the application's Q_TIMER_PUBLISH) is due, or session->wakeFd
+ * becomes readable. Every message that has arrived is read and handled before returning, so a burst costs one wake up.
+ * A sleeping client blocks until its sleep timer expires, and is then polled like any other until it is back asleep.
+ * @param session The session.
+ * @return An int: Q_NO_ERR indicates the session is still running. Q_DisconRead indicates it is over, in which case
+ * session->status holds the reason.
+ */
+int sessionPoll(Session_t *session)
+{
+    Client_t *clientPtr = session->event.client;
+
+    //A sleeping client only wakes up for its sleep timer, nothing else can wake it.
+    if(session->event.eventID == Q_SLEEP && !session->waking &&
+            timerWait(&session->loop, Q_TIMER_SLEEP) != Q_TimerExpired){
+        return Q_NO_ERR;
+    }
+    int returnCode = sessionPrepare(session);
+    if(returnCode != Q_NO_ERR || (session->event.eventID == Q_SLEEP && !session->waking)){
+        return returnCode;
+    }
+    if(eventLoopWaitWake(&session->loop, clientPtr->transport.sock, session->wakeFd) != Q_MsgPending){
+        return Q_NO_ERR;
+    }
+    return sessionRead(session);
+}//End sessionPoll
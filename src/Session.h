@@ -0,0 +1,106 @@
+/**
+ * Header file for Session.c
+ * Defines the Session_t struct an application uses to run a client without writing its own state machine.
+ * Client_t.h, Events.h, and MQTTSNPacket.h must be included before this file.
+ */
+
+#ifndef Q_SESSION_H
+#define Q_SESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "EventLoop.h"
+#include "TopicCache.h"
+#include "Discovery.h"
+#include "WakeDrain.h"
+
+//The most Register and Subscribe messages that can wait for the one before them to be answered.
+#define Q_SESSION_PENDING 8
+//The number of PingReq messages sent again without a PingResp before the Gateway is taken to be gone and the session
+//ends with Q_ERR_NoPingResp.
+#define Q_SESSION_PING_RETRIES 3
+
+typedef struct Session Session_t;
+
+//Called when something the application may want to act on happens. code is the status code of the event, for
+//example Q_ConnackRead, Q_RegAckRead, Q_SubAckRead, Q_BulkDone, Q_PubAckRead, Q_PubCompRead, Q_PingRespRead, Q_DisconRead,
+//or an error code such as Q_ERR_RetryLimit. The msgID of the message the event is about, if it has one, is in
+//session->event.msgID; for Q_ERR_RetryLimit it is the message given up on.
+typedef void (*SessionNotify_t)(Session_t *session, int code, void *context);
+
+//A Register or Subscribe message waiting to be sent, or one of the messages given to sessionBulk.
+typedef struct {
+    //MQTTSN_REGISTER or MQTTSN_SUBSCRIBE.
+    uint8_t msgType;
+    uint8_t qos;
+    const char *topicName;
+    MessageHandler_t handler;
+    void *context;
+    //For a Register message sent because the Gateway rejected a topicID, the topicID it replaces. Otherwise 0.
+    uint16_t replacesID;
+} SessionOp_t;
+
+struct Session {
+    //The client, its current state (event.eventID), and the details of the message being answered.
+    Client_Event_t event;
+    //The keep alive ping, retry, sleep, and state timers. Q_TIMER_PUBLISH is left to the application.
+    EventLoop_t loop;
+    //How often a PingReq is sent while connected, and how long after going to sleep the client wakes up.
+    uint32_t pingMs;
+    uint32_t wakeMs;
+    //The number of PingReq messages sent since the last PingResp.
+    uint8_t pingAttempts;
+    //The sleep duration sent in the Disconnect message, or 0 for a disconnect that ends the session.
+    uint16_t sleepSeconds;
+    //True while a sleeping client is awake collecting its buffered messages, and how far it has got. Q_TIMER_SLEEP
+    //then holds how long to wait for the Gateway's next message.
+    bool waking;
+    WakeDrain_t wake;
+    //The Will Topic and Will Message sent when the Gateway asks for them. NULL if the client has no will.
+    const char *willTopic;
+    const char *willMsg;
+    //Register and Subscribe messages waiting to be sent, in order.
+    SessionOp_t pending[Q_SESSION_PENDING];
+    size_t pendingHead;
+    size_t pendingCount;
+    //The topicID the Register message being waited on replaces, or 0.
+    uint16_t replacesID;
+    //True from sessionBulk until Q_BulkDone is reported, and whether the messages of the bulk request have been sent.
+    bool bulkActive;
+    bool bulkSent;
+    //The file the topicIDs of registered topic names are kept in, or NULL if they are not kept.
+    const char *topicCache;
+    //The clientID and Gateway the topicIDs belong to, and whether any were registered since they were last saved.
+    char topicCacheKey[Q_TOPIC_CACHE_KEY];
+    bool topicsChanged;
+    //The file the Gateway is remembered in once the session connects, and the Gateway, or NULL if it is not kept.
+    const char *gatewayCache;
+    const Gateway_t *gateway;
+    //The clean session flag of the last Connect message.
+    uint8_t cleanSession;
+    //A descriptor that ends sessionPoll's wait when it becomes readable, so another thread can hand the session work.
+    //-1 if there is none.
+    int wakeFd;
+    //Why the session ended: Q_NO_ERR for a disconnect the application asked for, otherwise the error.
+    int status;
+    SessionNotify_t notify;
+    void *notifyContext;
+};
+
+void sessionInit(Session_t *session, Client_t *clientPtr, uint16_t keepAlive, SessionNotify_t notify, void *context); //prototype
+void sessionTopicCache(Session_t *session, const char *path); //prototype
+void sessionGatewayCache(Session_t *session, const char *path, const Gateway_t *gateway); //prototype
+int sessionConnect(Session_t *session, const char *willTopic, const char *willMsg, uint8_t cleanSession); //prototype
+int sessionRegister(Session_t *session, const char *topicName); //prototype
+int sessionSubscribe(Session_t *session, const char *topicName, uint8_t qos, MessageHandler_t handler, void *context); //prototype
+int sessionBulk(Session_t *session, const SessionOp_t *ops, size_t count); //prototype
+int sessionPublish(Session_t *session, const char *topicName, uint8_t qos, const unsigned char *data, size_t dataLength); //prototype
+int sessionSleep(Session_t *session, uint16_t seconds); //prototype
+int sessionDisconnect(Session_t *session); //prototype
+int sessionPoll(Session_t *session); //prototype
+int sessionPrepare(Session_t *session); //prototype
+int sessionRead(Session_t *session); //prototype
+
+#endif
@@ -0,0 +1,296 @@
+/**
+ * Contains the functions a client uses to keep statistics about itself.
+ * Every message sent, received, sent again, rejected by the Gateway, or that could not be deserialized is counted
+ * by its message type. The round trip of every Connect, Register, Subscribe, and QoS level 1 and 2 Publish message
+ * answered without being sent again is recorded in a log-linear histogram, and the time the client spends in each
+ * state is added up. Together they show whether a slow client is waiting on the Gateway, sending messages again,
+ * or busy with its own processing.
+ * Recording only adds to counters in the client, so it is cheap enough to leave on. statsSnapshot copies everything
+ * out at once so it can be read or reported without disturbing the client.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Stats.h"
+#include "Client_t.h"
+#include "Events.h"
+#include "ErrorCodes.h"
+#include "EventLoop.h"
+#include "MQTTSNPacket.h"
+
+_Static_assert(Q_STATS_STATES == Q_EVENT_COUNT, "Q_STATS_STATES must count the states of enum Q_MQTTSN_EVENT");
+
+//The names of the states, in the order of enum Q_MQTTSN_EVENT.
+static const char *stateNames[] = {
+    "CONNECTING", "CONNECTED", "WILL_TOP_REQ", "WILL_MSG_REQ",
+    "REGISTERING", "SLEEP", "SUBSCRIBING", "DISCONNECTING",
+    "DISCONNECTED", "WILL_TOP_UPD", "WILL_MSG_UPD", "UNSUBSCRIBE",
+    "CLIENT_PING", "SERVER_PING", "PUBLISH", "PUB_QOS2", "RCV_QOS1", "RCV_QOS2"
+};
+_Static_assert(sizeof(stateNames) / sizeof(stateNames[0]) == Q_EVENT_COUNT, "Every state needs a name");
+
+//The names of the round trips, in the order of enum Q_STATS_RTT.
+static const char *rttNames[Q_RTT_KINDS] = {
+    "Connack", "RegAck", "SubAck", "PubAck", "PubRec", "PubComp"
+};
+
+/**
+ * @param valueUs A latency in microseconds.
+ * @return The index of the histogram bucket the latency belongs in.
+ */
+static size_t bucketIndex(uint64_t valueUs)
+{
+    //Values below Q_HIST_SUB_COUNT each have a bucket of their own.
+    if(valueUs < Q_HIST_SUB_COUNT){
+        return (size_t)valueUs;
+    }
+    unsigned int topBit = 63u - (unsigned int)__builtin_clzll(valueUs);
+    if(topBit >= Q_HIST_MAX_BITS){
+        return Q_HIST_BUCKETS - 1;
+    }
+    //Keep the Q_HIST_SUB_BITS bits below the top bit to pick the bucket within this power of two.
+    unsigned int shift = topBit - Q_HIST_SUB_BITS;
+    return (size_t)(shift + 1) * Q_HIST_SUB_COUNT + (size_t)((valueUs >> shift) - Q_HIST_SUB_COUNT);
+}//End bucketIndex
+
+/**
+ * @param index The index of a histogram bucket.
+ * @return The largest latency in microseconds that belongs in the bucket.
+ */
+static uint64_t bucketUpper(size_t index)
+{
+    if(index < Q_HIST_SUB_COUNT){
+        return (uint64_t)index;
+    }
+    unsigned int shift = (unsigned int)(index / Q_HIST_SUB_COUNT) - 1;
+    uint64_t sub = (uint64_t)(index % Q_HIST_SUB_COUNT) + Q_HIST_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}//End bucketUpper
+
+/**
+ * Clears every counter and histogram. Must be called before the client connects.
+ * @param stats The statistics to be initialized.
+ * @return void
+ */
+void statsInit(Stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for(size_t kind = 0; kind < Q_RTT_KINDS; ++kind){
+        stats->rtt[kind].minUs = UINT64_MAX;
+    }
+    stats->state = -1;
+}//End statsInit
+
+/**
+ * @param frame A serialized message.
+ * @param length The length of the message.
+ * @return The message type, or -1 if the message is too short to have one.
+ */
+int statsFrameType(const unsigned char *frame, size_t length)
+{
+    //The length field is 1 byte, or 3 bytes starting with 0x01.
+    size_t typeOffset = (frame[0] == 0x01) ? 3 : 1;
+    return (length > typeOffset) ? frame[typeOffset] : -1;
+}//End statsFrameType
+
+/**
+ * Counts a message handed to the socket.
+ * @param stats The statistics of the client that sent the message.
+ * @param msgType The type of the message, for example MQTTSN_PUBLISH.
+ * @return void
+ */
+void statsSent(Stats_t *stats, int msgType)
+{
+    if(msgType >= 0 && msgType < Q_STATS_MSG_TYPES){
+        stats->sent[msgType] += 1;
+    }
+}//End statsSent
+
+/**
+ * Counts a message read from the Gateway, along with whether it was rejected or could not be deserialized.
+ * @param stats The statistics of the client that received the message.
+ * @param msgType The type of the message, or MQTTSNPACKET_READ_ERROR if it was not a valid message.
+ * @param returnCode The status code readMsg returns for the message.
+ * @return void
+ */
+void statsReceived(Stats_t *stats, int msgType, int returnCode)
+{
+    if(msgType == MQTTSNPACKET_READ_ERROR){
+        stats->readErrors += 1;
+        return;
+    }
+    if(msgType < 0 || msgType >= Q_STATS_MSG_TYPES){
+        stats->unknown += 1;
+        return;
+    }
+    stats->received[msgType] += 1;
+    if(returnCode == Q_ERR_Rejected || returnCode == Q_ERR_TopicRejected){
+        stats->rejected[msgType] += 1;
+    } else if(returnCode == Q_ERR_Deserial){
+        stats->deserialErrors[msgType] += 1;
+    }
+}//End statsReceived
+
+/**
+ * Counts a message sent again because the Gateway did not answer it in time.
+ * @param stats The statistics of the client that sent the message.
+ * @param msgType The type of the message, for example MQTTSN_PUBREL.
+ * @return void
+ */
+void statsRetransmitted(Stats_t *stats, int msgType)
+{
+    if(msgType >= 0 && msgType < Q_STATS_MSG_TYPES){
+        stats->retransmitted[msgType] += 1;
+    }
+}//End statsRetransmitted
+
+/**
+ * Records a measured round trip.
+ * @param stats The statistics of the client that measured the round trip.
+ * @param kind The message that completed the round trip.
+ * @param rttUs The round trip in microseconds.
+ * @return void
+ */
+void statsRtt(Stats_t *stats, enum Q_STATS_RTT kind, uint64_t rttUs)
+{
+    if(kind < Q_RTT_KINDS){
+        histogramRecord(&stats->rtt[kind], rttUs);
+    }
+}//End statsRtt
+
+/**
+ * Tells the statistics which state the client is in. Called once for every pass through the client's state machine;
+ * the time since the last call is added to the state the client was in, and a change of state is counted.
+ * @param stats The statistics of the client.
+ * @param state The state the client is in, a value of enum Q_MQTTSN_EVENT.
+ * @return void
+ */
+void statsState(Stats_t *stats, int state)
+{
+    if(state < 0 || state >= Q_STATS_STATES){
+        return;
+    }
+    uint64_t nowUs = timeNowUs();
+    if(stats->state >= 0){
+        stats->stateUs[stats->state] += nowUs - stats->stateSinceUs;
+    }
+    if(state != stats->state){
+        stats->stateEntries[state] += 1;
+        if(stats->state >= 0){
+            stats->transitions[stats->state][state] += 1;
+        }
+        stats->state = state;
+    }
+    stats->stateSinceUs = nowUs;
+}//End statsState
+
+/**
+ * Copies the statistics so they can be read or reported while the client carries on. The time spent so far in the
+ * state the client is in is included in the copy.
+ * @param stats The statistics of the client.
+ * @param snapshot Where the copy is written.
+ * @return void
+ */
+void statsSnapshot(const Stats_t *stats, Stats_t *snapshot)
+{
+    memcpy(snapshot, stats, sizeof(*snapshot));
+    if(snapshot->state >= 0){
+        uint64_t nowUs = timeNowUs();
+        snapshot->stateUs[snapshot->state] += nowUs - snapshot->stateSinceUs;
+        snapshot->stateSinceUs = nowUs;
+    }
+}//End statsSnapshot
+
+/**
+ * Adds a latency to a histogram.
+ * @param hist The histogram.
+ * @param valueUs The latency in microseconds.
+ * @return void
+ */
+void histogramRecord(Histogram_t *hist, uint64_t valueUs)
+{
+    hist->buckets[bucketIndex(valueUs)] += 1;
+    hist->count += 1;
+    hist->sumUs += valueUs;
+    if(valueUs < hist->minUs){
+        hist->minUs = valueUs;
+    }
+    if(valueUs > hist->maxUs){
+        hist->maxUs = valueUs;
+    }
+}//End histogramRecord
+
+/**
+ * @param hist The histogram.
+ * @param percentile The percentile to find, from 0 to 100, for example 99.9.
+ * @return The latency in microseconds that the given percentage of the recorded latencies are at or below, to within
+ * the width of a bucket. 0 if nothing has been recorded.
+ */
+uint64_t histogramPercentile(const Histogram_t *hist, double percentile)
+{
+    if(hist->count == 0){
+        return 0;
+    }
+    //The rank of the latency being looked for, at least the first one.
+    uint64_t rank = (uint64_t)((double)hist->count * percentile / 100.0 + 0.5);
+    if(rank == 0){
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for(size_t index = 0; index < Q_HIST_BUCKETS; ++index){
+        seen += hist->buckets[index];
+        if(seen >= rank){
+            uint64_t upper = bucketUpper(index);
+            return (upper < hist->maxUs) ? upper : hist->maxUs;
+        }
+    }
+    return hist->maxUs;
+}//End histogramPercentile
+
+/**
+ * Prints the statistics that have anything recorded in them. Meant to be given a snapshot.
+ * @param stats The statistics to be printed.
+ * @return void
+ */
+void statsPrint(const Stats_t *stats)
+{
+    puts("Messages:          sent  received  resent  rejected  deserial");
+    for(int msgType = 0; msgType < Q_STATS_MSG_TYPES; ++msgType){
+        if(stats->sent[msgType] == 0 && stats->received[msgType] == 0){
+            continue;
+        }
+        printf("  %-14s %7llu  %8llu  %6llu  %8llu  %8llu\n", MQTTSNPacket_name(msgType),
+            (unsigned long long)stats->sent[msgType], (unsigned long long)stats->received[msgType],
+            (unsigned long long)stats->retransmitted[msgType], (unsigned long long)stats->rejected[msgType],
+            (unsigned long long)stats->deserialErrors[msgType]);
+    }
+    if(stats->readErrors > 0 || stats->unknown > 0){
+        printf("  Read errors: %llu, unknown message types: %llu\n",
+            (unsigned long long)stats->readErrors, (unsigned long long)stats->unknown);
+    }
+
+    puts("Round trips (us):  count     min     p50     p99   p99.9     max");
+    for(int kind = 0; kind < Q_RTT_KINDS; ++kind){
+        const Histogram_t *hist = &stats->rtt[kind];
+        if(hist->count == 0){
+            continue;
+        }
+        printf("  %-14s %7llu %7llu %7llu %7llu %7llu %7llu\n", rttNames[kind], (unsigned long long)hist->count,
+            (unsigned long long)hist->minUs, (unsigned long long)histogramPercentile(hist, 50.0),
+            (unsigned long long)histogramPercentile(hist, 99.0), (unsigned long long)histogramPercentile(hist, 99.9),
+            (unsigned long long)hist->maxUs);
+    }
+
+    puts("States:          entered   time (ms)");
+    for(int state = 0; state < Q_STATS_STATES; ++state){
+        if(stats->stateEntries[state] == 0){
+            continue;
+        }
+        printf("  %-14s %7llu  %10.3f\n", stateNames[state], (unsigned long long)stats->stateEntries[state],
+            (double)stats->stateUs[state] / 1000.0);
+    }
+}//End statsPrint
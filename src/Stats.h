@@ -0,0 +1,76 @@
+/**
+ * Header file for Stats.c
+ * Defines the counters and latency histograms a client keeps about the messages it sends and receives, and the time
+ * it spends in each state.
+ */
+
+#ifndef Q_STATS_H
+#define Q_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//Message types run from 0x00 (Advertise) to 0x1D (WillMsgResp).
+#define Q_STATS_MSG_TYPES 30
+//The number of states in enum Q_MQTTSN_EVENT. Events.h needs Client_t, which includes this file, so the count is
+//repeated here and Stats.c checks it against Q_EVENT_COUNT.
+#define Q_STATS_STATES 18
+
+//Each power of two is split into 2^Q_HIST_SUB_BITS buckets, so a latency is recorded to within 1/8th of its value.
+#define Q_HIST_SUB_BITS 3
+#define Q_HIST_SUB_COUNT (1u << Q_HIST_SUB_BITS)
+//Latencies are recorded in microseconds up to 2^Q_HIST_MAX_BITS (about 12 days), longer ones go in the last bucket.
+#define Q_HIST_MAX_BITS 40
+#define Q_HIST_BUCKETS ((Q_HIST_MAX_BITS - Q_HIST_SUB_BITS + 1) * Q_HIST_SUB_COUNT)
+
+//The round trips a client measures, named after the message that completes them.
+enum Q_STATS_RTT {
+    Q_RTT_CONNACK, Q_RTT_REGACK, Q_RTT_SUBACK, Q_RTT_PUBACK, Q_RTT_PUBREC, Q_RTT_PUBCOMP, Q_RTT_KINDS
+};
+
+//A log-linear latency histogram, in the style of HdrHistogram.
+typedef struct {
+    uint64_t count;
+    uint64_t sumUs;
+    uint64_t minUs;
+    uint64_t maxUs;
+    uint32_t buckets[Q_HIST_BUCKETS];
+} Histogram_t;
+
+typedef struct {
+    //Indexed by message type. sent includes messages that were sent again.
+    uint64_t sent[Q_STATS_MSG_TYPES];
+    uint64_t received[Q_STATS_MSG_TYPES];
+    uint64_t retransmitted[Q_STATS_MSG_TYPES];
+    //Messages from the Gateway with a rejected return code, and those that could not be deserialized.
+    uint64_t rejected[Q_STATS_MSG_TYPES];
+    uint64_t deserialErrors[Q_STATS_MSG_TYPES];
+    //Datagrams that were not a valid message, and messages of a type the client does not know.
+    uint64_t readErrors;
+    uint64_t unknown;
+    //Round trips of messages that were answered without being sent again.
+    Histogram_t rtt[Q_RTT_KINDS];
+    //Indexed by state: the time spent in it in microseconds and the number of times it was entered.
+    uint64_t stateUs[Q_STATS_STATES];
+    uint64_t stateEntries[Q_STATS_STATES];
+    //The number of times the client moved from one state (first index) to another (second index).
+    uint32_t transitions[Q_STATS_STATES][Q_STATS_STATES];
+    //The state the client is in and when it entered it. state is -1 before the first call to statsState.
+    int state;
+    uint64_t stateSinceUs;
+} Stats_t;
+
+void statsInit(Stats_t *stats); //prototype
+int statsFrameType(const unsigned char *frame, size_t length); //prototype
+void statsSent(Stats_t *stats, int msgType); //prototype
+void statsReceived(Stats_t *stats, int msgType, int returnCode); //prototype
+void statsRetransmitted(Stats_t *stats, int msgType); //prototype
+void statsRtt(Stats_t *stats, enum Q_STATS_RTT kind, uint64_t rttUs); //prototype
+void statsState(Stats_t *stats, int state); //prototype
+void statsSnapshot(const Stats_t *stats, Stats_t *snapshot); //prototype
+void histogramRecord(Histogram_t *hist, uint64_t valueUs); //prototype
+uint64_t histogramPercentile(const Histogram_t *hist, double percentile); //prototype
+void statsPrint(const Stats_t *stats); //prototype
+
+#endif
@@ -9,6 +9,7 @@
 #include "MQTTSNSubscribe.h"
 #include "ErrorCodes.h"
 #include "Subscribe.h"
+#include "Retransmit.h"
 #include "transport.h"
 #include "StackTrace.h"
 
@@ -63,8 +64,8 @@ int subscribe(Client_t *clientPtr, MQTTSN_topicid *topic, MQTTSNFlags flags, uin
         serialLength = (size_t) returnCode;
     }
     
-    //Send the message out and check if it was successful.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    //Send the message out and check if it was successful. It is sent again with the dup flag if no SubAck arrives in time.
+    int returnCode2 = requestSend(clientPtr, buf, serialLength, MQTTSN_SUBSCRIBE, msgID);
 
     if(returnCode2 != 0)
     {
@@ -78,3 +79,40 @@ exit:
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 }
+
+/**
+ * Builds a Subscribe message and adds it to the client's send batch instead of sending it on its own, so the messages
+ * of a bulk request go out back to back. The message is not kept by the client; the bulk request sends it again
+ * with the dup flag set if no SubAck arrives in time.
+ * @param clientPtr The Client who will be subscribing to a topic.
+ * @param topic The topic the client will be subscribing to.
+ * @param flags A struct that will contain the appropriate values for the dup, qos, and topicIDType flags.
+ * @param msgID The message ID used to identify this particular message for the SubAck message.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Serial, Q_ERR_Socket, Q_ERR_TopicIdType, or Q_ERR_Qos
+ * indicate an error.
+ */
+int subscribeQueue(Client_t *clientPtr, MQTTSN_topicid *topic, MQTTSNFlags flags, uint16_t msgID)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    unsigned char buf[MQTTSNPacket_len(MQTTSNSerialize_subscribeLength(topic))];
+    if(topic->type > MQTTSN_TOPIC_TYPE_SHORT){
+        returnCode = Q_ERR_TopicIdType;
+        goto exit;
+    }
+    if(flags.bits.QoS > 0b10){
+        returnCode = Q_ERR_Qos;
+        goto exit;
+    }
+    returnCode = MQTTSNSerialize_subscribe(buf, sizeof(buf), flags.bits.dup, flags.bits.QoS, msgID, topic);
+    if(returnCode <= 0){
+        returnCode = Q_ERR_Serial;
+        goto exit;
+    }
+    returnCode = sendBatchQueue(&clientPtr->batch, &clientPtr->transport, buf, (size_t)returnCode);
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End subscribeQueue
@@ -1,4 +1,5 @@
 //Header file for Subscribe message
 
 int subscribe(Client_t *clientPtr, MQTTSN_topicid *topic, MQTTSNFlags flags, uint16_t msgID); //prototype
+int subscribeQueue(Client_t *clientPtr, MQTTSN_topicid *topic, MQTTSNFlags flags, uint16_t msgID); //prototype
 
@@ -0,0 +1,206 @@
+/**
+ * Contains the functions used to keep the topicIDs of a client's registered topic names in a file.
+ * A Gateway keeps a client's registrations when the client connects without a clean session, so the topicIDs it gave
+ * out before are still valid and the client does not have to wait for a RegAck for every topic name after reconnecting.
+ * The file is keyed by the clientID and the Gateway's address, since topicIDs are only valid for the client and Gateway
+ * that registered them. A topicID the Gateway no longer knows is rejected in the PubAck, and the session then simply
+ * registers the topic name again.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "ErrorCodes.h"
+#include "TopicTable.h"
+#include "TopicCache.h"
+#include "StackTrace.h"
+
+//Identifies a topic cache file ("QTPC").
+#define Q_TOPIC_CACHE_MAGIC 0x51545043u
+#define Q_TOPIC_CACHE_VERSION 1u
+
+/**
+ * Builds the key a cache file is stored under.
+ * @param key Where the key is written.
+ * @param keySize The size of key in bytes, usually Q_TOPIC_CACHE_KEY.
+ * @param clientID The clientID sent in the Connect message.
+ * @param host The IP address of the Gateway.
+ * @param port The port of the Gateway.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_TopicCache indicates the key does not fit.
+ */
+int topicCacheKey(char *key, size_t keySize, const char *clientID, const char *host, int port)
+{
+    int length = snprintf(key, keySize, "%s@%s:%d", (clientID != NULL) ? clientID : "", host, port);
+    if(length < 0 || (size_t)length >= keySize){
+        return Q_ERR_TopicCache;
+    }
+    return Q_NO_ERR;
+}//End topicCacheKey
+
+/**
+ * Adds the topics in a cache file to a client's topic table as registered for publishing.
+ * @param table The client's topic table.
+ * @param path The cache file.
+ * @param key The key built by topicCacheKey for the client and the Gateway it is connecting to.
+ * @return An int: Q_NO_ERR indicates the topics were added. Otherwise, Q_ERR_TopicCache indicates there is no cache file,
+ * it is not valid, or it was written for another client or Gateway, and Q_ERR_Unknown that a topic could not be added.
+ */
+int topicCacheLoad(TopicTable_t *table, const char *path, const char *key)
+{
+    int returnCode = Q_ERR_TopicCache;
+    unsigned char *file = NULL;
+    struct stat fileInfo;
+
+    FUNC_ENTRY;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        goto exit;
+    }
+    if(fstat(fd, &fileInfo) != 0 || fileInfo.st_size < (off_t)sizeof(TopicCacheHeader_t) ||
+            fileInfo.st_size > Q_TOPIC_CACHE_MAX){
+        close(fd);
+        goto exit;
+    }
+    size_t fileLen = (size_t)fileInfo.st_size;
+    file = malloc(fileLen);
+    bool readAll = file != NULL && read(fd, file, fileLen) == (ssize_t)fileLen;
+    close(fd);
+    if(!readAll){
+        goto exit;
+    }
+
+    TopicCacheHeader_t header;
+    memcpy(&header, file, sizeof(header));
+    size_t keyLen = strlen(key);
+    size_t offset = sizeof(header);
+    if(header.magic != Q_TOPIC_CACHE_MAGIC || header.version != Q_TOPIC_CACHE_VERSION || header.keyLen != keyLen ||
+            fileLen - offset < keyLen || memcmp(file + offset, key, keyLen) != 0){
+        goto exit;
+    }
+    offset += keyLen;
+
+    //Check every record fits in the file before adding any of them.
+    size_t check = offset;
+    for(uint16_t index = 0; index < header.count; ++index){
+        TopicCacheRecord_t record;
+        if(fileLen - check < sizeof(record)){
+            goto exit;
+        }
+        memcpy(&record, file + check, sizeof(record));
+        check += sizeof(record);
+        if(record.topicID == 0 || record.nameLen == 0 || fileLen - check < record.nameLen){
+            goto exit;
+        }
+        check += record.nameLen;
+    }
+
+    for(uint16_t index = 0; index < header.count; ++index){
+        TopicCacheRecord_t record;
+        memcpy(&record, file + offset, sizeof(record));
+        offset += sizeof(record);
+        returnCode = topicAdd(table, record.topicID, (const char *)file + offset, record.nameLen, 0, Q_TOPIC_PUB);
+        if(returnCode != Q_NO_ERR){
+            goto exit;
+        }
+        offset += record.nameLen;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    free(file);
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicCacheLoad
+
+/**
+ * Writes every topic the client registered for publishing to a cache file. The file is written in full and then
+ * renamed over the old one, so a client that loses power while saving still has the old topicIDs next time.
+ * @param table The client's topic table.
+ * @param path The cache file.
+ * @param key The key built by topicCacheKey for the client and the Gateway it is connected to.
+ * @return An int: Q_NO_ERR indicates the topics were saved. Otherwise, Q_ERR_TopicCache indicates an error.
+ */
+int topicCacheSave(const TopicTable_t *table, const char *path, const char *key)
+{
+    int returnCode = Q_ERR_TopicCache;
+    unsigned char *file = NULL;
+    char tempPath[256];
+
+    FUNC_ENTRY;
+    if(snprintf(tempPath, sizeof(tempPath), "%s.tmp", path) >= (int)sizeof(tempPath)){
+        goto exit;
+    }
+
+    TopicCacheHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = Q_TOPIC_CACHE_MAGIC;
+    header.version = Q_TOPIC_CACHE_VERSION;
+    header.keyLen = (uint16_t)strlen(key);
+    size_t fileLen = sizeof(header) + header.keyLen;
+    for(size_t index = 0; index < table->capacity; ++index){
+        const Topic_t *topic = &table->slots[index];
+        if(topic->topicID != 0 && (topic->flags & Q_TOPIC_PUB) && topic->name != NULL){
+            fileLen += sizeof(TopicCacheRecord_t) + strlen(topic->name);
+            header.count += 1;
+        }
+    }
+    if(fileLen > Q_TOPIC_CACHE_MAX){
+        goto exit;
+    }
+    file = malloc(fileLen);
+    if(file == NULL){
+        goto exit;
+    }
+
+    memcpy(file, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    memcpy(file + offset, key, header.keyLen);
+    offset += header.keyLen;
+    for(size_t index = 0; index < table->capacity; ++index){
+        const Topic_t *topic = &table->slots[index];
+        if(topic->topicID == 0 || !(topic->flags & Q_TOPIC_PUB) || topic->name == NULL){
+            continue;
+        }
+        TopicCacheRecord_t record;
+        record.topicID = topic->topicID;
+        record.nameLen = (uint16_t)strlen(topic->name);
+        memcpy(file + offset, &record, sizeof(record));
+        offset += sizeof(record);
+        memcpy(file + offset, topic->name, record.nameLen);
+        offset += record.nameLen;
+    }
+
+    int fd = open(tempPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd < 0){
+        goto exit;
+    }
+    bool written = write(fd, file, fileLen) == (ssize_t)fileLen && fsync(fd) == 0;
+    close(fd);
+    if(!written || rename(tempPath, path) != 0){
+        unlink(tempPath);
+        goto exit;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    free(file);
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicCacheSave
+
+/**
+ * Forgets every cached topicID. Used when the client connects with a clean session, since the Gateway then forgets
+ * the client's registrations as well.
+ * @param path The cache file.
+ * @return void
+ */
+void topicCacheForget(const char *path)
+{
+    unlink(path);
+}//End topicCacheForget
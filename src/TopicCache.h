@@ -0,0 +1,42 @@
+/**
+ * Header file for TopicCache.c
+ * Defines the small file a client keeps the topicIDs of its registered topic names in, so a client that reconnects
+ * without a clean session can publish straight away instead of registering every topic name again.
+ */
+
+#ifndef Q_TOPICCACHE_H
+#define Q_TOPICCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TopicTable.h"
+
+//The longest key a cache file can have: the clientID and the Gateway's address and port.
+#define Q_TOPIC_CACHE_KEY 96
+//The largest cache file that will be read.
+#define Q_TOPIC_CACHE_MAX (64 * 1024)
+
+//Stored at the start of the cache file, followed by the key and then one TopicCacheRecord_t and topic name per topic.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    //The length of the key, which is not null terminated in the file.
+    uint16_t keyLen;
+    //The number of topics in the file.
+    uint16_t count;
+} TopicCacheHeader_t;
+
+//Stored in front of every topic name in the cache file.
+typedef struct {
+    uint16_t topicID;
+    //The length of the topic name that follows, which is not null terminated in the file.
+    uint16_t nameLen;
+} TopicCacheRecord_t;
+
+int topicCacheKey(char *key, size_t keySize, const char *clientID, const char *host, int port); //prototype
+int topicCacheLoad(TopicTable_t *table, const char *path, const char *key); //prototype
+int topicCacheSave(const TopicTable_t *table, const char *path, const char *key); //prototype
+void topicCacheForget(const char *path); //prototype
+
+#endif
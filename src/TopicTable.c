@@ -0,0 +1,279 @@
+/**
+ * Contains the functions used to store and look up the topics a client knows about.
+ * Topics are kept in an open addressing hash table keyed by topicID so that an incoming Publish or Register message
+ * can be matched with a single lookup, no matter how many topics the client is subscribed or registered to.
+ * The table doubles in size whenever it becomes half full.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "TopicTable.h"
+#include "ErrorCodes.h"
+#include "StackTrace.h"
+
+/**
+ * Finds the slot a topicID hashes to.
+ * @param topicID The topicID to be hashed.
+ * @param capacity The number of slots in the table, a power of two.
+ * @return The index of the topicID's home slot.
+ */
+static size_t topicSlot(uint16_t topicID, size_t capacity)
+{
+    //Topic IDs are usually handed out one after another by the Gateway, so spread them over the table
+    //with a multiplicative hash instead of using them as the index directly.
+    return ((uint32_t)topicID * 2654435761u >> 16) & (capacity - 1);
+}//End topicSlot
+
+/**
+ * Creates an empty topic table.
+ * @param table The table to be initialized.
+ * @param capacity The number of slots to start with. Rounded up to a power of two.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the table could not be allocated.
+ */
+int topicTableInit(TopicTable_t *table, size_t capacity)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    size_t size = 2;
+    while(size < capacity){
+        size <<= 1;
+    }
+
+    table->slots = calloc(size, sizeof(Topic_t));
+    if(table->slots == NULL){
+        goto exit;
+    }
+    table->capacity = size;
+    table->count = 0;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicTableInit
+
+/**
+ * Releases the memory held by the table, including the topic names.
+ * @param table The table to be freed.
+ * @return void
+ */
+void topicTableFree(TopicTable_t *table)
+{
+    for(size_t index = 0; index < table->capacity; ++index){
+        free(table->slots[index].name);
+    }
+    free(table->slots);
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}//End topicTableFree
+
+/**
+ * Looks up a topic by its topicID.
+ * @param table The table to be searched.
+ * @param topicID The topicID contained in the message from the Gateway.
+ * @return A pointer to the topic, or NULL if the client does not know this topicID.
+ */
+Topic_t *topicFind(const TopicTable_t *table, uint16_t topicID)
+{
+    if(table->slots == NULL || topicID == 0){
+        return NULL;
+    }
+
+    size_t mask = table->capacity - 1;
+    for(size_t index = topicSlot(topicID, table->capacity); table->slots[index].topicID != 0; index = (index + 1) & mask){
+        if(table->slots[index].topicID == topicID){
+            return &table->slots[index];
+        }
+    }
+    return NULL;
+}//End topicFind
+
+/**
+ * Looks up the topicID of a topic name. This has to check every slot, so it is meant for the client's own
+ * publishing code and not for handling incoming messages.
+ * @param table The table to be searched.
+ * @param name The topic name.
+ * @param flags Only topics with at least one of these flags are considered, for example Q_TOPIC_PUB.
+ * @return The topicID, or 0 if no matching topic has been registered or subscribed to.
+ */
+uint16_t topicLookupID(const TopicTable_t *table, const char *name, uint8_t flags)
+{
+    for(size_t index = 0; index < table->capacity; ++index){
+        Topic_t *topic = &table->slots[index];
+        if(topic->topicID != 0 && (topic->flags & flags) && topic->name != NULL && strcmp(topic->name, name) == 0){
+            return topic->topicID;
+        }
+    }
+    return 0;
+}//End topicLookupID
+
+/**
+ * Doubles the number of slots in the table and moves every topic to its new slot.
+ * @param table The table to be grown.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_Unknown indicates the new slots could not be allocated,
+ * in which case the table is left unchanged.
+ */
+static int topicTableGrow(TopicTable_t *table)
+{
+    size_t capacity = table->capacity * 2;
+    Topic_t *slots = calloc(capacity, sizeof(Topic_t));
+    if(slots == NULL){
+        return Q_ERR_Unknown;
+    }
+
+    for(size_t index = 0; index < table->capacity; ++index){
+        if(table->slots[index].topicID == 0){
+            continue;
+        }
+        size_t slot = topicSlot(table->slots[index].topicID, capacity);
+        while(slots[slot].topicID != 0){
+            slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot] = table->slots[index];
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return Q_NO_ERR;
+}//End topicTableGrow
+
+/**
+ * Adds a topic to the table. If the topicID is already known, the new flags are added to the existing ones and
+ * the QoS level and name (if given) are replaced.
+ * @param table The table the topic is added to.
+ * @param topicID The topicID given out by the Gateway. Must not be 0.
+ * @param name The topic name, which does not have to be null terminated. Can be NULL if the name is not known.
+ * @param nameLen The length of the topic name in bytes.
+ * @param qos The QoS level granted for this topic.
+ * @param flags One or more of Q_TOPIC_SUB, Q_TOPIC_PUB, and Q_TOPIC_WILD.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_WrongTopicID indicates a topicID of 0 and
+ * Q_ERR_Unknown indicates memory could not be allocated.
+ */
+int topicAdd(TopicTable_t *table, uint16_t topicID, const char *name, size_t nameLen, uint8_t qos, uint8_t flags)
+{
+    int returnCode = Q_ERR_Unknown;
+    char *nameCopy = NULL;
+
+    FUNC_ENTRY;
+    if(topicID == 0){
+        returnCode = Q_ERR_WrongTopicID;
+        goto exit;
+    }
+    if(table->slots == NULL){
+        goto exit;
+    }
+    if(name != NULL){
+        nameCopy = malloc(nameLen + 1);
+        if(nameCopy == NULL){
+            goto exit;
+        }
+        memcpy(nameCopy, name, nameLen);
+        nameCopy[nameLen] = '\0';
+    }
+
+    Topic_t *topic = topicFind(table, topicID);
+    if(topic == NULL){
+        //Keep the table at most half full so probe sequences stay short.
+        if((table->count + 1) * 2 > table->capacity && topicTableGrow(table) != Q_NO_ERR){
+            free(nameCopy);
+            goto exit;
+        }
+        size_t mask = table->capacity - 1;
+        size_t index = topicSlot(topicID, table->capacity);
+        while(table->slots[index].topicID != 0){
+            index = (index + 1) & mask;
+        }
+        topic = &table->slots[index];
+        topic->topicID = topicID;
+        topic->flags = 0;
+        topic->name = NULL;
+        topic->handler = NULL;
+        topic->context = NULL;
+        table->count += 1;
+    }
+
+    topic->qos = qos;
+    topic->flags |= flags;
+    if(nameCopy != NULL){
+        free(topic->name);
+        topic->name = nameCopy;
+    }
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicAdd
+
+/**
+ * Removes a topic from the table. The topics that follow it in the same probe sequence are shifted back
+ * so no tombstones are left behind.
+ * @param table The table the topic is removed from.
+ * @param topicID The topicID of the topic to be removed.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_WrongTopicID indicates the topicID is not in the table.
+ */
+int topicRemove(TopicTable_t *table, uint16_t topicID)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    Topic_t *topic = topicFind(table, topicID);
+    if(topic == NULL){
+        returnCode = Q_ERR_WrongTopicID;
+        goto exit;
+    }
+
+    free(topic->name);
+    size_t mask = table->capacity - 1;
+    size_t hole = (size_t)(topic - table->slots);
+    size_t index = (hole + 1) & mask;
+    while(table->slots[index].topicID != 0){
+        size_t home = topicSlot(table->slots[index].topicID, table->capacity);
+        //Move the topic into the hole if its home slot is not between the hole and its current slot.
+        if(((index - home) & mask) >= ((index - hole) & mask)){
+            table->slots[hole] = table->slots[index];
+            hole = index;
+        }
+        index = (index + 1) & mask;
+    }
+    table->slots[hole].topicID = 0;
+    table->slots[hole].name = NULL;
+    table->count -= 1;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicRemove
+
+/**
+ * Sets the function called for every Publish message received on a topic.
+ * @param table The table that holds the topic.
+ * @param topicID The topicID of the topic.
+ * @param handler The function to be called, or NULL to fall back to the client's default handler.
+ * @param context Passed to the handler unchanged.
+ * @return An int: Q_NO_ERR indicates success. Otherwise, Q_ERR_WrongTopicID indicates the topicID is not in the table.
+ */
+int topicSetHandler(TopicTable_t *table, uint16_t topicID, MessageHandler_t handler, void *context)
+{
+    int returnCode = Q_ERR_Unknown;
+
+    FUNC_ENTRY;
+    Topic_t *topic = topicFind(table, topicID);
+    if(topic == NULL){
+        returnCode = Q_ERR_WrongTopicID;
+        goto exit;
+    }
+    topic->handler = handler;
+    topic->context = context;
+    returnCode = Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End topicSetHandler
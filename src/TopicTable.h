@@ -0,0 +1,71 @@
+/**
+ * Header file for TopicTable.c
+ * Defines the table a client uses to map the topicIDs given out by the Gateway to the topic name, QoS level,
+ * and the way the client came to know the topicID (subscription, registration for publishing, or a wildcard match).
+ */
+
+#ifndef Q_TOPICTABLE_H
+#define Q_TOPICTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//The number of slots a topic table starts with when no other size is chosen. The table grows as needed.
+#define Q_TOPIC_TABLE_SIZE 16
+
+//Flags describing how the client came to know a topicID. A topicID can have more than one.
+//The client subscribed to the topic name and was given this topicID in the SubAck.
+#define Q_TOPIC_SUB 0x01
+//The client registered the topic name to publish to it and was given this topicID in the RegAck.
+#define Q_TOPIC_PUB 0x02
+//The Gateway registered this topicID because it matched one of the client's wildcard subscriptions.
+#define Q_TOPIC_WILD 0x04
+
+//An incoming Publish message as handed to the application. The payload points directly into the client's
+//receive buffer, so it is only valid until the handler returns.
+typedef struct {
+    uint16_t topicID;
+    //The topic name, or NULL if the client does not know it.
+    const char *topicName;
+    uint16_t msgID;
+    uint8_t qos;
+    bool retained;
+    bool dup;
+    const unsigned char *payload;
+    size_t payloadLen;
+} Q_Message_t;
+
+//Called for every Publish message received on a topic. The context is the pointer given when the handler was set.
+typedef void (*MessageHandler_t)(const Q_Message_t *message, void *context);
+
+//A topic known to the client. A topicID of 0 marks an empty slot, since the Gateway never assigns it.
+typedef struct {
+    uint16_t topicID;
+    uint8_t qos;
+    uint8_t flags;
+    //Copy of the topic name owned by the table, or NULL if the name is not known.
+    char *name;
+    //Called when a Publish message arrives with this topicID. If NULL, the client's default handler is used.
+    MessageHandler_t handler;
+    void *context;
+} Topic_t;
+
+//Open addressing hash table of topics keyed by topicID.
+typedef struct {
+    Topic_t *slots;
+    //Number of slots, always a power of two.
+    size_t capacity;
+    //Number of slots in use.
+    size_t count;
+} TopicTable_t;
+
+int topicTableInit(TopicTable_t *table, size_t capacity); //prototype
+void topicTableFree(TopicTable_t *table); //prototype
+Topic_t *topicFind(const TopicTable_t *table, uint16_t topicID); //prototype
+uint16_t topicLookupID(const TopicTable_t *table, const char *name, uint8_t flags); //prototype
+int topicAdd(TopicTable_t *table, uint16_t topicID, const char *name, size_t nameLen, uint8_t qos, uint8_t flags); //prototype
+int topicRemove(TopicTable_t *table, uint16_t topicID); //prototype
+int topicSetHandler(TopicTable_t *table, uint16_t topicID, MessageHandler_t handler, void *context); //prototype
+
+#endif
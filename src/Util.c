@@ -20,15 +20,13 @@
 #include "Util.h"
 #include "StackTrace.h"
 #include "transport.h"
-#include "MQTTSNConnect.h"
-#include "MQTTSNUnsubscribe.h"
-#include "MQTTSNSubscribe.h"
-#include "MQTTSNPublish.h"
 #include "PubAck.h"
 #include "PubRecRelComp.h"
+#include "EventLoop.h"
+#include "Retransmit.h"
 
 //The maximum size of the buffer that is used to read in a message.
-#define Q_BUF_LEN 1600
+#define Q_BUF_LEN TRANSPORT_RX_LEN
 
 /**
  * This function will be used to create an MQTTSNString, which is needed to create a WillTopic message and WillMsg,
@@ -62,25 +60,19 @@ int MQTTSNStrCreate(MQTTSNString *strContainer, char *string)
 }//End MQTTSNStrCreate
 
 /**
- * Used to deserialize a Connack message and check its return code status.
- * @param buf The buffer that contains the Connack message.
- * @param bufSize The size of the buffer containing the Connack message.
+ * Used to check the return code status of a Connack message.
+ * @param view The decoded Connack message.
  * @return An int: Q_NO_ERR indicates a Connack message with an accepted return code. Otherwise, Q_ERR_Unknown indicates 
- * something went wrong, Q_ERR_Deserial indicates a problem with deserialization, and Q_ERR_Rejected indicates that 
+ * something went wrong, and Q_ERR_Rejected indicates that 
  * //the a rejected return code was received in the Connack message.
  */ 
-int readConnack(unsigned char *buf, size_t bufSize)
+int readConnack(const PacketView_t *view)
 {
     int returnCode = Q_ERR_Unknown;
 
     FUNC_ENTRY;
-    //Check if the deserialization is unsuccessful
-    if(MQTTSNDeserialize_connack(&returnCode, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
     //Check if the return code value of the message is accepted.
-    if(returnCode == MQTTSN_RC_ACCEPTED){
+    if(view->returnCode == MQTTSN_RC_ACCEPTED){
         returnCode = Q_NO_ERR;
         goto exit;
     } else{
@@ -94,24 +86,18 @@ exit:
 }//End readConnack
 
 /**
- * Deserializes a WillTopicResp message.
- * @param buf The buffer that contains the WillTopicResp message.
- * @param bufSize The size of the buffer containing the WillTopicResp message.
+ * Checks the return code of a WillTopicResp message.
+ * @param view The decoded WillTopicResp message.
  * @return An int: Q_NO_ERR indicates a return code of accepted. Otherwise, Q_ERR_Unknown indicates something went wrong, 
- * Q_ERR_Deserial indicates an error with deserialization, and Q_ERR_Rejected indicates a return code of rejected.
+ * and Q_ERR_Rejected indicates a return code of rejected.
  */ 
-int readWillTopResp(unsigned char *buf, size_t bufSize)
+int readWillTopResp(const PacketView_t *view)
 {
 
     int returnCode = Q_ERR_Unknown;
     FUNC_ENTRY;
-    //Check if deserialization is successful.
-    if(MQTTSNDeserialize_willtopicresp(&returnCode, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
     //Check if the return code value of the message is accepted.
-    if(returnCode == MQTTSN_RC_ACCEPTED){
+    if(view->returnCode == MQTTSN_RC_ACCEPTED){
         returnCode = Q_NO_ERR;
         goto exit;
     } else{
@@ -125,25 +111,19 @@ exit:
 }//End readWillTopResp
 
 /**
- * Deserializes a WillMsgResp message.
- * @param buf The buffer that contains the WillMsgResp message.
- * @param bufSize The size of the buffer containing the WillMsgResp message.
+ * Checks the return code of a WillMsgResp message.
+ * @param view The decoded WillMsgResp message.
  * @return An int: Q_NO_ERR indicates a WillMsgResp message with an accepted return code. Otherwise, Q_ERR_Unknown indicates 
- * something went wrong, Q_ERR_Deserial indicates an error with deserialization, and Q_ERR_Rejected indicates 
+ * something went wrong, and Q_ERR_Rejected indicates 
  * a return code of rejected.
  */ 
-int readWillMsgResp(unsigned char *buf, size_t bufSize)
+int readWillMsgResp(const PacketView_t *view)
 {
 
     int returnCode = Q_ERR_Unknown;
     FUNC_ENTRY;
-    //Check if deserialization is successful.
-    if(MQTTSNDeserialize_willmsgresp(&returnCode, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
     //Check if the return code value is accepted for this message.
-    if(returnCode == MQTTSN_RC_ACCEPTED){
+    if(view->returnCode == MQTTSN_RC_ACCEPTED){
         returnCode = Q_NO_ERR;
         goto exit;
     } else{
@@ -157,27 +137,21 @@ exit:
 }//End readWillMsgResp
 
 /**
- * Deserializes an UnsubAck message.
- * @param buf The buffer that contains the UnsubAck message.
- * @param bufSize The size of the buffer containing the UnsubAck message.
+ * Processes an UnsubAck message.
+ * @param view The decoded UnsubAck message.
  * @param event Needed to check for a matching msgID between the Unsubscribe and UnsubAck message.
  * @return An int: Q_NO_ERR indicates receipt and processing of the Unsubscribe message sent by the client. Otherwise,
- * Q_ERR_Unknown indicates something went wrong, Q_ERR_Deserial indicates an error with deserialization, and Q_ERR_MsgID 
+ * Q_ERR_Unknown indicates something went wrong, and Q_ERR_MsgID 
  * indicates a mismatching msgID. 
  */ 
-int readUnsubAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readUnsubAck(const PacketView_t *view, Client_Event_t *event)
 {
 
     int returnCode = Q_ERR_Unknown;
     //Stores the messageID of the unsuback message.
-    uint16_t ack_msgID = 0;
+    uint16_t ack_msgID = view->msgID;
 
     FUNC_ENTRY;
-    //Check if deserialization is successful
-    if(MQTTSNDeserialize_unsuback(&ack_msgID, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
     //Make sure the msgID of the unsuback message matches the msgID of the sent subscribe message
     if(ack_msgID != event->send_msgID){
         returnCode = Q_ERR_MsgID;
@@ -193,33 +167,52 @@ exit:
 }//End readUnsubAck
 
 /**
- * Deserializes a SubAck message. If the return code is accepted and the topic did not include wildcard characters,
- * the topicID is saved in the client's array of subscribed topics.
- * @param buf The buffer that contains the SubAck message.
- * @param bufSize The size of the buffer containing the SubAck message.
+ * Processes a SubAck message. If the return code is accepted and the topic did not include wildcard characters,
+ * the topicID is saved in the client's topic table along with the topic name in event->topicName, or the topic name of
+ * the bulk request message it answers. The answer is recorded in the bulk request as well.
+ * @param view The decoded SubAck message.
  * @param event Needed to check for a matching msgID and Qos level between the Subscribe and SubAck message.
  * @return An int: Q_NO_ERR indicates the client has successfully subscribed to a topic. Otherwise, Q_ERR_Unknown indicates
- * something unknown went wrong, Q_ERR_Deserial indicates an error with deserialization, Q_ERR_Rejected indicates a return code
+ * something unknown went wrong, Q_ERR_Rejected indicates a return code
  * of rejected, Q_ERR_MsgID indicates a mismatching msgID, and Q_ERR_Qos indicates a mismatching Qos level.
  */ 
-int readSubAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readSubAck(const PacketView_t *view, Client_Event_t *event)
 {
 
     int returnCode = Q_ERR_Unknown;
 
     //Following variables are used to store the values contained within
-    //the unsuback message sent by the server.
-    int ack_qos = 0;
-    uint16_t ack_topicID = 0;
-    uint16_t ack_msgID = 0;
+    //the suback message sent by the server.
+    int ack_qos = view->qos;
+    uint16_t ack_topicID = view->topicID;
+    uint16_t ack_msgID = view->msgID;
     //Stores the return code contained in the message
-    uint8_t ack_Return = 0;
+    uint8_t ack_Return = view->returnCode;
+    //The message of the client's bulk request this SubAck answers, if any.
+    Bulk_t *bulk = &event->client->bulk;
+    BulkOp_t *bulkOp = NULL;
     
     FUNC_ENTRY;
-    //Check if deserialization if successful.
-    if(MQTTSNDeserialize_suback(&ack_qos, &ack_topicID, &ack_msgID, &ack_Return, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
+    //The Gateway answered, so the Subscribe message does not have to be sent again.
+    requestAcked(event->client, MQTTSN_SUBSCRIBE, ack_msgID);
+    event->msgID = ack_msgID;
+    //The topic name, QoS level, and handler come from the bulk request if the Subscribe message was part of one.
+    bulkOp = bulkFind(bulk, MQTTSN_SUBSCRIBE, ack_msgID);
+    const char *topicName = event->topicName;
+    unsigned char qos = event->qos;
+    MessageHandler_t handler = event->handler;
+    void *handlerContext = event->handlerContext;
+    if(bulkOp != NULL){
+        //A second SubAck for a Subscribe message that was sent again.
+        if(bulkOp->answered){
+            returnCode = Q_ERR_MsgID;
+            goto exit;
+        }
+        retransmitBulkAcked(event->client, bulkOp);
+        topicName = bulkOp->topicName;
+        qos = bulkOp->qos;
+        handler = bulkOp->handler;
+        handlerContext = bulkOp->context;
     }
     //Check if the return code value of the message is accepted.
     if(ack_Return != MQTTSN_RC_ACCEPTED){
@@ -227,23 +220,33 @@ int readSubAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
         goto exit;
     }
     //Check that the msgID and qos level match.
-    if(event->send_msgID != ack_msgID){
+    if(bulkOp == NULL && event->send_msgID != ack_msgID){
         returnCode = Q_ERR_MsgID;
         goto exit;
     }
-    if(event->qos != ack_qos){
+    if(qos != ack_qos){
         returnCode = Q_ERR_Qos;
         goto exit;
     }
     //Check if this was a wildcard subscription.
-    //If not, assign the new topicID to the array of the client's subscribed topics.
+    //If not, add the new topicID to the client's topic table.
     if(ack_topicID != 0) {
-        //Number of topics the client is subscribed to will increase by one.
-        event->client->subscribe_Num += 1;
-        //Get the index for this new topic to be added in for the array of the client's subscribed topics.
-        size_t subIndex = event->client->subscribe_Num - 1;
-        event->client->sub_topicID[subIndex] = ack_topicID;
+        size_t nameLen = (topicName != NULL) ? strlen(topicName) : 0;
+        returnCode = topicAdd(&event->client->topics, ack_topicID, topicName, nameLen, (uint8_t)ack_qos, Q_TOPIC_SUB);
+        if(returnCode != Q_NO_ERR){
+            goto exit;
+        }
+        //Publish messages for this topic will be passed to the handler given when subscribing.
+        if(handler != NULL){
+            topicSetHandler(&event->client->topics, ack_topicID, handler, handlerContext);
+        }
     } else {
+        //The topicIDs of a wildcard subscription are only known once the Gateway registers them,
+        //so its handler receives every message on a topic without a handler of its own.
+        if(handler != NULL){
+            event->client->defaultHandler = handler;
+            event->client->defaultContext = handlerContext;
+        }
         //Increment the number of wildcard topics the client is subscribed to.
         event->client->sub_Wild_Num += 1;
         //The client now has a wildcard subscription.
@@ -254,6 +257,10 @@ int readSubAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
     goto exit;
 
 exit:
+    if(bulkOp != NULL && returnCode != Q_ERR_MsgID){
+        bulkOp->topicID = (returnCode == Q_NO_ERR) ? ack_topicID : 0;
+        bulkAnswered(bulk, bulkOp, (returnCode == Q_NO_ERR) ? Q_SubAckRead : returnCode);
+    }
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 }//End readSubAck
@@ -261,86 +268,66 @@ exit:
 
 /**
  * 
- * Used to deserialize and read in a publish message for a subscribed client. If the client is subscribed to the topic, 
- * the data within the Publish message is also displayed.
- * @param buf The buffer that contains the Publish message.
- * @param bufSize The size of the buffer containing the Publish message.
+ * Used to read in a publish message for a subscribed client. If the client is subscribed to the topic, 
+ * the message is passed to the topic's handler, or to the client's default handler if the topic has none. The payload
+ * given to the handler points into the client's receive buffer, it is not copied.
+ * @param view The decoded Publish message.
  * @param event Needed to check if the client is subscribed to the topic within the Publish message and to store
  * //the appropriate information that may be needed if the message must be acknowledged or rejected.
  * @return An int: Q_pubQos0, Q_pubQos1, and Q_pubQos2 all the client is subscribed to this publish message and
  * the Qos level associated with the Publish message, which dictates how the Client will respond. Otherwise, Q_ERR_Unknown indicates
- * something unknown went wrong, Q_ERR_Deserial indicates an error with deserialization, and Q_ERR_WrongTopicID indicates the client
+ * something unknown went wrong, and Q_ERR_WrongTopicID indicates the client
  * is not subscribed to this topic.
+ * A QoS level 2 message that is still waiting for its PubRel is not passed to the handler again, but Q_pubQos2 is still
+ * returned so the PubRec is sent again. Q_ERR_WindowFull indicates the client is waiting for the PubRel of too many QoS
+ * level 2 messages, in which case the message is dropped without an answer and the Gateway sends it again later.
  */ 
-int readPub(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readPub(const PacketView_t *view, Client_Event_t *event)
 {
     int returnCode = Q_ERR_Unknown;
 
-    //Used to hold flags and data of the Publish message
-    unsigned char dup = 0;
-    int qos = 0;
-    unsigned char retained = 0;
-    unsigned short pubMsgID = 0;
-    MQTTSN_topicid pubTopic;
-    unsigned char *pubData = 0;
-    int dataLen = 0;
+    //The flags, msgID, and topicID of the Publish message.
+    int qos = view->qos;
+    uint16_t pubMsgID = view->msgID;
+    uint16_t pubTopicID = view->topicID;
 
     FUNC_ENTRY;
-    //Check if deserialization was successful.
-    if(MQTTSNDeserialize_publish(&dup, &qos, &retained, &pubMsgID, &pubTopic, &pubData, &dataLen, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
-
-    //Stores the topicID contained in the publish message.
-    uint16_t pubTopicID = pubTopic.data.id;
 
-    //Check if the topicID of the message matches with a wildcard subscription of the client's.
-    if(event->client->wildcard_Sub && pubTopicID == event->client->wild_topicID){
-        //Display the data in the publish message.
-        for(int index = 0; index < dataLen; ++index){
-            printf("%c", pubData[index]);
-            //Print a new line once this is the end of the data to be printed.
-            if(index == (dataLen - 1)){
-                puts("");
-            }
-        }
-    //Check if the client has any subscriptions to topics without wildcards.
-    } else if(event->client->subscribe_Num > 0) {
-        //Used to indicate if the client is subscribed to this topic.
-        bool subscribed = false;
-        //Check if the topicID of the message matches with a topicID the client is subscribed to.
-        for(size_t index = 0; index < event->client->subscribe_Num; ++index){
-            if(pubTopicID == event->client->sub_topicID[index]){
-                subscribed = true;
-                break;
-            }
-        }
-        //Display the data in the publish message if the client is subscribed to this topic.
-        if(subscribed){
-            for(int index = 0; index < dataLen; ++index){
-                printf("%c", pubData[index]);
-                //Print a new line once this is the end of the data to be printed.
-                if(index == (dataLen - 1)){
-                    puts("");
-                }
-            }
-        //Client is not subscribed to this topicID
-        } else{
-            returnCode = Q_ERR_WrongTopicID;
-            //Need this information when sending a pubAck for rejection.
-            event->topicID = pubTopicID;
-            event->msgID = pubMsgID;
-            goto exit;
-        }
-    //Client is not subscribed to this topicID
-    } else{
+    //Check if the client is subscribed to this topicID, either directly or through a wildcard subscription.
+    Topic_t *topic = topicFind(&event->client->topics, pubTopicID);
+    if(topic == NULL || !(topic->flags & (Q_TOPIC_SUB | Q_TOPIC_WILD))){
         returnCode = Q_ERR_WrongTopicID;
         //Need this information when sending a pubAck for rejection.
         event->topicID = pubTopicID;
         event->msgID = pubMsgID;
         goto exit;
     }
+    //A QoS level 2 message that was received before and has not been released is only answered with another PubRec.
+    if(qos == 2){
+        event->msgID = pubMsgID;
+        int recvCode = qos2RecvAdd(&event->client->qos2Recv, pubMsgID);
+        if(recvCode == Q_ERR_MsgID){
+            returnCode = Q_pubQos2;
+            goto exit;
+        } else if(recvCode != Q_NO_ERR){
+            returnCode = recvCode;
+            goto exit;
+        }
+    }
+    //Hand the message to the application.
+    MessageHandler_t handler = (topic->handler != NULL) ? topic->handler : event->client->defaultHandler;
+    if(handler != NULL){
+        Q_Message_t message;
+        message.topicID = pubTopicID;
+        message.topicName = topic->name;
+        message.msgID = pubMsgID;
+        message.qos = (uint8_t)qos;
+        message.retained = (view->retained != 0);
+        message.dup = (view->dup != 0);
+        message.payload = view->payload;
+        message.payloadLen = view->payloadLen;
+        handler(&message, (topic->handler != NULL) ? topic->context : event->client->defaultContext);
+    }
 
     //Check the qos levels to return the appropriate message to the gateway.
     if(qos == 1){
@@ -365,57 +352,47 @@ exit:
 }//End readPub
 
 /**
- * Deserializes a Register message. 
- * @param buf The buffer that contains the Register message.
- * @param bufSize The size of the buffer containing the Register message.
+ * Processes a Register message. 
+ * @param view The decoded Register message.
  * @param event Needed to determine if the client is subscribed to the topic included in the Register message
  * and assign the TopicID and MsgID for the RegAck message that will be sent back to the Gateway. 
  * @return An int: Q_Subscribed indicates the Client has a subscription to this topic and Q_Wildcard indicates the client will be
- * received Publish messages with the included topicID. Otherwise, Q_ERR_Unknown indicates an unknown error, Q_ERR_Deserial 
- * indicates an error with deserialization, and Q_RejectReg indicates the client must return a RegAck with a reject return code.
+ * received Publish messages with the included topicID. Otherwise, Q_ERR_Unknown indicates an unknown error, 
+ * and Q_RejectReg indicates the client must return a RegAck with a reject return code.
  */ 
-int readReg(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readReg(const PacketView_t *view, Client_Event_t *event)
 {
     int returnCode = Q_ERR_Unknown;
 
     //Following variables are used to store values contained within the Register message.
-    uint16_t regTopicID = 0;
-    uint16_t regMsgID = 0;
-    MQTTSNString topicName;
+    uint16_t regTopicID = view->topicID;
+    uint16_t regMsgID = view->msgID;
 
     FUNC_ENTRY;
-    //Check that deserialization is successful.
-    if(MQTTSNDeserialize_register(&regTopicID, &regMsgID, &topicName, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
+
+    //The msgID and topicID of the register message will need to be used by the client when it sends the regAck message.
+    event->msgID = regMsgID;
+    event->topicID = regTopicID;
 
     //If the client reconnected with the cleanSession flag off, then check if it 
-    //has any subscriptions (excluding wildcards) and then check if it supposed to be subscribed to the topic mentioned.
-    if(event->client->subscribe_Num > 0){
-        for(size_t index = 0; index < event->client->subscribe_Num; ++index){
-            if(regTopicID == event->client->sub_topicID[index]){
-            //The msgID and topicID to be used by the client when it sends the regAck message.
-            event->msgID = regMsgID;
-            event->topicID = regTopicID;
-            returnCode = Q_Subscribed;
-            goto exit;
-            }
-        }
+    //is supposed to be subscribed to the topic mentioned (excluding wildcards).
+    Topic_t *topic = topicFind(&event->client->topics, regTopicID);
+    if(topic != NULL && (topic->flags & Q_TOPIC_SUB)){
+        returnCode = Q_Subscribed;
+        goto exit;
     //Check if the client has any wildcard subscriptions    
     } else if (event->client->wildcard_Sub){
-        //client will need this topicID when it checks the publish messages.
-        event->client->wild_topicID = regTopicID;
-        //The msgID and topicID of the register message will need to be used by the client when it sends the regAck message.
-        event->msgID = regMsgID;
-        event->topicID = regTopicID;
+        //Client will need this topicID when it checks the publish messages. Every topic matching one of its
+        //wildcard subscriptions gets its own entry, so a second match does not replace the first.
+        returnCode = topicAdd(&event->client->topics, regTopicID, (const char *)view->payload, view->payloadLen, 0, Q_TOPIC_WILD);
+        if(returnCode != Q_NO_ERR){
+            goto exit;
+        }
         returnCode = Q_Wildcard;
         goto exit;
     //Otherwise, the client needs to send a regack message rejecting this topicID.
     } else{
         returnCode = Q_RejectReg;
-        event->msgID = regMsgID;
-        event->topicID = regTopicID;
         goto exit;
     }
 
@@ -425,27 +402,41 @@ exit:
 }//end readReg
 
 /**
- * Deserializes a RegAck message. Saves the topicID for the client as well, if it has an accepted return code.
- * @param buf The buffer that contains the RegAck message.
- * @param bufSize The size of the buffer containing the RegAck message.
+ * Processes a RegAck message. If it has an accepted return code, the topicID is saved in the client's topic table along with
+ * the topic name in event->topicName, or the topic name of the bulk request message it answers. The answer is recorded in
+ * the bulk request as well.
+ * @param view The decoded RegAck message.
  * @return An int: Q_NO_ERR indicates successful processing of the RegAck message and a return code of accepted. 
- * Otherwise, Q_ERR_Unknown indicates an unknown error, Q_ERR_Deserial indicates an error with deserialization, Q_ERR_Rejected
+ * Otherwise, Q_ERR_Unknown indicates an unknown error, Q_ERR_Rejected
  * indicates a return code of rejected, and Q_ERR_MsgID indicates a mismatching msgID between the Register message and this RegAck
  * message.
  */ 
-int readRegAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readRegAck(const PacketView_t *view, Client_Event_t *event)
 {
     int returnCode = Q_ERR_Unknown;
 
-    uint8_t ack_Return = 0;
-    uint16_t ack_topicID = 0;
-    uint16_t ack_msgID = 0;
+    uint8_t ack_Return = view->returnCode;
+    uint16_t ack_topicID = view->topicID;
+    uint16_t ack_msgID = view->msgID;
+    //The message of the client's bulk request this RegAck answers, if any.
+    Bulk_t *bulk = &event->client->bulk;
+    BulkOp_t *bulkOp = NULL;
     
     FUNC_ENTRY;
-    //Check if deserialization was successful
-    if(MQTTSNDeserialize_regack(&ack_topicID, &ack_msgID, &ack_Return, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
+    //The Gateway answered, so the Register message does not have to be sent again.
+    requestAcked(event->client, MQTTSN_REGISTER, ack_msgID);
+    event->msgID = ack_msgID;
+    //The topic name comes from the bulk request if the Register message was part of one.
+    bulkOp = bulkFind(bulk, MQTTSN_REGISTER, ack_msgID);
+    const char *topicName = event->topicName;
+    if(bulkOp != NULL){
+        //A second RegAck for a Register message that was sent again.
+        if(bulkOp->answered){
+            returnCode = Q_ERR_MsgID;
+            goto exit;
+        }
+        retransmitBulkAcked(event->client, bulkOp);
+        topicName = bulkOp->topicName;
     }
     //Check if the return code value is accepted.
     if(ack_Return != MQTTSN_RC_ACCEPTED){
@@ -453,64 +444,95 @@ int readRegAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
         goto exit;
     }
     //Check that the messageID of the RegAck message matches with the one from the client's register message.
-    if(ack_msgID != event->send_msgID){
+    if(bulkOp == NULL && ack_msgID != event->send_msgID){
         returnCode = Q_ERR_MsgID;
         goto exit;
     }
 
-    //Index for this topicID to be stored.
-    size_t pubIndex = event->client->publish_Num;
-    //Increment the number of topicIDs the client has to publish to.
-    event->client->publish_Num += 1;
-    //Store the topicID given by the Server
-    event->client->pub_topicID[pubIndex] = ack_topicID;
-    returnCode = Q_NO_ERR;
+    //Store the topicID given by the Server along with the topic name that was registered.
+    size_t nameLen = (topicName != NULL) ? strlen(topicName) : 0;
+    returnCode = topicAdd(&event->client->topics, ack_topicID, topicName, nameLen, 0, Q_TOPIC_PUB);
+    if(returnCode != Q_NO_ERR){
+        goto exit;
+    }
+    //The client will need the topicID to publish to this topic.
+    if(bulkOp == NULL){
+        event->topicID = ack_topicID;
+    }
 
 exit:
+    if(bulkOp != NULL && returnCode != Q_ERR_MsgID){
+        bulkOp->topicID = (returnCode == Q_NO_ERR) ? ack_topicID : 0;
+        bulkAnswered(bulk, bulkOp, (returnCode == Q_NO_ERR) ? Q_RegAckRead : returnCode);
+    }
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 }//end readRegAck
 
 /**
- * Deserializes a PubAck message.
- * @param buf The buffer that contains the PubAck message.
- * @param bufSize The size of the buffer containing the PubAck message.
- * @param event Needed to check if the msgID and topicID of the PubAck message match with those of the sent out Publish message.
+ * Matches a PubAck message with the in flight Publish message that has the same msgID.
+ * PubAcks do not have to arrive in the order the Publish messages were sent.
+ * @param view The decoded PubAck message.
+ * @param event Used to find the client's in flight messages. On success, the msgID and topicID of the acknowledged
+ * Publish message are stored in it.
  * @return An int: Q_NO_ERR indicates a return code of accepted and a matching msgID and topicID. Otherwise, 
- * Q_ERR_Unknown indicates an unknown error, Q_ERR_Deserial indicates an error with deserialization, Q_ERR_Rejected indicates a 
- * return code of rejected, Q_ERR_MsgID indicates an error with the msgID, and Q_ERR_WrongTopicID indicates a mismatching 
- * topicID between the PubAck and Publish message.
+ * Q_ERR_Unknown indicates an unknown error, Q_ERR_Rejected indicates a 
+ * return code of rejected, Q_ERR_MsgID indicates no QoS level 1 Publish message with this msgID is in flight, 
+ * Q_ERR_WrongTopicID indicates a mismatching topicID between the PubAck and Publish message, and Q_ERR_TopicRejected
+ * indicates the Gateway does not know the topicID, in which case the rejected topicID is stored in event.
  */ 
-int readPubAck(unsigned char *buf, size_t bufSize, Client_Event_t *event)
+int readPubAck(const PacketView_t *view, Client_Event_t *event)
 {
     int returnCode = Q_ERR_Unknown;
 
     //Following variables are needed to store corresponding values contained within the message.
-    uint16_t ack_topicID = 0;
-    uint16_t ack_msgID = 0;
-    uint8_t ack_return = 0;
+    uint16_t ack_topicID = view->topicID;
+    uint16_t ack_msgID = view->msgID;
+    uint8_t ack_return = view->returnCode;
 
-    //Check if deserialization is successful
-    if (MQTTSNDeserialize_puback(&ack_topicID, &ack_msgID, &ack_return, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
+    FUNC_ENTRY;
+    //Find the Publish message this PubAck belongs to.
+    InFlightMsg_t *inFlight = inFlightFind(&event->client->inFlight, ack_msgID);
+    //The Gateway does not know the topicID, which can come back for a Publish message of any QoS level.
+    if(ack_return == MQTTSN_RC_REJECTED_INVALID_TOPIC_ID){
+        event->msgID = ack_msgID;
+        event->topicID = ack_topicID;
+        //Keep the message, it is sent again with the new topicID once the topic name has been registered again
+        //(see publishRetarget). If that has already happened, it is sent again straight away.
+        if(inFlight != NULL && (inFlight->state == Q_INFLIGHT_PUBACK || inFlight->state == Q_INFLIGHT_PUBREC)){
+            inFlight->deadlineMs = (inFlight->topicID == ack_topicID) ? 0 : timeNowMs();
+        }
+        returnCode = Q_ERR_TopicRejected;
         goto exit;
     }
-    //Check if the message has a return code value of accepted.
-    if(ack_return != MQTTSN_RC_ACCEPTED){
-        returnCode = Q_ERR_Rejected;
+    if(inFlight == NULL || inFlight->state != Q_INFLIGHT_PUBACK){
+        returnCode = Q_ERR_MsgID;
         goto exit;
     }
-    //Check that the msgID matches with that of the corresponding publish message.
-    if(ack_msgID != event->send_msgID){
-        returnCode = Q_ERR_MsgID;
+    retransmitAcked(event->client, inFlight);
+    //A rejected message will not be acknowledged again, so it no longer needs to be tracked.
+    if(ack_return != MQTTSN_RC_ACCEPTED){
+        inFlightRemove(&event->client->inFlight, inFlight);
+        //The message will not be accepted if it is sent again either, so drop it from the offline queue as well.
+        if(event->client->offline != NULL){
+            offlineQueueAcked(event->client->offline, ack_msgID);
+        }
+        returnCode = Q_ERR_Rejected;
         goto exit;
     }
     //Check that the topicID matches with that of the corresponding publish message.
-    if(ack_topicID != event->topicID){
+    if(ack_topicID != inFlight->topicID){
         returnCode = Q_ERR_WrongTopicID;
         goto exit;
     }
 
+    event->msgID = ack_msgID;
+    event->topicID = ack_topicID;
+    inFlightRemove(&event->client->inFlight, inFlight);
+    //The message is done with, so it no longer has to be kept in the offline queue (if it came from there).
+    if(event->client->offline != NULL){
+        offlineQueueAcked(event->client->offline, ack_msgID);
+    }
     returnCode = Q_NO_ERR;
 
 exit:
@@ -520,28 +542,64 @@ exit:
 
 
 /**
- * Deserializes a PubRec, PubRel, or PubComp message.
- * @param buf The buffer that contains the message.
- * @param bufSize The size of the buffer containing the message.
- * @param msgType Indicates whether this is a PubRec, PubRel, or PubComp message. 
+ * Processes a PubRec, PubRel, or PubComp message.
+ * A PubRec or PubComp is matched with the in flight QoS level 2 Publish message that has the same msgID, so they
+ * can arrive in any order. A PubRel releases the received QoS level 2 Publish message with the same msgID, so many of them
+ * can be waiting at once. A PubRel for a message the client does not know is still accepted, since the Gateway sends it
+ * again when the PubComp for it was lost.
+ * @param view The decoded message, which says whether it is a PubRec, PubRel, or PubComp message.
+ * @param event Used to find the client's in flight and received messages. The msgID of the message is stored in it.
  * @return An int: Q_NO_ERR indicates a matching msgID with the Publish message. Otherwise, Q_ERR_Unknown indicates
- * an unknown error, Q_ERR_Deserial indicates an error with deserialization, and Q_ERR_MsgID indicates a mismatching msgID 
+ * an unknown error, and Q_ERR_MsgID indicates a mismatching msgID 
  * with the Publish message.
  */ 
-int readRecRelComp(unsigned char *buf, size_t bufSize, Client_Event_t *event, unsigned char msgType)
+int readRecRelComp(const PacketView_t *view, Client_Event_t *event)
 {
     int returnCode = Q_ERR_Unknown;
-    uint16_t ack_msgID = 0;
+    uint16_t ack_msgID = view->msgID;
+    InFlightMsg_t *inFlight = NULL;
 
-    //Check if message deserialization is successful
-    if(MQTTSNDeserialize_ack(&msgType, &ack_msgID, buf, bufSize) != 1){
-        returnCode = Q_ERR_Deserial;
-        goto exit;
-    }
-    //Check if the msgID matches with the msgID of the sent publish message.
-    if(ack_msgID != event->msgID){
-        returnCode = Q_ERR_MsgID;
-        goto exit;
+    FUNC_ENTRY;
+    switch(view->msgType){
+        case MQTTSN_PUBREC:
+            inFlight = inFlightFind(&event->client->inFlight, ack_msgID);
+            //A repeated PubRec (the Gateway did not get our PubRel) is accepted so the PubRel is sent again.
+            if(inFlight == NULL || (inFlight->state != Q_INFLIGHT_PUBREC && inFlight->state != Q_INFLIGHT_PUBCOMP)){
+                returnCode = Q_ERR_MsgID;
+                goto exit;
+            }
+            //The PubRel sent in answer is timed and sent again like the Publish message was.
+            if(inFlight->state == Q_INFLIGHT_PUBREC){
+                retransmitAcked(event->client, inFlight);
+                inFlight->state = Q_INFLIGHT_PUBCOMP;
+                retransmitStart(event->client, inFlight);
+            }
+            event->msgID = ack_msgID;
+            break;
+
+        case MQTTSN_PUBCOMP:
+            inFlight = inFlightFind(&event->client->inFlight, ack_msgID);
+            if(inFlight == NULL || inFlight->state != Q_INFLIGHT_PUBCOMP){
+                returnCode = Q_ERR_MsgID;
+                goto exit;
+            }
+            event->msgID = ack_msgID;
+            retransmitAcked(event->client, inFlight);
+            inFlightRemove(&event->client->inFlight, inFlight);
+            if(event->client->offline != NULL){
+                offlineQueueAcked(event->client->offline, ack_msgID);
+            }
+            break;
+
+        case MQTTSN_PUBREL:
+            //A PubRel for a message that was already released is answered too, since the PubComp may have been lost.
+            qos2RecvRelease(&event->client->qos2Recv, ack_msgID);
+            event->msgID = ack_msgID;
+            break;
+
+        default:
+            returnCode = Q_ERR_MsgID;
+            goto exit;
     }
     returnCode = Q_NO_ERR;
 
@@ -553,60 +611,44 @@ exit:
 
 
 /**
- * Checks if there is a message that has been sent by the server.
- * @param clientSock The socket that the Client is using to exchange messages with the Gateway
+ * Checks if there is a message that has been sent by the server. Any messages waiting in the client's send batch
+ * are sent first, since the Gateway may need them before it can answer. The client waits until the next message
+ * it is waiting on an acknowledgement for is due to be sent again, or for one retransmission timeout if there is
+ * none, so the wait follows the round trip time of the Gateway. If nothing arrives, the messages that are due are
+ * sent again.
+ * @param clientPtr The Client that is exchanging messages with the Gateway
  * @return An int: Q_MsgPending indicates there is a message to be read by the Client. Q_NoMsg indicates there is no message
- * for the Client. Q_ERR_Unknown indicates an unknown error.
+ * for the Client. Q_ERR_RetryLimit indicates a message was sent the maximum number of times without an answer.
+ * Q_ERR_Socket and Q_ERR_Unknown indicate an error.
  */
-int msgReceived(int clientSock)
+int msgReceived(Client_t *clientPtr)
 {
     int returnCode = Q_ERR_Unknown;
 
-    //Determines how many microseconds the client will wait for a message.
-    //The value of 400000 gives the machine enough time to process an incoming message.
-    suseconds_t micro_sec = 400000;
-
     FUNC_ENTRY;
-    //Will be used to check the return value of select which is the number of file descriptors (FDs) 
-    //returned, 0, or -1 if there is an error.
-    int numFD_Rtrn = 0;
-    //The set of file descriptors (FDs) to be checked 
-    //if any data has been received on.
-    fd_set readSet;
-
-    //Clears out the set. This should be done before initializing and checking the FD.
-    FD_ZERO(&readSet);
-
-    //The maximum number of FDs to be read.
-    //This value must be set to the highest numbered FD (in this case, the socket) plus 1.
-    int maxFDP1 = clientSock + 1;
-
-    //Place our socket in the FD set for reading FDs.
-    FD_SET(clientSock, &readSet);
-
-    //Determines how long the client will wait for the server to send a message.
-    struct timeval timer = {0, micro_sec};
-
-    //Check if the client's socket has received any data.
-    numFD_Rtrn = select(maxFDP1, &readSet, NULL, NULL, &timer);
-    if(numFD_Rtrn > 0 && FD_ISSET(clientSock, &readSet)){
-        returnCode = Q_MsgPending;
-        goto exit;
+    sendBatchFlush(&clientPtr->batch, &clientPtr->transport);
+    int timeoutMs = retransmitTimeout(clientPtr, timeNowMs());
+    if(timeoutMs < 0){
+        timeoutMs = (int)rttTimeoutMs(&clientPtr->rtt, 0);
     }
-    else{
-        returnCode = Q_NoMsg;
-        goto exit;
+    //Check if the client's socket has received any data within the response window.
+    returnCode = socketWait(clientPtr->transport.sock, timeoutMs);
+    if(returnCode != Q_MsgPending){
+        returnCode = retransmitDue(clientPtr, timeNowMs(), NULL);
+        if(returnCode == Q_NO_ERR){
+            returnCode = Q_NoMsg;
+        }
     }
-    
-exit:    
+
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 }//End msgReceived
 
 
 /**
- * Reads in a message to a buffer and checks its type. The appropriate function is then called to deserialize the message
- * and carry out any other necessary actions. 
+ * Reads in a message to the client's receive buffer and decodes it once into the client's rxView, checking its length
+ * and type. The appropriate function is then called with the view to carry out any other necessary actions.
+ * The receive buffer is reused for every message without being cleared, since only the bytes received are decoded.
  * @param event Needed for certain messages for things such as the topicID and msgID
  * @return An int: Returns a status code that indicates a success or a failure. Some error codes are printed, while others
  * will trigger to client to take a certain action or set of actions.
@@ -615,32 +657,30 @@ int readMsg(Client_Event_t *event)
 {
     //Used to check the error code returned when a message is deserialized and processed.
     int returnCode = Q_ERR_Unknown;
-    //Buffer used to read in a message
-    unsigned char buf[Q_BUF_LEN] = {0};
-    //The size of the buffer.
-    size_t bufSize = sizeof(buf);
-    int msgType = 0;
+    //The client's own receive buffer is used to read in a message.
+    Transport_t *transport = &event->client->transport;
+    PacketView_t *view = &event->client->rxView;
+    int msgType = MQTTSNPACKET_READ_ERROR;
     FUNC_ENTRY;
-    msgType = MQTTSNPacket_read(buf, bufSize, transport_getdata);
-
-    //Check if the message has a length that is longer than the size allowed by the buffer.
-    //If it is, return an error code indicating the message is rejected due to exceeding the
-    //maximum allowed size.
-    if(buf[0] == 1) {
-        int packetLength = 0;
-        //The next two bytes determine the packet length so they will be read in as a 16 byte number.
-        unsigned char *len = (buf+1);
-        packetLength = readInt(&len);
-        if(packetLength > Q_BUF_LEN) {
-            returnCode = Q_ERR_MaxLength;
-            returnCodeHandler(returnCode);
-            goto exit;
-        }    
+    //Read in a single datagram and decode it. A datagram that could not be read is decoded as an empty one.
+    if(transport_sessionRecv(transport) < 0){
+        transport->rxLen = 0;
     }
-    
-    //Read operation failed.
-    if(msgType == MQTTSNPACKET_READ_ERROR) {
-        returnCode = Q_ERR_Read;
+    returnCode = packetViewParse(view, transport->rxBuf, transport->rxLen, Q_BUF_LEN);
+
+    //The message is longer than the size allowed by the buffer, its length field does not match the number of
+    //bytes received, or its type is not a message type. Either way it is rejected.
+    if(returnCode == Q_ERR_MaxLength || returnCode == Q_ERR_Read) {
+        //A message of an unknown type is still counted by its type, as unknown rather than as a read error.
+        if(returnCode == Q_ERR_Read && view->length == transport->rxLen){
+            msgType = view->msgType;
+        }
+        returnCodeHandler(returnCode);
+        goto exit;
+    }
+    msgType = view->msgType;
+    //The message is too short for the fields of its type.
+    if(returnCode == Q_ERR_Deserial) {
         returnCodeHandler(returnCode);
         goto exit;
     } else {
@@ -648,7 +688,9 @@ int readMsg(Client_Event_t *event)
         //and returns the appropriate status code with regards to any processing of that message.
         switch (msgType){
             case MQTTSN_CONNACK:
-                returnCode = readConnack(buf, bufSize);
+                //Accepted or not, the Connect message has been answered and does not have to be sent again.
+                requestAcked(event->client, MQTTSN_CONNECT, 0);
+                returnCode = readConnack(view);
                 //Check if the Connack indicated an accepted value for the return code.
                 if(returnCode == Q_NO_ERR) {
                     returnCode = Q_ConnackRead;
@@ -660,6 +702,8 @@ int readMsg(Client_Event_t *event)
 
             //No need to deserialize the WillTopicReq or WillMsgReq messages, as there is nothing to be checked.
             case MQTTSN_WILLTOPICREQ:
+                //The Gateway answers a Connect message with the will flag set with a WillTopicReq.
+                requestAcked(event->client, MQTTSN_CONNECT, 0);
                 returnCode = Q_WillTopReq;
                 break;
 
@@ -668,7 +712,7 @@ int readMsg(Client_Event_t *event)
                 break;
 
             case MQTTSN_WILLTOPICRESP:
-                returnCode = readWillTopResp(buf, bufSize);
+                returnCode = readWillTopResp(view);
                 //Check if the WillTopResp indicated an accepted value for the return code.
                 if(returnCode == Q_NO_ERR) {
                     returnCode = Q_TopicRespRead;
@@ -680,7 +724,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_WILLMSGRESP:
-                returnCode = readWillMsgResp(buf, bufSize);
+                returnCode = readWillMsgResp(view);
                 //Check if the WillMsgResp indicated an accepted value for the return code.
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_MsgRespRead;
@@ -707,7 +751,7 @@ int readMsg(Client_Event_t *event)
                 break;
 
             case MQTTSN_UNSUBACK:
-                returnCode = readUnsubAck(buf, bufSize, event);
+                returnCode = readUnsubAck(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_UnsubackRead;
                     break;
@@ -718,7 +762,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_SUBACK:
-                returnCode = readSubAck(buf, bufSize, event);
+                returnCode = readSubAck(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_SubAckRead;
                     break;
@@ -728,7 +772,7 @@ int readMsg(Client_Event_t *event)
                 }
             
             case MQTTSN_REGISTER:
-                returnCode = readReg(buf, bufSize, event);
+                returnCode = readReg(view, event);
                 if(returnCode != Q_ERR_Deserial && returnCode != Q_ERR_Unknown){
                     break;
                 }else{
@@ -737,7 +781,7 @@ int readMsg(Client_Event_t *event)
                 }
             
             case MQTTSN_REGACK:
-                returnCode = readRegAck(buf, bufSize, event);
+                returnCode = readRegAck(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_RegAckRead;
                     break;
@@ -747,7 +791,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_PUBACK:
-                returnCode = readPubAck(buf, bufSize, event);
+                returnCode = readPubAck(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_PubAckRead;
                     break;
@@ -757,7 +801,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_PUBREC:
-                returnCode = readRecRelComp(buf, bufSize, event, MQTTSN_PUBREC);
+                returnCode = readRecRelComp(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_PubRecRead;
                     break;
@@ -767,7 +811,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_PUBREL:
-                returnCode = readRecRelComp(buf, bufSize, event, MQTTSN_PUBREL);
+                returnCode = readRecRelComp(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_PubRelRead;
                     break;
@@ -777,7 +821,7 @@ int readMsg(Client_Event_t *event)
                 }
 
             case MQTTSN_PUBCOMP:
-                returnCode = readRecRelComp(buf, bufSize, event, MQTTSN_PUBCOMP);
+                returnCode = readRecRelComp(view, event);
                 if(returnCode == Q_NO_ERR){
                     returnCode = Q_PubCompRead;
                     break;
@@ -788,10 +832,10 @@ int readMsg(Client_Event_t *event)
 
             case MQTTSN_PUBLISH:
                 //Will have to check the returnCode in the event handler to determine what to do next.
-                returnCode = readPub(buf, bufSize, event);
+                returnCode = readPub(view, event);
                 break;
 
-            //If unknown, message type, print out its value.
+            //A message type the client does not expect from a Gateway, print out its value.
             default: 
                 puts("Unknown message type.");
                 printf("MsgType: %d\n",  msgType);
@@ -801,6 +845,8 @@ int readMsg(Client_Event_t *event)
     }//end else
 
 exit:
+    //Count the message, along with whether it was rejected or could not be deserialized.
+    statsReceived(&event->client->stats, msgType, returnCode);
     FUNC_EXIT_RC(returnCode);
     return returnCode;
 
@@ -984,6 +1030,58 @@ void returnCodeHandler(int returnCode)
             puts("Read error");
             break;
 
+        case Q_TimerExpired:
+            puts("Timer expired");
+            break;
+
+        case Q_ERR_WindowFull:
+            puts("Too many Publish messages in flight");
+            break;
+
+        case Q_ERR_QueueFull:
+            puts("Offline queue is full");
+            break;
+
+        case Q_ERR_QueueFile:
+            puts("Offline queue file could not be opened");
+            break;
+
+        case Q_ERR_RetryLimit:
+            puts("No acknowledgement after the maximum number of retransmissions");
+            break;
+
+        case Q_ERR_NotConnected:
+            puts("Not connected to the Gateway");
+            break;
+
+        case Q_ERR_NotRegistered:
+            puts("Topic name has not been registered");
+            break;
+
+        case Q_ERR_NoGateway:
+            puts("No Gateway found");
+            break;
+
+        case Q_ERR_GatewayCache:
+            puts("Error with the Gateway cache file");
+            break;
+
+        case Q_ERR_TopicCache:
+            puts("Error with the topic cache file");
+            break;
+
+        case Q_ERR_TopicRejected:
+            puts("TopicID not known to the Gateway");
+            break;
+
+        case Q_BulkDone:
+            puts("Bulk request answered");
+            break;
+
+        case Q_Wakeup:
+            puts("Woken by another thread");
+            break;
+
         default:
             puts("Foreign return code");
             break;
@@ -0,0 +1,193 @@
+/**
+ * Contains the function a sleeping client uses to collect the messages the Gateway buffered for it while it slept.
+ * The client wakes by sending a PingReq with its clientID, and the Gateway answers with every buffered Publish and
+ * Register message followed by a PingResp. Every message that has already arrived is read back to back without
+ * waiting, and the acknowledgements for them are sent together in one batch once the socket runs dry. The client can
+ * go back to sleep as soon as the PingResp has been read, so the radio stays on for as short a time as possible.
+ * wakeDrain does the whole wake in one blocking call. A client run by an executor uses wakeStart, wakeRead, and
+ * wakeTimeout instead, waiting for the socket and the timeout along with every other client.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "Events.h"
+#include "ErrorCodes.h"
+#include "Util.h"
+#include "PingReq.h"
+#include "PubAck.h"
+#include "RegAck.h"
+#include "PubRecRelComp.h"
+#include "EventLoop.h"
+#include "WakeDrain.h"
+#include "StackTrace.h"
+
+/**
+ * Starts a sleeping client's wake by sending a PingReq with its clientID.
+ * @param clientPtr The client. It must have been put to sleep with a Disconnect message with a duration.
+ * @param clientID An MQTTSNString holding the client's clientID, so the Gateway sends its buffered messages.
+ * @param wake The state of the wake, which is reset.
+ * @return An int: Q_NO_ERR indicates the PingReq was sent, and the client should wait rttTimeoutMs of its round trip
+ * time estimate with wake->attempts for the Gateway's messages. Otherwise, Q_ERR_Socket or Q_ERR_Serial.
+ */
+int wakeStart(Client_t *clientPtr, MQTTSNString *clientID, WakeDrain_t *wake)
+{
+    wake->attempts = 0;
+    wake->pingResp = false;
+    wake->awaitingPubRel = 0;
+    return pingReq(clientPtr, clientID);
+}//End wakeStart
+
+/**
+ * Reads one message the Gateway sent a waking client and adds its acknowledgement to the client's batch. Received
+ * Publish messages are passed to their topic's handler as usual. The batch is left for the caller to send once the
+ * socket runs dry.
+ * @param event The client's event.
+ * @param wake The state of the wake, from wakeStart.
+ * @return An int: Q_NO_ERR indicates more messages are to come. Q_PingRespRead indicates every buffered message was
+ * read, and the client can go back to sleep once the batch has been sent. Otherwise, Q_DisconRead indicates the Gateway
+ * disconnected the client, and Q_ERR_Socket or Q_ERR_Serial indicate an acknowledgement could not be sent.
+ */
+int wakeRead(Client_Event_t *event, WakeDrain_t *wake)
+{
+    int returnCode = Q_ERR_Unknown;
+    Client_t *clientPtr = event->client;
+    int ackCode = Q_NO_ERR;
+
+    FUNC_ENTRY;
+    //Acknowledgements are added to the client's batch rather than sent one by one.
+    returnCode = readMsg(event);
+    switch(returnCode){
+        case Q_pubQos1:
+            ackCode = pubAck(clientPtr, event->topicID, event->msgID, MQTTSN_RC_ACCEPTED);
+            break;
+
+        case Q_pubQos2:
+            ackCode = pubRecRelComp(clientPtr, event->msgID, MQTTSN_PUBREC);
+            wake->awaitingPubRel += 1;
+            break;
+
+        //A PubRel for a message from an earlier wake counts too, which can only end the wait early.
+        case Q_PubRelRead:
+            ackCode = pubRecRelComp(clientPtr, event->msgID, MQTTSN_PUBCOMP);
+            if(wake->awaitingPubRel > 0){
+                wake->awaitingPubRel -= 1;
+            }
+            break;
+
+        //A Publish message for a topicID the client does not know.
+        case Q_ERR_WrongTopicID:
+            ackCode = pubAck(clientPtr, event->topicID, event->msgID, MQTTSN_RC_REJECTED_INVALID_TOPIC_ID);
+            break;
+
+        //A Register message for a wildcard subscription.
+        case Q_Subscribed:
+        case Q_Wildcard:
+            ackCode = regAck(clientPtr, event->topicID, event->msgID, MQTTSN_RC_ACCEPTED);
+            break;
+
+        case Q_RejectReg:
+            ackCode = regAck(clientPtr, event->topicID, event->msgID, MQTTSN_RC_REJECTED_INVALID_TOPIC_ID);
+            break;
+
+        case Q_PingRespRead:
+            wake->pingResp = true;
+            break;
+
+        case Q_DisconRead:
+            goto exit;
+
+        //QoS level 0 Publish messages and acknowledgements of the client's own messages need no answer.
+        default:
+            break;
+    }
+    if(ackCode != Q_NO_ERR){
+        returnCode = ackCode;
+        goto exit;
+    }
+    //The PubRel of every QoS level 2 message answered during this wake is waited for too. Messages left unreleased by
+    //an earlier wake are not, so one whose PubRel never comes does not keep the radio on for every later wake.
+    returnCode = (wake->pingResp && wake->awaitingPubRel == 0) ? Q_PingRespRead : Q_NO_ERR;
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End wakeRead
+
+/**
+ * Handles a waking client's wait running out with nothing received: sends the PingReq again with the same backoff as
+ * any other message, up to Q_RETRANSMIT_MAX times, or ends the wake if the PingResp has already been read.
+ * @param clientPtr The client.
+ * @param clientID An MQTTSNString holding the client's clientID.
+ * @param wake The state of the wake, from wakeStart.
+ * @return An int: Q_NO_ERR indicates the PingReq was sent again, and the client should wait rttTimeoutMs of its round
+ * trip time estimate with wake->attempts once more. Q_PingRespRead indicates the wake is over. Otherwise,
+ * Q_ERR_NoPingResp indicates no PingResp arrived, and Q_ERR_Socket or Q_ERR_Serial that the PingReq could not be sent.
+ */
+int wakeTimeout(Client_t *clientPtr, MQTTSNString *clientID, WakeDrain_t *wake)
+{
+    //The PingResp arrived, so a missing PubRel will be sent again on the next wake.
+    if(wake->pingResp){
+        return Q_PingRespRead;
+    }
+    //Otherwise the PingReq or its PingResp was lost.
+    if(wake->attempts >= Q_RETRANSMIT_MAX){
+        return Q_ERR_NoPingResp;
+    }
+    wake->attempts += 1;
+    statsRetransmitted(&clientPtr->stats, MQTTSN_PINGREQ);
+    return pingReq(clientPtr, clientID);
+}//End wakeTimeout
+
+/**
+ * Wakes a sleeping client and reads every message the Gateway buffered for it, acknowledging them in batches.
+ * Received Publish messages are passed to their topic's handler as usual. If nothing arrives in time, the PingReq
+ * is sent again with the same backoff as any other message, up to Q_RETRANSMIT_MAX times. Once the PingResp has been
+ * read, the client waits at most one more timeout for the PubRel of each QoS level 2 message it received on this wake.
+ * Blocks until the wake is over, so it is only for a client that has the thread to itself.
+ * @param event The client's event. Its client must have been put to sleep with a Disconnect message with a duration.
+ * @param clientID An MQTTSNString holding the client's clientID, so the Gateway sends its buffered messages.
+ * @return An int: Q_PingRespRead indicates every buffered message was read and acknowledged, and the client can go
+ * back to sleep. Otherwise, Q_DisconRead indicates the Gateway disconnected the client, Q_ERR_NoPingResp indicates
+ * no PingResp arrived, and Q_ERR_Socket or Q_ERR_Serial indicate a message could not be sent.
+ */
+int wakeDrain(Client_Event_t *event, MQTTSNString *clientID)
+{
+    int returnCode = Q_ERR_Unknown;
+    Client_t *clientPtr = event->client;
+    WakeDrain_t wake;
+
+    FUNC_ENTRY;
+    returnCode = wakeStart(clientPtr, clientID, &wake);
+    while(returnCode == Q_NO_ERR){
+        //Read everything that has already arrived before waiting, so a burst is handled back to back.
+        if(socketWait(clientPtr->transport.sock, 0) != Q_MsgPending){
+            //Send the acknowledgements for everything read so far together, then wait for more.
+            if(sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+                returnCode = Q_ERR_Socket;
+                goto exit;
+            }
+            int timeoutMs = (int)rttTimeoutMs(&clientPtr->rtt, wake.attempts);
+            if(socketWait(clientPtr->transport.sock, timeoutMs) != Q_MsgPending){
+                returnCode = wakeTimeout(clientPtr, clientID, &wake);
+                continue;
+            }
+        }
+        returnCode = wakeRead(event, &wake);
+    }
+    if(returnCode != Q_PingRespRead){
+        goto exit;
+    }
+
+    //The acknowledgements of the last messages read go out before the client goes back to sleep.
+    if(sendBatchFlush(&clientPtr->batch, &clientPtr->transport) != Q_NO_ERR){
+        returnCode = Q_ERR_Socket;
+    }
+
+exit:
+    FUNC_EXIT_RC(returnCode);
+    return returnCode;
+}//End wakeDrain
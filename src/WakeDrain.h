@@ -0,0 +1,29 @@
+/**
+ * Header file for WakeDrain.c
+ * Defines the WakeDrain_t struct that keeps track of a sleeping client's wake, so a client that cannot block while it
+ * waits for the Gateway (one of many run by an executor) can drive the wake one message at a time.
+ * Client_t.h, Events.h, and MQTTSNPacket.h must be included before this file.
+ */
+
+#ifndef Q_WAKEDRAIN_H
+#define Q_WAKEDRAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    //The number of times the PingReq has been sent again.
+    uint8_t attempts;
+    //Whether the PingResp that ends the Gateway's buffered messages has been read.
+    bool pingResp;
+    //QoS level 2 messages answered with a PubRec during this wake whose PubRel has not been read yet.
+    size_t awaitingPubRel;
+} WakeDrain_t;
+
+int wakeStart(Client_t *clientPtr, MQTTSNString *clientID, WakeDrain_t *wake); //prototype
+int wakeRead(Client_Event_t *event, WakeDrain_t *wake); //prototype
+int wakeTimeout(Client_t *clientPtr, MQTTSNString *clientID, WakeDrain_t *wake); //prototype
+int wakeDrain(Client_Event_t *event, MQTTSNString *clientID); //prototype
+
+#endif
@@ -53,7 +53,7 @@ int willMsg(Client_t *clientPtr, MQTTSNString *willMsg)
         goto exit;
     }
     //Send the message out.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
 
     //Ensure transfer of the packet is successful. 
     if(returnCode2 != 0) {
@@ -53,7 +53,7 @@ int WillMsgUpd(Client_t *clientPtr, const MQTTSNString *willMsg)
     }
 
     //Send the message out.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
 
     //Check if the message was successfully sent out.
     if(returnCode2 != 0){
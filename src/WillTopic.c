@@ -59,7 +59,7 @@ int willTopic(Client_t *clientPtr, MQTTSNFlags flags, MQTTSNString willTopic)
     }
 
     //Send out the packet.
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
 
     if (returnCode2 != 0){
         returnCode = Q_ERR_Socket;
@@ -57,7 +57,7 @@ int WillTopicUpd(Client_t *clientPtr, const MQTTSNFlags *flags, const MQTTSNStri
     }
 
     //Send the message
-    ssize_t returnCode2 = transport_sendPacketBuffer(clientPtr->host, clientPtr->destinationPort, buf, serialLength);
+    int returnCode2 = sendBatchDirect(&clientPtr->batch, &clientPtr->transport, buf, serialLength);
 
     //Ensure that the message was successfully sent
     if(returnCode2 != 0){
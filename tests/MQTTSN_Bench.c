@@ -0,0 +1,1067 @@
+/**
+ * Throughput and latency benchmark for the client library.
+ * Runs a minimal MQTT-SN gateway on a thread of its own, listening on a UDP port on localhost, so no real Gateway
+ * is needed. The stand-in answers Connect, Register, Subscribe, Publish, PubRel, PingReq, and Disconnect messages,
+ * echoes Publish messages back on topics the client subscribed to, streams Publish messages to the client
+ * when it subscribes to the fan-in topic, and answers a sleeping client's wake up with a burst of buffered messages.
+ * A second client that never connects publishes with QoS level -1, and a third runs its session on an I/O thread of
+ * its own and publishes with QoS level 1 from BENCH_PRODUCERS threads at once. Finally BENCH_FLOWS clients run side by
+ * side on this thread, each as a flow that connects, registers, and publishes with QoS level 1 one message at a time,
+ * first with the executor waiting on epoll and then with every datagram going through a transport ring (io_uring).
+ * Each scenario is timed on the client side and the results are written to stdout as a single JSON object, with
+ * msgs/sec and the 50th, 99th, and 99.9th percentile round trip latency in microseconds. The latency of the QoS 1
+ * scenarios that keep several messages in flight is from send to PubAck, taken from the clients' statistics to within
+ * 1/8th, and the latency of the burst scenarios, which time no single message, is null. Progress goes to stderr.
+ * Usage: ./MQTTSN_Bench [messages per scenario]
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "MQTTSNPublish.h"
+#include "MQTTSNConnect.h"
+#include "Events.h"
+#include "Util.h"
+#include "ErrorCodes.h"
+#include "transport.h"
+#include "Connect.h"
+#include "Register.h"
+#include "Subscribe.h"
+#include "Publish.h"
+#include "PubAck.h"
+#include "PubRecRelComp.h"
+#include "PingReq.h"
+#include "Disconnect.h"
+#include "StackTrace.h"
+#include "EventLoop.h"
+#include "WakeDrain.h"
+#include "Session.h"
+#include "ClientThread.h"
+#include "Executor.h"
+
+//Number of messages sent in each scenario unless given on the command line.
+#define BENCH_DEFAULT_MESSAGES 20000
+//How long the client waits for any single reply before the scenario is abandoned.
+#define BENCH_REPLY_TIMEOUT_MS 2000
+//Most topics the stand-in gateway keeps track of.
+#define BENCH_GW_TOPICS 16
+//QoS 0 Publish messages sent in a row before the client waits for the gateway to catch up.
+#define BENCH_BURST_LEN 128
+//Most Publish messages the stand-in gateway streams to the client before it waits for PubAcks.
+#define BENCH_FANIN_WINDOW 32
+//Application threads that publish at once through the I/O thread in the publish_qos1_threaded scenario.
+#define BENCH_PRODUCERS 8
+//Clients run at once by the executor in the publish_qos1_flows scenario.
+#define BENCH_FLOWS 256
+//Submission queue entries of the transport ring in the publish_qos1_flows_ring scenario.
+#define BENCH_RING_ENTRIES 1024
+//Publish messages the stand-in gateway buffers for the client each time it sleeps in the wake_drain scenario.
+#define BENCH_WAKE_BURST 50
+
+//Topic the client subscribes and publishes to, so every message comes back to it.
+#define BENCH_TOPIC_ECHO "bench/echo"
+//Topic the client only publishes to.
+#define BENCH_TOPIC_DATA "bench/data"
+//Subscribing to this topic makes the stand-in gateway stream messages to the client.
+#define BENCH_TOPIC_FANIN "bench/fanin"
+
+//State of the stand-in gateway, shared with the benchmark thread.
+typedef struct {
+    int sock;
+    volatile bool stop;
+    //Topic names in order of their topicID, which is the index plus one.
+    char topics[BENCH_GW_TOPICS][32];
+    bool subscribed[BENCH_GW_TOPICS];
+    uint16_t topicCount;
+    //Publish messages received from the client.
+    volatile uint64_t published;
+    //Fan-in messages to stream, sent so far, and acknowledged by the client.
+    uint32_t fanInTotal;
+    uint32_t fanInSent;
+    uint32_t fanInAcked;
+    uint16_t fanInTopicID;
+    //Publish messages sent to the client when it wakes from sleep, before the PingResp. 0 to send none.
+    uint32_t wakeBurst;
+    uint16_t wakeMsgID;
+} BenchGateway_t;
+
+//Latency samples and counters collected by a scenario.
+typedef struct {
+    uint64_t *samples;
+    size_t count;
+    size_t capacity;
+    //Messages received through the client's message handler.
+    size_t received;
+    //PubAck round trips taken from the clients' statistics, for the scenarios that keep several messages in flight
+    //and so cannot time each one themselves.
+    Histogram_t acks;
+} BenchSamples_t;
+
+//One of the application threads of the publish_qos1_threaded scenario.
+typedef struct {
+    ClientThread_t *ct;
+    size_t messages;
+    const unsigned char *payload;
+    size_t payloadLen;
+} BenchProducer_t;
+
+//One of the clients of the publish_qos1_flows scenario, and the state its flow keeps across waits.
+typedef struct {
+    Client_t client;
+    Session_t session;
+    Flow_t flow;
+    size_t messages;
+    size_t acked;
+    const unsigned char *payload;
+    size_t payloadLen;
+} BenchFlow_t;
+
+uint64_t benchNowNs(void); //prototype
+void *gatewayThread(void *arg); //prototype
+void gatewayHandle(BenchGateway_t *gw, unsigned char *buf, size_t len, struct sockaddr_in *from); //prototype
+void gatewayFanIn(BenchGateway_t *gw, struct sockaddr_in *to); //prototype
+void gatewayWake(BenchGateway_t *gw, struct sockaddr_in *to); //prototype
+uint16_t gatewayTopic(BenchGateway_t *gw, const char *name, size_t nameLen); //prototype
+void benchMessageArrived(const Q_Message_t *message, void *context); //prototype
+int benchWait(Client_Event_t *event, int expected); //prototype
+void benchRecord(BenchSamples_t *samples, uint64_t value); //prototype
+void benchRecordAcks(BenchSamples_t *samples, const Histogram_t *acks); //prototype
+int benchCompare(const void *first, const void *second); //prototype
+void benchReport(const char *name, BenchSamples_t *samples, size_t messages, uint64_t elapsedNs, bool *firstResult); //prototype
+void *benchProducer(void *arg); //prototype
+size_t benchThreaded(int port, size_t messages, const unsigned char *payload, size_t payloadLen, BenchSamples_t *samples); //prototype
+int benchFlow(Flow_t *flow); //prototype
+size_t benchFlows(int port, size_t messages, const unsigned char *payload, size_t payloadLen, unsigned int ringEntries,
+    BenchSamples_t *samples); //prototype
+
+/**
+ * @return The current time of the monotonic clock in nanoseconds.
+ */
+uint64_t benchNowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}//End benchNowNs
+
+/**
+ * Finds the topicID of a topic name, giving the name a new topicID if the stand-in gateway has not seen it before.
+ * @param gw The stand-in gateway.
+ * @param name The topic name, not null terminated.
+ * @param nameLen The length of the topic name.
+ * @return The topicID, or 0 if the gateway has no room for another topic.
+ */
+uint16_t gatewayTopic(BenchGateway_t *gw, const char *name, size_t nameLen)
+{
+    if(nameLen >= sizeof(gw->topics[0])){
+        return 0;
+    }
+    for(uint16_t index = 0; index < gw->topicCount; ++index){
+        if(strlen(gw->topics[index]) == nameLen && memcmp(gw->topics[index], name, nameLen) == 0){
+            return (uint16_t)(index + 1);
+        }
+    }
+    if(gw->topicCount == BENCH_GW_TOPICS){
+        return 0;
+    }
+    memcpy(gw->topics[gw->topicCount], name, nameLen);
+    gw->topics[gw->topicCount][nameLen] = '\0';
+    gw->topicCount = (uint16_t)(gw->topicCount + 1);
+    return gw->topicCount;
+}//End gatewayTopic
+
+/**
+ * Sends QoS level 1 fan-in messages to the client until BENCH_FANIN_WINDOW of them are waiting for a PubAck.
+ * Each payload starts with the time it was sent, so the client can work out the latency.
+ * @param gw The stand-in gateway.
+ * @param to The address of the client.
+ * @return void
+ */
+void gatewayFanIn(BenchGateway_t *gw, struct sockaddr_in *to)
+{
+    unsigned char frame[64];
+    unsigned char payload[16];
+    MQTTSN_topicid topic;
+    topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    topic.data.id = gw->fanInTopicID;
+
+    while(gw->fanInSent < gw->fanInTotal && gw->fanInSent - gw->fanInAcked < BENCH_FANIN_WINDOW){
+        uint64_t stamp = benchNowNs();
+        memcpy(payload, &stamp, sizeof(stamp));
+        memcpy(payload + sizeof(stamp), &gw->fanInSent, sizeof(gw->fanInSent));
+        //MsgIDs 1 to 65535 are reused in turn.
+        uint16_t msgID = (uint16_t)(gw->fanInSent % 65535u + 1u);
+        int len = MQTTSNSerialize_publish(frame, sizeof(frame), 0, 1, 0, msgID, topic, payload, sizeof(payload));
+        if(len <= 0){
+            return;
+        }
+        sendto(gw->sock, frame, (size_t)len, 0, (struct sockaddr *)to, sizeof(*to));
+        gw->fanInSent += 1;
+    }
+}//End gatewayFanIn
+
+/**
+ * Sends the client the QoS level 1 messages buffered for it while it slept, on the fan-in topic. The payloads are
+ * too short to carry a time, so they are counted but not timed by the client.
+ * @param gw The stand-in gateway.
+ * @param to The address of the client.
+ * @return void
+ */
+void gatewayWake(BenchGateway_t *gw, struct sockaddr_in *to)
+{
+    unsigned char frame[32];
+    unsigned char payload[4] = {'w', 'a', 'k', 'e'};
+    MQTTSN_topicid topic;
+    topic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    topic.data.id = gw->fanInTopicID;
+
+    for(uint32_t count = 0; count < gw->wakeBurst; ++count){
+        gw->wakeMsgID = (uint16_t)(gw->wakeMsgID % 65535u + 1u);
+        int len = MQTTSNSerialize_publish(frame, sizeof(frame), 0, 1, 0, gw->wakeMsgID, topic, payload, sizeof(payload));
+        if(len <= 0){
+            return;
+        }
+        sendto(gw->sock, frame, (size_t)len, 0, (struct sockaddr *)to, sizeof(*to));
+    }
+}//End gatewayWake
+
+/**
+ * Answers a single message from the client the way a Gateway would.
+ * @param gw The stand-in gateway.
+ * @param buf The message from the client.
+ * @param len The length of the message.
+ * @param from The address of the client, where the answer is sent.
+ * @return void
+ */
+void gatewayHandle(BenchGateway_t *gw, unsigned char *buf, size_t len, struct sockaddr_in *from)
+{
+    unsigned char reply[64];
+    int replyLen = 0;
+    //The length field is 1 byte, or 3 bytes starting with 0x01.
+    size_t typeOffset = (buf[0] == 0x01) ? 3 : 1;
+    if(len <= typeOffset){
+        return;
+    }
+
+    switch(buf[typeOffset]){
+        case MQTTSN_CONNECT:
+            reply[0] = 3;
+            reply[1] = MQTTSN_CONNACK;
+            reply[2] = MQTTSN_RC_ACCEPTED;
+            replyLen = 3;
+            break;
+
+        case MQTTSN_REGISTER: {
+            unsigned short topicID = 0;
+            unsigned short msgID = 0;
+            MQTTSNString topicName = MQTTSNString_initializer;
+            if(MQTTSNDeserialize_register(&topicID, &msgID, &topicName, buf, len) != 1){
+                return;
+            }
+            topicID = gatewayTopic(gw, topicName.lenstring.data, topicName.lenstring.len);
+            replyLen = MQTTSNSerialize_regack(reply, sizeof(reply), topicID, msgID,
+                (topicID != 0) ? MQTTSN_RC_ACCEPTED : MQTTSN_RC_REJECTED_CONGESTED);
+            break;
+        }
+
+        case MQTTSN_SUBSCRIBE: {
+            //Flags, msgID, and the topic name follow the message type.
+            if(len < typeOffset + 4){
+                return;
+            }
+            MQTTSNFlags flags;
+            flags.all = buf[typeOffset + 1];
+            uint16_t msgID = (uint16_t)(buf[typeOffset + 2] << 8 | buf[typeOffset + 3]);
+            const char *name = (const char *)&buf[typeOffset + 4];
+            size_t nameLen = len - typeOffset - 4;
+            uint16_t topicID = gatewayTopic(gw, name, nameLen);
+            if(topicID != 0){
+                gw->subscribed[topicID - 1] = true;
+            }
+            reply[0] = 8;
+            reply[1] = MQTTSN_SUBACK;
+            reply[2] = (unsigned char)(flags.bits.QoS << 5);
+            reply[3] = (unsigned char)(topicID >> 8);
+            reply[4] = (unsigned char)topicID;
+            reply[5] = (unsigned char)(msgID >> 8);
+            reply[6] = (unsigned char)msgID;
+            reply[7] = (topicID != 0) ? MQTTSN_RC_ACCEPTED : MQTTSN_RC_REJECTED_CONGESTED;
+            sendto(gw->sock, reply, 8, 0, (struct sockaddr *)from, sizeof(*from));
+            //The fan-in stream starts as soon as the client has its SubAck.
+            if(topicID != 0 && nameLen == strlen(BENCH_TOPIC_FANIN) && memcmp(name, BENCH_TOPIC_FANIN, nameLen) == 0){
+                gw->fanInTopicID = topicID;
+                gw->fanInSent = 0;
+                gw->fanInAcked = 0;
+                gatewayFanIn(gw, from);
+            }
+            return;
+        }
+
+        case MQTTSN_PUBLISH: {
+            unsigned char dup = 0;
+            int qos = 0;
+            unsigned char retained = 0;
+            unsigned short msgID = 0;
+            MQTTSN_topicid topic;
+            unsigned char *payload = NULL;
+            int payloadLen = 0;
+            if(MQTTSNDeserialize_publish(&dup, &qos, &retained, &msgID, &topic, &payload, &payloadLen, buf, len) != 1){
+                return;
+            }
+            gw->published += 1;
+            //Send the message straight back if the client is subscribed to its topic.
+            if(topic.data.id != 0 && topic.data.id <= gw->topicCount && gw->subscribed[topic.data.id - 1]){
+                sendto(gw->sock, buf, len, 0, (struct sockaddr *)from, sizeof(*from));
+            }
+            if(qos == 1){
+                replyLen = MQTTSNSerialize_puback(reply, sizeof(reply), topic.data.id, msgID, MQTTSN_RC_ACCEPTED);
+            } else if(qos == 2){
+                replyLen = MQTTSNSerialize_pubrec(reply, sizeof(reply), msgID);
+            }
+            break;
+        }
+
+        case MQTTSN_PUBREL: {
+            unsigned char type = 0;
+            unsigned short msgID = 0;
+            if(MQTTSNDeserialize_ack(&type, &msgID, buf, len) != 1){
+                return;
+            }
+            replyLen = MQTTSNSerialize_pubcomp(reply, sizeof(reply), msgID);
+            break;
+        }
+
+        case MQTTSN_PUBACK:
+            //Acknowledges a fan-in message, so there is room for another one.
+            gw->fanInAcked += 1;
+            gatewayFanIn(gw, from);
+            return;
+
+        case MQTTSN_PINGREQ:
+            //A PingReq with a clientID wakes a sleeping client, which is sent its buffered messages first.
+            if(len > typeOffset + 1){
+                gatewayWake(gw, from);
+            }
+            reply[0] = 2;
+            reply[1] = MQTTSN_PINGRESP;
+            replyLen = 2;
+            break;
+
+        case MQTTSN_DISCONNECT:
+            replyLen = MQTTSNSerialize_disconnect(reply, sizeof(reply), -1);
+            break;
+
+        default:
+            return;
+    }
+
+    if(replyLen > 0){
+        sendto(gw->sock, reply, (size_t)replyLen, 0, (struct sockaddr *)from, sizeof(*from));
+    }
+}//End gatewayHandle
+
+/**
+ * Runs the stand-in gateway until it is told to stop.
+ * @param arg The BenchGateway_t the gateway uses.
+ * @return NULL
+ */
+void *gatewayThread(void *arg)
+{
+    BenchGateway_t *gw = (BenchGateway_t *)arg;
+    unsigned char buf[TRANSPORT_RX_LEN];
+    struct pollfd readFD;
+    readFD.fd = gw->sock;
+    readFD.events = POLLIN;
+
+    while(!gw->stop){
+        //Wake up now and then to check if the benchmark is over.
+        if(poll(&readFD, 1, 100) <= 0){
+            continue;
+        }
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t len = recvfrom(gw->sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromLen);
+        if(len > 0){
+            gatewayHandle(gw, buf, (size_t)len, &from);
+        }
+    }
+    return NULL;
+}//End gatewayThread
+
+/**
+ * Counts a Publish message received by the client. Fan-in messages carry the time the gateway sent them,
+ * which is used to record their latency.
+ * @param message The received message.
+ * @param context The BenchSamples_t of the scenario that is running.
+ * @return void
+ */
+void benchMessageArrived(const Q_Message_t *message, void *context)
+{
+    BenchSamples_t *samples = (BenchSamples_t *)context;
+    samples->received += 1;
+    if(message->qos == 1 && message->payloadLen >= sizeof(uint64_t)){
+        uint64_t stamp;
+        memcpy(&stamp, message->payload, sizeof(stamp));
+        benchRecord(samples, benchNowNs() - stamp);
+    }
+}//End benchMessageArrived
+
+/**
+ * Reads messages from the gateway until one of the expected type arrives. Fan-in messages that arrive in the
+ * meantime are acknowledged.
+ * @param event The client's event.
+ * @param expected The return code of readMsg that is waited for, for example Q_PubAckRead.
+ * @return An int: Q_NO_ERR indicates the expected message arrived. Otherwise, Q_NoMsg indicates nothing arrived
+ * within BENCH_REPLY_TIMEOUT_MS.
+ */
+int benchWait(Client_Event_t *event, int expected)
+{
+    uint64_t deadline = benchNowNs() + (uint64_t)BENCH_REPLY_TIMEOUT_MS * 1000000u;
+
+    while(benchNowNs() < deadline){
+        //Any batched messages are sent before waiting.
+        sendBatchFlush(&event->client->batch, &event->client->transport);
+        if(socketWait(event->client->transport.sock, BENCH_REPLY_TIMEOUT_MS) != Q_MsgPending){
+            continue;
+        }
+        int returnCode = readMsg(event);
+        if(returnCode == Q_pubQos1){
+            pubAck(event->client, event->topicID, event->msgID, MQTTSN_RC_ACCEPTED);
+        }
+        if(returnCode == expected){
+            return Q_NO_ERR;
+        }
+    }
+    return Q_NoMsg;
+}//End benchWait
+
+/**
+ * Adds a latency sample, growing the sample array as needed.
+ * @param samples The samples of the scenario that is running.
+ * @param value The latency in nanoseconds.
+ * @return void
+ */
+void benchRecord(BenchSamples_t *samples, uint64_t value)
+{
+    if(samples->count == samples->capacity){
+        size_t capacity = (samples->capacity == 0) ? 1024 : samples->capacity * 2;
+        uint64_t *grown = realloc(samples->samples, capacity * sizeof(uint64_t));
+        if(grown == NULL){
+            return;
+        }
+        samples->samples = grown;
+        samples->capacity = capacity;
+    }
+    samples->samples[samples->count++] = value;
+}//End benchRecord
+
+/**
+ * Adds the PubAck round trips a client recorded in its statistics to those of the scenario.
+ * @param samples The samples of the scenario that is running.
+ * @param acks The client's PubAck histogram, clientPtr->stats.rtt[Q_RTT_PUBACK].
+ * @return void
+ */
+void benchRecordAcks(BenchSamples_t *samples, const Histogram_t *acks)
+{
+    for(size_t index = 0; index < Q_HIST_BUCKETS; ++index){
+        samples->acks.buckets[index] += acks->buckets[index];
+    }
+    samples->acks.count += acks->count;
+    samples->acks.sumUs += acks->sumUs;
+    if(acks->count > 0 && (samples->acks.count == acks->count || acks->minUs < samples->acks.minUs)){
+        samples->acks.minUs = acks->minUs;
+    }
+    if(acks->maxUs > samples->acks.maxUs){
+        samples->acks.maxUs = acks->maxUs;
+    }
+}//End benchRecordAcks
+
+/**
+ * Orders two latency samples for qsort.
+ */
+int benchCompare(const void *first, const void *second)
+{
+    uint64_t a = *(const uint64_t *)first;
+    uint64_t b = *(const uint64_t *)second;
+    return (a > b) - (a < b);
+}//End benchCompare
+
+/**
+ * Writes the result of one scenario as a JSON object and clears its samples.
+ * @param name The name of the scenario.
+ * @param samples The latency samples of the scenario. The percentiles come from the PubAck round trips if there are
+ * no samples, and are null if there are neither.
+ * @param messages The number of messages that made it through.
+ * @param elapsedNs How long the scenario took.
+ * @param firstResult True for the first scenario, so no comma is written before it. Set to false.
+ * @return void
+ */
+void benchReport(const char *name, BenchSamples_t *samples, size_t messages, uint64_t elapsedNs, bool *firstResult)
+{
+    //Each percentile as JSON and as text, left as null and - when nothing was measured.
+    char json[3][24] = {"null", "null", "null"};
+    char text[3][24] = {"-", "-", "-"};
+    const double rank[3] = {0.50, 0.99, 0.999};
+
+    for(int index = 0; index < 3; ++index){
+        double percentile = 0.0;
+        if(samples->count > 0){
+            if(index == 0){
+                qsort(samples->samples, samples->count, sizeof(uint64_t), benchCompare);
+            }
+            size_t position = (size_t)(rank[index] * (double)samples->count);
+            if(position >= samples->count){
+                position = samples->count - 1;
+            }
+            percentile = (double)samples->samples[position] / 1000.0;
+        } else if(samples->acks.count > 0){
+            percentile = (double)histogramPercentile(&samples->acks, rank[index] * 100.0);
+        } else {
+            continue;
+        }
+        snprintf(json[index], sizeof(json[index]), "%.2f", percentile);
+        snprintf(text[index], sizeof(text[index]), "%.2f", percentile);
+    }
+    double rate = (elapsedNs > 0) ? (double)messages * 1e9 / (double)elapsedNs : 0.0;
+
+    printf("%s\n    {\"name\": \"%s\", \"messages\": %zu, \"msgs_per_sec\": %.1f, "
+        "\"p50_us\": %s, \"p99_us\": %s, \"p999_us\": %s}",
+        *firstResult ? "" : ",", name, messages, rate, json[0], json[1], json[2]);
+    fprintf(stderr, "%-20s %8zu msgs %12.1f msgs/s  p50 %8s us  p99 %8s us  p999 %8s us\n",
+        name, messages, rate, text[0], text[1], text[2]);
+    *firstResult = false;
+    samples->count = 0;
+    samples->received = 0;
+    memset(&samples->acks, 0, sizeof(samples->acks));
+}//End benchReport
+
+/**
+ * Body of an application thread of the publish_qos1_threaded scenario. Publishes its share of the messages through
+ * the I/O thread, trying again whenever the submission ring is full.
+ * @param arg The thread's BenchProducer_t.
+ * @return NULL
+ */
+void *benchProducer(void *arg)
+{
+    BenchProducer_t *producer = arg;
+    for(size_t done = 0; done < producer->messages; ){
+        int returnCode = clientThreadPublish(producer->ct, BENCH_TOPIC_DATA, 1, producer->payload, producer->payloadLen);
+        if(returnCode == Q_NO_ERR){
+            done += 1;
+        } else if(returnCode == Q_ERR_QueueFull){
+            sched_yield();
+        } else {
+            break;
+        }
+    }
+    return NULL;
+}//End benchProducer
+
+/**
+ * Runs the publish_qos1_threaded scenario: connects a client of its own, hands its session to an I/O thread, and
+ * publishes QoS level 1 messages from BENCH_PRODUCERS threads at once until every one has been acknowledged.
+ * @param port The port of the stand-in gateway.
+ * @param messages The number of messages to publish, split between the threads.
+ * @param payload The payload of every message.
+ * @param payloadLen The length of the payload in bytes.
+ * @param samples The samples of the scenario, given the client's PubAck round trips.
+ * @return The number of messages the gateway acknowledged.
+ */
+size_t benchThreaded(int port, size_t messages, const unsigned char *payload, size_t payloadLen, BenchSamples_t *samples)
+{
+    size_t acked = 0;
+    Client_t threaded;
+    memset(&threaded, 0, sizeof(threaded));
+    threaded.destinationPort = port;
+    threaded.host = "127.0.0.1";
+    threaded.clientID = "BenchThreaded";
+    statsInit(&threaded.stats);
+    transport_sessionInit(&threaded.transport);
+    if(topicTableInit(&threaded.topics, Q_TOPIC_TABLE_SIZE) != Q_NO_ERR ||
+            inFlightInit(&threaded.inFlight, Q_INFLIGHT_WINDOW) != Q_NO_ERR ||
+            qos2RecvInit(&threaded.qos2Recv, Q_QOS2_RECV_WINDOW) != Q_NO_ERR){
+        return 0;
+    }
+
+    //Connect and register on this thread, then leave the session to the I/O thread.
+    Session_t session;
+    ClientThread_t ct;
+    sessionInit(&session, &threaded, 60, NULL, NULL);
+    if(sessionConnect(&session, NULL, NULL, 1) != Q_NO_ERR || sessionRegister(&session, BENCH_TOPIC_DATA) != Q_NO_ERR){
+        goto exit;
+    }
+    uint64_t deadline = benchNowNs() + (uint64_t)BENCH_REPLY_TIMEOUT_MS * 1000000u;
+    while(topicLookupID(&threaded.topics, BENCH_TOPIC_DATA, Q_TOPIC_PUB) == 0 && benchNowNs() < deadline){
+        if(sessionPoll(&session) != Q_NO_ERR){
+            goto exit;
+        }
+    }
+    if(clientThreadInit(&ct, &session, Q_THREAD_RING) != Q_NO_ERR){
+        goto exit;
+    }
+    if(clientThreadStart(&ct) != Q_NO_ERR){
+        clientThreadFree(&ct);
+        goto exit;
+    }
+
+    pthread_t threads[BENCH_PRODUCERS];
+    BenchProducer_t producers[BENCH_PRODUCERS];
+    for(size_t index = 0; index < BENCH_PRODUCERS; ++index){
+        producers[index].ct = &ct;
+        producers[index].messages = messages / BENCH_PRODUCERS + ((index < messages % BENCH_PRODUCERS) ? 1 : 0);
+        producers[index].payload = payload;
+        producers[index].payloadLen = payloadLen;
+        pthread_create(&threads[index], NULL, benchProducer, &producers[index]);
+    }
+    //Count the PubAcks as the I/O thread hands them back.
+    while(acked < messages && socketWait(clientThreadFd(&ct), BENCH_REPLY_TIMEOUT_MS) == Q_MsgPending){
+        ThreadCompletion_t *completion;
+        while((completion = clientThreadPeek(&ct)) != NULL){
+            if(completion->kind == Q_COMPLETE_STATUS && completion->code == Q_PubAckRead){
+                acked += 1;
+            }
+            clientThreadRelease(&ct);
+        }
+    }
+    for(size_t index = 0; index < BENCH_PRODUCERS; ++index){
+        pthread_join(threads[index], NULL);
+    }
+
+    clientThreadDisconnect(&ct);
+    while(socketWait(clientThreadFd(&ct), BENCH_REPLY_TIMEOUT_MS) == Q_MsgPending){
+        ThreadCompletion_t *completion;
+        bool over = false;
+        while((completion = clientThreadPeek(&ct)) != NULL){
+            over = over || completion->code == Q_DisconRead;
+            clientThreadRelease(&ct);
+        }
+        if(over){
+            break;
+        }
+    }
+    clientThreadStop(&ct);
+    clientThreadFree(&ct);
+    benchRecordAcks(samples, &threaded.stats.rtt[Q_RTT_PUBACK]);
+
+exit:
+    transport_sessionClose(&threaded.transport);
+    qos2RecvFree(&threaded.qos2Recv);
+    inFlightFree(&threaded.inFlight);
+    topicTableFree(&threaded.topics);
+    return acked;
+}//End benchThreaded
+
+/**
+ * The flow of a client in the publish_qos1_flows scenario: connects, registers the data topic, publishes its messages
+ * with QoS level 1 one at a time, waiting for each PubAck, and disconnects.
+ * @param flow The client's flow. Its context is the client's BenchFlow_t.
+ * @return An int: Q_FLOW_WAITING or Q_FLOW_DONE.
+ */
+int benchFlow(Flow_t *flow)
+{
+    BenchFlow_t *bench = flow->context;
+
+    Q_FLOW_BEGIN(flow);
+    if(sessionConnect(flow->session, NULL, NULL, 1) != Q_NO_ERR){
+        Q_FLOW_EXIT(flow);
+    }
+    Q_FLOW_AWAIT_CODE(flow, Q_ConnackRead);
+    if(flow->code == Q_DisconRead || sessionRegister(flow->session, BENCH_TOPIC_DATA) != Q_NO_ERR){
+        Q_FLOW_EXIT(flow);
+    }
+    Q_FLOW_AWAIT_CODE(flow, Q_RegAckRead);
+    while(flow->code != Q_DisconRead && bench->acked < bench->messages){
+        if(sessionPublish(flow->session, BENCH_TOPIC_DATA, 1, bench->payload, bench->payloadLen) != Q_NO_ERR){
+            break;
+        }
+        Q_FLOW_AWAIT_CODE(flow, Q_PubAckRead);
+        if(flow->code == Q_PubAckRead){
+            bench->acked += 1;
+        }
+    }
+    if(flow->code != Q_DisconRead && sessionDisconnect(flow->session) == Q_NO_ERR){
+        Q_FLOW_AWAIT_CODE(flow, Q_DisconRead);
+    }
+    Q_FLOW_END(flow);
+}//End benchFlow
+
+/**
+ * Runs the publish_qos1_flows scenarios: BENCH_FLOWS clients, each with its own socket and session, run side by side
+ * on this thread by one executor.
+ * @param port The port of the stand-in gateway.
+ * @param messages The number of messages to publish, split between the clients.
+ * @param payload The payload of every message.
+ * @param payloadLen The length of the payload in bytes.
+ * @param ringEntries The size of the transport ring the executor uses, or 0 to use epoll.
+ * @param samples The samples of the scenario, given the PubAck round trips of every client.
+ * @return The number of messages the gateway acknowledged, or 0 if the ring could not be set up.
+ */
+size_t benchFlows(int port, size_t messages, const unsigned char *payload, size_t payloadLen, unsigned int ringEntries,
+    BenchSamples_t *samples)
+{
+    static char clientIDs[BENCH_FLOWS][24];
+    size_t acked = 0;
+    size_t started = 0;
+    Executor_t exec;
+
+    BenchFlow_t *flows = calloc(BENCH_FLOWS, sizeof(BenchFlow_t));
+    if(flows == NULL || executorInit(&exec, BENCH_FLOWS) != Q_NO_ERR){
+        free(flows);
+        return 0;
+    }
+    if(ringEntries > 0 && executorUseRing(&exec, ringEntries) != Q_NO_ERR){
+        fprintf(stderr, "io_uring is not available, skipping the ring scenario\n");
+        executorFree(&exec);
+        free(flows);
+        return 0;
+    }
+    for(; started < BENCH_FLOWS; ++started){
+        BenchFlow_t *bench = &flows[started];
+        snprintf(clientIDs[started], sizeof(clientIDs[started]), "BenchFlow%zu", started);
+        bench->client.destinationPort = port;
+        bench->client.host = "127.0.0.1";
+        bench->client.clientID = clientIDs[started];
+        bench->messages = messages / BENCH_FLOWS + ((started < messages % BENCH_FLOWS) ? 1 : 0);
+        bench->payload = payload;
+        bench->payloadLen = payloadLen;
+        statsInit(&bench->client.stats);
+        transport_sessionInit(&bench->client.transport);
+        if(topicTableInit(&bench->client.topics, Q_TOPIC_TABLE_SIZE) != Q_NO_ERR ||
+                inFlightInit(&bench->client.inFlight, Q_INFLIGHT_WINDOW) != Q_NO_ERR ||
+                qos2RecvInit(&bench->client.qos2Recv, Q_QOS2_RECV_WINDOW) != Q_NO_ERR){
+            break;
+        }
+        sessionInit(&bench->session, &bench->client, 60, NULL, NULL);
+        executorAdd(&exec, &bench->flow, &bench->session, benchFlow, bench);
+    }
+
+    uint64_t deadline = benchNowNs() + (uint64_t)BENCH_REPLY_TIMEOUT_MS * 1000000u;
+    size_t before = 0;
+    while(executorRun(&exec, BENCH_REPLY_TIMEOUT_MS) > 0){
+        //Give up if no PubAck has arrived for a while.
+        size_t total = 0;
+        for(size_t index = 0; index < started; ++index){
+            total += flows[index].acked;
+        }
+        if(total != before){
+            before = total;
+            deadline = benchNowNs() + (uint64_t)BENCH_REPLY_TIMEOUT_MS * 1000000u;
+        } else if(benchNowNs() > deadline){
+            break;
+        }
+    }
+
+    for(size_t index = 0; index < started; ++index){
+        acked += flows[index].acked;
+        benchRecordAcks(samples, &flows[index].client.stats.rtt[Q_RTT_PUBACK]);
+        transport_sessionClose(&flows[index].client.transport);
+        qos2RecvFree(&flows[index].client.qos2Recv);
+        inFlightFree(&flows[index].client.inFlight);
+        topicTableFree(&flows[index].client.topics);
+    }
+    if(started < BENCH_FLOWS){
+        qos2RecvFree(&flows[started].client.qos2Recv);
+        inFlightFree(&flows[started].client.inFlight);
+        topicTableFree(&flows[started].client.topics);
+    }
+    executorFree(&exec);
+    free(flows);
+    return acked;
+}//End benchFlows
+
+int main(int argc, char **argv)
+{
+    size_t messages = BENCH_DEFAULT_MESSAGES;
+    if(argc > 1 && atol(argv[1]) > 0){
+        messages = (size_t)atol(argv[1]);
+    }
+
+    //Start the stand-in gateway on a free port on localhost.
+    static BenchGateway_t gw;
+    gw.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in gwAddr;
+    memset(&gwAddr, 0, sizeof(gwAddr));
+    gwAddr.sin_family = AF_INET;
+    gwAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    gwAddr.sin_port = 0;
+    socklen_t gwAddrLen = sizeof(gwAddr);
+    if(gw.sock < 0 || bind(gw.sock, (struct sockaddr *)&gwAddr, sizeof(gwAddr)) != 0 ||
+            getsockname(gw.sock, (struct sockaddr *)&gwAddr, &gwAddrLen) != 0){
+        puts("Could not start the stand-in gateway.");
+        return 1;
+    }
+    pthread_t gwThread;
+    if(pthread_create(&gwThread, NULL, gatewayThread, &gw) != 0){
+        puts("Could not start the stand-in gateway.");
+        return 1;
+    }
+
+    BenchSamples_t samples;
+    memset(&samples, 0, sizeof(samples));
+
+    Client_t benchClient;
+    memset(&benchClient, 0, sizeof(benchClient));
+    benchClient.destinationPort = ntohs(gwAddr.sin_port);
+    benchClient.host = "127.0.0.1";
+    benchClient.clientID = "BenchClient";
+    benchClient.defaultHandler = NULL;
+    benchClient.defaultContext = NULL;
+    benchClient.wildcard_Sub = false;
+    benchClient.sub_Wild_Num = 0;
+    benchClient.offline = NULL;
+    statsInit(&benchClient.stats);
+    transport_sessionInit(&benchClient.transport);
+    if(topicTableInit(&benchClient.topics, Q_TOPIC_TABLE_SIZE) != Q_NO_ERR ||
+            inFlightInit(&benchClient.inFlight, Q_INFLIGHT_WINDOW) != Q_NO_ERR ||
+            qos2RecvInit(&benchClient.qos2Recv, Q_QOS2_RECV_WINDOW) != Q_NO_ERR){
+        puts("Could not create the client's tables.");
+        return 1;
+    }
+
+    Client_Event_t event;
+    event.client = &benchClient;
+    event.duration = 60;
+    event.eventID = Q_CONNECTING;
+    event.send_msgID = 1;
+    event.qos = 0;
+    event.topicName = NULL;
+    event.handler = NULL;
+    event.handlerContext = NULL;
+
+    if(clientConnect(&benchClient, event.duration, 0, 1) != Q_NO_ERR || benchWait(&event, Q_ConnackRead) != Q_NO_ERR){
+        puts("Could not connect to the stand-in gateway.");
+        return 1;
+    }
+
+    //Subscribe to the echo topic and register both publishing topics.
+    MQTTSN_topicid subTopic;
+    MQTTSNFlags flags;
+    flags.all = 0;
+    subTopic.type = MQTTSN_TOPIC_TYPE_NORMAL;
+    subTopic.data.long_.name = BENCH_TOPIC_ECHO;
+    subTopic.data.long_.len = strlen(BENCH_TOPIC_ECHO);
+    event.topicName = BENCH_TOPIC_ECHO;
+    event.handler = benchMessageArrived;
+    event.handlerContext = &samples;
+    if(subscribe(&benchClient, &subTopic, flags, event.send_msgID) != Q_NO_ERR || benchWait(&event, Q_SubAckRead) != Q_NO_ERR){
+        puts("Could not subscribe.");
+        return 1;
+    }
+    const char *pubTopics[2] = {BENCH_TOPIC_ECHO, BENCH_TOPIC_DATA};
+    for(int index = 0; index < 2; ++index){
+        MQTTSNString topicString;
+        event.send_msgID = (uint16_t)(event.send_msgID + 1);
+        event.topicName = pubTopics[index];
+        MQTTSNStrCreate(&topicString, (char *)pubTopics[index]);
+        if(reg(&benchClient, event.send_msgID, &topicString) != Q_NO_ERR || benchWait(&event, Q_RegAckRead) != Q_NO_ERR){
+            puts("Could not register.");
+            return 1;
+        }
+    }
+    uint16_t echoID = topicLookupID(&benchClient.topics, BENCH_TOPIC_ECHO, Q_TOPIC_PUB);
+    uint16_t dataID = topicLookupID(&benchClient.topics, BENCH_TOPIC_DATA, Q_TOPIC_PUB);
+
+    unsigned char payload[32];
+    memset(payload, 'b', sizeof(payload));
+    bool firstResult = true;
+    uint64_t start = 0;
+    size_t done = 0;
+    printf("{\"benchmark\": \"MQTTSN_Bench\", \"messages\": %zu, \"results\": [", messages);
+
+    //QoS 0: publish to the echo topic and wait for the message to come back.
+    flags.bits.QoS = 0b00;
+    start = benchNowNs();
+    for(done = 0; done < messages; ++done){
+        uint64_t sent = benchNowNs();
+        if(publishLen(&benchClient, &flags, echoID, 0, payload, sizeof(payload)) != Q_NO_ERR ||
+                benchWait(&event, Q_pubQos0) != Q_NO_ERR){
+            break;
+        }
+        benchRecord(&samples, benchNowNs() - sent);
+    }
+    benchReport("publish_qos0_rtt", &samples, done, benchNowNs() - start, &firstResult);
+
+    //QoS 0 without waiting: how fast messages reach the gateway when they are batched. A PingResp means the
+    //gateway has handled everything sent before the PingReq, so one is sent after every BENCH_BURST_LEN messages
+    //to keep the gateway's receive queue from overflowing.
+    MQTTSNString emptyID;
+    MQTTSNStrCreate(&emptyID, NULL);
+    uint64_t before = gw.published;
+    start = benchNowNs();
+    for(done = 0; done < messages; ++done){
+        publishLen(&benchClient, &flags, dataID, 0, payload, sizeof(payload));
+        if((done + 1) % BENCH_BURST_LEN == 0 || done + 1 == messages){
+            if(pingReq(&benchClient, &emptyID) != Q_NO_ERR || benchWait(&event, Q_PingRespRead) != Q_NO_ERR){
+                break;
+            }
+        }
+    }
+    benchReport("publish_qos0_burst", &samples, (size_t)(gw.published - before), benchNowNs() - start, &firstResult);
+
+    //QoS -1: a sensor that never connects publishes to a short topic name, batched the same way. The PingReq
+    //barrier works without a connection too.
+    Client_t sensor;
+    memset(&sensor, 0, sizeof(sensor));
+    sensor.destinationPort = benchClient.destinationPort;
+    sensor.host = benchClient.host;
+    sensor.clientID = "BenchSensor";
+    statsInit(&sensor.stats);
+    transport_sessionInit(&sensor.transport);
+    Client_Event_t sensorEvent = event;
+    sensorEvent.client = &sensor;
+    uint16_t shortTopic = (uint16_t)(('q' << 8) | 'm');
+    before = gw.published;
+    start = benchNowNs();
+    if(topicTableInit(&sensor.topics, Q_TOPIC_TABLE_SIZE) == Q_NO_ERR && clientOpen(&sensor) == Q_NO_ERR){
+        for(done = 0; done < messages; ++done){
+            publishM1(&sensor, MQTTSN_TOPIC_TYPE_SHORT, shortTopic, payload, sizeof(payload));
+            if((done + 1) % BENCH_BURST_LEN == 0 || done + 1 == messages){
+                if(pingReq(&sensor, &emptyID) != Q_NO_ERR || benchWait(&sensorEvent, Q_PingRespRead) != Q_NO_ERR){
+                    break;
+                }
+            }
+        }
+        transport_sessionClose(&sensor.transport);
+        topicTableFree(&sensor.topics);
+    }
+    benchReport("publish_qosm1_burst", &samples, (size_t)(gw.published - before), benchNowNs() - start, &firstResult);
+
+    //QoS 1: publish and wait for the PubAck.
+    flags.bits.QoS = 0b01;
+    start = benchNowNs();
+    for(done = 0; done < messages; ++done){
+        uint64_t sent = benchNowNs();
+        uint16_t msgID = inFlightNextMsgID(&benchClient.inFlight);
+        if(publishLen(&benchClient, &flags, dataID, msgID, payload, sizeof(payload)) != Q_NO_ERR ||
+                benchWait(&event, Q_PubAckRead) != Q_NO_ERR){
+            break;
+        }
+        benchRecord(&samples, benchNowNs() - sent);
+    }
+    benchReport("publish_qos1_rtt", &samples, done, benchNowNs() - start, &firstResult);
+
+    //QoS 1 with the in flight window kept full. The client times each message from its send to its PubAck.
+    statsInit(&benchClient.stats);
+    size_t acked = 0;
+    done = 0;
+    start = benchNowNs();
+    while(acked < messages){
+        uint16_t msgID = (done < messages) ? inFlightNextMsgID(&benchClient.inFlight) : 0;
+        if(msgID != 0 && publishLen(&benchClient, &flags, dataID, msgID, payload, sizeof(payload)) == Q_NO_ERR){
+            done += 1;
+            continue;
+        }
+        if(benchWait(&event, Q_PubAckRead) != Q_NO_ERR){
+            break;
+        }
+        acked += 1;
+    }
+    benchRecordAcks(&samples, &benchClient.stats.rtt[Q_RTT_PUBACK]);
+    benchReport("publish_qos1_window", &samples, acked, benchNowNs() - start, &firstResult);
+
+    //QoS 2: publish, answer the PubRec, and wait for the PubComp.
+    flags.bits.QoS = 0b10;
+    start = benchNowNs();
+    for(done = 0; done < messages; ++done){
+        uint64_t sent = benchNowNs();
+        uint16_t msgID = inFlightNextMsgID(&benchClient.inFlight);
+        if(publishLen(&benchClient, &flags, dataID, msgID, payload, sizeof(payload)) != Q_NO_ERR ||
+                benchWait(&event, Q_PubRecRead) != Q_NO_ERR ||
+                pubRecRelComp(&benchClient, event.msgID, MQTTSN_PUBREL) != Q_NO_ERR ||
+                benchWait(&event, Q_PubCompRead) != Q_NO_ERR){
+            break;
+        }
+        benchRecord(&samples, benchNowNs() - sent);
+    }
+    benchReport("publish_qos2_rtt", &samples, done, benchNowNs() - start, &firstResult);
+
+    //QoS 1 from BENCH_PRODUCERS threads at once, through a session run on an I/O thread.
+    start = benchNowNs();
+    acked = benchThreaded(benchClient.destinationPort, messages, payload, sizeof(payload), &samples);
+    benchReport("publish_qos1_threaded", &samples, acked, benchNowNs() - start, &firstResult);
+
+    //QoS 1 from BENCH_FLOWS clients at once, each waiting for its PubAcks one at a time, all run by one executor.
+    start = benchNowNs();
+    acked = benchFlows(benchClient.destinationPort, messages, payload, sizeof(payload), 0, &samples);
+    benchReport("publish_qos1_flows", &samples, acked, benchNowNs() - start, &firstResult);
+
+    //The same, with one io_uring_enter per wake up sending and receiving the datagrams of every client.
+    start = benchNowNs();
+    acked = benchFlows(benchClient.destinationPort, messages, payload, sizeof(payload), BENCH_RING_ENTRIES, &samples);
+    benchReport("publish_qos1_flows_ring", &samples, acked, benchNowNs() - start, &firstResult);
+
+    //Fan-in: the gateway streams QoS 1 messages to the client, which acknowledges each one.
+    gw.fanInTotal = (uint32_t)messages;
+    subTopic.data.long_.name = BENCH_TOPIC_FANIN;
+    subTopic.data.long_.len = strlen(BENCH_TOPIC_FANIN);
+    flags.all = 0;
+    flags.bits.QoS = 0b01;
+    event.qos = 1;
+    event.send_msgID = (uint16_t)(event.send_msgID + 1);
+    event.topicName = BENCH_TOPIC_FANIN;
+    start = benchNowNs();
+    if(subscribe(&benchClient, &subTopic, flags, event.send_msgID) == Q_NO_ERR && benchWait(&event, Q_SubAckRead) == Q_NO_ERR){
+        while(samples.received < messages && benchWait(&event, Q_pubQos1) == Q_NO_ERR){
+        }
+    }
+    sendBatchFlush(&benchClient.batch, &benchClient.transport);
+    benchReport("subscribe_fanin", &samples, samples.received, benchNowNs() - start, &firstResult);
+
+    //Sleep and wake: a Disconnect with a duration, then a PingReq with the clientID, as a sleeping client does.
+    MQTTSNString clientString;
+    MQTTSNStrCreate(&clientString, benchClient.clientID);
+    start = benchNowNs();
+    for(done = 0; done < messages; ++done){
+        uint64_t sent = benchNowNs();
+        if(disconnect(&benchClient, event.duration) != Q_NO_ERR || benchWait(&event, Q_DisconRead) != Q_NO_ERR ||
+                pingReq(&benchClient, &clientString) != Q_NO_ERR || benchWait(&event, Q_PingRespRead) != Q_NO_ERR){
+            break;
+        }
+        benchRecord(&samples, benchNowNs() - sent);
+    }
+    benchReport("sleep_wake_cycle", &samples, done, benchNowNs() - start, &firstResult);
+
+    //Wake and drain: the gateway buffers BENCH_WAKE_BURST QoS 1 messages for the sleeping client, which reads and
+    //acknowledges all of them on waking. The latency is the time the client is awake for each cycle.
+    gw.wakeBurst = BENCH_WAKE_BURST;
+    samples.received = 0;
+    start = benchNowNs();
+    for(done = 0; done * BENCH_WAKE_BURST < messages; ++done){
+        if(disconnect(&benchClient, event.duration) != Q_NO_ERR || benchWait(&event, Q_DisconRead) != Q_NO_ERR){
+            break;
+        }
+        uint64_t woke = benchNowNs();
+        if(wakeDrain(&event, &clientString) != Q_PingRespRead){
+            break;
+        }
+        benchRecord(&samples, benchNowNs() - woke);
+    }
+    gw.wakeBurst = 0;
+    benchReport("wake_drain", &samples, samples.received, benchNowNs() - start, &firstResult);
+
+    printf("\n]}\n");
+
+    disconnect(&benchClient, 0);
+    benchWait(&event, Q_DisconRead);
+    transport_sessionClose(&benchClient.transport);
+    gw.stop = true;
+    pthread_join(gwThread, NULL);
+    close(gw.sock);
+    inFlightFree(&benchClient.inFlight);
+    qos2RecvFree(&benchClient.qos2Recv);
+    topicTableFree(&benchClient.topics);
+    free(samples.samples);
+    return 0;
+}
@@ -0,0 +1,311 @@
+/**
+ * Checks that QoS level 1 Publish messages stored in the offline queue survive an outage of the Gateway.
+ * A stand-in gateway on localhost is driven from this thread, so every step happens in a known order, and the
+ * clock passed to retransmitDue is moved forward instead of waiting for the retransmission timeouts to run out.
+ * The client publishes TEST_MESSAGES messages through the queue while the gateway answers nothing, and sends each of
+ * the ones in its in flight window until it gives up on them, which must report every msgID and put the messages back
+ * in the queue to be sent again. The client then reconnects while those are in flight. Every message must then reach
+ * the gateway, the start of the queue must move past all of them, and the queue must have room for new messages again.
+ * Last, the client gives up on a message in the middle of its window while the ones around it are still waiting, and
+ * the queue is closed and opened again as if the client had restarted. Every message must then be sent again.
+ * Prints PASS or FAIL with the step that failed, and exits with 0 or 1.
+ * Usage: ./MQTTSN_OfflineTest
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Client_t.h"
+#include "MQTTSNPacket.h"
+#include "MQTTSNPublish.h"
+#include "Events.h"
+#include "Util.h"
+#include "ErrorCodes.h"
+#include "transport.h"
+#include "Connect.h"
+#include "Publish.h"
+#include "Retransmit.h"
+#include "StackTrace.h"
+#include "EventLoop.h"
+
+//Messages published during the outage, more than fit in the in flight window.
+#define TEST_MESSAGES 12
+//The client's in flight window.
+#define TEST_WINDOW 4
+//The queue file, removed before and after the test.
+#define TEST_QUEUE "OfflineTest.queue"
+//The topicID the messages are published to. The stand-in gateway does not check it.
+#define TEST_TOPIC 1
+
+//State of the stand-in gateway.
+typedef struct {
+    int sock;
+    //Publish messages are answered with a PubAck unless the gateway is out.
+    bool out;
+    //Publish messages received, by the number in their payload.
+    uint32_t seen[TEST_MESSAGES];
+    //The msgID each message was last received with, by the number in its payload.
+    uint16_t msgIDs[TEST_MESSAGES];
+} TestGateway_t;
+
+void gatewayRun(TestGateway_t *gw); //prototype
+void clientRun(Client_Event_t *event); //prototype
+int testFail(const char *step); //prototype
+
+/**
+ * Handles every message waiting on the stand-in gateway's socket: answers a Connect with a Connack, and a Publish
+ * with a PubAck unless the gateway is out. Publish messages are counted either way.
+ * @param gw The stand-in gateway.
+ * @return void
+ */
+void gatewayRun(TestGateway_t *gw)
+{
+    unsigned char buf[TRANSPORT_RX_LEN];
+    struct pollfd readFD;
+    readFD.fd = gw->sock;
+    readFD.events = POLLIN;
+
+    while(poll(&readFD, 1, 50) > 0){
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+        ssize_t len = recvfrom(gw->sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &fromLen);
+        if(len < 2){
+            continue;
+        }
+        unsigned char reply[16];
+        int replyLen = 0;
+        if(buf[1] == MQTTSN_CONNECT){
+            reply[0] = 3;
+            reply[1] = MQTTSN_CONNACK;
+            reply[2] = MQTTSN_RC_ACCEPTED;
+            replyLen = 3;
+        } else if(buf[1] == MQTTSN_PUBLISH){
+            unsigned char dup = 0;
+            int qos = 0;
+            unsigned char retained = 0;
+            unsigned short msgID = 0;
+            MQTTSN_topicid topic;
+            unsigned char *payload = NULL;
+            int payloadLen = 0;
+            if(MQTTSNDeserialize_publish(&dup, &qos, &retained, &msgID, &topic, &payload, &payloadLen, buf,
+                    (size_t)len) != 1 || payloadLen != 1 || payload[0] >= TEST_MESSAGES){
+                continue;
+            }
+            gw->seen[payload[0]] += 1;
+            gw->msgIDs[payload[0]] = msgID;
+            if(!gw->out){
+                replyLen = MQTTSNSerialize_puback(reply, sizeof(reply), topic.data.id, msgID, MQTTSN_RC_ACCEPTED);
+            }
+        }
+        if(replyLen > 0){
+            sendto(gw->sock, reply, (size_t)replyLen, 0, (struct sockaddr *)&from, fromLen);
+        }
+    }
+}//End gatewayRun
+
+/**
+ * Reads and handles every message the stand-in gateway has sent the client.
+ * @param event The client's event.
+ * @return void
+ */
+void clientRun(Client_Event_t *event)
+{
+    sendBatchFlush(&event->client->batch, &event->client->transport);
+    while(socketWait(event->client->transport.sock, 50) == Q_MsgPending){
+        readMsg(event);
+    }
+}//End clientRun
+
+/**
+ * @param step What was being checked.
+ * @return 1, the exit code of a failed test.
+ */
+int testFail(const char *step)
+{
+    printf("FAIL: %s\n", step);
+    unlink(TEST_QUEUE);
+    return 1;
+}//End testFail
+
+int main(void)
+{
+    //Start the stand-in gateway on a free port on localhost.
+    static TestGateway_t gw;
+    gw.sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in gwAddr;
+    memset(&gwAddr, 0, sizeof(gwAddr));
+    gwAddr.sin_family = AF_INET;
+    gwAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t gwAddrLen = sizeof(gwAddr);
+    if(gw.sock < 0 || bind(gw.sock, (struct sockaddr *)&gwAddr, sizeof(gwAddr)) != 0 ||
+            getsockname(gw.sock, (struct sockaddr *)&gwAddr, &gwAddrLen) != 0){
+        return testFail("start the stand-in gateway");
+    }
+
+    Client_t testClient;
+    memset(&testClient, 0, sizeof(testClient));
+    testClient.destinationPort = ntohs(gwAddr.sin_port);
+    testClient.host = "127.0.0.1";
+    testClient.clientID = "OfflineTest";
+    statsInit(&testClient.stats);
+    transport_sessionInit(&testClient.transport);
+    OfflineQueue_t queue;
+    unlink(TEST_QUEUE);
+    //Just large enough for the messages, so a queue that never lets go of them fills up.
+    if(topicTableInit(&testClient.topics, Q_TOPIC_TABLE_SIZE) != Q_NO_ERR ||
+            inFlightInit(&testClient.inFlight, TEST_WINDOW) != Q_NO_ERR ||
+            qos2RecvInit(&testClient.qos2Recv, Q_QOS2_RECV_WINDOW) != Q_NO_ERR ||
+            offlineQueueOpen(&queue, TEST_QUEUE, sizeof(OfflineQueueHeader_t) + TEST_MESSAGES * 32) != Q_NO_ERR){
+        return testFail("create the client's tables and queue");
+    }
+    testClient.offline = &queue;
+
+    Client_Event_t event;
+    memset(&event, 0, sizeof(event));
+    event.client = &testClient;
+    event.duration = 60;
+    event.eventID = Q_CONNECTING;
+    event.send_msgID = 1;
+
+    if(clientConnect(&testClient, event.duration, 0, 1) != Q_NO_ERR){
+        return testFail("connect");
+    }
+    gatewayRun(&gw);
+    clientRun(&event);
+
+    //The Gateway goes away, and every message is published into the queue while it is gone.
+    gw.out = true;
+    MQTTSNFlags flags;
+    flags.all = 0;
+    flags.bits.QoS = 0b01;
+    for(unsigned char number = 0; number < TEST_MESSAGES; ++number){
+        if(publishOffline(&testClient, &flags, TEST_TOPIC, &number, 1) != Q_NO_ERR){
+            return testFail("queue the messages");
+        }
+    }
+    if(publishQueued(&testClient) != Q_NO_ERR || testClient.inFlight.count != TEST_WINDOW){
+        return testFail("send a window of messages");
+    }
+    gatewayRun(&gw);
+
+    //Move the clock on until every message in flight has been given up on, each one reported with its msgID.
+    uint64_t nowMs = timeNowMs();
+    uint16_t sentIDs = 0;
+    uint16_t givenUpIDs = 0;
+    for(uint16_t msgID = 1; msgID <= TEST_WINDOW; ++msgID){
+        if(inFlightFind(&testClient.inFlight, msgID) != NULL){
+            sentIDs = (uint16_t)(sentIDs | 1u << msgID);
+        }
+    }
+    for(int attempt = 0; attempt <= Q_RETRANSMIT_MAX && testClient.inFlight.count > 0; ++attempt){
+        nowMs += Q_RTO_MAX_MS + 1;
+        uint16_t givenUpID = 0;
+        while(retransmitDue(&testClient, nowMs, &givenUpID) == Q_ERR_RetryLimit){
+            givenUpIDs = (uint16_t)(givenUpIDs | 1u << givenUpID);
+        }
+        gatewayRun(&gw);
+    }
+    if(testClient.inFlight.count != 0 || givenUpIDs != sentIDs){
+        return testFail("give up on the messages in flight, reporting each msgID");
+    }
+    //The messages given up on are back in the queue, and are the first to be sent again.
+    if(publishQueued(&testClient) != Q_NO_ERR || testClient.inFlight.count != TEST_WINDOW){
+        return testFail("send the messages given up on again");
+    }
+    gatewayRun(&gw);
+    for(int number = 0; number < TEST_WINDOW; ++number){
+        if(gw.seen[number] < 2){
+            return testFail("send the messages given up on again");
+        }
+    }
+
+    //The Gateway comes back and the client reconnects. Every message must now be acknowledged.
+    gw.out = false;
+    if(clientConnect(&testClient, event.duration, 0, 1) != Q_NO_ERR){
+        return testFail("reconnect");
+    }
+    gatewayRun(&gw);
+    clientRun(&event);
+    for(int round = 0; round < TEST_MESSAGES && offlineQueuePending(&queue) > 0; ++round){
+        if(publishQueued(&testClient) != Q_NO_ERR){
+            return testFail("send the queued messages");
+        }
+        gatewayRun(&gw);
+        clientRun(&event);
+    }
+    for(int number = 0; number < TEST_MESSAGES; ++number){
+        if(gw.seen[number] == 0){
+            return testFail("deliver every message");
+        }
+    }
+    if(offlineQueuePending(&queue) != 0 || queue.header->head != queue.header->tail){
+        return testFail("move the start of the queue past every message");
+    }
+    for(unsigned char number = 0; number < TEST_MESSAGES; ++number){
+        if(publishOffline(&testClient, &flags, TEST_TOPIC, &number, 1) != Q_NO_ERR){
+            return testFail("reuse the space of the acknowledged messages");
+        }
+    }
+
+    //The Gateway goes away again. The client gives up on the second message while the first, third, and fourth are
+    //still waiting for their PubAcks, and is then restarted with the queue closed and opened again.
+    gw.out = true;
+    memset(gw.seen, 0, sizeof(gw.seen));
+    if(publishQueued(&testClient) != Q_NO_ERR || testClient.inFlight.count != TEST_WINDOW){
+        return testFail("send a window of the new messages");
+    }
+    gatewayRun(&gw);
+    InFlightMsg_t *middle = inFlightFind(&testClient.inFlight, gw.msgIDs[1]);
+    if(middle == NULL){
+        return testFail("find the second message in flight");
+    }
+    middle->attempts = Q_RETRANSMIT_MAX;
+    middle->deadlineMs = 1;
+    uint16_t middleID = 0;
+    if(retransmitDue(&testClient, middle->deadlineMs, &middleID) != Q_ERR_RetryLimit || middleID != gw.msgIDs[1] ||
+            testClient.inFlight.count != TEST_WINDOW - 1){
+        return testFail("give up on a message in the middle of the window");
+    }
+    offlineQueueClose(&queue);
+    if(offlineQueueOpen(&queue, TEST_QUEUE, 0) != Q_NO_ERR){
+        return testFail("open the queue again");
+    }
+    gw.out = false;
+    if(clientConnect(&testClient, event.duration, 0, 1) != Q_NO_ERR){
+        return testFail("reconnect after the restart");
+    }
+    gatewayRun(&gw);
+    clientRun(&event);
+    for(int round = 0; round < TEST_MESSAGES && offlineQueuePending(&queue) > 0; ++round){
+        if(publishQueued(&testClient) != Q_NO_ERR){
+            return testFail("send the queued messages after the restart");
+        }
+        gatewayRun(&gw);
+        clientRun(&event);
+    }
+    for(int number = 0; number < TEST_MESSAGES; ++number){
+        if(gw.seen[number] < ((number < TEST_WINDOW) ? 2u : 1u)){
+            return testFail("send every message again after the restart");
+        }
+    }
+    if(offlineQueuePending(&queue) != 0){
+        return testFail("move the start of the queue past every message after the restart");
+    }
+
+    transport_sessionClose(&testClient.transport);
+    offlineQueueClose(&queue);
+    inFlightFree(&testClient.inFlight);
+    qos2RecvFree(&testClient.qos2Recv);
+    topicTableFree(&testClient.topics);
+    close(gw.sock);
+    unlink(TEST_QUEUE);
+    puts("PASS");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * Checks that packetViewParse, the only check a datagram from the network goes through before it is read, rejects
+ * every malformed message without reading past the bytes received.
+ * Each case is copied to the very end of a page that is followed by one that cannot be read, so reading a single byte
+ * too far stops the test with a segmentation fault instead of going unnoticed. The cases cover length fields cut
+ * short, length fields that claim more bytes than were received or than are accepted, a body too short for each
+ * message type the client reads fields from, and types that are not MQTT-SN message types, along with a few messages
+ * that are just long enough to be accepted.
+ * Prints PASS or FAIL with the case that failed, and exits with 0 or 1.
+ * Usage: ./MQTTSN_PacketViewTest
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "PacketView.h"
+#include "MQTTSNPacket.h"
+#include "ErrorCodes.h"
+#include "transport.h"
+
+//The longest case, in bytes.
+#define TEST_CASE_MAX 12
+
+//A datagram as received, and the status code packetViewParse must return for it.
+typedef struct {
+    const char *name;
+    unsigned char bytes[TEST_CASE_MAX];
+    size_t length;
+    int expected;
+} TestCase_t;
+
+static const TestCase_t testCases[] = {
+    //Length fields cut short.
+    { "empty datagram", {0}, 0, Q_ERR_Read },
+    { "1 byte length field without a type", {0x02}, 1, Q_ERR_Read },
+    { "3 byte length field of 1 byte", {0x01}, 1, Q_ERR_Read },
+    { "3 byte length field of 2 bytes", {0x01, 0x00}, 2, Q_ERR_Read },
+    { "3 byte length field without a type", {0x01, 0x00, 0x04}, 3, Q_ERR_Read },
+    //Length fields that do not match the bytes received.
+    { "1 byte length field past the end", {0x07, MQTTSN_PUBACK, 0x00, 0x01, 0x00, 0x02}, 6, Q_ERR_Read },
+    { "3 byte length field past the end", {0x01, 0x00, 0x09, MQTTSN_PUBLISH, 0x20, 0x00, 0x01}, 7, Q_ERR_Read },
+    { "1 byte length field short of the end", {0x02, MQTTSN_PINGRESP, 0x00}, 3, Q_ERR_Read },
+    { "3 byte length field over the largest message", {0x01, 0xFF, 0xFF, MQTTSN_PUBLISH}, 4, Q_ERR_MaxLength },
+    //Bodies one byte short of the fields of their type.
+    { "Connack", {0x02, MQTTSN_CONNACK}, 2, Q_ERR_Deserial },
+    { "WillTopicResp", {0x02, MQTTSN_WILLTOPICRESP}, 2, Q_ERR_Deserial },
+    { "WillMsgResp", {0x02, MQTTSN_WILLMSGRESP}, 2, Q_ERR_Deserial },
+    { "Register", {0x05, MQTTSN_REGISTER, 0x00, 0x01, 0x00}, 5, Q_ERR_Deserial },
+    { "RegAck", {0x06, MQTTSN_REGACK, 0x00, 0x01, 0x00, 0x02}, 6, Q_ERR_Deserial },
+    { "PubAck", {0x06, MQTTSN_PUBACK, 0x00, 0x01, 0x00, 0x02}, 6, Q_ERR_Deserial },
+    { "Publish", {0x06, MQTTSN_PUBLISH, 0x20, 0x00, 0x01, 0x00}, 6, Q_ERR_Deserial },
+    { "Publish with a 3 byte length field", {0x01, 0x00, 0x08, MQTTSN_PUBLISH, 0x20, 0x00, 0x01, 0x00}, 8,
+        Q_ERR_Deserial },
+    { "SubAck", {0x07, MQTTSN_SUBACK, 0x20, 0x00, 0x01, 0x00, 0x02}, 7, Q_ERR_Deserial },
+    { "PubRec", {0x03, MQTTSN_PUBREC, 0x00}, 3, Q_ERR_Deserial },
+    { "PubRel", {0x03, MQTTSN_PUBREL, 0x00}, 3, Q_ERR_Deserial },
+    { "PubComp", {0x03, MQTTSN_PUBCOMP, 0x00}, 3, Q_ERR_Deserial },
+    { "UnsubAck", {0x03, MQTTSN_UNSUBACK, 0x00}, 3, Q_ERR_Deserial },
+    //Types that are not MQTT-SN message types.
+    { "reserved type", {0x02, MQTTSN_RESERVED2}, 2, Q_ERR_Read },
+    { "type past the last message type", {0x02, MQTTSN_WILLMSGRESP + 1}, 2, Q_ERR_Read },
+    { "encapsulated message", {0x03, MQTTSN_ENCAPSULATED, 0x00}, 3, Q_ERR_Read },
+    { "type 0xFF", {0x02, 0xFF}, 2, Q_ERR_Read },
+    //Messages just long enough for their type.
+    { "PingResp", {0x02, MQTTSN_PINGRESP}, 2, Q_NO_ERR },
+    { "PubAck with every field", {0x07, MQTTSN_PUBACK, 0x00, 0x01, 0x00, 0x02, MQTTSN_RC_ACCEPTED}, 7, Q_NO_ERR },
+    { "Publish without data", {0x07, MQTTSN_PUBLISH, 0x20, 0x00, 0x01, 0x00, 0x02}, 7, Q_NO_ERR },
+    { "Publish without data, 3 byte length field", {0x01, 0x00, 0x09, MQTTSN_PUBLISH, 0x20, 0x00, 0x01, 0x00, 0x02}, 9,
+        Q_NO_ERR },
+};
+
+int testFail(const char *step); //prototype
+int testCase(const TestCase_t *test, unsigned char *pageEnd); //prototype
+
+/**
+ * @param step What was being checked.
+ * @return 1, the exit code of a failed test.
+ */
+int testFail(const char *step)
+{
+    printf("FAIL: %s\n", step);
+    return 1;
+}//End testFail
+
+/**
+ * Parses one case from the end of a readable page and checks the status code. A payload the view points to must
+ * also end within the bytes received.
+ * @param test The case to be checked.
+ * @param pageEnd The first byte that cannot be read.
+ * @return An int: 0 indicates the case passed, 1 that it failed.
+ */
+int testCase(const TestCase_t *test, unsigned char *pageEnd)
+{
+    unsigned char *buf = pageEnd - test->length;
+    memcpy(buf, test->bytes, test->length);
+
+    PacketView_t view;
+    int returnCode = packetViewParse(&view, buf, test->length, TRANSPORT_RX_LEN);
+    if(returnCode != test->expected){
+        printf("FAIL: %s returned %d instead of %d\n", test->name, returnCode, test->expected);
+        return 1;
+    }
+    if(view.payload != NULL && (view.payload < buf || view.payload + view.payloadLen > pageEnd)){
+        return testFail(test->name);
+    }
+    return 0;
+}//End testCase
+
+int main(void)
+{
+    //A page the cases are copied to the end of, followed by a page that cannot be read.
+    long pageSize = sysconf(_SC_PAGESIZE);
+    unsigned char *pages = mmap(NULL, (size_t)pageSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED || mprotect(pages + pageSize, (size_t)pageSize, PROT_NONE) != 0){
+        return testFail("map a page followed by one that cannot be read");
+    }
+
+    for(size_t index = 0; index < sizeof(testCases) / sizeof(testCases[0]); ++index){
+        if(testCase(&testCases[index], pages + pageSize) != 0){
+            return 1;
+        }
+    }
+
+    munmap(pages, (size_t)pageSize * 2);
+    puts("PASS");
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * Decodes a trace dump written by the trace ring in mqtt-sn-lib/StackTrace.c, which a client writes when it is
+ * started with the MQTTSN_TRACE environment variable set to a path and then gets SIGUSR1 or has a session end with an
+ * error. Every thread's events are printed oldest first, one per line: the time in microseconds since the thread's
+ * first event, whether the function was entered or left or a status code was reported, the function and line, and
+ * the return code.
+ * Usage: ./MQTTSN_TraceDecode dump_file
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "StackTrace.h"
+
+//The most threads a dump is decoded for. Each thread that records an event has its own ring, so this is far more than
+//any client starts.
+#define TRACE_DECODE_RINGS_MAX 65536u
+
+//A function name from the name table at the end of the dump.
+typedef struct {
+    uint64_t address;
+    char *name;
+} TraceName_t;
+
+/**
+ * @param names The name table.
+ * @param count The number of names in the table.
+ * @param address The address an event recorded.
+ * @return The function name, or NULL if the dump does not have it.
+ */
+static const char *traceName(const TraceName_t *names, uint32_t count, uint64_t address)
+{
+    for(uint32_t i = 0; i < count; ++i){
+        if(names[i].address == address){
+            return names[i].name;
+        }
+    }
+    return NULL;
+}//End traceName
+
+/**
+ * @param kind The kind of an event.
+ * @return A short label for it.
+ */
+static const char *traceKind(uint8_t kind)
+{
+    switch(kind){
+        case TRACE_KIND_ENTRY:
+            return "enter";
+        case TRACE_KIND_EXIT:
+            return "exit ";
+        case TRACE_KIND_CODE:
+            return "code ";
+        default:
+            return "?    ";
+    }
+}//End traceKind
+
+int main(int argc, char *argv[])
+{
+    int returnCode = EXIT_FAILURE;
+    FILE *dump = NULL;
+    TraceDumpHeader header;
+    TraceDumpRing *rings = NULL;
+    TraceEvent **events = NULL;
+    TraceName_t *names = NULL;
+    uint32_t nameCount = 0;
+    uint32_t namesRead = 0;
+
+    if(argc != 2){
+        fprintf(stderr, "Usage: %s dump_file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if((dump = fopen(argv[1], "rb")) == NULL){
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if(fread(&header, sizeof(header), 1, dump) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+            || header.version != TRACE_VERSION){
+        fprintf(stderr, "%s is not a trace dump of version %d\n", argv[1], TRACE_VERSION);
+        goto exit;
+    }
+    //A damaged dump can claim any number of threads, and the tables below would be too small for one near UINT32_MAX.
+    if(header.rings > TRACE_DECODE_RINGS_MAX){
+        fprintf(stderr, "%s claims %u threads, more than the %u it can be decoded for\n", argv[1], header.rings,
+                TRACE_DECODE_RINGS_MAX);
+        goto exit;
+    }
+
+    //The names come after every ring, so the events are kept until they can be named.
+    rings = calloc(header.rings + 1u, sizeof(*rings));
+    events = calloc(header.rings + 1u, sizeof(*events));
+    if(rings == NULL || events == NULL){
+        goto exit;
+    }
+    for(uint32_t r = 0; r < header.rings; ++r){
+        if(fread(&rings[r], sizeof(rings[r]), 1, dump) != 1 || rings[r].count > TRACE_EVENTS){
+            goto truncated;
+        }
+        events[r] = malloc(rings[r].count * sizeof(TraceEvent) + 1u);
+        if(events[r] == NULL || fread(events[r], sizeof(TraceEvent), rings[r].count, dump) != rings[r].count){
+            goto truncated;
+        }
+    }
+    if(fread(&nameCount, sizeof(nameCount), 1, dump) != 1 || nameCount > TRACE_NAMES
+            || (names = calloc(nameCount + 1u, sizeof(*names))) == NULL){
+        goto truncated;
+    }
+    for(; namesRead < nameCount; ++namesRead){
+        uint32_t length;
+        if(fread(&names[namesRead].address, sizeof(uint64_t), 1, dump) != 1
+                || fread(&length, sizeof(length), 1, dump) != 1 || length > 4096
+                || (names[namesRead].name = calloc(length + 1u, 1)) == NULL
+                || fread(names[namesRead].name, 1, length, dump) != length){
+            goto truncated;
+        }
+    }
+
+    printf("%u threads, %.1f ticks per microsecond\n", header.rings, header.ticksPerUs);
+    for(uint32_t r = 0; r < header.rings; ++r){
+        printf("\nthread %llu: %llu events recorded, last %u kept\n", (unsigned long long)rings[r].thread,
+                (unsigned long long)rings[r].total, rings[r].count);
+        for(uint32_t e = 0; e < rings[r].count; ++e){
+            const TraceEvent *event = &events[r][e];
+            const char *name = traceName(names, nameCount, event->name);
+            double us = (header.ticksPerUs > 0) ?
+                    (double)(event->time - events[r][0].time) / header.ticksPerUs : 0;
+            if(name != NULL){
+                printf("%14.3f %s %s:%u rc=%d\n", us, traceKind(event->kind), name, event->line, event->rc);
+            } else {
+                printf("%14.3f %s 0x%llx:%u rc=%d\n", us, traceKind(event->kind), (unsigned long long)event->name,
+                        event->line, event->rc);
+            }
+        }
+    }
+    returnCode = EXIT_SUCCESS;
+    goto exit;
+
+truncated:
+    fprintf(stderr, "%s is truncated\n", argv[1]);
+
+exit:
+    fclose(dump);
+    if(events != NULL){
+        for(uint32_t r = 0; r < header.rings; ++r){
+            free(events[r]);
+        }
+    }
+    if(names != NULL){
+        for(uint32_t i = 0; i < nameCount; ++i){
+            free(names[i].name);
+        }
+    }
+    free(events);
+    free(rings);
+    free(names);
+    return returnCode;
+}//End main